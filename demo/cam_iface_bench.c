@@ -0,0 +1,660 @@
+/*
+
+Copyright (c) 2004-2009, California Institute of Technology. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+/* Benchmark the frame path of libcamiface.
+
+   Runs a set of standard scenarios against the cameras found by the
+   mega backend and writes the results as JSON, one object per run, for
+   comparing builds. For each scenario it reports frames per second,
+   the time spent in each grab call, the latency from the camera's
+   timestamp to the frame being returned, the frames lost according to
+   the frame numbers, and the user and system CPU time per frame.
+
+   The delivery latency is only meaningful for backends whose
+   timestamps use the host clock (e.g. the synthetic backend). */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "cam_iface.h"
+
+#define MAX_CAMERAS 16
+#define MAX_CONSECUTIVE_TIMEOUTS 10
+
+typedef enum {
+  SCENARIO_GRAB = 0,   /* copy into a packed buffer */
+  SCENARIO_GRAB_STRIDE,/* copy into a buffer with padded rows */
+  SCENARIO_POINT,      /* zero-copy point/unpoint */
+  SCENARIO_CONVERT,    /* point, convert to RGB8 (or MONO8), unpoint */
+  SCENARIO_MULTI,      /* point/unpoint on every camera, whichever is ready */
+  NUM_SCENARIOS
+} Scenario;
+
+static const char *scenario_names[NUM_SCENARIOS] = {
+  "grab",
+  "grab_stride",
+  "point",
+  "convert",
+  "multi",
+};
+
+typedef struct {
+  CamContext *cc;
+  int width, height, depth;
+  CameraPixelCoding coding;
+  intptr_t row_bytes;
+  unsigned char *pixels;     /* grab destination */
+  unsigned char *converted;  /* convert destination */
+  unsigned long last_framenumber;
+  int have_framenumber;
+} BenchCamera;
+
+typedef struct {
+  long frames;
+  long timeouts;
+  long corrupt;
+  long other_errors;
+  unsigned long lost;
+  double *call_latency;      /* seconds, one per frame */
+  double *delivery_latency;
+  double elapsed;
+  double user_cpu, sys_cpu;  /* seconds */
+} BenchResult;
+
+static double monotonic_time(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + t.tv_nsec*1e-9;
+}
+
+static double wall_time(void) {
+  struct timeval t;
+  gettimeofday(&t, NULL);
+  return (double)t.tv_sec + t.tv_usec*1e-6;
+}
+
+static void cpu_times(double *user, double *sys) {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  *user = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec*1e-6;
+  *sys = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec*1e-6;
+}
+
+#define _check_error() {                                                \
+    int _check_error_err;                                               \
+    _check_error_err = cam_iface_have_error();                          \
+    if (_check_error_err != 0) {                                        \
+                                                                        \
+      fprintf(stderr,"%s:%d %s\n", __FILE__,__LINE__,cam_iface_get_error_string()); \
+      exit(1);                                                          \
+    }                                                                   \
+  }                                                                     \
+
+static int compare_double(const void *a, const void *b) {
+  double da = *(const double*)a, db = *(const double*)b;
+  return (da > db) - (da < db);
+}
+
+/* p-th quantile of n sorted values (nearest rank) */
+static double quantile(const double *sorted, long n, double p) {
+  long i;
+  if (n == 0)
+    return 0.0;
+  i = (long)(p*n + 0.999999) - 1;
+  if (i < 0) i = 0;
+  if (i >= n) i = n-1;
+  return sorted[i];
+}
+
+static void print_json_string(FILE *out, const char *s) {
+  fputc('"', out);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      fputc('\\', out);
+    if ((unsigned char)*s >= 0x20)
+      fputc(*s, out);
+  }
+  fputc('"', out);
+}
+
+/* latency statistics in microseconds */
+static void print_latency(FILE *out, const char *name, double *values, long n) {
+  double sum = 0;
+  long i;
+
+  qsort(values, n, sizeof(double), compare_double);
+  for (i=0; i<n; i++)
+    sum += values[i];
+  fprintf(out, "      \"%s\": {\"mean\": %.3f, \"p50\": %.3f, \"p99\": %.3f, "
+          "\"p999\": %.3f, \"max\": %.3f}",
+          name,
+          n ? sum/n*1e6 : 0.0,
+          quantile(values, n, 0.50)*1e6,
+          quantile(values, n, 0.99)*1e6,
+          quantile(values, n, 0.999)*1e6,
+          n ? values[n-1]*1e6 : 0.0);
+}
+
+/* Choose what the convert scenario turns this camera's frames into.
+Returns 0 if there is nothing to convert to. */
+static int convert_target(CameraPixelCoding coding, CameraPixelCoding *dst, int *dst_bpp) {
+  switch (coding) {
+  case CAM_IFACE_YUV411:
+  case CAM_IFACE_YUV422:
+  case CAM_IFACE_YUV444:
+  case CAM_IFACE_MONO8_BAYER_BGGR:
+  case CAM_IFACE_MONO8_BAYER_RGGB:
+  case CAM_IFACE_MONO8_BAYER_GRBG:
+  case CAM_IFACE_MONO8_BAYER_GBRG:
+    *dst = CAM_IFACE_RGB8;
+    *dst_bpp = 3;
+    return 1;
+  case CAM_IFACE_MONO16:
+    *dst = CAM_IFACE_MONO8;
+    *dst_bpp = 1;
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+/* Pick the mode for the convert scenario: the first one that
+cam_iface_convert_pixels() handles, else the first Bayer mode (which
+is demosaiced). Modes are opened one at a time, so the device must not
+be open. Returns -1 if no mode can be converted. */
+static int find_convert_mode(int device_number, int num_buffers) {
+  cam_iface_constructor_func_t new_CamContext;
+  CamContext *cc;
+  CameraPixelCoding coding, dst;
+  int num_modes, mode, dst_bpp, bayer_mode = -1;
+
+  cam_iface_get_num_modes(device_number, &num_modes);
+  _check_error();
+  new_CamContext = cam_iface_get_constructor_func(device_number);
+  for (mode=0; mode<num_modes; mode++) {
+    cc = new_CamContext(device_number,num_buffers,mode,NULL);
+    if (cam_iface_have_error()) {
+      cam_iface_clear_error();
+      continue;
+    }
+    coding = cc->coding;
+    delete_CamContext(cc);
+    cam_iface_clear_error();
+    if (!convert_target(coding, &dst, &dst_bpp))
+      continue;
+    if (coding == CAM_IFACE_MONO8_BAYER_BGGR || coding == CAM_IFACE_MONO8_BAYER_RGGB ||
+        coding == CAM_IFACE_MONO8_BAYER_GRBG || coding == CAM_IFACE_MONO8_BAYER_GBRG) {
+      if (bayer_mode < 0)
+        bayer_mode = mode;
+      continue;
+    }
+    return mode;
+  }
+  return bayer_mode;
+}
+
+static int convert_frame(BenchCamera *cam, const unsigned char *src) {
+  CameraPixelCoding dst;
+  int dst_bpp;
+
+  convert_target(cam->coding, &dst, &dst_bpp);
+  if (cam->coding == CAM_IFACE_YUV411 || cam->coding == CAM_IFACE_YUV422 ||
+      cam->coding == CAM_IFACE_YUV444 || cam->coding == CAM_IFACE_MONO16)
+    return cam_iface_convert_pixels(cam->coding, src, cam->row_bytes,
+                                    dst, cam->converted, (intptr_t)cam->width*dst_bpp,
+                                    cam->width, cam->height, NULL);
+  return cam_iface_demosaic(cam->coding, CAM_IFACE_DEMOSAIC_HQLINEAR,
+                            src, cam->row_bytes, cam->width, cam->height,
+                            cam->converted, (intptr_t)cam->width*dst_bpp);
+}
+
+/* Classify the error left by a grab call. Returns 1 if a frame was
+delivered. */
+static int account_error(BenchResult *r) {
+  int err = cam_iface_have_error();
+  if (err == 0)
+    return 1;
+  if (err == CAM_IFACE_FRAME_TIMEOUT) {
+    r->timeouts++;
+  } else if (err == CAM_IFACE_FRAME_DATA_CORRUPT_ERROR ||
+             err == CAM_IFACE_FRAME_DATA_MISSING_ERROR ||
+             err == CAM_IFACE_FRAME_DATA_LOST_ERROR ||
+             err == CAM_IFACE_FRAME_INTERRUPTED_SYSCALL) {
+    r->corrupt++;
+  } else {
+    fprintf(stderr,"error: %s\n",cam_iface_get_error_string());
+    r->other_errors++;
+  }
+  cam_iface_clear_error();
+  return 0;
+}
+
+/* Record the latencies and frame number of a frame delivered by cam. */
+static void account_frame(BenchResult *r, BenchCamera *cam, double t_call, double t_done) {
+  double timestamp;
+  unsigned long framenumber;
+
+  CamContext_get_last_timestamp(cam->cc, &timestamp);
+  CamContext_get_last_framenumber(cam->cc, &framenumber);
+  cam_iface_clear_error(); /* not all backends have both */
+
+  r->call_latency[r->frames] = t_done - t_call;
+  r->delivery_latency[r->frames] = wall_time() - timestamp;
+  if (cam->have_framenumber && framenumber > cam->last_framenumber + 1)
+    r->lost += framenumber - cam->last_framenumber - 1;
+  cam->last_framenumber = framenumber;
+  cam->have_framenumber = 1;
+  r->frames++;
+}
+
+/* Deliver one frame from cam using scenario s. */
+static void bench_one(Scenario s, BenchCamera *cam, BenchResult *r, float timeout) {
+  unsigned char *p;
+  double t_call, t_done;
+
+  t_call = monotonic_time();
+  switch (s) {
+  case SCENARIO_GRAB:
+    CamContext_grab_next_frame_blocking(cam->cc, cam->pixels, timeout);
+    t_done = monotonic_time();
+    if (account_error(r))
+      account_frame(r, cam, t_call, t_done);
+    break;
+  case SCENARIO_GRAB_STRIDE:
+    CamContext_grab_next_frame_blocking_with_stride(cam->cc, cam->pixels,
+                                                    (cam->row_bytes + 127) & ~63,
+                                                    timeout);
+    t_done = monotonic_time();
+    if (account_error(r))
+      account_frame(r, cam, t_call, t_done);
+    break;
+  default:
+    CamContext_point_next_frame_blocking(cam->cc, &p, timeout);
+    t_done = monotonic_time();
+    if (!account_error(r))
+      break;
+    account_frame(r, cam, t_call, t_done);
+    if (s == SCENARIO_CONVERT && convert_frame(cam, p)) {
+      fprintf(stderr,"error: conversion failed\n");
+      r->other_errors++;
+    }
+    CamContext_unpoint_frame(cam->cc);
+    _check_error();
+    break;
+  }
+}
+
+static void run_scenario(Scenario s, BenchCamera *cams, int num_cams,
+                         long num_frames, long warmup, float timeout, BenchResult *r) {
+  double u0, s0, u1, s1, t0;
+  int i, ready, consecutive = 0;
+  long prev_timeouts;
+
+  memset(r, 0, sizeof(BenchResult));
+  r->call_latency = malloc(num_frames*sizeof(double));
+  r->delivery_latency = malloc(num_frames*sizeof(double));
+  if (!r->call_latency || !r->delivery_latency) {
+    fprintf(stderr,"out of memory\n");
+    exit(1);
+  }
+
+  for (i=0; i<num_cams; i++) {
+    CamContext_start_camera(cams[i].cc);
+    _check_error();
+    cams[i].have_framenumber = 0;
+  }
+
+  /* warm up, then start counting afresh */
+  for (i=0; i<warmup; i++) {
+    bench_one(s == SCENARIO_MULTI ? SCENARIO_POINT : s, &cams[i % num_cams], r, timeout);
+    r->frames = 0;
+  }
+  r->frames = r->timeouts = r->corrupt = r->other_errors = 0;
+  r->lost = 0;
+
+  cpu_times(&u0, &s0);
+  t0 = monotonic_time();
+  i = 0;
+  while (r->frames < num_frames) {
+    prev_timeouts = r->timeouts;
+    if (s == SCENARIO_MULTI) {
+      CamContext *ctxs[MAX_CAMERAS];
+      int k, rc;
+      for (k=0; k<num_cams; k++)
+        ctxs[k] = cams[k].cc;
+      rc = cam_iface_wait_any(ctxs, num_cams, timeout, &ready);
+      if (rc == CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE) {
+        ready = i++ % num_cams; /* no way to wait: take turns */
+      } else if (rc == CAM_IFACE_FRAME_TIMEOUT) {
+        r->timeouts++;
+        ready = -1;
+      }
+      if (ready >= 0)
+        bench_one(SCENARIO_POINT, &cams[ready], r, timeout);
+    } else {
+      bench_one(s, &cams[0], r, timeout);
+    }
+    if (r->timeouts > prev_timeouts) {
+      if (++consecutive >= MAX_CONSECUTIVE_TIMEOUTS) {
+        fprintf(stderr,"%s: giving up after %d timeouts in a row\n",
+                scenario_names[s], consecutive);
+        break;
+      }
+    } else {
+      consecutive = 0;
+    }
+    if (r->other_errors > 100) {
+      fprintf(stderr,"%s: giving up after too many errors\n", scenario_names[s]);
+      break;
+    }
+  }
+  r->elapsed = monotonic_time() - t0;
+  cpu_times(&u1, &s1);
+  r->user_cpu = u1 - u0;
+  r->sys_cpu = s1 - s0;
+
+  for (i=0; i<num_cams; i++) {
+    CamContext_stop_camera(cams[i].cc);
+    _check_error();
+  }
+}
+
+/* mode_number is -1 unless the scenario ran in a mode of its own */
+static void print_result(FILE *out, Scenario s, int num_cams, int device_number,
+                         int mode_number, BenchResult *r, int first) {
+  char mode_string[255];
+  long n = r->frames;
+
+  fprintf(out, "%s    {\n", first ? "" : ",\n");
+  fprintf(out, "      \"scenario\": \"%s\",\n", scenario_names[s]);
+  fprintf(out, "      \"cameras\": %d,\n", num_cams);
+  if (mode_number >= 0) {
+    cam_iface_get_mode_string(device_number, mode_number, mode_string, sizeof(mode_string));
+    cam_iface_clear_error();
+    fprintf(out, "      \"mode\": ");
+    print_json_string(out, mode_string);
+    fprintf(out, ",\n");
+  }
+  fprintf(out, "      \"frames\": %ld,\n", n);
+  fprintf(out, "      \"seconds\": %.6f,\n", r->elapsed);
+  fprintf(out, "      \"fps\": %.2f,\n", r->elapsed > 0 ? n/r->elapsed : 0.0);
+  fprintf(out, "      \"frames_lost\": %lu,\n", r->lost);
+  fprintf(out, "      \"timeouts\": %ld,\n", r->timeouts);
+  fprintf(out, "      \"bad_frames\": %ld,\n", r->corrupt);
+  fprintf(out, "      \"errors\": %ld,\n", r->other_errors);
+  fprintf(out, "      \"cpu_user_us_per_frame\": %.3f,\n", n ? r->user_cpu/n*1e6 : 0.0);
+  fprintf(out, "      \"cpu_sys_us_per_frame\": %.3f,\n", n ? r->sys_cpu/n*1e6 : 0.0);
+  print_latency(out, "call_latency_us", r->call_latency, n);
+  fprintf(out, ",\n");
+  print_latency(out, "delivery_latency_us", r->delivery_latency, n);
+  fprintf(out, "\n    }");
+}
+
+static void print_skipped(FILE *out, Scenario s, const char *reason, int first) {
+  fprintf(stderr,"%s: %s, skipped\n", scenario_names[s], reason);
+  fprintf(out, "%s    {\"scenario\": \"%s\", \"skipped\": ", first ? "" : ",\n",
+          scenario_names[s]);
+  print_json_string(out, reason);
+  fprintf(out, "}");
+}
+
+static void show_usage(const char *cmd) {
+  printf("usage: %s [options]\n",cmd);
+  printf("  -n FRAMES     frames per scenario (default 1000)\n");
+  printf("  -w FRAMES     warm-up frames before each scenario (default 50)\n");
+  printf("  -c CAMERA     camera for single-camera scenarios (default 0)\n");
+  printf("  -m MODE       mode number for every camera (default 0)\n");
+  printf("  -M MODE       mode number for the convert scenario (default: MODE if it\n");
+  printf("                can be converted, else the first mode that can)\n");
+  printf("  -b BUFFERS    number of framebuffers (default 10)\n");
+  printf("  -f FPS        set the framerate before starting (default: leave as is)\n");
+  printf("  -t SECONDS    timeout for each grab (default 1.0)\n");
+  printf("  -s LIST       comma separated scenarios (default grab,grab_stride,point,convert,multi)\n");
+  printf("  -o FILE       write JSON to FILE instead of stdout\n");
+  exit(1);
+}
+
+static void open_camera(BenchCamera *cam, int device_number, int mode_number,
+                        int num_buffers, float framerate, int need_convert) {
+  cam_iface_constructor_func_t new_CamContext;
+  CameraPixelCoding dst;
+  int left, top, dst_bpp;
+
+  memset(cam, 0, sizeof(BenchCamera));
+  new_CamContext = cam_iface_get_constructor_func(device_number);
+  cam->cc = new_CamContext(device_number,num_buffers,mode_number,NULL);
+  _check_error();
+
+  if (framerate > 0) {
+    CamContext_set_framerate(cam->cc, framerate);
+    _check_error();
+  }
+
+  CamContext_get_frame_roi(cam->cc, &left, &top, &cam->width, &cam->height);
+  _check_error();
+  cam->depth = cam->cc->depth;
+  cam->coding = cam->cc->coding;
+  cam->row_bytes = (intptr_t)cam->width * cam->depth / 8;
+
+  /* room for the padded rows of the strided scenario */
+  cam->pixels = malloc(((cam->row_bytes + 127) & ~63) * cam->height);
+  if (need_convert && convert_target(cam->coding, &dst, &dst_bpp))
+    cam->converted = malloc((size_t)cam->width * cam->height * dst_bpp);
+  if (cam->pixels == NULL) {
+    fprintf(stderr,"out of memory\n");
+    exit(1);
+  }
+}
+
+static void print_camera(FILE *out, BenchCamera *cam, int device_number, int mode_number, int first) {
+  Camwire_id id;
+  char mode_string[255];
+  float framerate = 0;
+
+  cam_iface_get_camera_info(device_number, &id);
+  cam_iface_get_mode_string(device_number, mode_number, mode_string, sizeof(mode_string));
+  CamContext_get_framerate(cam->cc, &framerate);
+  cam_iface_clear_error();
+
+  fprintf(out, "%s    {\"device\": %d, \"vendor\": ", first ? "" : ",\n", device_number);
+  print_json_string(out, id.vendor);
+  fprintf(out, ", \"model\": ");
+  print_json_string(out, id.model);
+  fprintf(out, ", \"chip\": ");
+  print_json_string(out, id.chip);
+  fprintf(out, ", \"mode\": ");
+  print_json_string(out, mode_string);
+  fprintf(out, ", \"width\": %d, \"height\": %d, \"depth\": %d, \"framerate\": %.3f}",
+          cam->width, cam->height, cam->depth, framerate);
+}
+
+int main(int argc, char** argv) {
+  BenchCamera cams[MAX_CAMERAS], *single;
+  BenchResult result;
+  int run[NUM_SCENARIOS];
+  long num_frames = 1000, warmup = 50;
+  int device_number = 0, mode_number = 0, num_buffers = 10;
+  int convert_mode = -1, scenario_mode;
+  float framerate = 0, timeout = 1.0f;
+  const char *outname = NULL;
+  FILE *out = stdout;
+  int num_cameras, num_open, i, opt, first;
+  char *list, *tok;
+  time_t now;
+
+  for (i=0; i<NUM_SCENARIOS; i++)
+    run[i] = 1;
+
+  while ((opt = getopt(argc, argv, "n:w:c:m:M:b:f:t:s:o:h")) != -1) {
+    switch (opt) {
+    case 'n': num_frames = atol(optarg); break;
+    case 'w': warmup = atol(optarg); break;
+    case 'c': device_number = atoi(optarg); break;
+    case 'm': mode_number = atoi(optarg); break;
+    case 'M': convert_mode = atoi(optarg); break;
+    case 'b': num_buffers = atoi(optarg); break;
+    case 'f': framerate = (float)atof(optarg); break;
+    case 't': timeout = (float)atof(optarg); break;
+    case 'o': outname = optarg; break;
+    case 's':
+      for (i=0; i<NUM_SCENARIOS; i++)
+        run[i] = 0;
+      list = strdup(optarg);
+      for (tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        for (i=0; i<NUM_SCENARIOS; i++)
+          if (!strcmp(tok, scenario_names[i]))
+            break;
+        if (i == NUM_SCENARIOS) {
+          fprintf(stderr,"unknown scenario: %s\n",tok);
+          show_usage(argv[0]);
+        }
+        run[i] = 1;
+      }
+      free(list);
+      break;
+    default:
+      show_usage(argv[0]);
+    }
+  }
+  if (num_frames < 1 || warmup < 0 || num_buffers < 1)
+    show_usage(argv[0]);
+
+  cam_iface_startup_with_version_check();
+  _check_error();
+
+  num_cameras = cam_iface_get_num_cameras();
+  if (num_cameras <= device_number) {
+    fprintf(stderr,"camera %d not found (%d camera(s))\n",device_number,num_cameras);
+    exit(1);
+  }
+
+  /* the multi-camera scenario uses every camera, the others only one */
+  num_open = run[SCENARIO_MULTI] ? num_cameras : 1;
+  if (num_open > MAX_CAMERAS)
+    num_open = MAX_CAMERAS;
+  if (device_number >= num_open && num_open > 1) {
+    fprintf(stderr,"camera %d is beyond the first %d\n",device_number,MAX_CAMERAS);
+    exit(1);
+  }
+  for (i=0; i<num_open; i++)
+    open_camera(&cams[i], run[SCENARIO_MULTI] ? i : device_number,
+                mode_number, num_buffers, framerate, run[SCENARIO_CONVERT]);
+  single = &cams[run[SCENARIO_MULTI] ? device_number : 0];
+
+  if (outname) {
+    out = fopen(outname, "w");
+    if (out == NULL) {
+      perror(outname);
+      exit(1);
+    }
+  }
+
+  now = time(NULL);
+  fprintf(out, "{\n");
+  fprintf(out, "  \"api_version\": \"%s\",\n", cam_iface_get_api_version());
+  fprintf(out, "  \"driver\": \"%s\",\n", cam_iface_get_driver_name());
+  fprintf(out, "  \"time\": %ld,\n", (long)now);
+  fprintf(out, "  \"frames_per_scenario\": %ld,\n", num_frames);
+  fprintf(out, "  \"num_buffers\": %d,\n", num_buffers);
+  fprintf(out, "  \"cameras\": [\n");
+  for (i=0; i<num_open; i++)
+    print_camera(out, &cams[i], run[SCENARIO_MULTI] ? i : device_number,
+                 mode_number, i == 0);
+  fprintf(out, "\n  ],\n");
+  fprintf(out, "  \"results\": [\n");
+
+  first = 1;
+  for (i=0; i<NUM_SCENARIOS; i++) {
+    if (!run[i])
+      continue;
+    scenario_mode = -1;
+    if (i == SCENARIO_CONVERT &&
+        (single->converted == NULL || (convert_mode >= 0 && convert_mode != mode_number))) {
+      /* reopen the camera in a mode that can be converted */
+      delete_CamContext(single->cc);
+      free(single->pixels);
+      free(single->converted);
+      _check_error();
+      scenario_mode = convert_mode;
+      if (scenario_mode < 0)
+        scenario_mode = find_convert_mode(device_number, num_buffers);
+      if (scenario_mode >= 0) {
+        open_camera(single, device_number, scenario_mode, num_buffers, framerate, 1);
+        if (single->converted == NULL) {
+          delete_CamContext(single->cc);
+          free(single->pixels);
+          _check_error();
+          scenario_mode = -2;
+        }
+      }
+      if (scenario_mode < 0) {
+        print_skipped(out, (Scenario)i, scenario_mode == -2 ?
+                      "nothing to convert the pixel coding of this mode to" :
+                      "no mode of this camera can be converted", first);
+        first = 0;
+        open_camera(single, device_number, mode_number, num_buffers, framerate, 1);
+        continue;
+      }
+    }
+    fprintf(stderr,"running %s...\n",scenario_names[i]);
+    if (i == SCENARIO_MULTI)
+      run_scenario((Scenario)i, cams, num_open, num_frames, warmup, timeout, &result);
+    else
+      run_scenario((Scenario)i, single, 1, num_frames, warmup, timeout, &result);
+    print_result(out, (Scenario)i, i == SCENARIO_MULTI ? num_open : 1,
+                 device_number, scenario_mode, &result, first);
+    first = 0;
+    if (scenario_mode >= 0) {
+      /* back to the mode of the other scenarios */
+      delete_CamContext(single->cc);
+      free(single->pixels);
+      free(single->converted);
+      _check_error();
+      open_camera(single, device_number, mode_number, num_buffers, framerate, 1);
+    }
+    free(result.call_latency);
+    free(result.delivery_latency);
+  }
+  fprintf(out, "\n  ]\n}\n");
+  if (out != stdout)
+    fclose(out);
+
+  for (i=0; i<num_open; i++) {
+    delete_CamContext(cams[i].cc);
+    free(cams[i].pixels);
+    free(cams[i].converted);
+  }
+  cam_iface_shutdown();
+  return 0;
+}
@@ -97,91 +97,6 @@ GLhandleARB glsl_program;
 
 void setShaders();
 
-void yuv422_to_mono8(const unsigned char *src_pixels, unsigned char *dest_pixels, int width, int height,
-					 size_t src_stride, size_t dest_stride) {
-  size_t i,j;
-  const unsigned char *src_chunk;
-  unsigned char *dest_chunk;
-  for (i=0; i<(unsigned int)height; i++) {
-    src_chunk = src_pixels + i*src_stride;
-    dest_chunk = dest_pixels + i*dest_stride;
-    for (j=0; j<((unsigned int)width/2); j++) {
-      dest_chunk[0] = src_chunk[1];
-      dest_chunk[1] = src_chunk[3];
-      dest_chunk+=2;
-      src_chunk+=4;
-    }
-  }
-}
-
-#define CLIP(m)                                 \
-  (m)<0?0:((m)>255?255:(m))
-
-// from http://en.wikipedia.org/wiki/YUV
-#define convert_chunk(src,dest,rgba) {                                  \
-  u = src[0];                                                           \
-  y1 = src[1];                                                          \
-  v = src[2];                                                           \
-  y2 = src[3];                                                          \
-                                                                        \
-  C1 = y1-16;                                                           \
-  C2 = y2-16;                                                           \
-  D = u-128;                                                            \
-  E = v-128;                                                            \
-                                                                        \
-  dest[0] = CLIP(( 298 * C1           + 409 * E + 128) >> 8);           \
-  dest[1] = CLIP(( 298 * C1 - 100 * D - 208 * E + 128) >> 8);           \
-  dest[2] = CLIP(( 298 * C1 + 516 * D           + 128) >> 8);           \
-  if (rgba) {                                                           \
-    dest[3] = 255;                                                      \
-    dest[4] = CLIP(( 298 * C2           + 409 * E + 128) >> 8);         \
-    dest[5] = CLIP(( 298 * C2 - 100 * D - 208 * E + 128) >> 8);         \
-    dest[6] = CLIP(( 298 * C2 + 516 * D           + 128) >> 8);         \
-    dest[7] = 255;                                                      \
-  } else {                                                              \
-    dest[3] = CLIP(( 298 * C2           + 409 * E + 128) >> 8);         \
-    dest[4] = CLIP(( 298 * C2 - 100 * D - 208 * E + 128) >> 8);         \
-    dest[5] = CLIP(( 298 * C2 + 516 * D           + 128) >> 8);         \
-  }                                                                     \
-}
-
-void yuv422_to_rgb8(const unsigned char *src_pixels, unsigned char *dest_pixels,
-					int width, int height, size_t src_stride,
-					size_t dest_stride) {
-  int C1, C2, D, E;
-  int i,j;
-  const unsigned char* src_chunk;
-  unsigned char* dest_chunk;
-  unsigned char u,y1,v,y2;
-  for (i=0; i<height; i++) {
-    src_chunk = src_pixels + i*src_stride;
-    dest_chunk = dest_pixels + i*dest_stride;
-    for (j=0; j<(width/2); j++) {
-      convert_chunk(src_chunk,dest_chunk,0);
-      dest_chunk+=6;
-      src_chunk+=4;
-    }
-  }
-}
-
-void yuv422_to_rgba8(const unsigned char *src_pixels, unsigned char *dest_pixels, int width, int height,
-					 size_t src_stride, size_t dest_stride) {
-  int C1, C2, D, E;
-  int i,j;
-  const unsigned char* src_chunk;
-  unsigned char* dest_chunk;
-  unsigned char u,y1,v,y2;
-  for (i=0; i<height; i++) {
-    src_chunk = src_pixels + i*src_stride;
-    dest_chunk = dest_pixels + i*dest_stride;
-    for (j=0; j<(width/2); j++) {
-      convert_chunk(src_chunk,dest_chunk,1);
-      dest_chunk+=8;
-      src_chunk+=4;
-    }
-  }
-}
-
 #define do_copy() {                                       \
   rowstart = dest;                                        \
   for (i=0; i<height; i++) {                              \
@@ -198,9 +113,11 @@ unsigned char* convert_pixels(unsigned char* src,
   unsigned char *src_ptr;
   static int attempted_to_start_glsl_program=0;
   GLubyte* rowstart;
-  int i,j;
+  int i;
   int copy_required;
   GLint firstRed;
+  CameraPixelCoding dest_coding;
+  CamIfaceConvertOptions mono16_options;
 
   copy_required = force_copy || (dest_stride!=stride);
   src_ptr = src;
@@ -224,22 +141,26 @@ unsigned char* convert_pixels(unsigned char* src,
   case CAM_IFACE_YUV422:
     switch (gl_data_format) {
     case GL_LUMINANCE:
-      yuv422_to_mono8(src_ptr, dest, width, height, stride, dest_stride);
-      return dest;
+      dest_coding = CAM_IFACE_MONO8;
       break;
     case GL_RGB:
-      yuv422_to_rgb8(src_ptr, dest, width, height, stride, dest_stride);
-      return dest;
+      dest_coding = CAM_IFACE_RGB8;
       break;
     case GL_RGBA:
-      yuv422_to_rgba8(src_ptr, dest, width, height, stride, dest_stride);
-      return dest;
+      dest_coding = CAM_IFACE_RGBA8;
       break;
     default:
       fprintf(stderr,"ERROR: invalid conversion at line %d\n",__LINE__);
       exit(1);
       break;
     }
+    if (cam_iface_convert_pixels(src_coding, src_ptr, stride,
+                                 dest_coding, dest, dest_stride,
+                                 width, height, NULL)) {
+      fprintf(stderr,"ERROR: conversion failed at line %d\n",__LINE__);
+      exit(1);
+    }
+    return dest;
     break;
   case CAM_IFACE_RGB8:
     switch (gl_data_format) {
@@ -320,12 +241,14 @@ unsigned char* convert_pixels(unsigned char* src,
   case CAM_IFACE_MONO16:
     switch (gl_data_format) {
     case GL_LUMINANCE:
-      rowstart = dest;
-      for (i=0; i<height; i++) {
-        for (j=0; j<width; j++) {
-          rowstart[j] = (src + (stride*i))[j*2];
-        }
-        rowstart += dest_stride;
+      /* show the first (most significant on IIDC cameras) byte */
+      mono16_options.mono16_shift = 8;
+      mono16_options.mono16_big_endian = 1;
+      if (cam_iface_convert_pixels(src_coding, src_ptr, stride,
+                                   CAM_IFACE_MONO8, dest, dest_stride,
+                                   width, height, &mono16_options)) {
+        fprintf(stderr,"ERROR: conversion failed at line %d\n",__LINE__);
+        exit(1);
       }
       return dest;
       break;
@@ -91,6 +91,35 @@ void save_pgm(const char* filename,unsigned char *pixels,int width,int height) {
   fclose(fd);
 }
 
+/* grab a frame from one camera, returns 1 if a frame was grabbed */
+int grab_frame(CamContext *cc, unsigned char *pixels, int camno, float timeout) {
+  int errnum;
+
+  CamContext_grab_next_frame_blocking(cc,pixels,timeout);
+  errnum = cam_iface_have_error();
+
+  if (errnum == CAM_IFACE_FRAME_TIMEOUT) {
+    cam_iface_clear_error();
+    return 0; // wait again on next camera
+  } else if (errnum == CAM_IFACE_FRAME_DATA_MISSING_ERROR) {
+    cam_iface_clear_error();
+    fprintf(stdout,"M");
+    fflush(stdout);
+    return 0; // wait again on next camera
+  } else if (errnum == CAM_IFACE_FRAME_INTERRUPTED_SYSCALL) {
+    cam_iface_clear_error();
+    fprintf(stdout,"I");
+    fflush(stdout);
+    return 0; // wait again on next camera
+  }
+
+  _check_error();
+
+  fprintf(stdout,"%d",camno);
+  fflush(stdout);
+  return 1;
+}
+
 void show_usage(char * cmd) {
   printf("usage: %s [num_frames]\n",cmd);
   printf("  where num_frames can be a number or 'forever'\n");
@@ -118,6 +147,7 @@ int main(int argc, char** argv) {
   int left, top;
   int width, height;
   int do_num_frames;
+  int use_wait_any;
   CameraPixelCoding coding;
   cam_iface_constructor_func_t new_CamContext;
 
@@ -261,34 +291,33 @@ int main(int argc, char** argv) {
   }
 
 
+  use_wait_any = 1;
+
   while (1) {
     if (do_num_frames<0) break;
 
     have_frame = 0;
-    for (camno=0; camno<num_cameras; camno++) {
-      CamContext_grab_next_frame_blocking(cc[camno],pixels[camno],0.001f); // timeout after 1 msec
-      errnum = cam_iface_have_error();
-
-      if (errnum == CAM_IFACE_FRAME_TIMEOUT) {
-        cam_iface_clear_error();
-        continue; // wait again on next camera
-      } else if (errnum == CAM_IFACE_FRAME_DATA_MISSING_ERROR) {
-        cam_iface_clear_error();
-        fprintf(stdout,"M");
-        fflush(stdout);
-        continue; // wait again on next camera
-      } else if (errnum == CAM_IFACE_FRAME_INTERRUPTED_SYSCALL) {
-        cam_iface_clear_error();
-        fprintf(stdout,"I");
-        fflush(stdout);
-        continue; // wait again on next camera
+    if (use_wait_any) {
+      // sleep until any camera has a frame
+      errnum = cam_iface_wait_any(cc,num_cameras,1.0f,&camno);
+      if (errnum == CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE) {
+        printf("backend cannot wait on several cameras, polling instead\n");
+        use_wait_any = 0;
+        continue;
+      } else if (errnum == CAM_IFACE_FRAME_TIMEOUT) {
+        continue;
+      } else if (errnum != 0) {
+        fprintf(stderr,"%s:%d cam_iface_wait_any() error %d\n",__FILE__,__LINE__,errnum);
+        exit(1);
+      }
+      have_frame = grab_frame(cc[camno],pixels[camno],camno,0.001f);
+    } else {
+      for (camno=0; camno<num_cameras; camno++) {
+        // timeout after 1 msec
+        if (grab_frame(cc[camno],pixels[camno],camno,0.001f)) {
+          have_frame = 1;
+        }
       }
-
-      _check_error();
-      have_frame = 1;
-
-      fprintf(stdout,"%d",camno);
-      fflush(stdout);
     }
 
     if (!have_frame) {
@@ -38,8 +38,17 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
+#include <signal.h>
 #include "cam_iface.h"
 
+/* set by Ctrl-C, so that the movie gets closed properly */
+static volatile sig_atomic_t quit_requested = 0;
+
+static void on_sigint(int sig) {
+  (void)sig;
+  quit_requested = 1;
+}
+
 double my_floattime() {
 #ifdef _WIN32
 #if _MSC_VER == 1310
@@ -74,24 +83,6 @@ double my_floattime() {
     }                                                                   \
   }                                                                     \
 
-#pragma pack(push)  /* push current alignment to stack */
-#pragma pack(1)     /* set alignment to 1 byte boundary */
-
-typedef struct {
-  unsigned int version;
-  unsigned int len_format;
-} fmf_v3_header_part1;
-
-typedef struct {
-  unsigned int bpp;
-  unsigned int rows;
-  unsigned int cols;
-  unsigned long long bytes_per_chunk;
-  unsigned long long n_frames;
-} fmf_v3_header_part2;
-
-#pragma pack(pop)   /* restore original alignment from stack */
-
 int main(int argc, char** argv) {
   CamContext *cc;
   unsigned char *pixels;
@@ -102,6 +93,7 @@ int main(int argc, char** argv) {
   double fps;
   int n_frames;
   int buffer_size;
+  intptr_t stride;
   int num_modes, num_props, num_trigger_modes;
   char mode_string[255];
   int i,mode_number;
@@ -111,14 +103,11 @@ int main(int argc, char** argv) {
   int errnum;
   int left, top;
   int width, height;
-  fmf_v3_header_part1 hstart;
-  fmf_v3_header_part2 hstop;
   CameraPixelCoding coding;
-  char * format_str;
-  int bpp;
   cam_iface_constructor_func_t new_CamContext;
   Camwire_id cam_info_struct;
-  FILE* fd;
+  CamIfaceFmfWriter *writer;
+  CamIfaceFmfWriterStats writer_stats;
   char * filename;
 
   cam_iface_startup_with_version_check();
@@ -243,53 +232,25 @@ int main(int argc, char** argv) {
   printf("\n");
 
   coding = cc->coding;
-  bpp = 8;
-
-  switch (coding) {
-  case CAM_IFACE_MONO8_BAYER_BGGR:
-    format_str = "MONO8:BGGR";
-    break;
-  case CAM_IFACE_MONO8_BAYER_RGGB:
-    format_str = "MONO8:RGGB";
-    break;
-  case CAM_IFACE_MONO8_BAYER_GRBG:
-    format_str = "MONO8:GRBG";
-    break;
-  case CAM_IFACE_MONO8_BAYER_GBRG:
-    format_str = "MONO8:GBRG";
-    break;
-  case CAM_IFACE_MONO8:
-    format_str = "MONO8";
-    break;
-  case CAM_IFACE_YUV422:
-    format_str = "YUV422";
-    bpp = 16;
-    break;
-  default:
+  stride = buffer_size/height;
+
+  /* frames are written to disk by a background thread; allow up to
+     2 seconds of frames at 60 fps to queue up */
+  filename = "movie.fmf";
+  errnum = cam_iface_fmf_writer_open(&writer, filename, coding, width, height,
+                                     120, 0);
+  if (errnum == CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE) {
     fprintf(stderr,"do not know how to save sample image for this format\n");
     exit(1);
+  } else if (errnum) {
+    fprintf(stderr,"could not open %s for writing\n",filename);
+    exit(1);
   }
 
-  hstart.version = 3;
-  hstart.len_format = strlen(format_str);
-
-  hstop.rows = height;
-  hstop.cols = width;
-  hstop.bytes_per_chunk = sizeof(double) + height*width*bpp/8; /* timestamp, image */
-  hstop.n_frames = 0;
-  hstop.bpp = bpp;
-
-  filename = "movie.fmf";
-  fd = fopen(filename,"w");
-
-  /* write the FMF v3 header */
-  fwrite(&hstart,sizeof(fmf_v3_header_part1),1,fd);
-  fwrite(format_str,hstart.len_format,1,fd);
-  fwrite(&hstop,sizeof(fmf_v3_header_part2),1,fd);
-
-  /* grab frames forever */
+  /* grab frames until Ctrl-C */
+  signal(SIGINT,on_sigint);
   printf("Press Ctrl-C to quit. Will now save .fmf movie.\n");
-  while (1) {
+  while (!quit_requested) {
 #ifdef USE_COPY
     //CamContext_grab_next_frame_blocking(cc,pixels,0.2); // timeout after 200 msec
     CamContext_grab_next_frame_blocking(cc,pixels,-1.0f); // never timeout
@@ -321,23 +282,38 @@ int main(int argc, char** argv) {
     n_frames += 1;
 #else
     CamContext_point_next_frame_blocking(cc,&pixels,-1.0f);
+    if (cam_iface_have_error() == CAM_IFACE_FRAME_INTERRUPTED_SYSCALL) {
+      cam_iface_clear_error();
+      continue; /* probably Ctrl-C */
+    }
     now = my_floattime();
     n_frames += 1;
     _check_error();
     fprintf(stdout,".");
     fflush(stdout);
-    CamContext_unpoint_frame(cc);
-    _check_error();
 #endif
 
-    fwrite(&now,sizeof(double),1,fd);
-    fwrite(pixels,height*width*bpp/8,1,fd);
-
+    errnum = cam_iface_fmf_writer_add_frame(writer,pixels,stride,now);
+#ifndef USE_COPY
+    CamContext_unpoint_frame(cc); /* the writer has its own copy now */
+    _check_error();
+#endif
+    if (errnum == CAM_IFACE_BUFFER_OVERFLOW_ERROR) {
+      fprintf(stdout,"D"); /* disk did not keep up, frame dropped */
+      fflush(stdout);
+    } else if (errnum) {
+      cam_iface_fmf_writer_get_stats(writer,&writer_stats);
+      fprintf(stderr,"error writing %s: %s\n",filename,strerror(writer_stats.write_errno));
+      exit(1);
+    }
 
     t_diff = now-last_fps_print;
     if (t_diff > 5.0) {
       fps = n_frames/t_diff;
-      fprintf(stdout,"%.1f fps\n",fps);
+      cam_iface_fmf_writer_get_stats(writer,&writer_stats);
+      fprintf(stdout,"%.1f fps (%lu frames dropped, at most %d of %d buffers used)\n",
+              fps,writer_stats.num_dropped,writer_stats.buffers_high_water,
+              writer_stats.num_buffers);
       last_fps_print = now;
       n_frames = 0;
     }
@@ -345,6 +321,7 @@ int main(int argc, char** argv) {
 
 
   printf("\n");
+  cam_iface_fmf_writer_close(writer,NULL);
   delete_CamContext(cc);
   _check_error();
 
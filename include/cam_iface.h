@@ -32,7 +32,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef CAM_IFACE_H
 #define CAM_IFACE_H
 
-#define CAM_IFACE_API_VERSION "20140124"
+#define CAM_IFACE_API_VERSION "20261016"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -171,7 +171,8 @@ typedef enum CameraPixelCoding
   CAM_IFACE_MONO8_BAYER_BGGR, /* BGGR Bayer coding */
   CAM_IFACE_MONO8_BAYER_RGGB, /* RGGB Bayer coding */
   CAM_IFACE_MONO8_BAYER_GRBG, /* GRBG Bayer coding */
-  CAM_IFACE_MONO8_BAYER_GBRG  /* GBRG Bayer coding */
+  CAM_IFACE_MONO8_BAYER_GBRG, /* GBRG Bayer coding */
+  CAM_IFACE_RGBA8             /* RGB8 plus an opaque alpha byte */
 }
 CameraPixelCoding;
 
@@ -246,6 +247,17 @@ typedef struct {
   void (*set_framerate)(struct CamContext*,float);
   void (*get_num_framebuffers)(struct CamContext*,int*);
   void (*set_num_framebuffers)(struct CamContext*,int);
+  /* may be NULL, in which case grab_next_frame_blocking_with_stride is
+     called in a loop */
+  void (*grab_frames_batch)(struct CamContext*,
+                            unsigned char**,intptr_t,
+                            double*,unsigned long*,
+                            int,int,int*,float);
+  /* may be NULL. Returns a file descriptor that polls readable while a
+     frame can be grabbed without blocking, or -1 if there is none. */
+  void (*get_wait_fd)(struct CamContext*,int*);
+  /* may be NULL. First frame number with the current ROI. */
+  void (*get_frame_roi_framenumber)(struct CamContext*,unsigned long*);
 
 } CamContext_functable;
 
@@ -256,6 +268,7 @@ typedef struct CamContext { /* These are READ ONLY. To change, call the appropri
   CameraPixelCoding coding; /* CAM_IFACE_MONO8 etc. */
   int depth;           /* mean bits per pixel (e.g. 8 for MONO8, 12 for YUV411, 16 for YUV422) */
   int device_number;
+  void *core_extras;             /* opaque pointer to backend-independent data (see cam_iface_common.c) */
 } CamContext;
 
 CAM_IFACE_API void delete_CamContext(CamContext*);
@@ -284,15 +297,63 @@ CAM_IFACE_API void CamContext_set_camera_property(CamContext *ccntxt,
                                                   long Value,
                                                   int Auto);
 
+/* Read or write n properties at once, property_numbers[i] going with
+   values[i] and autos[i]. Values of properties in manual mode are
+   cached per camera, so repeated reads do not reach the hardware and
+   writes that would not change anything are skipped. Properties in
+   auto mode are always read from the camera. Property info is cached
+   too. Writes invalidate the written value and the info of every
+   property, as limits may follow other properties; changes of the
+   framerate, trigger mode or ROI invalidate all values and info;
+   CamContext_invalidate_property_cache() does so explicitly, e.g.
+   after changing a setting through the vendor SDK. Processing stops
+   at the first error. Returns 0 or an error code. */
+CAM_IFACE_API int CamContext_get_camera_properties(CamContext *ccntxt,
+                                                   const int *property_numbers,
+                                                   long *values,
+                                                   int *autos,
+                                                   int n);
+CAM_IFACE_API int CamContext_set_camera_properties(CamContext *ccntxt,
+                                                   const int *property_numbers,
+                                                   const long *values,
+                                                   const int *autos,
+                                                   int n);
+CAM_IFACE_API int CamContext_invalidate_property_cache(CamContext *ccntxt);
+
 /* copy the image data into a buffer passed in */
 CAM_IFACE_API void CamContext_grab_next_frame_blocking(CamContext *ccntxt, unsigned char* out_bytes, float timeout);
 
 /* copy the image data into a buffer passed in (with buffer stride information) */
 CAM_IFACE_API void CamContext_grab_next_frame_blocking_with_stride(CamContext *ccntxt, unsigned char* out_bytes, intptr_t stride0, float timeout);
 
-/* get a pointer to the image data */
+/* copy up to max_frames frames into the buffers out_bytes[0..max_frames-1]
+   (all with stride stride0), storing the timestamp and frame number of
+   each in the parallel arrays (which may be NULL). Blocks until at least
+   min_frames frames have arrived or timeout seconds have passed (wait
+   forever if timeout is negative), then adds any further frames that are
+   already waiting. The number of frames copied is returned in
+   num_frames, also when an error occurs part way through. */
+CAM_IFACE_API void CamContext_grab_frames_batch(CamContext *ccntxt,
+                                                unsigned char** out_bytes,
+                                                intptr_t stride0,
+                                                double* timestamps,
+                                                unsigned long* framenumbers,
+                                                int max_frames,
+                                                int min_frames,
+                                                int* num_frames,
+                                                float timeout);
+
+/* get a pointer to the image data without copying. The pointer stays
+   valid until the matching CamContext_unpoint_frame(). Backends may
+   allow several frames to be pointed to at once; frames are released
+   in the order they were pointed. At least one frame buffer always
+   stays with the driver, so with a single buffer this fails with
+   CAM_IFACE_BUFFER_OVERFLOW_ERROR. While frames are pointed to, the
+   dc1394, aravis and Prosilica backends refuse to stop the camera or
+   to change settings that restart capture (ROI, framerate, number of
+   frame buffers). */
 CAM_IFACE_API void CamContext_point_next_frame_blocking(CamContext *ccntxt, unsigned char** buf_ptr, float timeout);
-/* release point to the image data */
+/* release pointer to the oldest pointed image data */
 CAM_IFACE_API void CamContext_unpoint_frame(CamContext *ccntxt);
 
 CAM_IFACE_API void CamContext_get_last_timestamp( CamContext *ccntxt,
@@ -315,6 +376,39 @@ CAM_IFACE_API void CamContext_get_frame_roi( CamContext *ccntxt,
                                              int *left, int *top, int* width, int* height );
 CAM_IFACE_API void CamContext_set_frame_roi( CamContext *ccntxt,
                                              int left, int top, int width, int height );
+/* Frame number, as reported by CamContext_get_last_framenumber(), from
+   which on frames carry the ROI of the last CamContext_set_frame_roi().
+   Frames numbered below it may still have the previous ROI, which
+   happens when only the offset changed and the camera kept capturing.
+   Returns CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE if the backend
+   cannot tell. */
+CAM_IFACE_API int CamContext_get_frame_roi_framenumber( CamContext *ccntxt,
+                                                        unsigned long *framenumber );
+
+/* Software ROI, binning and decimation.
+
+   After CamContext_set_software_roi(), CamContext_grab_next_frame_blocking()
+   and its _with_stride and CamContext_grab_frames_batch() variants return
+   only the width x height region at (left,top) of the hardware ROI,
+   reduced by averaging binning x binning blocks (binning 1, 2 or 4) and
+   then keeping every decimation-th block in each direction. The region
+   is reduced while the frame is copied out of the backend, so with
+   backends that support CamContext_point_next_frame_blocking() it costs
+   no extra pass over memory; other backends, and grabs made while the
+   caller points to frames, go through a scratch frame first. Bayer and RAW codings are handled in 2x2 quads, so binning
+   averages pixels of the same colour and left and top must be even;
+   YUV422 and YUV411 are handled in groups of 2 and 4 pixels. A width or
+   height of 0 turns the stage off. It is also turned off when a later
+   CamContext_set_frame_roi() makes the region no longer fit.
+
+   CamContext_get_software_roi_size() gives the size of the frames that
+   are returned, which is the hardware ROI while the stage is off. Both
+   return 0 or an error code. */
+CAM_IFACE_API int CamContext_set_software_roi( CamContext *ccntxt,
+                                               int left, int top, int width, int height,
+                                               int binning, int decimation );
+CAM_IFACE_API int CamContext_get_software_roi_size( CamContext *ccntxt,
+                                                    int *width, int *height );
 
 CAM_IFACE_API void CamContext_get_max_frame_size( CamContext *ccntxt,
                                                   int *width,
@@ -334,6 +428,510 @@ CAM_IFACE_API void CamContext_get_num_framebuffers( CamContext *ccntxt,
 CAM_IFACE_API void CamContext_set_num_framebuffers( CamContext *ccntxt,
                                              int num_framebuffers );
 
+/* Size the frame buffer ring to a memory budget: sets the largest
+   number of frame buffers (at most 1024) whose
+   CamContext_get_buffer_size() bytes each fit in budget_bytes, halving
+   it while the backend cannot allocate that many. The number is chosen
+   again whenever CamContext_set_frame_roi() changes the buffer size,
+   until a budget of 0 or CamContext_set_num_framebuffers() turns this
+   off. Returns 0 or an error code, e.g. when the budget does not hold
+   two buffers, in which case automatic sizing stays off. */
+CAM_IFACE_API int CamContext_set_framebuffer_memory_budget( CamContext *ccntxt,
+                                                            size_t budget_bytes );
+
+/* Status-returning variants of the functions above.
+
+   Each of these clears any pending error, makes the call and returns 0
+   on success or the CAM_IFACE_* error code (e.g. CAM_IFACE_FRAME_TIMEOUT)
+   on failure, so callers need not poll cam_iface_have_error(). The
+   error stays set after a failed call: the message is only formatted
+   when cam_iface_get_error_string() is called, and
+   cam_iface_clear_error() still resets it. */
+CAM_IFACE_API int CamContext_close_rc(CamContext *ccntxt);
+CAM_IFACE_API int CamContext_start_camera_rc(CamContext *ccntxt);
+CAM_IFACE_API int CamContext_stop_camera_rc(CamContext *ccntxt);
+CAM_IFACE_API int CamContext_get_num_camera_properties_rc(CamContext *ccntxt,
+                                                          int* num_properties);
+CAM_IFACE_API int CamContext_get_camera_property_info_rc(CamContext *ccntxt,
+                                                         int property_number,
+                                                         CameraPropertyInfo *info);
+CAM_IFACE_API int CamContext_get_camera_property_rc(CamContext *ccntxt,
+                                                    int property_number,
+                                                    long* Value,
+                                                    int* Auto);
+CAM_IFACE_API int CamContext_set_camera_property_rc(CamContext *ccntxt,
+                                                    int property_number,
+                                                    long Value,
+                                                    int Auto);
+CAM_IFACE_API int CamContext_grab_next_frame_blocking_rc(CamContext *ccntxt,
+                                                         unsigned char* out_bytes,
+                                                         float timeout);
+CAM_IFACE_API int CamContext_grab_next_frame_blocking_with_stride_rc(CamContext *ccntxt,
+                                                                     unsigned char* out_bytes,
+                                                                     intptr_t stride0,
+                                                                     float timeout);
+CAM_IFACE_API int CamContext_grab_frames_batch_rc(CamContext *ccntxt,
+                                                  unsigned char** out_bytes,
+                                                  intptr_t stride0,
+                                                  double* timestamps,
+                                                  unsigned long* framenumbers,
+                                                  int max_frames,
+                                                  int min_frames,
+                                                  int* num_frames,
+                                                  float timeout);
+CAM_IFACE_API int CamContext_point_next_frame_blocking_rc(CamContext *ccntxt,
+                                                          unsigned char** buf_ptr,
+                                                          float timeout);
+CAM_IFACE_API int CamContext_unpoint_frame_rc(CamContext *ccntxt);
+CAM_IFACE_API int CamContext_get_last_timestamp_rc(CamContext *ccntxt,
+                                                   double* timestamp);
+CAM_IFACE_API int CamContext_get_last_framenumber_rc(CamContext *ccntxt,
+                                                     unsigned long* framenumber);
+CAM_IFACE_API int CamContext_get_num_trigger_modes_rc(CamContext *ccntxt,
+                                                      int *num_exposure_modes);
+CAM_IFACE_API int CamContext_get_trigger_mode_string_rc(CamContext *ccntxt,
+                                                        int exposure_mode_number,
+                                                        char* exposure_mode_string,
+                                                        int exposure_mode_string_maxlen);
+CAM_IFACE_API int CamContext_get_trigger_mode_number_rc(CamContext *ccntxt,
+                                                        int *exposure_mode_number);
+CAM_IFACE_API int CamContext_set_trigger_mode_number_rc(CamContext *ccntxt,
+                                                        int exposure_mode_number);
+CAM_IFACE_API int CamContext_get_frame_roi_rc(CamContext *ccntxt,
+                                              int *left, int *top, int* width, int* height);
+CAM_IFACE_API int CamContext_set_frame_roi_rc(CamContext *ccntxt,
+                                              int left, int top, int width, int height);
+CAM_IFACE_API int CamContext_get_max_frame_size_rc(CamContext *ccntxt,
+                                                   int *width,
+                                                   int *height);
+CAM_IFACE_API int CamContext_get_buffer_size_rc(CamContext *ccntxt,
+                                                int *size);
+CAM_IFACE_API int CamContext_get_framerate_rc(CamContext *ccntxt,
+                                              float *framerate);
+CAM_IFACE_API int CamContext_set_framerate_rc(CamContext *ccntxt,
+                                              float framerate);
+CAM_IFACE_API int CamContext_get_num_framebuffers_rc(CamContext *ccntxt,
+                                                     int *num_framebuffers);
+CAM_IFACE_API int CamContext_set_num_framebuffers_rc(CamContext *ccntxt,
+                                                     int num_framebuffers);
+
+/* Optional background capture thread.
+
+   CamContext_start_capture_thread() starts a thread that grabs frames
+   from the camera as fast as they arrive and stores them, along with
+   their timestamps and frame numbers, in a ring of num_slots
+   preallocated buffers. Take frames from the ring with
+   CamContext_point_queued_frame() and give them back, oldest first,
+   with CamContext_unpoint_queued_frame(). Several frames may be
+   pointed to at once.
+
+   If the ring is full when a frame arrives, that frame is discarded
+   and counted as an overrun. The num_overruns field of each queued
+   frame gives the number of frames discarded just before it.
+
+   The camera must be started first. While the capture thread runs, do
+   not grab or point frames from this CamContext directly, and do not
+   change the frame ROI. CamContext_stop_camera() stops the capture
+   thread.
+
+   These functions return 0 on success or a CAM_IFACE_* error code. */
+typedef struct CamIfaceQueuedFrame CamIfaceQueuedFrame;
+struct CamIfaceQueuedFrame {
+  unsigned char *data;
+  intptr_t stride;
+  int width;
+  int height;
+  double timestamp;
+  double arrival;             /* when the capture thread received it, seconds since the epoch */
+  unsigned long framenumber;
+  int error;                  /* error reported by the backend for this frame, e.g. CAM_IFACE_FRAME_DATA_LOST_ERROR */
+  unsigned long num_overruns; /* number of frames discarded just before this one */
+};
+
+CAM_IFACE_API int CamContext_start_capture_thread( CamContext *ccntxt,
+                                                   int num_slots );
+CAM_IFACE_API int CamContext_stop_capture_thread( CamContext *ccntxt );
+
+/* Returns CAM_IFACE_FRAME_TIMEOUT if no frame arrived within timeout
+   seconds (wait forever if timeout is negative). If the capture thread
+   stopped because of a backend error, that error is returned once all
+   queued frames have been taken. */
+CAM_IFACE_API int CamContext_point_queued_frame( CamContext *ccntxt,
+                                                 CamIfaceQueuedFrame *frame,
+                                                 float timeout );
+CAM_IFACE_API int CamContext_unpoint_queued_frame( CamContext *ccntxt );
+
+/* total number of frames discarded because the ring was full */
+CAM_IFACE_API int CamContext_get_capture_overruns( CamContext *ccntxt,
+                                                   unsigned long *num_overruns );
+
+/* Per-camera statistics.
+
+   The core library counts the outcome of every grab and point call
+   (including CamContext_grab_frames_batch() and the capture thread),
+   independent of the backend. The counters are updated with atomic
+   operations, so CamContext_get_statistics() may be called from a
+   monitoring thread while another thread grabs. Each field is read
+   atomically, but the snapshot as a whole is not. */
+#define CAM_IFACE_STATS_LATENCY_BINS 32
+
+typedef struct CamIfaceStats CamIfaceStats;
+struct CamIfaceStats {
+  unsigned long frames_delivered; /* frames handed to the caller */
+  unsigned long framenumber_gaps; /* frames skipped according to the frame numbers */
+  unsigned long frames_corrupt;   /* CAM_IFACE_FRAME_DATA_CORRUPT_ERROR */
+  unsigned long frames_missing;   /* CAM_IFACE_FRAME_DATA_MISSING_ERROR */
+  unsigned long frames_lost;      /* CAM_IFACE_FRAME_DATA_LOST_ERROR */
+  unsigned long timeouts;         /* CAM_IFACE_FRAME_TIMEOUT */
+  unsigned long other_errors;     /* any other error from a grab or point call */
+  unsigned long queue_overruns;   /* frames discarded because the capture ring was full */
+  long queue_depth;               /* frames in the capture ring now */
+  long queue_depth_peak;          /* largest queue_depth seen */
+  /* Time each grab or point call took. Bin 0 counts calls shorter than
+     1 microsecond, bin i calls of 2^(i-1) up to 2^i microseconds and
+     the last bin everything longer. */
+  unsigned long latency_usec_hist[CAM_IFACE_STATS_LATENCY_BINS];
+};
+
+/* These return 0 on success or a CAM_IFACE_* error code. */
+CAM_IFACE_API int CamContext_get_statistics( CamContext *ccntxt,
+                                             CamIfaceStats *stats );
+CAM_IFACE_API int CamContext_reset_statistics( CamContext *ccntxt );
+
+/* Host clock mapping.
+
+   Backends report timestamps on different clocks, often the camera's
+   own. For every camera the core library fits a line (offset and
+   drift) from these timestamps to the host clock, using the time each
+   frame reached the library. Mapped timestamps are in seconds since
+   the epoch, so frames from cameras on different backends can be
+   compared directly. The fit follows the earliest arrivals and so
+   ignores queueing delays, but a constant transfer latency is not
+   removed. A camera clock that jumps restarts the fit.
+
+   CamContext_camera_to_host_time() maps any timestamp of this camera,
+   e.g. from CamContext_grab_frames_batch() or a queued frame. Both
+   functions may be called from any thread. They return 0 on success,
+   CAM_IFACE_GENERIC_ERROR if no frame has been grabbed yet, or the
+   error of the backend. */
+CAM_IFACE_API int CamContext_get_last_timestamp_host( CamContext *ccntxt,
+                                                      double *timestamp );
+CAM_IFACE_API int CamContext_camera_to_host_time( CamContext *ccntxt,
+                                                  double camera_timestamp,
+                                                  double *host_timestamp );
+
+/* Logging.
+
+   Diagnostic messages from the core library and the backends are
+   grouped in categories, each with its own level. A message is only
+   formatted if its level is enabled, so disabled messages cost one
+   comparison. Enabled messages go to stderr and/or to an in-memory
+   ring of the most recent CAM_IFACE_LOG_RING_SIZE messages, which may
+   be written from any thread without locking and is drained with
+   cam_iface_log_read().
+
+   cam_iface_startup() reads the initial configuration from the
+   environment:
+
+     CAM_IFACE_LOG       comma separated list of category=level pairs,
+                         e.g. "prosilica_gige=trace,*=warn"; a bare
+                         level applies to every category
+     CAM_IFACE_LOG_SINK  "stderr" (the default), "ring" or "both"
+
+   Levels are off, error, warn (the default), info, debug and trace.
+   The mega and unity backends share a single configuration and ring
+   with the backends they load. */
+typedef enum CamIfaceLogLevel
+{
+  CAM_IFACE_LOG_OFF=0,
+  CAM_IFACE_LOG_ERROR,
+  CAM_IFACE_LOG_WARN,
+  CAM_IFACE_LOG_INFO,
+  CAM_IFACE_LOG_DEBUG,
+  CAM_IFACE_LOG_TRACE         /* per-frame messages */
+} CamIfaceLogLevel;
+
+typedef enum CamIfaceLogCategory
+{
+  CAM_IFACE_LOG_CORE=0,
+  CAM_IFACE_LOG_MEGA,
+  CAM_IFACE_LOG_UNITY,
+  CAM_IFACE_LOG_DC1394,
+  CAM_IFACE_LOG_ARAVIS,
+  CAM_IFACE_LOG_PROSILICA_GIGE,
+  CAM_IFACE_LOG_BASLER_PYLON,
+  CAM_IFACE_LOG_PGR_FLYCAPTURE,
+  CAM_IFACE_LOG_QUICKTIME,
+  CAM_IFACE_LOG_FMF_PLAYBACK,
+  CAM_IFACE_LOG_SYNTHETIC,
+  CAM_IFACE_LOG_NUM_CATEGORIES
+} CamIfaceLogCategory;
+
+#define CAM_IFACE_LOG_SINK_STDERR 1
+#define CAM_IFACE_LOG_SINK_RING   2
+
+#define CAM_IFACE_LOG_RING_SIZE 256
+#define CAM_IFACE_LOG_MSG_LEN 200
+
+typedef struct CamIfaceLogMessage CamIfaceLogMessage;
+struct CamIfaceLogMessage {
+  double timestamp;          /* seconds since the epoch */
+  int category;              /* a CamIfaceLogCategory */
+  int level;                 /* a CamIfaceLogLevel */
+  unsigned long num_lost;    /* messages overwritten before this one could be read */
+  char text[CAM_IFACE_LOG_MSG_LEN];
+};
+
+/* category -1 sets the level of every category */
+CAM_IFACE_API void cam_iface_log_set_level( int category, int level );
+CAM_IFACE_API int cam_iface_log_get_level( int category );
+/* sinks is a combination of the CAM_IFACE_LOG_SINK_* flags */
+CAM_IFACE_API void cam_iface_log_set_sinks( int sinks );
+/* Take the oldest message from the ring. Returns 1 if msg was filled
+   in, 0 if the ring is empty. Call from one thread at a time. */
+CAM_IFACE_API int cam_iface_log_read( CamIfaceLogMessage *msg );
+
+/* Bayer demosaicing.
+
+   cam_iface_demosaic() converts a width x height image in one of the
+   CAM_IFACE_MONO8_BAYER_* codings to interleaved RGB8, writing each
+   output row dst_stride bytes after the previous one. It needs no
+   memory besides src and dst, so it can be called from any backend or
+   thread. Width and height must be at least 3.
+
+   Returns 0 on success, CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE for
+   a coding that is not a Bayer mosaic, or CAM_IFACE_GENERIC_ERROR for
+   bad arguments. */
+typedef enum CamIfaceDemosaicMethod
+{
+  CAM_IFACE_DEMOSAIC_BILINEAR=0, /* average of nearest neighbours */
+  CAM_IFACE_DEMOSAIC_HQLINEAR    /* gradient-corrected (Malvar-He-Cutler) */
+}
+CamIfaceDemosaicMethod;
+
+CAM_IFACE_API int cam_iface_demosaic( CameraPixelCoding coding,
+                                      CamIfaceDemosaicMethod method,
+                                      const unsigned char *src,
+                                      intptr_t src_stride,
+                                      int width,
+                                      int height,
+                                      unsigned char *dst,
+                                      intptr_t dst_stride );
+
+/* instruction set used by cam_iface_demosaic() on this machine, e.g. "avx2" */
+CAM_IFACE_API const char *cam_iface_demosaic_get_isa(void);
+
+/* Pixel format conversion.
+
+   cam_iface_convert_pixels() converts a width x height image from
+   src_coding to dst_coding, reading and writing rows src_stride and
+   dst_stride bytes apart. Supported are YUV411, YUV422 and YUV444 to
+   MONO8, RGB8 or RGBA8, and MONO16 to MONO8. Width must be a multiple
+   of 4 for YUV411 and of 2 for YUV422. options may be NULL.
+
+   Large images are converted by several threads at once. Returns 0 on
+   success, CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE for an unsupported
+   pair of codings, or CAM_IFACE_GENERIC_ERROR for bad arguments. */
+typedef struct CamIfaceConvertOptions
+{
+  int mono16_shift;      /* MONO16 -> MONO8: right shift (default 8) */
+  int mono16_big_endian; /* MONO16 samples are stored high byte first */
+}
+CamIfaceConvertOptions;
+
+CAM_IFACE_API int cam_iface_convert_pixels( CameraPixelCoding src_coding,
+                                            const unsigned char *src,
+                                            intptr_t src_stride,
+                                            CameraPixelCoding dst_coding,
+                                            unsigned char *dst,
+                                            intptr_t dst_stride,
+                                            int width,
+                                            int height,
+                                            const CamIfaceConvertOptions *options );
+
+/* Set the number of threads, including the caller, used to convert a
+   large image (0 picks one per CPU, 1 disables the worker threads).
+   Running workers are stopped; new ones start on the next conversion. */
+CAM_IFACE_API void cam_iface_convert_set_num_threads( int num_threads );
+
+/* FMF v3 movie recording.
+
+   cam_iface_fmf_writer_open() creates filename and allocates room for
+   num_buffers frames of width x height pixels in coding.
+   cam_iface_fmf_writer_add_frame() copies one frame into that buffer
+   and returns at once; a writer thread saves it to disk. If the buffer
+   is full because the disk cannot keep up, the frame is discarded,
+   counted as dropped, and CAM_IFACE_BUFFER_OVERFLOW_ERROR is returned.
+   After a failed write, add_frame returns CAM_IFACE_GENERIC_ERROR and
+   the error number is in the write_errno field of the statistics.
+
+   cam_iface_fmf_writer_close() writes the remaining frames, stores the
+   frame count in the header, and frees the writer. If stats is not
+   NULL the final statistics are stored there.
+
+   Call add_frame from one thread at a time. These functions return 0
+   on success or a CAM_IFACE_* error code. */
+#define CAM_IFACE_FMF_WRITER_DIRECT 1 /* bypass the page cache (O_DIRECT) where supported */
+
+typedef struct CamIfaceFmfWriter CamIfaceFmfWriter;
+
+typedef struct CamIfaceFmfWriterStats CamIfaceFmfWriterStats;
+struct CamIfaceFmfWriterStats {
+  unsigned long num_frames;         /* frames accepted by add_frame */
+  unsigned long num_dropped;        /* frames discarded because the buffer was full */
+  int num_buffers;                  /* frames the buffer holds */
+  int buffers_high_water;           /* most frames waiting to be written at once */
+  unsigned long long bytes_written; /* bytes written to the file so far */
+  int write_errno;                  /* errno of the first failed write, or 0 */
+};
+
+CAM_IFACE_API int cam_iface_fmf_writer_open( CamIfaceFmfWriter **writer,
+                                             const char *filename,
+                                             CameraPixelCoding coding,
+                                             int width,
+                                             int height,
+                                             int num_buffers,
+                                             int flags );
+CAM_IFACE_API int cam_iface_fmf_writer_add_frame( CamIfaceFmfWriter *writer,
+                                                  const unsigned char *pixels,
+                                                  intptr_t stride,
+                                                  double timestamp );
+CAM_IFACE_API int cam_iface_fmf_writer_get_stats( CamIfaceFmfWriter *writer,
+                                                  CamIfaceFmfWriterStats *stats );
+CAM_IFACE_API int cam_iface_fmf_writer_close( CamIfaceFmfWriter *writer,
+                                              CamIfaceFmfWriterStats *stats );
+
+/* FMF movie reading.
+
+   cam_iface_fmf_reader_open() maps filename into memory, so opening is
+   immediate regardless of file size. cam_iface_fmf_reader_get_frame()
+   points pixels at frame number frame inside the mapping (rows are
+   info.stride bytes apart) and stores its timestamp; nothing is
+   copied, and the pointer stays valid until the reader is closed.
+   cam_iface_fmf_reader_find_timestamp() finds the first frame whose
+   timestamp is not before timestamp, assuming timestamps increase.
+
+   With CAM_IFACE_FMF_READER_SEQUENTIAL the kernel is told to read ahead
+   of the frames requested, for playback from start to end. Otherwise
+   the file is set up for random access.
+
+   Files whose header was never completed (n_frames 0) are read up to
+   the last complete frame. These functions return 0 on success or a
+   CAM_IFACE_* error code. */
+#define CAM_IFACE_FMF_READER_SEQUENTIAL 1
+
+typedef struct CamIfaceFmfReader CamIfaceFmfReader;
+
+typedef struct CamIfaceFmfInfo CamIfaceFmfInfo;
+struct CamIfaceFmfInfo {
+  CameraPixelCoding coding; /* CAM_IFACE_UNKNOWN if format is not recognized */
+  const char *format;       /* format string from the header, e.g. "MONO8:RGGB" */
+  int width;
+  int height;
+  int bpp;                  /* bits per pixel */
+  intptr_t stride;          /* bytes per row */
+  long num_frames;
+};
+
+CAM_IFACE_API int cam_iface_fmf_reader_open( CamIfaceFmfReader **reader,
+                                             const char *filename,
+                                             int flags );
+CAM_IFACE_API int cam_iface_fmf_reader_close( CamIfaceFmfReader *reader );
+CAM_IFACE_API int cam_iface_fmf_reader_get_info( CamIfaceFmfReader *reader,
+                                                 CamIfaceFmfInfo *info );
+CAM_IFACE_API int cam_iface_fmf_reader_get_frame( CamIfaceFmfReader *reader,
+                                                  long frame,
+                                                  const unsigned char **pixels,
+                                                  double *timestamp );
+CAM_IFACE_API int cam_iface_fmf_reader_find_timestamp( CamIfaceFmfReader *reader,
+                                                       double timestamp,
+                                                       long *frame );
+
+/* Wait until any of the n cameras in ctxs has a frame ready and store
+   its index in ready_index. Cameras with a running capture thread are
+   ready when CamContext_point_queued_frame() would not block, other
+   cameras when the next grab or point call would not block. Ready
+   cameras are reported in turn, so a busy camera cannot starve the
+   others.
+
+   Returns 0 on success, CAM_IFACE_FRAME_TIMEOUT if nothing became
+   ready within timeout seconds (wait forever if timeout is negative),
+   or CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE if a camera can be
+   waited on neither by its backend nor by a capture thread. */
+CAM_IFACE_API int cam_iface_wait_any( CamContext **ctxs,
+                                      int n,
+                                      float timeout,
+                                      int *ready_index );
+
+/* Multi-camera frame sets.
+
+   cam_iface_sync_open() starts a capture thread with num_slots slots
+   on each of the n (already started) cameras in ctxs.
+   cam_iface_sync_next_set() then returns one frame from every camera,
+   all belonging to the same trigger, as a set. The frames stay pointed
+   to in the capture rings until cam_iface_sync_release_set(), which
+   must be called before the next set is requested. The frames array
+   of the set belongs to the synchronizer; nothing is allocated after
+   cam_iface_sync_open().
+
+   With CAM_IFACE_SYNC_BY_TIMESTAMP, frames belong to the same set if
+   their host timestamps (see CamContext_camera_to_host_time()) are at
+   most tolerance seconds apart. Frames of a camera whose clock cannot
+   be mapped yet use their arrival time instead. With CAM_IFACE_SYNC_BY_FRAMENUMBER,
+   frames belong to the same set if their frame numbers plus a
+   per-camera offset are equal. The offsets are either set with
+   cam_iface_sync_set_framenumber_offset() or taken from the first set,
+   which is then matched by timestamp within tolerance. A nonzero
+   modulus is the range of the cameras' frame counters (e.g. 65536 for
+   a 16 bit counter); frame numbers are compared modulo it, so counters
+   may wrap.
+
+   When some camera has no frame for a set, e.g. because it was
+   dropped, the frames of that set are discarded and counted in the
+   statistics. Frames reported with an error by the backend are
+   discarded likewise. Only one thread may use a synchronizer.
+
+   Returns 0 on success, CAM_IFACE_FRAME_TIMEOUT if no complete set
+   arrived within timeout seconds (wait forever if timeout is
+   negative), or another CAM_IFACE_* error code. */
+#define CAM_IFACE_SYNC_BY_FRAMENUMBER 0
+#define CAM_IFACE_SYNC_BY_TIMESTAMP 1
+
+typedef struct CamIfaceSync CamIfaceSync;
+
+typedef struct CamIfaceFrameSet CamIfaceFrameSet;
+struct CamIfaceFrameSet {
+  int num_frames;
+  CamIfaceQueuedFrame *frames; /* one per camera, in the order of ctxs */
+  unsigned long framenumber;   /* frame number of the set (the first camera's plus its offset) */
+  double timestamp;            /* host timestamp of the first camera's frame */
+};
+
+typedef struct CamIfaceSyncStats CamIfaceSyncStats;
+struct CamIfaceSyncStats {
+  unsigned long sets_complete;
+  unsigned long sets_incomplete;   /* sets discarded because some camera missed them */
+  unsigned long frames_discarded;  /* frames discarded with incomplete sets or for errors */
+};
+
+CAM_IFACE_API int cam_iface_sync_open( CamIfaceSync **sync,
+                                       CamContext **ctxs,
+                                       int n,
+                                       int match,
+                                       double tolerance,
+                                       unsigned long modulus,
+                                       int num_slots );
+CAM_IFACE_API int cam_iface_sync_close( CamIfaceSync *sync );
+CAM_IFACE_API int cam_iface_sync_set_framenumber_offset( CamIfaceSync *sync,
+                                                         int camera,
+                                                         long offset );
+CAM_IFACE_API int cam_iface_sync_next_set( CamIfaceSync *sync,
+                                           CamIfaceFrameSet *set,
+                                           float timeout );
+CAM_IFACE_API int cam_iface_sync_release_set( CamIfaceSync *sync );
+CAM_IFACE_API int cam_iface_sync_get_stats( CamIfaceSync *sync,
+                                            CamIfaceSyncStats *stats );
+
 #ifdef __cplusplus
 }
 #endif
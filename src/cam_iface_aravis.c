@@ -30,6 +30,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 /* Backend for libaravis-0.2 */
 #include "cam_iface.h"
+#include "cam_iface_internal.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -37,6 +38,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <sys/select.h>
 #include <errno.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
 
 #include <arv.h>
 #include <glib.h>
@@ -82,6 +87,12 @@ typedef struct {
   void (*set_framerate)(struct CCaravis*,float);
   void (*get_num_framebuffers)(struct CCaravis*,int*);
   void (*set_num_framebuffers)(struct CCaravis*,int);
+  void (*grab_frames_batch)(struct CCaravis*,
+                            unsigned char**,intptr_t,
+                            double*,unsigned long*,
+                            int,int,int*,float);
+  void (*get_wait_fd)(struct CCaravis*,int*);
+  void (*get_frame_roi_framenumber)(struct CCaravis*,unsigned long*);
 } CCaravis_functable;
 
 typedef struct CCaravis {
@@ -102,6 +113,7 @@ typedef struct CCaravis {
   ArvCamera *camera;
   ArvStream *stream;
   int num_buffers;
+  int num_excess_buffers; /* dropped instead of pushed back, after shrinking */
   const char *guid;
 
   char **trigger_modes;
@@ -110,6 +122,16 @@ typedef struct CCaravis {
 
   guint32 framenumber_msbs;
 
+  /* buffers lent to the caller by point_next_frame_blocking(), oldest
+  at the head. They are pushed back to the stream by unpoint_frame(). */
+  GQueue *pointed_buffers;
+  int max_pointed;
+
+  /* eventfd counting completed buffers, created by get_wait_fd(). It is
+  bumped from the stream's new-buffer signal and resynchronised with
+  the stream's output queue after every pop. -1 if unused. */
+  int wait_fd;
+
 } CCaravis;
 
 // forward declarations
@@ -150,6 +172,11 @@ void CCaravis_get_framerate(struct CCaravis*,float*);
 void CCaravis_set_framerate(struct CCaravis*,float);
 void CCaravis_get_num_framebuffers(struct CCaravis*,int*);
 void CCaravis_set_num_framebuffers(struct CCaravis*,int);
+void CCaravis_grab_frames_batch(struct CCaravis*,
+                                unsigned char**,intptr_t,
+                                double*,unsigned long*,
+                                int,int,int*,float);
+void CCaravis_get_wait_fd(struct CCaravis*,int*);
 
 CCaravis_functable CCaravis_vmt = {
   (cam_iface_constructor_func_t)CCaravis_construct,
@@ -179,7 +206,10 @@ CCaravis_functable CCaravis_vmt = {
   CCaravis_get_framerate,
   CCaravis_set_framerate,
   CCaravis_get_num_framebuffers,
-  CCaravis_set_num_framebuffers
+  CCaravis_set_num_framebuffers,
+  CCaravis_grab_frames_batch,
+  CCaravis_get_wait_fd,
+  NULL /* get_frame_roi_framenumber: not known */
 };
 
 // See the following for a hint on how to make thread thread-local without __thread.
@@ -208,6 +238,7 @@ typedef struct {
 myTLS int BACKEND_GLOBAL(cam_iface_error) = 0;
 #define CAM_IFACE_MAX_ERROR_LEN 255
 myTLS char BACKEND_GLOBAL(cam_iface_error_string)[CAM_IFACE_MAX_ERROR_LEN]  = {0x00}; //...
+myTLS cam_iface_deferred_error BACKEND_GLOBAL(cam_iface_error_info) = {NULL};
 
 static unsigned int aravis_debug = 0;
 #define DEBUG_API       0x1
@@ -240,15 +271,8 @@ GMainLoop *aravis_mainloop = NULL;
 
 #define DWARNF(...) fprintf(stderr, "WARN :    " __VA_ARGS__); fflush(stderr);
 
-#ifdef MEGA_BACKEND
-#define CAM_IFACE_ERROR_FORMAT(m)                                       \
-  snprintf(aravis_cam_iface_error_string,CAM_IFACE_MAX_ERROR_LEN,              \
-           "%s (%d): %s\n",__FILE__,__LINE__,(m));
-#else
 #define CAM_IFACE_ERROR_FORMAT(m)                                       \
-  snprintf(cam_iface_error_string,CAM_IFACE_MAX_ERROR_LEN,              \
-           "%s (%d): %s\n",__FILE__,__LINE__,(m));
-#endif
+  CAM_IFACE_DEFER_ERROR(BACKEND_GLOBAL(cam_iface_error_info),(m));
 
 #ifdef MEGA_BACKEND
 # define NOT_IMPLEMENTED                                  \
@@ -288,6 +312,9 @@ int BACKEND_METHOD(cam_iface_have_error)() {
 }
 
 const char * BACKEND_METHOD(cam_iface_get_error_string)() {
+  CAM_IFACE_FORMAT_DEFERRED_ERROR(BACKEND_GLOBAL(cam_iface_error_info),
+                                  BACKEND_GLOBAL(cam_iface_error_string),
+                                  CAM_IFACE_MAX_ERROR_LEN);
   return BACKEND_GLOBAL(cam_iface_error_string);
 }
 
@@ -315,6 +342,8 @@ void BACKEND_METHOD(cam_iface_startup)() {
   const char *delay_env, *debug_env;
   float delay_sec;
 
+  cam_iface_log_init();
+
   DPRINTF("startup\n");
 
 #if !GLIB_CHECK_VERSION (2, 31, 0)
@@ -610,6 +639,21 @@ void delete_CCaravis( CCaravis *this ) {
   CCaravis_close(this);
   this->inherited.vmt = NULL;
 
+  if (this->wait_fd >= 0) {
+    if (this->stream) {
+      arv_stream_set_emit_signals (this->stream, FALSE);
+      g_signal_handlers_disconnect_by_data (this->stream, this);
+    }
+    close(this->wait_fd);
+  }
+
+  if (this->pointed_buffers) {
+    ArvBuffer *buffer;
+    while ((buffer = g_queue_pop_head(this->pointed_buffers)) != NULL)
+      g_object_unref (buffer);
+    g_queue_free(this->pointed_buffers);
+  }
+
   if (this->trigger_modes) {
     int i;
     for (i=0; i<this->num_trigger_modes; i++)
@@ -655,8 +699,16 @@ void CCaravis_CCaravis( CCaravis *this,
 
   this->last_timestamp_ns = 0;
   this->num_buffers = NumImageBuffers;
+  this->num_excess_buffers = 0;
   this->started = 0;
 
+  /* always leave at least one buffer queued so the stream keeps running
+  while the caller holds pointed frames */
+  this->pointed_buffers = g_queue_new();
+  this->stream = NULL;
+  this->wait_fd = -1;
+  this->max_pointed = this->num_buffers - 1;
+
   id = aravis_cameras[device_index].device_name;
 
   /* if an interface is supplied, use that to connect to the camera */
@@ -792,6 +844,36 @@ void CCaravis_close(CCaravis *this) {
 
 
 
+static void _CCaravis_new_buffer_cb( ArvStream *stream, gpointer data ) {
+  CCaravis *this = (CCaravis*)data;
+  guint64 one = 1;
+  if (write(this->wait_fd, &one, sizeof(one))) {}
+}
+
+static void _CCaravis_connect_wait_fd( CCaravis *this ) {
+  if ((this->wait_fd >= 0) && this->stream) {
+    g_signal_connect (this->stream, "new-buffer", G_CALLBACK(_CCaravis_new_buffer_cb), this);
+    arv_stream_set_emit_signals (this->stream, TRUE);
+  }
+}
+
+/* Make the eventfd count equal the number of buffers waiting in the
+stream's output queue, so it polls readable exactly while a pop would
+not block. */
+static void _CCaravis_sync_wait_fd( CCaravis *this ) {
+  guint64 count;
+  gint ib, ob;
+
+  if ((this->wait_fd < 0) || (this->stream == NULL))
+    return;
+  while (read(this->wait_fd, &count, sizeof(count)) > 0) {}
+  arv_stream_get_n_buffers (this->stream, &ib, &ob);
+  if (ob > 0) {
+    count = ob;
+    if (write(this->wait_fd, &count, sizeof(count))) {}
+  }
+}
+
 void CCaravis_start_camera( CCaravis *this ) {
   int i;
   unsigned int payload, resend_enabled;
@@ -811,10 +893,12 @@ void CCaravis_start_camera( CCaravis *this ) {
   if (!ARV_IS_STREAM(this->stream)) {
     ARAVIS_ERROR(CAM_IFACE_CAMERA_NOT_AVAILABLE_ERROR, "error connecting to camera");
   }
+  _CCaravis_connect_wait_fd(this);
 
   payload = arv_camera_get_payload(this->camera);
   for (i = 0; i < this->num_buffers; i++)
     arv_stream_push_buffer (this->stream, arv_buffer_new (payload, NULL));
+  this->num_excess_buffers = 0;
 
   arv_camera_get_region (this->camera,
                          &(this->roi_left), &(this->roi_top),
@@ -828,6 +912,12 @@ void CCaravis_start_camera( CCaravis *this ) {
 }
 
 void CCaravis_stop_camera( CCaravis *this ) {
+  /* the pointed buffers belong to this stream, start_camera() makes a
+  new one */
+  if (!g_queue_is_empty(this->pointed_buffers)) {
+    ARAVIS_ERROR(CAM_IFACE_GENERIC_ERROR, "cannot stop camera while frames are pointed to");
+    return;
+  }
   arv_camera_stop_acquisition (this->camera);
   this->started = 0;
 }
@@ -946,15 +1036,60 @@ void CCaravis_set_camera_property(CCaravis *this,
 
 }
 
-void CCaravis_grab_next_frame_blocking_with_stride( CCaravis *this,
-                                                    unsigned char *out_bytes,
-                                                    intptr_t stride0, float timeout) {
+/* Update frame number and timestamp bookkeeping for a completed buffer */
+static void _CCaravis_record_buffer( CCaravis *this, ArvBuffer *buffer ) {
+  ArvStream *stream = this->stream;
+
+  /* Check if frame_id wrapped - GigE Vision frames roll over at 2^16 (65536). */
+  if ((buffer->frame_id < 100) &&
+      (this->last_frame_id > 65000) ) {
+    this->framenumber_msbs++;
+  }
+
+  this->last_frame_id = buffer->frame_id;
+  this->last_timestamp_ns = buffer->timestamp_ns;
+
+  if (aravis_debug & DEBUG_STREAM) {
+    if (++aravis_debug_nth_count > aravis_debug_nth) {
+      guint64 n_resent_packets, n_missing_packets, n_completed_buffers, n_failures, n_underruns;
+      aravis_debug_nth_count = 0;
+      arv_stream_get_statistics (stream, &n_completed_buffers, &n_failures, &n_underruns);
+      arv_gv_stream_get_statistics (ARV_GV_STREAM(stream), &n_resent_packets, &n_missing_packets);
+      fprintf(stderr, "%s C:%06ld\tF:%06ld\tU:%06ld\tR:%06ld\tM:%06ld\n",
+                      this->guid,
+                      n_completed_buffers, n_failures, n_underruns,
+                      n_resent_packets, n_missing_packets);
+      fflush(stderr);
+    }
+  }
+}
+
+/* Hand a buffer back to the stream, or free it if the ring is being
+shrunk by set_num_framebuffers(). */
+static void _CCaravis_return_buffer( CCaravis *this, ArvBuffer *buffer ) {
+  if (this->num_excess_buffers > 0) {
+    this->num_excess_buffers--;
+    g_object_unref (buffer);
+    return;
+  }
+  arv_stream_push_buffer (this->stream, buffer);
+}
+
+/* Pop the next successfully completed buffer from the stream, pushing
+failed ones straight back. The returned buffer is owned by the caller
+and must be pushed back to the stream when done. A negative timeout
+waits forever and a zero timeout does not wait at all. Returns NULL if
+the timeout expires first. */
+static ArvBuffer *_CCaravis_try_pop_buffer( CCaravis *this );
+static ArvBuffer *_CCaravis_pop_buffer( CCaravis *this, float timeout ) {
   ArvBuffer *buffer;
-  int ok = 0;
-  unsigned int stride = (this->roi_width * this->inherited.depth + 7) / 8;
   ArvStream *stream = this->stream;
 
-  while (!ok) {
+  if (timeout == 0) {
+    return _CCaravis_try_pop_buffer(this);
+  }
+
+  while (1) {
     if (aravis_debug & DEBUG_FRAME) {
         gint ib, ob;
         arv_stream_get_n_buffers (stream, &ib, &ob);
@@ -962,7 +1097,7 @@ void CCaravis_grab_next_frame_blocking_with_stride( CCaravis *this,
         fflush(stderr);
     }
 
-    if (timeout <= 0) {
+    if (timeout < 0) {
       buffer = arv_stream_pop_buffer(stream);
       if (!buffer) {
         timeout = 0.5;
@@ -970,70 +1105,136 @@ void CCaravis_grab_next_frame_blocking_with_stride( CCaravis *this,
       }
     } else {
       buffer = arv_stream_timeout_pop_buffer(stream, timeout * G_USEC_PER_SEC);
+      if (!buffer) {
+        _CCaravis_sync_wait_fd(this);
+        return NULL;
+      }
     }
-      
 
     if (buffer) {
-      if (buffer->status == ARV_BUFFER_STATUS_SUCCESS) {
-        int wb = buffer->width * this->inherited.depth / 8;
+      if (buffer->status == ARV_BUFFER_STATUS_SUCCESS)
+        break;
+      _CCaravis_return_buffer(this, buffer);
+    }
+  }
 
-        if (wb>stride0) {
-          *out_bytes = '\0';
-          ARAVIS_ERROR(CAM_IFACE_GENERIC_ERROR, "the buffer provided is not large enough");
-          return;
-        }
+  _CCaravis_record_buffer(this, buffer);
+  _CCaravis_sync_wait_fd(this);
+  return buffer;
+}
 
-        if (aravis_debug & DEBUG_FRAME) {
-          fprintf(stderr, "%s [S:%d/%d(w%d)]\n", this->guid, stride, (int)stride0, this->roi_width);
-          fflush(stderr);
-        }
+/* Like _CCaravis_pop_buffer() but never waits: returns NULL if no
+completed buffer is already queued. */
+static ArvBuffer *_CCaravis_try_pop_buffer( CCaravis *this ) {
+  ArvBuffer *buffer;
 
-        if (stride0 == stride) {
-          /* same stride */
-          memcpy((void*)out_bytes /*dest*/, buffer->data, buffer->size);
-        } else {
-          int row;
-
-          /* different strides */
-          for (row=0; row < buffer->height; row++) {
-            memcpy((void*)(out_bytes + row * stride0), /*dest*/
-              (const void*)((char*)buffer->data + row * stride),/*src*/
-              stride);/*size*/
-          }
-        }
+  while ((buffer = arv_stream_try_pop_buffer(this->stream)) != NULL) {
+    if (buffer->status == ARV_BUFFER_STATUS_SUCCESS) {
+      _CCaravis_record_buffer(this, buffer);
+      _CCaravis_sync_wait_fd(this);
+      return buffer;
+    }
+    _CCaravis_return_buffer(this, buffer);
+  }
+  _CCaravis_sync_wait_fd(this);
+  return NULL;
+}
 
-        /* Check if frame_id wrapped - GigE Vision frames roll over at 2^16 (65536). */
-        if ((buffer->frame_id < 100) &&
-            (this->last_frame_id > 65000) ) {
-          this->framenumber_msbs++;
-        }
+/* Copy a buffer into out_bytes with the given stride. The buffer is
+always pushed back to the stream. */
+static void _CCaravis_copy_buffer( CCaravis *this, ArvBuffer *buffer,
+                                   unsigned char *out_bytes, intptr_t stride0 ) {
+  unsigned int stride = (this->roi_width * this->inherited.depth + 7) / 8;
+  int wb;
 
-        this->last_frame_id = buffer->frame_id;
-        this->last_timestamp_ns = buffer->timestamp_ns;
+  wb = buffer->width * this->inherited.depth / 8;
+  if (wb>stride0) {
+    _CCaravis_return_buffer(this, buffer);
+    *out_bytes = '\0';
+    ARAVIS_ERROR(CAM_IFACE_GENERIC_ERROR, "the buffer provided is not large enough");
+    return;
+  }
 
-        ok = 1;
-      }
-      arv_stream_push_buffer (stream, buffer);
-    }
+  if (aravis_debug & DEBUG_FRAME) {
+    fprintf(stderr, "%s [S:%d/%d(w%d)]\n", this->guid, stride, (int)stride0, this->roi_width);
+    fflush(stderr);
   }
 
-  if (aravis_debug & DEBUG_STREAM) {
-    if (++aravis_debug_nth_count > aravis_debug_nth) {
-      guint64 n_resent_packets, n_missing_packets, n_completed_buffers, n_failures, n_underruns;
-      aravis_debug_nth_count = 0;
-      arv_stream_get_statistics (stream, &n_completed_buffers, &n_failures, &n_underruns);
-      arv_gv_stream_get_statistics (ARV_GV_STREAM(stream), &n_resent_packets, &n_missing_packets);
-      fprintf(stderr, "%s C:%06ld\tF:%06ld\tU:%06ld\tR:%06ld\tM:%06ld\n",
-                      this->guid,
-                      n_completed_buffers, n_failures, n_underruns,
-                      n_resent_packets, n_missing_packets);
-      fflush(stderr);
+  if (stride0 == stride) {
+    /* same stride */
+    memcpy((void*)out_bytes /*dest*/, buffer->data, buffer->size);
+  } else {
+    int row;
+
+    /* different strides */
+    for (row=0; row < buffer->height; row++) {
+      memcpy((void*)(out_bytes + row * stride0), /*dest*/
+        (const void*)((char*)buffer->data + row * stride),/*src*/
+        stride);/*size*/
     }
   }
 
-  if (!ok) {
+  _CCaravis_return_buffer(this, buffer);
+}
+
+void CCaravis_grab_next_frame_blocking_with_stride( CCaravis *this,
+                                                    unsigned char *out_bytes,
+                                                    intptr_t stride0, float timeout) {
+  ArvBuffer *buffer;
+
+  buffer = _CCaravis_pop_buffer(this, timeout);
+  if (!buffer) {
     *out_bytes = '\0';
-    ARAVIS_ERROR(CAM_IFACE_FRAME_DATA_MISSING_ERROR, "no frame ready");
+    ARAVIS_ERROR(CAM_IFACE_FRAME_TIMEOUT, "timeout exceeded");
+    return;
+  }
+
+  _CCaravis_copy_buffer(this, buffer, out_bytes, stride0);
+}
+
+/* Wait for the first min_frames buffers, then drain whatever else is
+already queued with arv_stream_try_pop_buffer(). */
+void CCaravis_grab_frames_batch( CCaravis *this,
+                                 unsigned char **out_bytes, intptr_t stride0,
+                                 double *timestamps, unsigned long *framenumbers,
+                                 int max_frames, int min_frames, int *num_frames,
+                                 float timeout) {
+  ArvBuffer *buffer;
+  gint64 start;
+  float remaining;
+
+  *num_frames = 0;
+  start = g_get_monotonic_time();
+  while (*num_frames < max_frames) {
+    if (*num_frames < min_frames) {
+      remaining = timeout;
+      if (timeout > 0) {
+        remaining = timeout - (g_get_monotonic_time() - start) / (float)G_USEC_PER_SEC;
+        if (remaining <= 0) {
+          ARAVIS_ERROR(CAM_IFACE_FRAME_TIMEOUT, "timeout exceeded");
+          return;
+        }
+      }
+      buffer = _CCaravis_pop_buffer(this, remaining);
+      if (!buffer) {
+        ARAVIS_ERROR(CAM_IFACE_FRAME_TIMEOUT, "timeout exceeded");
+        return;
+      }
+    } else {
+      buffer = _CCaravis_try_pop_buffer(this);
+      if (!buffer)
+        return; /* no more frames waiting */
+    }
+
+    _CCaravis_copy_buffer(this, buffer, out_bytes[*num_frames], stride0);
+    if (BACKEND_GLOBAL(cam_iface_error))
+      return;
+
+    if (timestamps)
+      CCaravis_get_last_timestamp(this, &(timestamps[*num_frames]));
+    if (framenumbers)
+      CCaravis_get_last_framenumber(this, &(framenumbers[*num_frames]));
+    (*num_frames)++;
   }
 }
 
@@ -1046,11 +1247,43 @@ void CCaravis_grab_next_frame_blocking( CCaravis *this, unsigned char *out_bytes
 }
 
 void CCaravis_point_next_frame_blocking( CCaravis *this, unsigned char **buf_ptr, float timeout) {
-  NOT_IMPLEMENTED;
+  ArvBuffer *buffer;
+
+  if (!this->started) {
+    ARAVIS_ERROR(CAM_IFACE_GENERIC_ERROR, "camera not started");
+    return;
+  }
+
+  if (this->max_pointed < 1) {
+    ARAVIS_ERROR(CAM_IFACE_BUFFER_OVERFLOW_ERROR, "need at least two frame buffers to point to frames");
+    return;
+  }
+
+  if ((int)g_queue_get_length(this->pointed_buffers) >= this->max_pointed) {
+    ARAVIS_ERROR(CAM_IFACE_BUFFER_OVERFLOW_ERROR, "too many frames pointed to (call unpoint_frame first)");
+    return;
+  }
+
+  buffer = _CCaravis_pop_buffer(this, timeout);
+  if (!buffer) {
+    ARAVIS_ERROR(CAM_IFACE_FRAME_TIMEOUT, "timeout exceeded");
+    return;
+  }
+
+  g_queue_push_tail(this->pointed_buffers, buffer);
+  *buf_ptr = buffer->data;
 }
 
 void CCaravis_unpoint_frame( CCaravis *this){
-  NOT_IMPLEMENTED;
+  ArvBuffer *buffer;
+
+  buffer = g_queue_pop_head(this->pointed_buffers);
+  if (!buffer) {
+    ARAVIS_ERROR(CAM_IFACE_GENERIC_ERROR, "no frame pointed to");
+    return;
+  }
+
+  _CCaravis_return_buffer(this, buffer);
 }
 
 void CCaravis_get_last_timestamp( CCaravis *this, double* timestamp ) {
@@ -1135,6 +1368,11 @@ void CCaravis_set_frame_roi( CCaravis *this,
     unsigned int payload, i;
     ArvBuffer *buffer;
 
+    if (!g_queue_is_empty(this->pointed_buffers)) {
+      ARAVIS_ERROR(CAM_IFACE_GENERIC_ERROR, "cannot change roi while frames are pointed to");
+      return;
+    }
+
     DCAMPRINTF("reconfiguring camera as roi has changed\n");
 
     arv_camera_stop_acquisition (this->camera);
@@ -1193,7 +1431,54 @@ void CCaravis_get_num_framebuffers( CCaravis *this,
   *num_framebuffers = this->num_buffers;
 }
 
+/* Takes effect without stopping acquisition: new buffers are pushed to
+the stream at once, surplus ones are freed as they come back from
+it. */
 void CCaravis_set_num_framebuffers( CCaravis *this,
                                     int num_framebuffers ) {
-  NOT_IMPLEMENTED;
+  unsigned int payload;
+  int add;
+
+  if (num_framebuffers < 1) {
+    ARAVIS_ERROR(CAM_IFACE_GENERIC_ERROR, "need at least one frame buffer");
+    return;
+  }
+
+  DCAMPRINTF("set num framebuffers: %d -> %d\n", this->num_buffers, num_framebuffers);
+
+  if (this->started) {
+    add = num_framebuffers - this->num_buffers;
+    /* cancel pending drops first */
+    while ((add > 0) && (this->num_excess_buffers > 0)) {
+      this->num_excess_buffers--;
+      add--;
+    }
+    if (add > 0) {
+      payload = arv_camera_get_payload(this->camera);
+      while (add-- > 0)
+        arv_stream_push_buffer (this->stream, arv_buffer_new (payload, NULL));
+    } else {
+      this->num_excess_buffers -= add;
+    }
+  }
+
+  this->num_buffers = num_framebuffers;
+  this->max_pointed = this->num_buffers - 1;
+}
+
+void CCaravis_get_wait_fd( CCaravis *this, int *fd ) {
+#ifdef __linux__
+  if (this->wait_fd < 0) {
+    this->wait_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (this->wait_fd < 0) {
+      *fd = -1;
+      return;
+    }
+    _CCaravis_connect_wait_fd(this);
+    _CCaravis_sync_wait_fd(this);
+  }
+  *fd = this->wait_fd;
+#else
+  *fd = -1;
+#endif
 }
@@ -52,6 +52,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 /* Backend for libbasler_pylon version XXX */
 #include "cam_iface.h"
+#include "cam_iface_internal.h"
 #include <pylon/PylonIncludes.h>
 
 #if 1
@@ -113,6 +114,12 @@ typedef struct {
   void (*set_framerate)(struct CCbasler_pylon*,float);
   void (*get_num_framebuffers)(struct CCbasler_pylon*,int*);
   void (*set_num_framebuffers)(struct CCbasler_pylon*,int);
+  void (*grab_frames_batch)(struct CCbasler_pylon*,
+                            unsigned char**,intptr_t,
+                            double*,unsigned long*,
+                            int,int,int*,float);
+  void (*get_wait_fd)(struct CCbasler_pylon*,int*);
+  void (*get_frame_roi_framenumber)(struct CCbasler_pylon*,unsigned long*);
 } CCbasler_pylon_functable;
 
 typedef struct CCbasler_pylon {
@@ -207,7 +214,10 @@ CCbasler_pylon_functable CCbasler_pylon_vmt = {
   CCbasler_pylon_get_framerate,
   CCbasler_pylon_set_framerate,
   CCbasler_pylon_get_num_framebuffers,
-  CCbasler_pylon_set_num_framebuffers
+  CCbasler_pylon_set_num_framebuffers,
+  NULL, /* grab_frames_batch: use generic loop */
+  NULL, /* get_wait_fd: use a capture thread to wait */
+  NULL /* get_frame_roi_framenumber: not known */
 };
 
 // See the following for a hint on how to make thread thread-local without __thread.
@@ -337,6 +347,7 @@ const char* BACKEND_METHOD(cam_iface_get_api_version)() {
 }
 
 void BACKEND_METHOD(cam_iface_startup)() {
+  cam_iface_log_init();
   Pylon::PylonInitialize();
 }
 
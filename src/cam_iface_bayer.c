@@ -0,0 +1,395 @@
+/*
+
+Copyright (c) 2004-2009, California Institute of Technology. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+/* Bayer demosaicing into RGB8.
+
+   Both methods work on a 5x5 neighbourhood of the source image. Every
+   row of the mosaic holds one non-green colour ("X") on one column
+   parity and green on the other. The colour missing from the row
+   ("Y") sits on the rows above and below.
+
+   Bilinear: missing values are the mean of the nearest samples of
+   that colour.
+
+   HQ linear: the gradient-corrected filters of Malvar, He and Cutler,
+   "High-quality linear interpolation for demosaicing of Bayer-patterned
+   color images" (ICASSP 2004), which is also what libdc1394 calls
+   DC1394_BAYER_METHOD_HQLINEAR. The coefficients are scaled by 16 so
+   that they are all integers.
+
+   Image borders are handled by reflecting about the edge pixel, which
+   keeps the Bayer phase intact.
+
+   With GCC >= 9 or clang, the interior of each row is computed 16
+   pixels at a time using vector extensions. These are compiled once
+   for the baseline target (SSE2 on x86_64, NEON on ARM with NEON) and,
+   on x86, again for AVX2, chosen at run time. Other compilers use the
+   scalar code throughout. Both paths give identical output. */
+
+#include "cam_iface.h"
+#include "cam_iface_internal.h"
+#include <string.h>
+
+#if (defined(__GNUC__) && (__GNUC__ >= 9)) || defined(__clang__)
+#define CAM_IFACE_DEMOSAIC_VECTOR 1
+#if defined(__x86_64__) || defined(__i386__)
+#define CAM_IFACE_DEMOSAIC_X86 1
+#endif
+#endif
+
+#define DEMOSAIC_BLOCK 16
+
+/* per-row layout of the mosaic */
+typedef struct {
+  int xpar;     /* column parity of the non-green samples */
+  int x_is_red; /* non-green samples of this row are red (else blue) */
+} demosaic_row_layout;
+
+typedef void (*demosaic_block_func)(const unsigned char **rows,
+                                    int x0, int x1,
+                                    demosaic_row_layout layout,
+                                    CamIfaceDemosaicMethod method,
+                                    unsigned char *out);
+
+static int _reflect(int i, int n) {
+  if (i < 0) {
+    return -i;
+  }
+  if (i >= n) {
+    return 2*n-2-i;
+  }
+  return i;
+}
+
+static unsigned char _clamp_shift(int v, int shift) {
+  if (v < 0) {
+    return 0;
+  }
+  v >>= shift;
+  return (v > 255) ? 255 : (unsigned char)v;
+}
+
+/* Compute pixels [x0,x1) of one output row, reflecting columns at the
+   image edges. */
+static void _demosaic_row_scalar(const unsigned char **rows,
+                                 int x0, int x1, int width,
+                                 demosaic_row_layout layout,
+                                 CamIfaceDemosaicMethod method,
+                                 unsigned char *out) {
+  const unsigned char *rm2=rows[0], *rm1=rows[1], *r0=rows[2], *rp1=rows[3], *rp2=rows[4];
+  int x, xm2, xm1, xp1, xp2;
+  int c, n, s, w, e, diag, n2, s2, w2, e2;
+  int xval, gval, yval;
+  unsigned char *o;
+
+  for (x=x0; x<x1; x++) {
+    xm2 = _reflect(x-2,width);
+    xm1 = _reflect(x-1,width);
+    xp1 = _reflect(x+1,width);
+    xp2 = _reflect(x+2,width);
+
+    c = r0[x];
+    n = rm1[x];
+    s = rp1[x];
+    w = r0[xm1];
+    e = r0[xp1];
+    diag = rm1[xm1] + rm1[xp1] + rp1[xm1] + rp1[xp1];
+
+    if (method == CAM_IFACE_DEMOSAIC_BILINEAR) {
+      if ((x & 1) == layout.xpar) {
+        xval = c;
+        gval = (n+s+w+e+2) >> 2;
+        yval = (diag+2) >> 2;
+      } else {
+        gval = c;
+        xval = (w+e+1) >> 1;
+        yval = (n+s+1) >> 1;
+      }
+    } else {
+      n2 = rm2[x];
+      s2 = rp2[x];
+      w2 = r0[xm2];
+      e2 = r0[xp2];
+      if ((x & 1) == layout.xpar) {
+        xval = c;
+        gval = _clamp_shift(8*c + 4*(n+s+w+e) - 2*(n2+s2+w2+e2) + 8, 4);
+        yval = _clamp_shift(12*c + 4*diag - 3*(n2+s2+w2+e2) + 8, 4);
+      } else {
+        gval = c;
+        xval = _clamp_shift(10*c + 8*(w+e) - 2*(w2+e2) - 2*diag + (n2+s2) + 8, 4);
+        yval = _clamp_shift(10*c + 8*(n+s) - 2*(n2+s2) - 2*diag + (w2+e2) + 8, 4);
+      }
+    }
+
+    o = out + 3*x;
+    o[0] = (unsigned char)(layout.x_is_red ? xval : yval);
+    o[1] = (unsigned char)gval;
+    o[2] = (unsigned char)(layout.x_is_red ? yval : xval);
+  }
+}
+
+#ifdef CAM_IFACE_DEMOSAIC_VECTOR
+
+typedef int16_t demosaic_i16 __attribute__((vector_size(2*DEMOSAIC_BLOCK)));
+typedef uint8_t demosaic_u8 __attribute__((vector_size(DEMOSAIC_BLOCK)));
+
+/* These are macros rather than functions so that no 256 bit vector is
+   ever passed by value, which would depend on whether AVX is enabled. */
+
+/* load DEMOSAIC_BLOCK bytes from p, widened to 16 bits */
+#define DEMOSAIC_VLOAD(p) ({                                            \
+      demosaic_u8 vload_tmp_;                                           \
+      memcpy(&vload_tmp_,(p),sizeof(vload_tmp_));                       \
+      __builtin_convertvector(vload_tmp_,demosaic_i16);                 \
+    })
+
+/* arithmetic shift right, then clamp to 0..255 */
+#define DEMOSAIC_VCLAMP_SHIFT(expr,shift) ({                            \
+      demosaic_i16 vclamp_v_ = (expr) >> (shift);                       \
+      const demosaic_i16 vclamp_max_ = {255,255,255,255,255,255,255,255, \
+                                        255,255,255,255,255,255,255,255}; \
+      vclamp_v_ &= ~(vclamp_v_ < 0);                                    \
+      (vclamp_v_ & ~(vclamp_v_ > vclamp_max_)) |                        \
+        (vclamp_max_ & (vclamp_v_ > vclamp_max_));                      \
+    })
+
+/* Compute pixels [x0,x1) of one output row. x0 must be even, x1-x0 a
+   multiple of DEMOSAIC_BLOCK, and columns x0-2 to x1+1 must exist. */
+static inline __attribute__((always_inline))
+void _demosaic_row_vector(const unsigned char **rows,
+                          int x0, int x1,
+                          demosaic_row_layout layout,
+                          CamIfaceDemosaicMethod method,
+                          unsigned char *out) {
+  const unsigned char *rm2=rows[0], *rm1=rows[1], *r0=rows[2], *rp1=rows[3], *rp2=rows[4];
+  const demosaic_i16 even = {-1,0,-1,0,-1,0,-1,0,-1,0,-1,0,-1,0,-1,0};
+  demosaic_i16 xmask, c, n, s, w, e, diag, n2, s2, w2, e2;
+  demosaic_i16 x_at_x, g_at_x, y_at_x, x_at_g, y_at_g, xv, gv, yv;
+  demosaic_u8 r8, g8, b8;
+  unsigned char rr[DEMOSAIC_BLOCK], gg[DEMOSAIC_BLOCK], bb[DEMOSAIC_BLOCK];
+  unsigned char *o;
+  int x, i;
+
+  xmask = layout.xpar ? ~even : even;
+
+  for (x=x0; x<x1; x+=DEMOSAIC_BLOCK) {
+    c = DEMOSAIC_VLOAD(r0+x);
+    n = DEMOSAIC_VLOAD(rm1+x);
+    s = DEMOSAIC_VLOAD(rp1+x);
+    w = DEMOSAIC_VLOAD(r0+x-1);
+    e = DEMOSAIC_VLOAD(r0+x+1);
+    diag = DEMOSAIC_VLOAD(rm1+x-1) + DEMOSAIC_VLOAD(rm1+x+1) + DEMOSAIC_VLOAD(rp1+x-1) + DEMOSAIC_VLOAD(rp1+x+1);
+
+    x_at_x = c;
+    if (method == CAM_IFACE_DEMOSAIC_BILINEAR) {
+      g_at_x = (n+s+w+e+2) >> 2;
+      y_at_x = (diag+2) >> 2;
+      x_at_g = (w+e+1) >> 1;
+      y_at_g = (n+s+1) >> 1;
+    } else {
+      n2 = DEMOSAIC_VLOAD(rm2+x);
+      s2 = DEMOSAIC_VLOAD(rp2+x);
+      w2 = DEMOSAIC_VLOAD(r0+x-2);
+      e2 = DEMOSAIC_VLOAD(r0+x+2);
+      g_at_x = DEMOSAIC_VCLAMP_SHIFT(8*c + 4*(n+s+w+e) - 2*(n2+s2+w2+e2) + 8, 4);
+      y_at_x = DEMOSAIC_VCLAMP_SHIFT(12*c + 4*diag - 3*(n2+s2+w2+e2) + 8, 4);
+      x_at_g = DEMOSAIC_VCLAMP_SHIFT(10*c + 8*(w+e) - 2*(w2+e2) - 2*diag + (n2+s2) + 8, 4);
+      y_at_g = DEMOSAIC_VCLAMP_SHIFT(10*c + 8*(n+s) - 2*(n2+s2) - 2*diag + (w2+e2) + 8, 4);
+    }
+
+    xv = (x_at_x & xmask) | (x_at_g & ~xmask);
+    gv = (g_at_x & xmask) | (c & ~xmask);
+    yv = (y_at_x & xmask) | (y_at_g & ~xmask);
+
+    if (layout.x_is_red) {
+      r8 = __builtin_convertvector(xv,demosaic_u8);
+      b8 = __builtin_convertvector(yv,demosaic_u8);
+    } else {
+      r8 = __builtin_convertvector(yv,demosaic_u8);
+      b8 = __builtin_convertvector(xv,demosaic_u8);
+    }
+    g8 = __builtin_convertvector(gv,demosaic_u8);
+    memcpy(rr,&r8,DEMOSAIC_BLOCK);
+    memcpy(gg,&g8,DEMOSAIC_BLOCK);
+    memcpy(bb,&b8,DEMOSAIC_BLOCK);
+
+    o = out + 3*x;
+    for (i=0; i<DEMOSAIC_BLOCK; i++) {
+      o[3*i+0] = rr[i];
+      o[3*i+1] = gg[i];
+      o[3*i+2] = bb[i];
+    }
+  }
+}
+
+static void _demosaic_row_baseline(const unsigned char **rows,
+                                   int x0, int x1,
+                                   demosaic_row_layout layout,
+                                   CamIfaceDemosaicMethod method,
+                                   unsigned char *out) {
+  _demosaic_row_vector(rows,x0,x1,layout,method,out);
+}
+
+#ifdef CAM_IFACE_DEMOSAIC_X86
+__attribute__((target("avx2")))
+static void _demosaic_row_avx2(const unsigned char **rows,
+                               int x0, int x1,
+                               demosaic_row_layout layout,
+                               CamIfaceDemosaicMethod method,
+                               unsigned char *out) {
+  _demosaic_row_vector(rows,x0,x1,layout,method,out);
+}
+#endif
+
+static demosaic_block_func demosaic_block_impl = NULL;
+static const char *demosaic_isa_name = NULL;
+
+static demosaic_block_func _get_block_func(void) {
+  demosaic_block_func f = cam_iface_atomic_load(&demosaic_block_impl);
+  if (f != NULL) {
+    return f;
+  }
+  f = _demosaic_row_baseline;
+#if defined(CAM_IFACE_DEMOSAIC_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    f = _demosaic_row_avx2;
+    cam_iface_atomic_store(&demosaic_isa_name,"avx2");
+  } else if (__builtin_cpu_supports("sse2")) {
+    cam_iface_atomic_store(&demosaic_isa_name,"sse2");
+  } else {
+    cam_iface_atomic_store(&demosaic_isa_name,"scalar");
+  }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  cam_iface_atomic_store(&demosaic_isa_name,"neon");
+#else
+  cam_iface_atomic_store(&demosaic_isa_name,"generic vector");
+#endif
+  cam_iface_atomic_store(&demosaic_block_impl,f);
+  return f;
+}
+
+CAM_IFACE_API const char *cam_iface_demosaic_get_isa(void) {
+  _get_block_func();
+  return cam_iface_atomic_load(&demosaic_isa_name);
+}
+
+#else /* CAM_IFACE_DEMOSAIC_VECTOR */
+
+CAM_IFACE_API const char *cam_iface_demosaic_get_isa(void) {
+  return "scalar";
+}
+
+#endif /* CAM_IFACE_DEMOSAIC_VECTOR */
+
+/* layout of row 0 of each coding; row 1 swaps both fields */
+static int _get_layout(CameraPixelCoding coding, demosaic_row_layout *row0) {
+  switch (coding) {
+  case CAM_IFACE_MONO8_BAYER_BGGR:
+    row0->xpar = 0; row0->x_is_red = 0;
+    break;
+  case CAM_IFACE_MONO8_BAYER_RGGB:
+    row0->xpar = 0; row0->x_is_red = 1;
+    break;
+  case CAM_IFACE_MONO8_BAYER_GRBG:
+    row0->xpar = 1; row0->x_is_red = 1;
+    break;
+  case CAM_IFACE_MONO8_BAYER_GBRG:
+    row0->xpar = 1; row0->x_is_red = 0;
+    break;
+  default:
+    return -1;
+  }
+  return 0;
+}
+
+CAM_IFACE_API int cam_iface_demosaic(CameraPixelCoding coding,
+                                     CamIfaceDemosaicMethod method,
+                                     const unsigned char *src,
+                                     intptr_t src_stride,
+                                     int width,
+                                     int height,
+                                     unsigned char *dst,
+                                     intptr_t dst_stride) {
+  demosaic_row_layout row0, layout;
+  const unsigned char *rows[5];
+  unsigned char *out;
+  int y, k;
+#ifdef CAM_IFACE_DEMOSAIC_VECTOR
+  demosaic_block_func block_func = _get_block_func();
+  int x_vec0, x_vec1;
+#endif
+
+  if (_get_layout(coding,&row0)) {
+    return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+  }
+  if ((method != CAM_IFACE_DEMOSAIC_BILINEAR) &&
+      (method != CAM_IFACE_DEMOSAIC_HQLINEAR)) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  if ((src==NULL) || (dst==NULL) || (width < 3) || (height < 3) ||
+      (src_stride < width) || (dst_stride < 3*(intptr_t)width)) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+
+#ifdef CAM_IFACE_DEMOSAIC_VECTOR
+  /* vectorized span: the 5x5 neighbourhood must lie inside the row */
+  x_vec0 = 2;
+  x_vec1 = x_vec0 + ((width-4)/DEMOSAIC_BLOCK)*DEMOSAIC_BLOCK;
+  if (x_vec1 < x_vec0) {
+    x_vec1 = x_vec0;
+  }
+#endif
+
+  for (y=0; y<height; y++) {
+    for (k=0; k<5; k++) {
+      rows[k] = src + _reflect(y+k-2,height)*src_stride;
+    }
+    if (y & 1) {
+      layout.xpar = 1 - row0.xpar;
+      layout.x_is_red = !row0.x_is_red;
+    } else {
+      layout = row0;
+    }
+    out = dst + y*dst_stride;
+
+#ifdef CAM_IFACE_DEMOSAIC_VECTOR
+    if (x_vec1 > x_vec0) {
+      _demosaic_row_scalar(rows,0,x_vec0,width,layout,method,out);
+      block_func(rows,x_vec0,x_vec1,layout,method,out);
+      _demosaic_row_scalar(rows,x_vec1,width,width,layout,method,out);
+      continue;
+    }
+#endif
+    _demosaic_row_scalar(rows,0,width,width,layout,method,out);
+  }
+  return 0;
+}
@@ -30,7 +30,451 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
 #include "cam_iface.h"
+#include "cam_iface_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <sys/timeb.h>
+#else
+#include <pthread.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#endif
+
+static double cam_iface_floattime(void) {
+#ifdef _WIN32
+  struct _timeb t;
+  _ftime(&t);
+  return (double)t.time + (double)t.millitm * (double)0.001;
+#else
+  struct timeval t;
+  if (gettimeofday(&t, (struct timezone *)NULL) == 0)
+    return (double)t.tv_sec + t.tv_usec*0.000001;
+  else
+    return 0.0;
+#endif
+}
+
+/* Backend-independent per-camera state, allocated on first use and
+   stored in CamContext.core_extras. */
+typedef struct cam_iface_capture_thread cam_iface_capture_thread;
+
+/* number of recent block minima kept by the clock fit */
+#define CLOCK_SYNC_HISTORY 16
+
+/* Linear model from camera timestamps to host time, see
+   CamContext_get_last_timestamp_host():
+   host = host_ref + x + a + b*x with x = camera - cam_ref */
+typedef struct {
+  double cam_ref;
+  double host_ref;    /* CLOCK_REALTIME */
+  double a;
+  double b;
+} cam_iface_clock_model;
+
+typedef struct {
+  /* fit state, only touched by the grabbing thread */
+  int have_ref;
+  double cam_ref;
+  double mono_ref;                /* CLOCK_MONOTONIC at cam_ref */
+  double last_x;
+  int num_late;                   /* consecutive frames far behind the model */
+  int block_count;                /* frames in the current block */
+  int num_blocks;
+  double block_x, block_d;        /* earliest arrival in the current block */
+  double sw, sx, sd, sxx, sxd;    /* weighted sums over block minima */
+  double hist_x[CLOCK_SYNC_HISTORY], hist_d[CLOCK_SYNC_HISTORY]; /* recent block minima */
+
+  /* published model, guarded by seq (odd while being written) */
+  unsigned long seq;
+  int valid;
+  cam_iface_clock_model model;
+} cam_iface_clock_sync;
+
+/* Property cache, see CamContext_get_camera_properties(). Arrays are
+   allocated on first use, num is -1 until then. */
+typedef struct {
+  int num;
+  CameraPropertyInfo *info;
+  unsigned char *have_info;
+  long *values;
+  int *autos;
+  unsigned char *have_value;   /* only for properties in manual mode */
+} cam_iface_property_cache;
+
+/* Software ROI, see CamContext_set_software_roi(). */
+typedef struct {
+  int active;
+  int left, top, width, height;   /* as requested */
+  int binning, decimation;
+  cam_iface_reduce_layout layout;
+  int out_cells_x, out_cells_y;   /* size of the frames returned, in cells */
+  intptr_t src_stride;            /* of a full frame of the hardware ROI */
+  size_t src_size;
+  int cannot_point;               /* backend has no point_next_frame_blocking */
+  unsigned char *scratch;         /* full frame, allocated when first needed */
+  size_t scratch_size;
+} cam_iface_software_roi;
+
+typedef struct cam_iface_core_extras cam_iface_core_extras;
+struct cam_iface_core_extras {
+  cam_iface_capture_thread *capture;
+  /* error state of the backend that owns this camera (see
+     cam_iface_core_set_error_funcs), NULL to use the global one */
+  int (*have_error)(void);
+  void (*clear_error)(void);
+
+  /* see CamContext_get_statistics(), updated with atomic operations */
+  CamIfaceStats stats;
+  unsigned long last_framenumber;   /* only touched by the grabbing thread */
+  int have_last_framenumber;
+
+  cam_iface_clock_sync clock;
+
+  cam_iface_property_cache props;
+
+  cam_iface_software_roi sw_roi;
+  int num_pointed;            /* frames the caller is pointing to */
+
+  size_t framebuffer_budget;  /* bytes, 0 unless sized automatically */
+};
+
+static cam_iface_core_extras* _get_core_extras(CamContext *this) {
+  cam_iface_core_extras *core;
+  if (this->core_extras==NULL) {
+    core = (cam_iface_core_extras*)calloc(1,sizeof(cam_iface_core_extras));
+    if (core!=NULL) {
+      core->props.num = -1;
+    }
+    /* published atomically, CamContext_get_statistics() may be looking */
+    cam_iface_atomic_store(&(this->core_extras),core);
+  }
+  return (cam_iface_core_extras*)this->core_extras;
+}
+
+static int _core_have_error(cam_iface_core_extras *core) {
+  if ((core!=NULL) && (core->have_error!=NULL)) {
+    return core->have_error();
+  }
+  return cam_iface_have_error();
+}
+
+static void _core_clear_error(cam_iface_core_extras *core) {
+  if ((core!=NULL) && (core->clear_error!=NULL)) {
+    core->clear_error();
+  } else {
+    cam_iface_clear_error();
+  }
+}
+
+/* statistics --------------------------------------------------------- */
+
+/* seconds on a clock that does not jump */
+static double _stats_now(void) {
+#ifdef _WIN32
+  return cam_iface_floattime();
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return (double)t.tv_sec + t.tv_nsec*1e-9;
+#endif
+}
+
+static void _stats_add_latency(CamIfaceStats *stats, double start, double stop) {
+  unsigned long usec = (unsigned long)((stop-start)*1e6);
+  int bin = 0;
+  while ((usec!=0) && (bin < CAM_IFACE_STATS_LATENCY_BINS-1)) {
+    usec >>= 1;
+    bin++;
+  }
+  cam_iface_atomic_add(&(stats->latency_usec_hist[bin]),1);
+}
+
+static void _stats_add_error(CamIfaceStats *stats, int err) {
+  switch (err) {
+  case CAM_IFACE_FRAME_DATA_CORRUPT_ERROR:
+    cam_iface_atomic_add(&(stats->frames_corrupt),1);
+    break;
+  case CAM_IFACE_FRAME_DATA_MISSING_ERROR:
+    cam_iface_atomic_add(&(stats->frames_missing),1);
+    break;
+  case CAM_IFACE_FRAME_DATA_LOST_ERROR:
+    cam_iface_atomic_add(&(stats->frames_lost),1);
+    break;
+  case CAM_IFACE_FRAME_TIMEOUT:
+    cam_iface_atomic_add(&(stats->timeouts),1);
+    break;
+  default:
+    cam_iface_atomic_add(&(stats->other_errors),1);
+    break;
+  }
+}
+
+/* Count the gap between the previous frame number and framenumber,
+   given that num_frames frames ended with it. */
+static void _stats_add_framenumber(cam_iface_core_extras *core,
+                                   unsigned long framenumber,
+                                   unsigned long num_frames) {
+  unsigned long step;
+  if (core->have_last_framenumber) {
+    step = framenumber - core->last_framenumber;
+    /* frame numbers that go backwards (a restarted camera) are no gap */
+    if ((step > num_frames) && (step < (~0UL >> 1))) {
+      cam_iface_atomic_add(&(core->stats.framenumber_gaps),step-num_frames);
+    }
+  }
+  core->last_framenumber = framenumber;
+  core->have_last_framenumber = 1;
+}
+
+/* clock synchronization --------------------------------------------- */
+
+/* Each frame gives a pair (camera timestamp, arrival time). The arrival
+   is the capture time plus a transfer delay that is never smaller than
+   some minimum but often larger, so only the earliest arrival of every
+   CLOCK_SYNC_BLOCK frames is used. A line is fit through these block
+   minima by least squares, weighting older blocks exponentially less,
+   and then lowered onto the earliest of the last CLOCK_SYNC_HISTORY
+   block minima.
+   The fit is done on the offset d = arrival - camera timestamp, which
+   changes slowly, rather than on the arrival itself. The arrival is
+   taken on CLOCK_MONOTONIC so that clock steps do not disturb the fit,
+   and converted to CLOCK_REALTIME when the model is published. */
+#define CLOCK_SYNC_BLOCK 32
+#define CLOCK_SYNC_DECAY (63.0/64.0)
+/* a frame arriving this much earlier than the model allows means the
+   camera clock jumped ahead, one arriving this much later was probably
+   held up on the host and is skipped (seconds) */
+#define CLOCK_SYNC_MAX_ERROR 1.0
+
+static double _clock_realtime_minus_mono(void) {
+#ifdef _WIN32
+  return 0.0; /* _stats_now() is already the realtime clock */
+#else
+  return cam_iface_floattime() - _stats_now();
+#endif
+}
+
+static void _clock_sync_publish(cam_iface_clock_sync *cs, double a, double b) {
+  cam_iface_atomic_store(&(cs->seq),cs->seq+1);
+  cam_iface_atomic_fence();
+  cs->model.cam_ref = cs->cam_ref;
+  cs->model.host_ref = cs->mono_ref + _clock_realtime_minus_mono();
+  cs->model.a = a;
+  cs->model.b = b;
+  cs->valid = 1;
+  cam_iface_atomic_fence();
+  cam_iface_atomic_store(&(cs->seq),cs->seq+1);
+}
+
+static void _clock_sync_add(cam_iface_clock_sync *cs, double camera, double arrival) {
+  double x, d, det, a, b, r, rmin;
+  int i, n;
+
+  if (cs->have_ref) {
+    x = camera - cs->cam_ref;
+    d = (arrival - cs->mono_ref) - x;
+    r = cs->valid ? d - (cs->model.a + cs->model.b*x) : 0.0;
+    if ((x < cs->last_x) || (r < -CLOCK_SYNC_MAX_ERROR)) {
+      cs->have_ref = 0; /* camera clock jumped, start over */
+    } else if (r > CLOCK_SYNC_MAX_ERROR) {
+      if (++(cs->num_late) < CLOCK_SYNC_BLOCK) {
+        return;
+      }
+      cs->have_ref = 0; /* late for too long, the model must be off */
+    }
+  }
+  if (!cs->have_ref) {
+    cs->have_ref = 1;
+    cs->cam_ref = camera;
+    cs->mono_ref = arrival;
+    cs->block_count = 0;
+    cs->num_blocks = 0;
+    cs->num_late = 0;
+    cs->sw = cs->sx = cs->sd = cs->sxx = cs->sxd = 0.0;
+  }
+  x = camera - cs->cam_ref;
+  d = (arrival - cs->mono_ref) - x;
+  cs->last_x = x;
+  cs->num_late = 0;
+
+  if ((cs->block_count==0) || (d < cs->block_d)) {
+    cs->block_x = x;
+    cs->block_d = d;
+    if (cs->num_blocks==0) {
+      /* no fit yet, the earliest arrival so far is the best guess */
+      _clock_sync_publish(cs,d,0.0);
+    }
+  }
+  if (++(cs->block_count) < CLOCK_SYNC_BLOCK) {
+    return;
+  }
+
+  cs->sw = cs->sw*CLOCK_SYNC_DECAY + 1.0;
+  cs->sx = cs->sx*CLOCK_SYNC_DECAY + cs->block_x;
+  cs->sd = cs->sd*CLOCK_SYNC_DECAY + cs->block_d;
+  cs->sxx = cs->sxx*CLOCK_SYNC_DECAY + cs->block_x*cs->block_x;
+  cs->sxd = cs->sxd*CLOCK_SYNC_DECAY + cs->block_x*cs->block_d;
+  cs->hist_x[cs->num_blocks % CLOCK_SYNC_HISTORY] = cs->block_x;
+  cs->hist_d[cs->num_blocks % CLOCK_SYNC_HISTORY] = cs->block_d;
+  cs->num_blocks++;
+  cs->block_count = 0;
+
+  det = cs->sw*cs->sxx - cs->sx*cs->sx;
+  if ((cs->num_blocks < 2) || (det <= 0.0)) {
+    a = cs->sd/cs->sw;
+    b = 0.0;
+  } else {
+    b = (cs->sw*cs->sxd - cs->sx*cs->sd)/det;
+    a = (cs->sd - b*cs->sx)/cs->sw;
+  }
+  n = (cs->num_blocks < CLOCK_SYNC_HISTORY) ? cs->num_blocks : CLOCK_SYNC_HISTORY;
+  rmin = 0.0;
+  for (i=0; i<n; i++) {
+    r = cs->hist_d[i] - (a + b*cs->hist_x[i]);
+    if ((i==0) || (r < rmin)) {
+      rmin = r;
+    }
+  }
+  _clock_sync_publish(cs,a+rmin,b);
+}
+
+/* Returns 0 and fills in model, or -1 if no frame arrived yet. */
+static int _clock_sync_get(cam_iface_clock_sync *cs, cam_iface_clock_model *model) {
+  unsigned long seq;
+  int valid;
+  do {
+    seq = cam_iface_atomic_load(&(cs->seq));
+    valid = cs->valid;
+    *model = cs->model;
+    cam_iface_atomic_fence();
+  } while ((seq & 1) || (seq != cam_iface_atomic_load(&(cs->seq))));
+  return valid ? 0 : -1;
+}
+
+/* Account for a grab or point call that ran from start to stop,
+   returned num_frames frames and left err. */
+static void _stats_add_call(CamContext *this, cam_iface_core_extras *core,
+                            double start, double stop, int err,
+                            unsigned long num_frames) {
+  unsigned long framenumber;
+  double timestamp;
+
+  _stats_add_latency(&(core->stats),start,stop);
+  if (err) {
+    _stats_add_error(&(core->stats),err);
+  }
+  if (num_frames==0) {
+    return;
+  }
+  cam_iface_atomic_add(&(core->stats.frames_delivered),num_frames);
+  if (err) {
+    /* do not disturb the caller's error state, and start counting
+       gaps afresh with the next frame */
+    core->have_last_framenumber = 0;
+    return;
+  }
+  this->vmt->get_last_framenumber(this,&framenumber);
+  if (_core_have_error(core)) {
+    /* backend keeps no frame numbers */
+    _core_clear_error(core);
+    core->have_last_framenumber = 0;
+  } else {
+    _stats_add_framenumber(core,framenumber,num_frames);
+  }
+  this->vmt->get_last_timestamp(this,&timestamp);
+  if (_core_have_error(core)) {
+    _core_clear_error(core);
+  } else {
+    _clock_sync_add(&(core->clock),timestamp,stop);
+  }
+}
+
+CAM_IFACE_API int CamContext_get_statistics( CamContext *this,
+                                             CamIfaceStats *stats ) {
+  cam_iface_core_extras *core = cam_iface_atomic_load(&(this->core_extras));
+  CamIfaceStats *s;
+  int i;
+
+  memset(stats,0,sizeof(CamIfaceStats));
+  if (core==NULL) {
+    return 0; /* nothing grabbed yet */
+  }
+  s = &(core->stats);
+  stats->frames_delivered = cam_iface_atomic_load(&(s->frames_delivered));
+  stats->framenumber_gaps = cam_iface_atomic_load(&(s->framenumber_gaps));
+  stats->frames_corrupt = cam_iface_atomic_load(&(s->frames_corrupt));
+  stats->frames_missing = cam_iface_atomic_load(&(s->frames_missing));
+  stats->frames_lost = cam_iface_atomic_load(&(s->frames_lost));
+  stats->timeouts = cam_iface_atomic_load(&(s->timeouts));
+  stats->other_errors = cam_iface_atomic_load(&(s->other_errors));
+  stats->queue_overruns = cam_iface_atomic_load(&(s->queue_overruns));
+  stats->queue_depth = cam_iface_atomic_load(&(s->queue_depth));
+  stats->queue_depth_peak = cam_iface_atomic_load(&(s->queue_depth_peak));
+  for (i=0; i<CAM_IFACE_STATS_LATENCY_BINS; i++) {
+    stats->latency_usec_hist[i] = cam_iface_atomic_load(&(s->latency_usec_hist[i]));
+  }
+  return 0;
+}
+
+/* The current queue depth is a level, not a count, so it survives. */
+CAM_IFACE_API int CamContext_reset_statistics( CamContext *this ) {
+  cam_iface_core_extras *core = cam_iface_atomic_load(&(this->core_extras));
+  CamIfaceStats *s;
+  int i;
+
+  if (core==NULL) {
+    return 0;
+  }
+  s = &(core->stats);
+  cam_iface_atomic_store(&(s->frames_delivered),0);
+  cam_iface_atomic_store(&(s->framenumber_gaps),0);
+  cam_iface_atomic_store(&(s->frames_corrupt),0);
+  cam_iface_atomic_store(&(s->frames_missing),0);
+  cam_iface_atomic_store(&(s->frames_lost),0);
+  cam_iface_atomic_store(&(s->timeouts),0);
+  cam_iface_atomic_store(&(s->other_errors),0);
+  cam_iface_atomic_store(&(s->queue_overruns),0);
+  cam_iface_atomic_store(&(s->queue_depth_peak),
+                         cam_iface_atomic_load(&(s->queue_depth)));
+  for (i=0; i<CAM_IFACE_STATS_LATENCY_BINS; i++) {
+    cam_iface_atomic_store(&(s->latency_usec_hist[i]),0);
+  }
+  return 0;
+}
+
+void cam_iface_core_set_error_funcs(CamContext *this,
+                                    int (*have_error)(void),
+                                    void (*clear_error)(void)) {
+  cam_iface_core_extras *core = _get_core_extras(this);
+  if (core!=NULL) {
+    core->have_error = have_error;
+    core->clear_error = clear_error;
+  }
+}
+
+static void _props_free(cam_iface_property_cache *props);
+
+static void _free_core_extras(CamContext *this) {
+  if (this->core_extras!=NULL) {
+    CamContext_stop_capture_thread(this);
+    _props_free(&(((cam_iface_core_extras*)this->core_extras)->props));
+    free(((cam_iface_core_extras*)this->core_extras)->sw_roi.scratch);
+    free(this->core_extras);
+    this->core_extras = NULL;
+  }
+}
+
 CAM_IFACE_API void delete_CamContext(CamContext*this) {
+  _free_core_extras(this);
   this->vmt->destruct(this);
 }
 
@@ -38,9 +482,11 @@ CAM_IFACE_API void CamContext_CamContext(CamContext *this,int device_number, int
                            int mode_number, const char *interface ) {
   // Must call derived class to make instance.
   this->vmt = NULL;
+  this->core_extras = NULL;
 }
 
 CAM_IFACE_API void CamContext_close(struct CamContext *this) {
+  _free_core_extras(this);
   this->vmt->close(this);
 }
 
@@ -49,6 +495,7 @@ CAM_IFACE_API void CamContext_start_camera(CamContext *this) {
 }
 
 CAM_IFACE_API void CamContext_stop_camera(CamContext *this) {
+  CamContext_stop_capture_thread(this);
   this->vmt->stop_camera(this);
 }
 
@@ -57,37 +504,456 @@ CAM_IFACE_API void CamContext_get_num_camera_properties(CamContext *this,
   this->vmt->get_num_camera_properties(this,num_properties);
 }
 
+/* property cache ----------------------------------------------------- */
+
+static void _props_free(cam_iface_property_cache *props) {
+  free(props->info);
+  free(props->have_info);
+  free(props->values);
+  free(props->autos);
+  free(props->have_value);
+  memset(props,0,sizeof(cam_iface_property_cache));
+  props->num = -1;
+}
+
+/* Returns the cache of this camera, or NULL if it cannot be set up (in
+   which case callers go to the backend directly). */
+static cam_iface_property_cache* _props_get(CamContext *this) {
+  cam_iface_core_extras *core = _get_core_extras(this);
+  cam_iface_property_cache *props;
+  int num = 0;
+
+  if (core==NULL) {
+    return NULL;
+  }
+  props = &(core->props);
+  if (props->num >= 0) {
+    return props;
+  }
+
+  this->vmt->get_num_camera_properties(this,&num);
+  if (_core_have_error(core)) {
+    return NULL;
+  }
+  if (num < 0) {
+    num = 0;
+  }
+  props->info = (CameraPropertyInfo*)calloc(num+1,sizeof(CameraPropertyInfo));
+  props->have_info = (unsigned char*)calloc(num+1,1);
+  props->values = (long*)calloc(num+1,sizeof(long));
+  props->autos = (int*)calloc(num+1,sizeof(int));
+  props->have_value = (unsigned char*)calloc(num+1,1);
+  if ((props->info==NULL) || (props->have_info==NULL) || (props->values==NULL) ||
+      (props->autos==NULL) || (props->have_value==NULL)) {
+    _props_free(props);
+    return NULL;
+  }
+  props->num = num;
+  return props;
+}
+
+/* Forget the values and the property info, e.g. after a change that
+   may move the values or their limits. */
+static void _props_invalidate(CamContext *this) {
+  cam_iface_core_extras *core = (cam_iface_core_extras*)this->core_extras;
+  if ((core!=NULL) && (core->props.num > 0)) {
+    memset(core->props.have_value,0,core->props.num);
+    memset(core->props.have_info,0,core->props.num);
+  }
+}
+
+/* After a write: the written value may have been adjusted by the
+   camera, and the limits of other properties may follow it (e.g. the
+   shutter range with the frame rate). */
+static void _props_written(cam_iface_property_cache *props, int property_number) {
+  if (props->num > 0) {
+    memset(props->have_info,0,props->num);
+  }
+  if ((property_number >= 0) && (property_number < props->num)) {
+    props->have_value[property_number] = 0;
+  }
+}
+
+static void _props_store(CamContext *this, int property_number, long value, int is_auto) {
+  cam_iface_core_extras *core = (cam_iface_core_extras*)this->core_extras;
+  cam_iface_property_cache *props;
+
+  if (core==NULL) {
+    return;
+  }
+  props = &(core->props);
+  if ((property_number < 0) || (property_number >= props->num)) {
+    return;
+  }
+  /* the camera changes values in auto mode by itself */
+  props->have_value[property_number] = !is_auto;
+  props->values[property_number] = value;
+  props->autos[property_number] = is_auto;
+}
+
 CAM_IFACE_API void CamContext_get_camera_property_info(CamContext *this,
                                          int property_number,
                                          CameraPropertyInfo *info){
+  cam_iface_property_cache *props = _props_get(this);
+
+  if ((props!=NULL) && (property_number >= 0) && (property_number < props->num) &&
+      props->have_info[property_number]) {
+    *info = props->info[property_number];
+    return;
+  }
   this->vmt->get_camera_property_info(this,property_number,info);
+  if ((props!=NULL) && (property_number >= 0) && (property_number < props->num) &&
+      !_core_have_error((cam_iface_core_extras*)this->core_extras)) {
+    props->info[property_number] = *info;
+    props->have_info[property_number] = 1;
+  }
 }
 
 CAM_IFACE_API void CamContext_get_camera_property(CamContext *this,
                                     int property_number,
                                     long* Value,
                                     int* Auto){
+  cam_iface_property_cache *props = _props_get(this);
+
   this->vmt->get_camera_property(this,property_number,Value,Auto);
+  if ((props!=NULL) &&
+      !_core_have_error((cam_iface_core_extras*)this->core_extras)) {
+    _props_store(this,property_number,*Value,*Auto);
+  }
 }
 
 CAM_IFACE_API void CamContext_set_camera_property(CamContext *this,
                                     int property_number,
                                     long Value,
                                     int Auto) {
+  cam_iface_core_extras *core = (cam_iface_core_extras*)this->core_extras;
+
   this->vmt->set_camera_property(this,property_number,Value,Auto);
+  if (core!=NULL) {
+    _props_written(&(core->props),property_number);
+  }
+}
+
+CAM_IFACE_API int CamContext_get_camera_properties( CamContext *this,
+                                                    const int *property_numbers,
+                                                    long *values,
+                                                    int *autos,
+                                                    int n ) {
+  cam_iface_core_extras *core;
+  cam_iface_property_cache *props;
+  int i, p, err;
+
+  _core_clear_error((cam_iface_core_extras*)this->core_extras);
+  props = _props_get(this);
+  core = (cam_iface_core_extras*)this->core_extras;
+  for (i=0; i<n; i++) {
+    p = property_numbers[i];
+    if ((props!=NULL) && (p >= 0) && (p < props->num) && props->have_value[p]) {
+      values[i] = props->values[p];
+      autos[i] = props->autos[p];
+      continue;
+    }
+    this->vmt->get_camera_property(this,p,&(values[i]),&(autos[i]));
+    err = _core_have_error(core);
+    if (err) {
+      return err;
+    }
+    _props_store(this,p,values[i],autos[i]);
+  }
+  return 0;
+}
+
+CAM_IFACE_API int CamContext_set_camera_properties( CamContext *this,
+                                                    const int *property_numbers,
+                                                    const long *values,
+                                                    const int *autos,
+                                                    int n ) {
+  cam_iface_core_extras *core;
+  cam_iface_property_cache *props;
+  int i, p, err;
+
+  _core_clear_error((cam_iface_core_extras*)this->core_extras);
+  props = _props_get(this);
+  core = (cam_iface_core_extras*)this->core_extras;
+  for (i=0; i<n; i++) {
+    p = property_numbers[i];
+    if ((props!=NULL) && (p >= 0) && (p < props->num) && props->have_value[p] &&
+        !autos[i] && (props->values[p]==values[i])) {
+      continue; /* already set, save the round trip */
+    }
+    this->vmt->set_camera_property(this,p,values[i],autos[i]);
+    if (props!=NULL) {
+      _props_written(props,p);
+    }
+    err = _core_have_error(core);
+    if (err) {
+      return err;
+    }
+  }
+  return 0;
+}
+
+CAM_IFACE_API int CamContext_invalidate_property_cache( CamContext *this ) {
+  _props_invalidate(this);
+  return 0;
+}
+
+CAM_IFACE_API int CamContext_camera_to_host_time( CamContext *this,
+                                                  double camera_timestamp,
+                                                  double *host_timestamp ) {
+  cam_iface_core_extras *core = cam_iface_atomic_load(&(this->core_extras));
+  cam_iface_clock_model m;
+  double x;
+
+  if ((core==NULL) || _clock_sync_get(&(core->clock),&m)) {
+    return CAM_IFACE_GENERIC_ERROR; /* no frame grabbed yet */
+  }
+  x = camera_timestamp - m.cam_ref;
+  *host_timestamp = m.host_ref + x + m.a + m.b*x;
+  return 0;
+}
+
+CAM_IFACE_API int CamContext_get_last_timestamp_host( CamContext *this,
+                                                      double *timestamp ) {
+  cam_iface_core_extras *core = (cam_iface_core_extras*)this->core_extras;
+  double camera_timestamp;
+  int err;
+
+  this->vmt->get_last_timestamp(this,&camera_timestamp);
+  err = _core_have_error(core);
+  if (err) {
+    _core_clear_error(core);
+    return err;
+  }
+  return CamContext_camera_to_host_time(this,camera_timestamp,timestamp);
+}
+
+/* Evaluate a call that returns at most one frame and count it in the
+   statistics. */
+#define CAM_IFACE_STATS_CALL(call) {                                    \
+    cam_iface_core_extras *core = _get_core_extras(this);               \
+    double start = _stats_now();                                        \
+    int err;                                                            \
+    call;                                                               \
+    if (core!=NULL) {                                                   \
+      err = _core_have_error(core);                                     \
+      _stats_add_call(this,core,start,_stats_now(),err,err ? 0 : 1);    \
+    }                                                                   \
+  }
+
+/* Make sure the scratch frame holds a full frame. Returns 0 or
+   CAM_IFACE_GENERIC_ERROR. */
+static int _sw_roi_alloc_scratch(cam_iface_software_roi *sw) {
+  unsigned char *scratch;
+
+  if (sw->src_size > sw->scratch_size) {
+    scratch = (unsigned char*)realloc(sw->scratch,sw->src_size);
+    if (scratch==NULL) {
+      return CAM_IFACE_GENERIC_ERROR;
+    }
+    sw->scratch = scratch;
+    sw->scratch_size = sw->src_size;
+  }
+  return 0;
+}
+
+/* Grab a frame through the software ROI. The backend buffer is reduced
+   straight into out_bytes. Backends that cannot point to their buffers,
+   calls where pointing failed, and calls made while the caller points
+   to frames itself (our unpoint would release the caller's oldest
+   frame) need the extra copy into the scratch frame. */
+static void _sw_roi_grab(CamContext *this, cam_iface_core_extras *core,
+                         unsigned char *out_bytes, intptr_t stride0, float timeout) {
+  cam_iface_software_roi *sw = &(core->sw_roi);
+  unsigned char *buf;
+  int err;
+
+  if (core->num_pointed>0) {
+    if (_sw_roi_alloc_scratch(sw)) {
+      CAM_IFACE_LOG(CAM_IFACE_LOG_CORE,CAM_IFACE_LOG_ERROR,
+                    "camera %d: cannot allocate software ROI scratch frame",
+                    this->device_number);
+      return;
+    }
+  } else if (!sw->cannot_point) {
+    this->vmt->point_next_frame_blocking(this,&buf,timeout);
+    err = _core_have_error(core);
+    if (!err) {
+      cam_iface_reduce_frame(&(sw->layout),buf,sw->src_stride,sw->left,sw->top,
+                             sw->out_cells_x,sw->out_cells_y,
+                             sw->binning,sw->decimation,out_bytes,stride0);
+      this->vmt->unpoint_frame(this);
+      return;
+    }
+    if ((err!=CAM_IFACE_GENERIC_ERROR) &&
+        (err!=CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE) &&
+        (err!=CAM_IFACE_BUFFER_OVERFLOW_ERROR)) {
+      return; /* timeout or bad frame */
+    }
+    if (_sw_roi_alloc_scratch(sw)) {
+      return; /* leave the backend's error set */
+    }
+    _core_clear_error(core);
+    if (err==CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE) {
+      CAM_IFACE_LOG(CAM_IFACE_LOG_CORE,CAM_IFACE_LOG_INFO,
+                    "camera %d cannot point to frames, software ROI copies whole frames",
+                    this->device_number);
+      sw->cannot_point = 1;
+    }
+  }
+
+  this->vmt->grab_next_frame_blocking_with_stride(this,sw->scratch,sw->src_stride,timeout);
+  if (_core_have_error(core)) {
+    return;
+  }
+  cam_iface_reduce_frame(&(sw->layout),sw->scratch,sw->src_stride,sw->left,sw->top,
+                         sw->out_cells_x,sw->out_cells_y,
+                         sw->binning,sw->decimation,out_bytes,stride0);
+}
+
+static void _grab_with_stride(CamContext *this, unsigned char* out_bytes, intptr_t stride0, float timeout) {
+  cam_iface_core_extras *core = (cam_iface_core_extras*)this->core_extras;
+  if ((core!=NULL) && core->sw_roi.active) {
+    _sw_roi_grab(this,core,out_bytes,stride0,timeout);
+  } else {
+    this->vmt->grab_next_frame_blocking_with_stride(this,out_bytes,stride0,timeout);
+  }
 }
 
 CAM_IFACE_API void CamContext_grab_next_frame_blocking(CamContext *this, unsigned char* out_bytes, float timeout){
-  this->vmt->grab_next_frame_blocking(this,out_bytes,timeout);
+  cam_iface_core_extras *sw_core = (cam_iface_core_extras*)this->core_extras;
+  if ((sw_core!=NULL) && sw_core->sw_roi.active) {
+    CAM_IFACE_STATS_CALL(_sw_roi_grab(this,sw_core,out_bytes,
+                                      (intptr_t)sw_core->sw_roi.out_cells_x*
+                                      sw_core->sw_roi.layout.cell_bytes,timeout));
+    return;
+  }
+  CAM_IFACE_STATS_CALL(this->vmt->grab_next_frame_blocking(this,out_bytes,timeout));
 }
 CAM_IFACE_API void CamContext_grab_next_frame_blocking_with_stride(CamContext *this, unsigned char* out_bytes, intptr_t stride0, float timeout){
-  this->vmt->grab_next_frame_blocking_with_stride(this,out_bytes,stride0,timeout);
+  CAM_IFACE_STATS_CALL(_grab_with_stride(this,out_bytes,stride0,timeout));
+}
+/* Returns 1 if the backend says a frame can be grabbed without
+   blocking. Backends without a wait descriptor cannot tell, so this
+   returns 0 for them: a zero timeout is not non-blocking everywhere. */
+static int _frame_waiting(CamContext *this) {
+#ifdef _WIN32
+  return 0;
+#else
+  struct pollfd pfd;
+  int fd = -1;
+
+  if (this->vmt->get_wait_fd == NULL) {
+    return 0;
+  }
+  this->vmt->get_wait_fd(this,&fd);
+  if (fd < 0) {
+    return 0;
+  }
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  return (poll(&pfd,1,0) > 0) && (pfd.revents & POLLIN);
+#endif
+}
+
+#define CAM_IFACE_BATCH_MIN_WAIT 0.001f
+
+static void _grab_frames_batch(CamContext *this,
+                               unsigned char** out_bytes,
+                               intptr_t stride0,
+                               double* timestamps,
+                               unsigned long* framenumbers,
+                               int max_frames,
+                               int min_frames,
+                               int* num_frames,
+                               float timeout){
+  cam_iface_core_extras *core;
+  double start;
+  float remaining;
+  int err;
+
+  core = (cam_iface_core_extras*)this->core_extras;
+  if ((this->vmt->grab_frames_batch!=NULL) &&
+      ((core==NULL) || !core->sw_roi.active)) {
+    this->vmt->grab_frames_batch(this,out_bytes,stride0,timestamps,framenumbers,
+                                 max_frames,min_frames,num_frames,timeout);
+    return;
+  }
+
+  /* generic implementation on top of grab_next_frame_blocking_with_stride,
+     also used for the software ROI */
+  *num_frames = 0;
+  start = cam_iface_floattime();
+  while (*num_frames < max_frames) {
+    if (*num_frames < min_frames) {
+      remaining = timeout;
+      if (timeout >= 0) {
+        remaining = timeout - (float)(cam_iface_floattime()-start);
+        if (remaining < CAM_IFACE_BATCH_MIN_WAIT) {
+          /* The deadline has passed. Ask for a short wait rather than
+             zero, which some backends take as "forever", so that the
+             backend itself reports the timeout. */
+          remaining = CAM_IFACE_BATCH_MIN_WAIT;
+        }
+      }
+    } else {
+      /* only take frames that are already waiting */
+      if (!_frame_waiting(this)) {
+        return;
+      }
+      remaining = 0;
+    }
+
+    _grab_with_stride(this,out_bytes[*num_frames],stride0,remaining);
+    err = _core_have_error(core);
+    if (err) {
+      if ((*num_frames >= min_frames) && (err==CAM_IFACE_FRAME_TIMEOUT)) {
+        _core_clear_error(core);
+      }
+      return;
+    }
+
+    if (timestamps!=NULL) {
+      this->vmt->get_last_timestamp(this,&(timestamps[*num_frames]));
+    }
+    if (framenumbers!=NULL) {
+      this->vmt->get_last_framenumber(this,&(framenumbers[*num_frames]));
+    }
+    (*num_frames)++;
+  }
+}
+CAM_IFACE_API void CamContext_grab_frames_batch(CamContext *this,
+                                                unsigned char** out_bytes,
+                                                intptr_t stride0,
+                                                double* timestamps,
+                                                unsigned long* framenumbers,
+                                                int max_frames,
+                                                int min_frames,
+                                                int* num_frames,
+                                                float timeout){
+  cam_iface_core_extras *core = _get_core_extras(this);
+  double start = _stats_now();
+
+  _grab_frames_batch(this,out_bytes,stride0,timestamps,framenumbers,
+                     max_frames,min_frames,num_frames,timeout);
+  if (core!=NULL) {
+    _stats_add_call(this,core,start,_stats_now(),_core_have_error(core),
+                    (*num_frames > 0) ? *num_frames : 0);
+  }
 }
 CAM_IFACE_API void CamContext_point_next_frame_blocking(CamContext *this, unsigned char** buf_ptr, float timeout){
-  this->vmt->point_next_frame_blocking(this,buf_ptr,timeout);
+  CAM_IFACE_STATS_CALL(this->vmt->point_next_frame_blocking(this,buf_ptr,timeout);
+                       if ((core!=NULL) && !_core_have_error(core)) {
+                         core->num_pointed++;
+                       });
 }
 CAM_IFACE_API void CamContext_unpoint_frame(CamContext *this){
+  cam_iface_core_extras *core = (cam_iface_core_extras*)this->core_extras;
   this->vmt->unpoint_frame(this);
+  if ((core!=NULL) && (core->num_pointed>0) && !_core_have_error(core)) {
+    core->num_pointed--;
+  }
 }
 CAM_IFACE_API void CamContext_get_last_timestamp( CamContext *this,
                                     double* timestamp ){
@@ -114,14 +980,133 @@ CAM_IFACE_API void CamContext_get_trigger_mode_number( CamContext *this,
 CAM_IFACE_API void CamContext_set_trigger_mode_number( CamContext *this,
                                          int exposure_mode_number ){
   this->vmt->set_trigger_mode_number(this,exposure_mode_number);
+  _props_invalidate(this);
 }
 CAM_IFACE_API void CamContext_get_frame_roi( CamContext *this,
                                int *left, int *top, int *width, int *height ){
   this->vmt->get_frame_roi(this,left,top,width,height);
 }
+/* Check the software ROI against the hardware ROI and coding and work
+   out the size of a full frame. Returns 0 or an error code; the stage
+   is left off on error. */
+static int _sw_roi_configure(CamContext *this, cam_iface_core_extras *core) {
+  cam_iface_software_roi *sw = &(core->sw_roi);
+  int frame_left, frame_top, frame_width, frame_height;
+  int cw, ch, group, err;
+
+  sw->active = 0;
+  err = cam_iface_reduce_get_layout(this->coding,&(sw->layout));
+  if (err) {
+    return err;
+  }
+  cw = sw->layout.cell_width;
+  ch = sw->layout.cell_height;
+  if (((sw->binning!=1) && (sw->binning!=2) && (sw->binning!=4)) ||
+      (sw->decimation < 1) || (sw->left < 0) || (sw->top < 0) ||
+      (sw->left % cw) || (sw->top % ch)) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+
+  _core_clear_error(core);
+  this->vmt->get_frame_roi(this,&frame_left,&frame_top,&frame_width,&frame_height);
+  err = _core_have_error(core);
+  if (err) {
+    _core_clear_error(core);
+    return err;
+  }
+  if ((sw->left + sw->width > frame_width) || (sw->top + sw->height > frame_height)) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+
+  group = sw->binning*sw->decimation;
+  sw->out_cells_x = sw->width/cw/group;
+  sw->out_cells_y = sw->height/ch/group;
+  if ((sw->out_cells_x < 1) || (sw->out_cells_y < 1)) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+
+  sw->src_stride = (intptr_t)(frame_width/cw)*sw->layout.cell_bytes;
+  sw->src_size = (size_t)sw->src_stride*frame_height;
+  /* otherwise the scratch frame is only allocated when a grab needs it */
+  if (sw->cannot_point && _sw_roi_alloc_scratch(sw)) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  sw->active = 1;
+  return 0;
+}
+
+static int _framebuffers_fit_budget(CamContext *this, cam_iface_core_extras *core);
+
 CAM_IFACE_API void CamContext_set_frame_roi( CamContext *this,
                                int left, int top, int width, int height ){
+  cam_iface_core_extras *core = (cam_iface_core_extras*)this->core_extras;
+
   this->vmt->set_frame_roi(this,left,top, width, height);
+  _props_invalidate(this);
+  if ((core==NULL) || _core_have_error(core)) {
+    return;
+  }
+  if (core->sw_roi.active && _sw_roi_configure(this,core)) {
+    CAM_IFACE_LOG(CAM_IFACE_LOG_CORE,CAM_IFACE_LOG_WARN,
+                  "camera %d: software ROI does not fit the new frame ROI, turned off",
+                  this->device_number);
+  }
+  /* the buffer size follows the ROI */
+  if ((core->framebuffer_budget > 0) && _framebuffers_fit_budget(this,core)) {
+    CAM_IFACE_LOG(CAM_IFACE_LOG_CORE,CAM_IFACE_LOG_WARN,
+                  "camera %d: could not fit the frame buffers to the memory budget",
+                  this->device_number);
+  }
+}
+
+CAM_IFACE_API int CamContext_set_software_roi( CamContext *this,
+                                               int left, int top, int width, int height,
+                                               int binning, int decimation ){
+  cam_iface_core_extras *core = _get_core_extras(this);
+  cam_iface_software_roi *sw;
+
+  if (core==NULL) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  sw = &(core->sw_roi);
+  if ((width==0) || (height==0)) {
+    sw->active = 0;
+    return 0;
+  }
+  sw->left = left;
+  sw->top = top;
+  sw->width = width;
+  sw->height = height;
+  sw->binning = binning;
+  sw->decimation = decimation;
+  return _sw_roi_configure(this,core);
+}
+
+CAM_IFACE_API int CamContext_get_software_roi_size( CamContext *this,
+                                                    int *width, int *height ){
+  cam_iface_core_extras *core = (cam_iface_core_extras*)this->core_extras;
+  int left, top, err;
+
+  if ((core!=NULL) && core->sw_roi.active) {
+    *width = core->sw_roi.out_cells_x*core->sw_roi.layout.cell_width;
+    *height = core->sw_roi.out_cells_y*core->sw_roi.layout.cell_height;
+    return 0;
+  }
+  _core_clear_error(core);
+  this->vmt->get_frame_roi(this,&left,&top,width,height);
+  err = _core_have_error(core);
+  _core_clear_error(core);
+  return err;
+}
+CAM_IFACE_API int CamContext_get_frame_roi_framenumber( CamContext *this,
+                                                        unsigned long *framenumber ){
+  cam_iface_core_extras *core = (cam_iface_core_extras*)this->core_extras;
+  if (this->vmt->get_frame_roi_framenumber==NULL) {
+    return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+  }
+  _core_clear_error(core);
+  this->vmt->get_frame_roi_framenumber(this,framenumber);
+  return _core_have_error(core);
 }
 CAM_IFACE_API void CamContext_get_max_frame_size( CamContext *this,
                                     int *width,
@@ -139,6 +1124,7 @@ CAM_IFACE_API void CamContext_get_framerate( CamContext *this,
 CAM_IFACE_API void CamContext_set_framerate( CamContext *this,
                                float framerate ){
   this->vmt->set_framerate(this,framerate);
+  _props_invalidate(this); /* e.g. shutter limits follow the framerate */
 }
 CAM_IFACE_API void CamContext_get_num_framebuffers( CamContext *this,
                                       int *num_framebuffers ){
@@ -146,5 +1132,742 @@ CAM_IFACE_API void CamContext_get_num_framebuffers( CamContext *this,
 }
 CAM_IFACE_API void CamContext_set_num_framebuffers( CamContext *this,
                                       int num_framebuffers ){
+  cam_iface_core_extras *core = (cam_iface_core_extras*)this->core_extras;
+  if (core!=NULL) {
+    core->framebuffer_budget = 0;
+  }
   this->vmt->set_num_framebuffers(this,num_framebuffers);
 }
+
+/* upper limit for CamContext_set_framebuffer_memory_budget() */
+#define CAM_IFACE_MAX_AUTO_FRAMEBUFFERS 1024
+
+/* Set the largest number of frame buffers that fits the budget,
+   halving it while the backend cannot allocate that many. */
+static int _framebuffers_fit_budget(CamContext *this, cam_iface_core_extras *core) {
+  int size = 0;
+  int num, current, err;
+  size_t fit;
+
+  _core_clear_error(core);
+  this->vmt->get_buffer_size(this,&size);
+  err = _core_have_error(core);
+  if (err) {
+    _core_clear_error(core);
+    return err;
+  }
+  if (size <= 0) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  fit = core->framebuffer_budget/(size_t)size;
+  if (fit < 2) {
+    return CAM_IFACE_GENERIC_ERROR; /* budget too small for a ring */
+  }
+  num = (fit > CAM_IFACE_MAX_AUTO_FRAMEBUFFERS) ? CAM_IFACE_MAX_AUTO_FRAMEBUFFERS : (int)fit;
+
+  this->vmt->get_num_framebuffers(this,&current);
+  if (!_core_have_error(core) && (current==num)) {
+    return 0;
+  }
+  _core_clear_error(core);
+
+  while (1) {
+    this->vmt->set_num_framebuffers(this,num);
+    err = _core_have_error(core);
+    if (!err) {
+      break;
+    }
+    _core_clear_error(core);
+    if (num <= 2) {
+      return err;
+    }
+    num /= 2;
+  }
+  CAM_IFACE_LOG(CAM_IFACE_LOG_CORE,CAM_IFACE_LOG_INFO,
+                "camera %d: %d frame buffers of %d bytes",
+                this->device_number,num,size);
+  return 0;
+}
+
+CAM_IFACE_API int CamContext_set_framebuffer_memory_budget( CamContext *this,
+                                                            size_t budget_bytes ){
+  cam_iface_core_extras *core = _get_core_extras(this);
+  int err;
+
+  if (core==NULL) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  core->framebuffer_budget = budget_bytes;
+  if (budget_bytes==0) {
+    return 0;
+  }
+  err = _framebuffers_fit_budget(this,core);
+  if (err) {
+    core->framebuffer_budget = 0;
+  }
+  return err;
+}
+
+/* status-returning API ----------------------------------------------- */
+
+/* Clear the error state, evaluate call and return the resulting error
+   code. The error state is looked up before the call because close
+   frees core_extras. */
+#define CAM_IFACE_RC_CALL(call) {                                       \
+    cam_iface_core_extras *core = (cam_iface_core_extras*)this->core_extras; \
+    int (*have_error)(void) = cam_iface_have_error;                     \
+    if ((core!=NULL) && (core->have_error!=NULL)) {                     \
+      have_error = core->have_error;                                    \
+      core->clear_error();                                              \
+    } else {                                                            \
+      cam_iface_clear_error();                                          \
+    }                                                                   \
+    call;                                                               \
+    return have_error();                                                \
+  }
+
+CAM_IFACE_API int CamContext_close_rc(CamContext *this) {
+  CAM_IFACE_RC_CALL(CamContext_close(this));
+}
+CAM_IFACE_API int CamContext_start_camera_rc(CamContext *this) {
+  CAM_IFACE_RC_CALL(CamContext_start_camera(this));
+}
+CAM_IFACE_API int CamContext_stop_camera_rc(CamContext *this) {
+  CAM_IFACE_RC_CALL(CamContext_stop_camera(this));
+}
+CAM_IFACE_API int CamContext_get_num_camera_properties_rc(CamContext *this,
+                                                          int* num_properties) {
+  CAM_IFACE_RC_CALL(CamContext_get_num_camera_properties(this,num_properties));
+}
+CAM_IFACE_API int CamContext_get_camera_property_info_rc(CamContext *this,
+                                                         int property_number,
+                                                         CameraPropertyInfo *info) {
+  CAM_IFACE_RC_CALL(CamContext_get_camera_property_info(this,property_number,info));
+}
+CAM_IFACE_API int CamContext_get_camera_property_rc(CamContext *this,
+                                                    int property_number,
+                                                    long* Value,
+                                                    int* Auto) {
+  CAM_IFACE_RC_CALL(CamContext_get_camera_property(this,property_number,Value,Auto));
+}
+CAM_IFACE_API int CamContext_set_camera_property_rc(CamContext *this,
+                                                    int property_number,
+                                                    long Value,
+                                                    int Auto) {
+  CAM_IFACE_RC_CALL(CamContext_set_camera_property(this,property_number,Value,Auto));
+}
+CAM_IFACE_API int CamContext_grab_next_frame_blocking_rc(CamContext *this,
+                                                         unsigned char* out_bytes,
+                                                         float timeout) {
+  CAM_IFACE_RC_CALL(CamContext_grab_next_frame_blocking(this,out_bytes,timeout));
+}
+CAM_IFACE_API int CamContext_grab_next_frame_blocking_with_stride_rc(CamContext *this,
+                                                                     unsigned char* out_bytes,
+                                                                     intptr_t stride0,
+                                                                     float timeout) {
+  CAM_IFACE_RC_CALL(CamContext_grab_next_frame_blocking_with_stride(this,out_bytes,stride0,timeout));
+}
+CAM_IFACE_API int CamContext_grab_frames_batch_rc(CamContext *this,
+                                                  unsigned char** out_bytes,
+                                                  intptr_t stride0,
+                                                  double* timestamps,
+                                                  unsigned long* framenumbers,
+                                                  int max_frames,
+                                                  int min_frames,
+                                                  int* num_frames,
+                                                  float timeout) {
+  CAM_IFACE_RC_CALL(CamContext_grab_frames_batch(this,out_bytes,stride0,
+                                                 timestamps,framenumbers,
+                                                 max_frames,min_frames,
+                                                 num_frames,timeout));
+}
+CAM_IFACE_API int CamContext_point_next_frame_blocking_rc(CamContext *this,
+                                                          unsigned char** buf_ptr,
+                                                          float timeout) {
+  CAM_IFACE_RC_CALL(CamContext_point_next_frame_blocking(this,buf_ptr,timeout));
+}
+CAM_IFACE_API int CamContext_unpoint_frame_rc(CamContext *this) {
+  CAM_IFACE_RC_CALL(CamContext_unpoint_frame(this));
+}
+CAM_IFACE_API int CamContext_get_last_timestamp_rc(CamContext *this,
+                                                   double* timestamp) {
+  CAM_IFACE_RC_CALL(CamContext_get_last_timestamp(this,timestamp));
+}
+CAM_IFACE_API int CamContext_get_last_framenumber_rc(CamContext *this,
+                                                     unsigned long* framenumber) {
+  CAM_IFACE_RC_CALL(CamContext_get_last_framenumber(this,framenumber));
+}
+CAM_IFACE_API int CamContext_get_num_trigger_modes_rc(CamContext *this,
+                                                      int *num_exposure_modes) {
+  CAM_IFACE_RC_CALL(CamContext_get_num_trigger_modes(this,num_exposure_modes));
+}
+CAM_IFACE_API int CamContext_get_trigger_mode_string_rc(CamContext *this,
+                                                        int exposure_mode_number,
+                                                        char* exposure_mode_string,
+                                                        int exposure_mode_string_maxlen) {
+  CAM_IFACE_RC_CALL(CamContext_get_trigger_mode_string(this,exposure_mode_number,
+                                                       exposure_mode_string,
+                                                       exposure_mode_string_maxlen));
+}
+CAM_IFACE_API int CamContext_get_trigger_mode_number_rc(CamContext *this,
+                                                        int *exposure_mode_number) {
+  CAM_IFACE_RC_CALL(CamContext_get_trigger_mode_number(this,exposure_mode_number));
+}
+CAM_IFACE_API int CamContext_set_trigger_mode_number_rc(CamContext *this,
+                                                        int exposure_mode_number) {
+  CAM_IFACE_RC_CALL(CamContext_set_trigger_mode_number(this,exposure_mode_number));
+}
+CAM_IFACE_API int CamContext_get_frame_roi_rc(CamContext *this,
+                                              int *left, int *top, int* width, int* height) {
+  CAM_IFACE_RC_CALL(CamContext_get_frame_roi(this,left,top,width,height));
+}
+CAM_IFACE_API int CamContext_set_frame_roi_rc(CamContext *this,
+                                              int left, int top, int width, int height) {
+  CAM_IFACE_RC_CALL(CamContext_set_frame_roi(this,left,top,width,height));
+}
+CAM_IFACE_API int CamContext_get_max_frame_size_rc(CamContext *this,
+                                                   int *width,
+                                                   int *height) {
+  CAM_IFACE_RC_CALL(CamContext_get_max_frame_size(this,width,height));
+}
+CAM_IFACE_API int CamContext_get_buffer_size_rc(CamContext *this,
+                                                int *size) {
+  CAM_IFACE_RC_CALL(CamContext_get_buffer_size(this,size));
+}
+CAM_IFACE_API int CamContext_get_framerate_rc(CamContext *this,
+                                              float *framerate) {
+  CAM_IFACE_RC_CALL(CamContext_get_framerate(this,framerate));
+}
+CAM_IFACE_API int CamContext_set_framerate_rc(CamContext *this,
+                                              float framerate) {
+  CAM_IFACE_RC_CALL(CamContext_set_framerate(this,framerate));
+}
+CAM_IFACE_API int CamContext_get_num_framebuffers_rc(CamContext *this,
+                                                     int *num_framebuffers) {
+  CAM_IFACE_RC_CALL(CamContext_get_num_framebuffers(this,num_framebuffers));
+}
+CAM_IFACE_API int CamContext_set_num_framebuffers_rc(CamContext *this,
+                                                     int num_framebuffers) {
+  CAM_IFACE_RC_CALL(CamContext_set_num_framebuffers(this,num_framebuffers));
+}
+
+/* background capture thread ------------------------------------------ */
+
+#ifndef _WIN32
+
+/* how long the capture thread blocks in the backend before checking
+   whether it should quit (seconds) */
+#define CAPTURE_THREAD_GRAB_TIMEOUT 0.1f
+
+/* The ring is a single-producer/single-consumer queue. The capture
+   thread only writes write_idx, the caller only writes point_idx and
+   read_idx. Slots between read_idx and point_idx are pointed to by the
+   caller, slots between point_idx and write_idx are ready to be
+   pointed to. The mutex and condition variable are only used to put
+   the caller to sleep while the ring is empty. */
+struct cam_iface_capture_thread {
+  CamContext *cam;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  int num_slots;
+  CamIfaceQueuedFrame *slots;
+  unsigned char *slot_data;
+  unsigned char *overrun_data; /* frames that do not fit are grabbed here */
+  intptr_t stride;
+  int width;
+  int height;
+
+  unsigned long write_idx;
+  unsigned long point_idx;
+  unsigned long read_idx;
+
+  int quit;
+  int consumer_waiting;
+  int fd_waiting;                  /* set while cam_iface_wait_any() polls wait_fd */
+  int wait_fd[2];                  /* read and write end, signalled when fd_waiting */
+  int thread_error;                /* backend error that stopped the thread */
+  unsigned long pending_overruns;  /* only touched by the capture thread */
+  unsigned long num_overruns;
+};
+
+static int _is_frame_error(int err) {
+  return ((err==CAM_IFACE_FRAME_DATA_MISSING_ERROR) ||
+          (err==CAM_IFACE_FRAME_DATA_LOST_ERROR) ||
+          (err==CAM_IFACE_FRAME_DATA_CORRUPT_ERROR));
+}
+
+static int _is_retry_error(int err) {
+  return ((err==CAM_IFACE_FRAME_TIMEOUT) ||
+          (err==CAM_IFACE_FRAME_INTERRUPTED_SYSCALL) ||
+          (err==CAM_IFACE_SELECT_RETURNED_BUT_NO_FRAME_AVAILABLE));
+}
+
+static void _capture_thread_wake_consumer(cam_iface_capture_thread *ct) {
+  uint64_t one = 1;
+  cam_iface_atomic_fence();
+  if (cam_iface_atomic_load(&(ct->consumer_waiting))) {
+    pthread_mutex_lock(&(ct->lock));
+    pthread_cond_broadcast(&(ct->cond));
+    pthread_mutex_unlock(&(ct->lock));
+  }
+  if (cam_iface_atomic_load(&(ct->fd_waiting))) {
+    /* may fail with EAGAIN if already signalled, which is fine */
+    if (write(ct->wait_fd[1],&one,sizeof(one))) {}
+  }
+}
+
+/* Create the descriptor pair used to wake cam_iface_wait_any(). An
+   eventfd on Linux, a pipe elsewhere. */
+static int _capture_thread_open_wait_fd(cam_iface_capture_thread *ct) {
+#ifdef __linux__
+  ct->wait_fd[0] = eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+  ct->wait_fd[1] = ct->wait_fd[0];
+  return (ct->wait_fd[0] < 0) ? -1 : 0;
+#else
+  int i;
+  if (pipe(ct->wait_fd)) {
+    ct->wait_fd[0] = ct->wait_fd[1] = -1;
+    return -1;
+  }
+  for (i=0; i<2; i++) {
+    fcntl(ct->wait_fd[i],F_SETFL,fcntl(ct->wait_fd[i],F_GETFL) | O_NONBLOCK);
+    fcntl(ct->wait_fd[i],F_SETFD,FD_CLOEXEC);
+  }
+  return 0;
+#endif
+}
+
+static void _capture_thread_drain_wait_fd(cam_iface_capture_thread *ct) {
+  uint64_t buf[8];
+  while (read(ct->wait_fd[0],buf,sizeof(buf)) > 0) {}
+}
+
+/* true if CamContext_point_queued_frame() would return without waiting */
+static int _capture_thread_ready(cam_iface_capture_thread *ct) {
+  return ((cam_iface_atomic_load(&(ct->write_idx)) != ct->point_idx) ||
+          cam_iface_atomic_load(&(ct->quit)));
+}
+
+static void* _capture_thread_func(void *arg) {
+  cam_iface_capture_thread *ct = (cam_iface_capture_thread*)arg;
+  CamContext *this = ct->cam;
+  cam_iface_core_extras *core = (cam_iface_core_extras*)this->core_extras;
+  CamIfaceQueuedFrame *slot;
+  unsigned char *dest;
+  unsigned long w;
+  long depth;
+  double arrival;
+  int err, full;
+
+  while (!cam_iface_atomic_load(&(ct->quit))) {
+    w = ct->write_idx;
+    full = (w - cam_iface_atomic_load(&(ct->read_idx))) >= (unsigned long)ct->num_slots;
+    slot = &(ct->slots[w % ct->num_slots]);
+    dest = full ? ct->overrun_data : slot->data;
+
+    cam_iface_clear_error();
+    this->vmt->grab_next_frame_blocking_with_stride(this,dest,ct->stride,
+                                                    CAPTURE_THREAD_GRAB_TIMEOUT);
+    arrival = _stats_now();
+    err = cam_iface_have_error();
+    cam_iface_clear_error();
+
+    if (_is_retry_error(err)) {
+      continue;
+    }
+    if (err) {
+      _stats_add_error(&(core->stats),err);
+    }
+    if (err && !_is_frame_error(err)) {
+      cam_iface_atomic_store(&(ct->thread_error),err);
+      break;
+    }
+
+    if (full) {
+      ct->pending_overruns++;
+      cam_iface_atomic_add(&(ct->num_overruns),1);
+      cam_iface_atomic_add(&(core->stats.queue_overruns),1);
+      continue;
+    }
+
+    slot->error = err;
+    slot->arrival = arrival + _clock_realtime_minus_mono();
+    this->vmt->get_last_timestamp(this,&(slot->timestamp));
+    this->vmt->get_last_framenumber(this,&(slot->framenumber));
+    if (!err && !cam_iface_have_error()) {
+      _stats_add_framenumber(core,slot->framenumber,1);
+      _clock_sync_add(&(core->clock),slot->timestamp,arrival);
+    }
+    cam_iface_clear_error();
+    slot->num_overruns = ct->pending_overruns;
+    ct->pending_overruns = 0;
+
+    cam_iface_atomic_store(&(ct->write_idx),w+1);
+    depth = cam_iface_atomic_add(&(core->stats.queue_depth),1);
+    if (depth > cam_iface_atomic_load(&(core->stats.queue_depth_peak))) {
+      cam_iface_atomic_store(&(core->stats.queue_depth_peak),depth);
+    }
+    _capture_thread_wake_consumer(ct);
+  }
+
+  cam_iface_atomic_store(&(ct->quit),1);
+  _capture_thread_wake_consumer(ct);
+  return NULL;
+}
+
+static void _capture_thread_free(cam_iface_capture_thread *ct) {
+  if (ct->wait_fd[0] >= 0) {
+    close(ct->wait_fd[0]);
+  }
+  if (ct->wait_fd[1] != ct->wait_fd[0]) {
+    close(ct->wait_fd[1]);
+  }
+  free(ct->slots);
+  free(ct->slot_data);
+  free(ct->overrun_data);
+  pthread_cond_destroy(&(ct->cond));
+  pthread_mutex_destroy(&(ct->lock));
+  free(ct);
+}
+
+CAM_IFACE_API int CamContext_start_capture_thread( CamContext *this,
+                                                   int num_slots ) {
+  cam_iface_core_extras *core;
+  cam_iface_capture_thread *ct;
+  int left, top, i, err;
+  size_t frame_size;
+
+  if (num_slots < 1) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  core = _get_core_extras(this);
+  if (core==NULL) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  if (core->capture!=NULL) {
+    return CAM_IFACE_GENERIC_ERROR; /* already running */
+  }
+
+  ct = (cam_iface_capture_thread*)calloc(1,sizeof(cam_iface_capture_thread));
+  if (ct==NULL) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  ct->cam = this;
+  ct->num_slots = num_slots;
+  pthread_mutex_init(&(ct->lock),NULL);
+  pthread_cond_init(&(ct->cond),NULL);
+  if (_capture_thread_open_wait_fd(ct)) {
+    _capture_thread_free(ct);
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+
+  this->vmt->get_frame_roi(this,&left,&top,&(ct->width),&(ct->height));
+  err = cam_iface_have_error();
+  if (err) {
+    _capture_thread_free(ct);
+    return err;
+  }
+  ct->stride = (ct->width*this->depth+7)/8;
+  frame_size = (size_t)ct->stride*ct->height;
+
+  ct->slots = (CamIfaceQueuedFrame*)calloc(num_slots,sizeof(CamIfaceQueuedFrame));
+  ct->slot_data = (unsigned char*)malloc(frame_size*num_slots);
+  ct->overrun_data = (unsigned char*)malloc(frame_size);
+  if ((ct->slots==NULL) || (ct->slot_data==NULL) || (ct->overrun_data==NULL)) {
+    _capture_thread_free(ct);
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  for (i=0; i<num_slots; i++) {
+    ct->slots[i].data = ct->slot_data + i*frame_size;
+    ct->slots[i].stride = ct->stride;
+    ct->slots[i].width = ct->width;
+    ct->slots[i].height = ct->height;
+  }
+
+  if (pthread_create(&(ct->thread),NULL,_capture_thread_func,ct)) {
+    _capture_thread_free(ct);
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  core->capture = ct;
+  return 0;
+}
+
+CAM_IFACE_API int CamContext_stop_capture_thread( CamContext *this ) {
+  cam_iface_core_extras *core = (cam_iface_core_extras*)this->core_extras;
+  cam_iface_capture_thread *ct;
+
+  if ((core==NULL) || (core->capture==NULL)) {
+    return 0;
+  }
+  ct = core->capture;
+  cam_iface_atomic_store(&(ct->quit),1);
+  pthread_join(ct->thread,NULL);
+  core->capture = NULL;
+  _capture_thread_free(ct);
+  cam_iface_atomic_store(&(core->stats.queue_depth),0);
+  core->have_last_framenumber = 0;
+  return 0;
+}
+
+CAM_IFACE_API int CamContext_point_queued_frame( CamContext *this,
+                                                 CamIfaceQueuedFrame *frame,
+                                                 float timeout ) {
+  cam_iface_core_extras *core = (cam_iface_core_extras*)this->core_extras;
+  cam_iface_capture_thread *ct;
+  struct timespec abstime;
+  double start, t;
+  int result = 0;
+
+  if ((core==NULL) || (core->capture==NULL)) {
+    return CAM_IFACE_GENERIC_ERROR; /* capture thread not running */
+  }
+  ct = core->capture;
+  start = _stats_now();
+
+  if ((ct->point_idx - ct->read_idx) >= (unsigned long)ct->num_slots) {
+    return CAM_IFACE_BUFFER_OVERFLOW_ERROR; /* every slot is pointed to */
+  }
+
+  if (cam_iface_atomic_load(&(ct->write_idx)) == ct->point_idx) {
+    /* nothing queued, so sleep until the capture thread wakes us */
+    if (timeout >= 0) {
+      t = cam_iface_floattime() + timeout;
+      abstime.tv_sec = (time_t)t;
+      abstime.tv_nsec = (long)((t-(double)abstime.tv_sec)*1e9);
+    }
+    pthread_mutex_lock(&(ct->lock));
+    cam_iface_atomic_store(&(ct->consumer_waiting),1);
+    cam_iface_atomic_fence();
+    while ((cam_iface_atomic_load(&(ct->write_idx)) == ct->point_idx) &&
+           !cam_iface_atomic_load(&(ct->quit))) {
+      if (timeout >= 0) {
+        if (pthread_cond_timedwait(&(ct->cond),&(ct->lock),&abstime)==ETIMEDOUT) {
+          break;
+        }
+      } else {
+        pthread_cond_wait(&(ct->cond),&(ct->lock));
+      }
+    }
+    cam_iface_atomic_store(&(ct->consumer_waiting),0);
+    pthread_mutex_unlock(&(ct->lock));
+
+    if (cam_iface_atomic_load(&(ct->write_idx)) == ct->point_idx) {
+      result = cam_iface_atomic_load(&(ct->thread_error));
+      if (!result) {
+        result = CAM_IFACE_FRAME_TIMEOUT;
+        /* errors that stopped the thread were counted there */
+        _stats_add_error(&(core->stats),result);
+      }
+      _stats_add_latency(&(core->stats),start,_stats_now());
+      return result;
+    }
+  }
+
+  *frame = ct->slots[ct->point_idx % ct->num_slots];
+  ct->point_idx++;
+  _stats_add_latency(&(core->stats),start,_stats_now());
+  if (!frame->error) {
+    cam_iface_atomic_add(&(core->stats.frames_delivered),1);
+  }
+  return 0;
+}
+
+CAM_IFACE_API int CamContext_unpoint_queued_frame( CamContext *this ) {
+  cam_iface_core_extras *core = (cam_iface_core_extras*)this->core_extras;
+  cam_iface_capture_thread *ct;
+
+  if ((core==NULL) || (core->capture==NULL)) {
+    return CAM_IFACE_GENERIC_ERROR; /* capture thread not running */
+  }
+  ct = core->capture;
+  if (ct->read_idx == ct->point_idx) {
+    return CAM_IFACE_GENERIC_ERROR; /* no frame pointed to */
+  }
+  cam_iface_atomic_store(&(ct->read_idx),ct->read_idx+1);
+  cam_iface_atomic_add(&(core->stats.queue_depth),-1);
+  return 0;
+}
+
+CAM_IFACE_API int CamContext_get_capture_overruns( CamContext *this,
+                                                   unsigned long *num_overruns ) {
+  cam_iface_core_extras *core = (cam_iface_core_extras*)this->core_extras;
+
+  if ((core==NULL) || (core->capture==NULL)) {
+    return CAM_IFACE_GENERIC_ERROR; /* capture thread not running */
+  }
+  *num_overruns = cam_iface_atomic_load(&(core->capture->num_overruns));
+  return 0;
+}
+
+/* multi-camera wait ------------------------------------------------- */
+
+/* ready cameras are reported starting after the last one returned */
+cam_iface_static_thread_local int wait_any_next_start = 0;
+
+#define WAIT_ANY_STACK_FDS 32
+
+CAM_IFACE_API int cam_iface_wait_any( CamContext **ctxs,
+                                      int n,
+                                      float timeout,
+                                      int *ready_index ) {
+  struct pollfd stack_fds[WAIT_ANY_STACK_FDS];
+  struct pollfd *fds;
+  cam_iface_core_extras *core;
+  cam_iface_capture_thread *ct;
+  double stop_time = 0.0, remaining;
+  int i, j, fd, ms, nready, start;
+  int found = -1;
+  int result = 0;
+
+  if ((ctxs==NULL) || (n<1) || (ready_index==NULL)) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  if (n <= WAIT_ANY_STACK_FDS) {
+    fds = stack_fds;
+  } else {
+    fds = (struct pollfd*)malloc(n*sizeof(struct pollfd));
+    if (fds==NULL) {
+      return CAM_IFACE_GENERIC_ERROR;
+    }
+  }
+  if (timeout >= 0) {
+    stop_time = cam_iface_floattime() + timeout;
+  }
+  start = (wait_any_next_start < n) ? wait_any_next_start : 0;
+
+  while (found < 0) {
+    /* Collect a descriptor for every camera. A capture thread that
+       already holds a frame is ready without a system call. */
+    for (j=0; j<n; j++) {
+      i = (start+j) % n;
+      core = (cam_iface_core_extras*)ctxs[i]->core_extras;
+      ct = (core!=NULL) ? core->capture : NULL;
+      fd = -1;
+      if (ct!=NULL) {
+        cam_iface_atomic_store(&(ct->fd_waiting),1);
+        cam_iface_atomic_fence();
+        if (_capture_thread_ready(ct)) {
+          found = i;
+          break;
+        }
+        fd = ct->wait_fd[0];
+      } else if (ctxs[i]->vmt->get_wait_fd != NULL) {
+        ctxs[i]->vmt->get_wait_fd(ctxs[i],&fd);
+      }
+      if (fd < 0) {
+        result = CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+        goto done;
+      }
+      fds[i].fd = fd;
+      fds[i].events = POLLIN;
+      fds[i].revents = 0;
+    }
+    if (found >= 0) {
+      break;
+    }
+
+    if (timeout >= 0) {
+      remaining = stop_time - cam_iface_floattime();
+      if (remaining < 0.0) {
+        remaining = 0.0;
+      }
+      ms = (int)(remaining*1000.0);
+      if (ms*0.001 < remaining) {
+        ms++; /* round up, so we never spin on a zero timeout */
+      }
+    } else {
+      ms = -1;
+    }
+
+    nready = poll(fds,n,ms);
+    if (nready < 0) {
+      if (errno==EINTR) {
+        continue;
+      }
+      result = CAM_IFACE_GENERIC_ERROR;
+      goto done;
+    }
+    if (nready == 0) {
+      result = CAM_IFACE_FRAME_TIMEOUT;
+      goto done;
+    }
+
+    for (j=0; j<n; j++) {
+      i = (start+j) % n;
+      if (fds[i].revents == 0) {
+        continue;
+      }
+      core = (cam_iface_core_extras*)ctxs[i]->core_extras;
+      ct = (core!=NULL) ? core->capture : NULL;
+      if (ct!=NULL) {
+        /* the descriptor only says the ring changed, so check again */
+        _capture_thread_drain_wait_fd(ct);
+        if (!_capture_thread_ready(ct)) {
+          continue;
+        }
+      }
+      found = i;
+      break;
+    }
+  }
+
+ done:
+  for (i=0; i<n; i++) {
+    core = (cam_iface_core_extras*)ctxs[i]->core_extras;
+    if ((core!=NULL) && (core->capture!=NULL)) {
+      cam_iface_atomic_store(&(core->capture->fd_waiting),0);
+    }
+  }
+  if (fds != stack_fds) {
+    free(fds);
+  }
+  if (found >= 0) {
+    *ready_index = found;
+    wait_any_next_start = found+1;
+    return 0;
+  }
+  return result;
+}
+
+#else /* _WIN32 */
+
+/* no pthreads on Windows -- the capture thread is not available */
+
+struct cam_iface_capture_thread {
+  int unused;
+};
+
+CAM_IFACE_API int CamContext_start_capture_thread( CamContext *this,
+                                                   int num_slots ) {
+  return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+}
+
+CAM_IFACE_API int CamContext_stop_capture_thread( CamContext *this ) {
+  return 0;
+}
+
+CAM_IFACE_API int CamContext_point_queued_frame( CamContext *this,
+                                                 CamIfaceQueuedFrame *frame,
+                                                 float timeout ) {
+  return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+}
+
+CAM_IFACE_API int CamContext_unpoint_queued_frame( CamContext *this ) {
+  return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+}
+
+CAM_IFACE_API int CamContext_get_capture_overruns( CamContext *this,
+                                                   unsigned long *num_overruns ) {
+  return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+}
+
+CAM_IFACE_API int cam_iface_wait_any( CamContext **ctxs,
+                                      int n,
+                                      float timeout,
+                                      int *ready_index ) {
+  return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+}
+
+#endif /* _WIN32 */
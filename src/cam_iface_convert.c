@@ -0,0 +1,695 @@
+/*
+
+Copyright (c) 2004-2009, California Institute of Technology. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+/* Pixel format conversion for display and storage.
+
+   YUV411, YUV422 and YUV444 are the packed IIDC layouts (UYYVYY, UYVY
+   and UYV). They are converted to RGB with the ITU-R BT.601 integer
+   approximation that the liveview demo has always used, so results are
+   unchanged for existing callers. MONO16 is reduced to MONO8 by a
+   right shift with saturation.
+
+   With compilers that have __builtin_shufflevector (GCC >= 12, clang)
+   each row is processed 16 pixels at a time: byte shuffles gather the
+   samples into planar vectors, the arithmetic runs in 16-bit lanes and
+   shuffles interleave the result. The kernels are compiled for the
+   baseline target and, on x86, for AVX2, chosen at run time. Other
+   compilers, and the last pixels of each row, use the scalar code.
+
+   Frames of CONVERT_MIN_PARALLEL_PIXELS or more are split into bands
+   of rows shared between the calling thread and a small pool of
+   worker threads, started on first use. Only one frame at a time uses
+   the pool; concurrent callers convert on their own thread. */
+
+#include "cam_iface.h"
+#include "cam_iface_internal.h"
+#include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#ifdef __has_builtin
+#if __has_builtin(__builtin_shufflevector) && __has_builtin(__builtin_convertvector)
+#define CAM_IFACE_CONVERT_VECTOR 1
+#if defined(__x86_64__) || defined(__i386__)
+#define CAM_IFACE_CONVERT_X86 1
+#endif
+#endif
+#endif
+
+#ifdef CAM_IFACE_CONVERT_VECTOR
+#define CONVERT_INLINE static inline __attribute__((always_inline))
+#else
+#define CONVERT_INLINE static
+#endif
+
+#define CONVERT_BLOCK 16
+#define CONVERT_MAX_THREADS 8
+#define CONVERT_MIN_PARALLEL_PIXELS (256*1024)
+#define CONVERT_BANDS_PER_THREAD 4
+
+typedef struct convert_job convert_job;
+typedef void (*convert_row_func)(const convert_job *job,
+                                 const unsigned char *src,
+                                 unsigned char *dst);
+
+struct convert_job {
+  convert_row_func row_func;
+  CameraPixelCoding src_coding;
+  CameraPixelCoding dst_coding;
+  const unsigned char *src;
+  intptr_t src_stride;
+  unsigned char *dst;
+  intptr_t dst_stride;
+  int width;
+  int height;
+  int mono16_shift;
+  int mono16_big_endian;
+  int vector_width; /* pixels of each row the vector kernels handle */
+  int band_rows;
+  int num_bands;
+  int next_band; /* atomic */
+};
+
+static unsigned char _clip(int v) {
+  v >>= 8;
+  if (v < 0) {
+    return 0;
+  }
+  return (v > 255) ? 255 : (unsigned char)v;
+}
+
+/* Unpack n pixels starting at pixel x (a multiple of CONVERT_BLOCK)
+   into planar Y, U and V. */
+static void _unpack_yuv(CameraPixelCoding coding,
+                        const unsigned char *src, int x, int n,
+                        unsigned char *yy,
+                        unsigned char *uu,
+                        unsigned char *vv) {
+  const unsigned char *s;
+  int i;
+  switch (coding) {
+  case CAM_IFACE_YUV411:
+    s = src + (x/4)*6;
+    for (i=0; i<n; i+=4) {
+      uu[i] = uu[i+1] = uu[i+2] = uu[i+3] = s[0];
+      yy[i] = s[1];
+      yy[i+1] = s[2];
+      vv[i] = vv[i+1] = vv[i+2] = vv[i+3] = s[3];
+      yy[i+2] = s[4];
+      yy[i+3] = s[5];
+      s += 6;
+    }
+    break;
+  case CAM_IFACE_YUV422:
+    s = src + x*2;
+    for (i=0; i<n; i+=2) {
+      uu[i] = uu[i+1] = s[0];
+      yy[i] = s[1];
+      vv[i] = vv[i+1] = s[2];
+      yy[i+1] = s[3];
+      s += 4;
+    }
+    break;
+  default: /* CAM_IFACE_YUV444 */
+    s = src + x*3;
+    for (i=0; i<n; i++) {
+      uu[i] = s[0];
+      yy[i] = s[1];
+      vv[i] = s[2];
+      s += 3;
+    }
+    break;
+  }
+}
+
+static void _yuv_to_rgb_scalar(const unsigned char *yy,
+                               const unsigned char *uu,
+                               const unsigned char *vv,
+                               int n,
+                               unsigned char *rr,
+                               unsigned char *gg,
+                               unsigned char *bb) {
+  int i, c, d, e;
+  for (i=0; i<n; i++) {
+    c = 298*(yy[i]-16) + 128;
+    d = uu[i]-128;
+    e = vv[i]-128;
+    rr[i] = _clip(c + 409*e);
+    gg[i] = _clip(c - 100*d - 208*e);
+    bb[i] = _clip(c + 516*d);
+  }
+}
+
+static void _pack_rgb(const unsigned char *rr,
+                      const unsigned char *gg,
+                      const unsigned char *bb,
+                      int n, int rgba,
+                      unsigned char *out) {
+  int i;
+  if (rgba) {
+    for (i=0; i<n; i++) {
+      out[4*i+0] = rr[i];
+      out[4*i+1] = gg[i];
+      out[4*i+2] = bb[i];
+      out[4*i+3] = 255;
+    }
+  } else {
+    for (i=0; i<n; i++) {
+      out[3*i+0] = rr[i];
+      out[3*i+1] = gg[i];
+      out[3*i+2] = bb[i];
+    }
+  }
+}
+
+static unsigned char _mono16_to_mono8(const unsigned char *s, int shift,
+                                      int big_endian) {
+  unsigned int v;
+  if (big_endian) {
+    v = (s[0] << 8) | s[1];
+  } else {
+    v = s[0] | (s[1] << 8);
+  }
+  v >>= shift;
+  return (v > 255) ? 255 : (unsigned char)v;
+}
+
+#ifdef CAM_IFACE_CONVERT_VECTOR
+
+typedef short convert_i16 __attribute__((vector_size(CONVERT_BLOCK*2)));
+typedef unsigned short convert_u16 __attribute__((vector_size(CONVERT_BLOCK*2)));
+typedef unsigned char convert_u8x16 __attribute__((vector_size(CONVERT_BLOCK)));
+typedef unsigned char convert_u8x32 __attribute__((vector_size(CONVERT_BLOCK*2)));
+
+/* Shuffle indices picking the Y, U and V samples of 16 pixels out of
+   one load of packed source bytes. */
+#define CONVERT_YUV411_Y 1,2,4,5,7,8,10,11,13,14,16,17,19,20,22,23
+#define CONVERT_YUV411_U 0,0,0,0,6,6,6,6,12,12,12,12,18,18,18,18
+#define CONVERT_YUV411_V 3,3,3,3,9,9,9,9,15,15,15,15,21,21,21,21
+#define CONVERT_YUV422_Y 1,3,5,7,9,11,13,15,17,19,21,23,25,27,29,31
+#define CONVERT_YUV422_U 0,0,4,4,8,8,12,12,16,16,20,20,24,24,28,28
+#define CONVERT_YUV422_V 2,2,6,6,10,10,14,14,18,18,22,22,26,26,30,30
+#define CONVERT_YUV444_Y 1,4,7,10,13,16,19,22,25,28,31,34,37,40,43,46
+#define CONVERT_YUV444_U 0,3,6,9,12,15,18,21,24,27,30,33,36,39,42,45
+#define CONVERT_YUV444_V 2,5,8,11,14,17,20,23,26,29,32,35,38,41,44,47
+
+/* Shuffle indices interleaving planar R (0-15), G (16-31), B (32-47)
+   and A (48-63). */
+#define CONVERT_CONCAT                                                  \
+  0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,                                \
+  16,17,18,19,20,21,22,23,24,25,26,27,28,29,30,31
+#define CONVERT_RGB_0 0,16,32,1,17,33,2,18,34,3,19,35,4,20,36,5
+#define CONVERT_RGB_1 21,37,6,22,38,7,23,39,8,24,40,9,25,41,10,26
+#define CONVERT_RGB_2 42,11,27,43,12,28,44,13,29,45,14,30,46,15,31,47
+#define CONVERT_RGBA_0 0,16,32,48,1,17,33,49,2,18,34,50,3,19,35,51
+#define CONVERT_RGBA_1 4,20,36,52,5,21,37,53,6,22,38,54,7,23,39,55
+#define CONVERT_RGBA_2 8,24,40,56,9,25,41,57,10,26,42,58,11,27,43,59
+#define CONVERT_RGBA_3 12,28,44,60,13,29,45,61,14,30,46,62,15,31,47,63
+
+/* Clamp to [0,255] and narrow. */
+#define CONVERT_VCLIP(expr) ({                                          \
+      convert_i16 vclip_v_ = (expr);                                    \
+      convert_i16 vclip_m_;                                             \
+      vclip_v_ &= ~(vclip_v_ >> 15);                                    \
+      vclip_m_ = vclip_v_ > 255;                                        \
+      __builtin_convertvector((vclip_v_ & ~vclip_m_) | (255 & vclip_m_), \
+                              convert_u8x16);                           \
+    })
+
+/* Convert the 16 pixels whose packed samples start at s, read as two
+   loads of type T, and store them at out. These are macros because
+   GCC warns about passing wide vectors by value between functions. */
+#define CONVERT_VBLOCK(T,Y,U,V,s,rgba,mono,out) {                       \
+    T vb_lo_, vb_hi_;                                                   \
+    convert_u8x16 vb_y_, vb_u_, vb_v_;                                  \
+    memcpy(&vb_lo_,(s),sizeof(T));                                      \
+    memcpy(&vb_hi_,(s)+sizeof(T),sizeof(T));                            \
+    vb_y_ = __builtin_shufflevector(vb_lo_,vb_hi_,Y);                   \
+    if (mono) {                                                         \
+      memcpy((out),&vb_y_,CONVERT_BLOCK);                               \
+    } else {                                                            \
+      vb_u_ = __builtin_shufflevector(vb_lo_,vb_hi_,U);                 \
+      vb_v_ = __builtin_shufflevector(vb_lo_,vb_hi_,V);                 \
+      CONVERT_VRGB(vb_y_,vb_u_,vb_v_,rgba,out);                         \
+    }                                                                   \
+  }
+
+/* The same arithmetic as _yuv_to_rgb_scalar() rearranged to fit in
+   16 bits: 298*c = 256*c + 42*c, 409*e = 512*e - 103*e, 208*e = 256*e
+   - 48*e and 516*d = 512*d + 4*d. The multiples of 256 are added after
+   the shift, which gives the same result for negative sums too. */
+#define CONVERT_VRGB(y8,u8,v8,rgba,out) {                               \
+    convert_i16 vrgb_c_, vrgb_d_, vrgb_e_, vrgb_k_;                     \
+    convert_u8x16 vrgb_r_, vrgb_g_, vrgb_b_, vrgb_t_[4];                \
+    convert_u8x32 vrgb_rg_, vrgb_ba_;                                   \
+    vrgb_c_ = __builtin_convertvector((y8),convert_i16) - 16;           \
+    vrgb_d_ = __builtin_convertvector((u8),convert_i16) - 128;          \
+    vrgb_e_ = __builtin_convertvector((v8),convert_i16) - 128;          \
+    vrgb_k_ = 42*vrgb_c_ + 128;                                         \
+    vrgb_r_ = CONVERT_VCLIP(vrgb_c_ + 2*vrgb_e_ +                       \
+                            ((vrgb_k_ - 103*vrgb_e_) >> 8));            \
+    vrgb_g_ = CONVERT_VCLIP(vrgb_c_ - vrgb_e_ +                         \
+                            ((vrgb_k_ - 100*vrgb_d_ + 48*vrgb_e_) >> 8)); \
+    vrgb_b_ = CONVERT_VCLIP(vrgb_c_ + 2*vrgb_d_ +                       \
+                            ((vrgb_k_ + 4*vrgb_d_) >> 8));              \
+    vrgb_rg_ = __builtin_shufflevector(vrgb_r_,vrgb_g_,CONVERT_CONCAT); \
+    if (rgba) {                                                         \
+      vrgb_ba_ = __builtin_shufflevector(vrgb_b_,vrgb_b_|255,CONVERT_CONCAT); \
+      vrgb_t_[0] = __builtin_shufflevector(vrgb_rg_,vrgb_ba_,CONVERT_RGBA_0); \
+      vrgb_t_[1] = __builtin_shufflevector(vrgb_rg_,vrgb_ba_,CONVERT_RGBA_1); \
+      vrgb_t_[2] = __builtin_shufflevector(vrgb_rg_,vrgb_ba_,CONVERT_RGBA_2); \
+      vrgb_t_[3] = __builtin_shufflevector(vrgb_rg_,vrgb_ba_,CONVERT_RGBA_3); \
+      memcpy((out),vrgb_t_,4*CONVERT_BLOCK);                            \
+    } else {                                                            \
+      vrgb_ba_ = __builtin_shufflevector(vrgb_b_,vrgb_b_,CONVERT_CONCAT); \
+      vrgb_t_[0] = __builtin_shufflevector(vrgb_rg_,vrgb_ba_,CONVERT_RGB_0); \
+      vrgb_t_[1] = __builtin_shufflevector(vrgb_rg_,vrgb_ba_,CONVERT_RGB_1); \
+      vrgb_t_[2] = __builtin_shufflevector(vrgb_rg_,vrgb_ba_,CONVERT_RGB_2); \
+      memcpy((out),vrgb_t_,3*CONVERT_BLOCK);                            \
+    }                                                                   \
+  }
+
+#endif /* CAM_IFACE_CONVERT_VECTOR */
+
+/* The row kernels. With vector support the body is expanded into a
+   baseline and an AVX2 variant, otherwise into a single scalar one. */
+CONVERT_INLINE void _convert_row_body(const convert_job *job,
+                                      const unsigned char *src,
+                                      unsigned char *dst,
+                                      int vectorize) {
+  unsigned char yy[CONVERT_BLOCK], uu[CONVERT_BLOCK], vv[CONVERT_BLOCK];
+  unsigned char rr[CONVERT_BLOCK], gg[CONVERT_BLOCK], bb[CONVERT_BLOCK];
+  int x, n, rgba, mono, bpp;
+  int width = job->width;
+#ifdef CAM_IFACE_CONVERT_VECTOR
+  convert_u16 w16, m16;
+  convert_u8x16 w8;
+#endif
+
+  x = 0;
+  if (job->src_coding == CAM_IFACE_MONO16) {
+#ifdef CAM_IFACE_CONVERT_VECTOR
+    if (vectorize) {
+      for (; x<job->vector_width; x+=CONVERT_BLOCK) {
+        memcpy(&w16,src+2*x,sizeof(w16));
+        if (job->mono16_big_endian) {
+          w16 = (w16 << 8) | (w16 >> 8);
+        }
+        w16 >>= (unsigned short)job->mono16_shift;
+        m16 = (convert_u16)(w16 > 255);
+        w16 = (w16 & ~m16) | (255 & m16);
+        w8 = __builtin_convertvector(w16,convert_u8x16);
+        memcpy(dst+x,&w8,CONVERT_BLOCK);
+      }
+    }
+#endif
+    for (; x<width; x++) {
+      dst[x] = _mono16_to_mono8(src+2*x,job->mono16_shift,
+                                job->mono16_big_endian);
+    }
+    return;
+  }
+
+  rgba = (job->dst_coding == CAM_IFACE_RGBA8);
+  mono = (job->dst_coding == CAM_IFACE_MONO8);
+  bpp = mono ? 1 : (rgba ? 4 : 3);
+
+#ifdef CAM_IFACE_CONVERT_VECTOR
+  if (vectorize) {
+    switch (job->src_coding) {
+    case CAM_IFACE_YUV411:
+      for (; x<job->vector_width; x+=CONVERT_BLOCK) {
+        CONVERT_VBLOCK(convert_u8x16,CONVERT_YUV411_Y,CONVERT_YUV411_U,
+                       CONVERT_YUV411_V,src+(x/4)*6,rgba,mono,dst+x*bpp);
+      }
+      break;
+    case CAM_IFACE_YUV422:
+      for (; x<job->vector_width; x+=CONVERT_BLOCK) {
+        CONVERT_VBLOCK(convert_u8x16,CONVERT_YUV422_Y,CONVERT_YUV422_U,
+                       CONVERT_YUV422_V,src+x*2,rgba,mono,dst+x*bpp);
+      }
+      break;
+    default:
+      for (; x<job->vector_width; x+=CONVERT_BLOCK) {
+        CONVERT_VBLOCK(convert_u8x32,CONVERT_YUV444_Y,CONVERT_YUV444_U,
+                       CONVERT_YUV444_V,src+x*3,rgba,mono,dst+x*bpp);
+      }
+      break;
+    }
+  }
+#endif
+
+  /* remainder of the row, or all of it without vector support */
+  for (; x<width; x+=CONVERT_BLOCK) {
+    n = width - x;
+    if (n > CONVERT_BLOCK) {
+      n = CONVERT_BLOCK;
+    }
+    _unpack_yuv(job->src_coding,src,x,n,yy,uu,vv);
+    if (mono) {
+      memcpy(dst+x,yy,n);
+      continue;
+    }
+    _yuv_to_rgb_scalar(yy,uu,vv,n,rr,gg,bb);
+    _pack_rgb(rr,gg,bb,n,rgba,dst+x*bpp);
+  }
+}
+
+#ifdef CAM_IFACE_CONVERT_VECTOR
+static void _convert_row_baseline(const convert_job *job,
+                                  const unsigned char *src,
+                                  unsigned char *dst) {
+  _convert_row_body(job,src,dst,1);
+}
+
+#ifdef CAM_IFACE_CONVERT_X86
+__attribute__((target("avx2")))
+static void _convert_row_avx2(const convert_job *job,
+                              const unsigned char *src,
+                              unsigned char *dst) {
+  _convert_row_body(job,src,dst,1);
+}
+#endif
+#else /* CAM_IFACE_CONVERT_VECTOR */
+static void _convert_row_scalar(const convert_job *job,
+                                const unsigned char *src,
+                                unsigned char *dst) {
+  _convert_row_body(job,src,dst,0);
+}
+#endif /* CAM_IFACE_CONVERT_VECTOR */
+
+static convert_row_func convert_row_impl = NULL;
+
+static convert_row_func _get_row_func(void) {
+  convert_row_func f = cam_iface_atomic_load(&convert_row_impl);
+  if (f != NULL) {
+    return f;
+  }
+#ifdef CAM_IFACE_CONVERT_VECTOR
+  f = _convert_row_baseline;
+#ifdef CAM_IFACE_CONVERT_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    f = _convert_row_avx2;
+  }
+#endif
+#else
+  f = _convert_row_scalar;
+#endif
+  cam_iface_atomic_store(&convert_row_impl,f);
+  return f;
+}
+
+/* Convert bands until none are left. Called by every thread working
+   on the job. */
+static void _convert_run_bands(convert_job *job) {
+  int band, y, y1;
+  for (;;) {
+    band = cam_iface_atomic_add(&(job->next_band),1) - 1;
+    if (band >= job->num_bands) {
+      return;
+    }
+    y = band*job->band_rows;
+    y1 = y + job->band_rows;
+    if (y1 > job->height) {
+      y1 = job->height;
+    }
+    for (; y<y1; y++) {
+      job->row_func(job,
+                    job->src + y*job->src_stride,
+                    job->dst + y*job->dst_stride);
+    }
+  }
+}
+
+#ifndef _WIN32
+
+/* Worker pool. pool_lock protects everything below. */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done_cond = PTHREAD_COND_INITIALIZER; /* pending or busy changed */
+static pthread_t pool_threads[CONVERT_MAX_THREADS];
+static int pool_num_workers = 0;    /* running worker threads */
+static int pool_num_threads = 0;    /* requested total, 0 = automatic */
+static int pool_busy = 0;           /* a frame or a resize is using the pool */
+static int pool_quit = 0;
+static int pool_pending = 0;        /* workers yet to finish this job */
+static unsigned long pool_generation = 0;
+static convert_job *pool_job = NULL;
+
+static void* _pool_worker_func(void *arg) {
+  unsigned long seen = (unsigned long)(uintptr_t)arg;
+  convert_job *job;
+
+  pthread_mutex_lock(&pool_lock);
+  for (;;) {
+    while ((pool_generation==seen) && !pool_quit) {
+      pthread_cond_wait(&pool_work_cond,&pool_lock);
+    }
+    if (pool_quit) {
+      break;
+    }
+    seen = pool_generation;
+    job = pool_job;
+    pthread_mutex_unlock(&pool_lock);
+
+    _convert_run_bands(job);
+
+    pthread_mutex_lock(&pool_lock);
+    pool_pending--;
+    if (pool_pending==0) {
+      pthread_cond_broadcast(&pool_done_cond);
+    }
+  }
+  pthread_mutex_unlock(&pool_lock);
+  return NULL;
+}
+
+/* total number of threads (workers plus caller) to use */
+static int _pool_target_threads(void) {
+  long n = pool_num_threads;
+  if (n <= 0) {
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (n < 1) {
+    n = 1;
+  }
+  if (n > CONVERT_MAX_THREADS+1) {
+    n = CONVERT_MAX_THREADS+1;
+  }
+  return (int)n;
+}
+
+/* Start workers if needed. Called with pool_lock held. */
+static void _pool_start_workers(void) {
+  int target = _pool_target_threads() - 1;
+  while (pool_num_workers < target) {
+    if (pthread_create(&(pool_threads[pool_num_workers]),NULL,
+                       _pool_worker_func,
+                       (void*)(uintptr_t)pool_generation)) {
+      break;
+    }
+    pool_num_workers++;
+  }
+}
+
+/* Run job on the pool. Returns 0 if the pool was busy or has no
+   workers, in which case the caller converts on its own. */
+static int _pool_run(convert_job *job) {
+  int workers;
+
+  pthread_mutex_lock(&pool_lock);
+  if (pool_busy) {
+    pthread_mutex_unlock(&pool_lock);
+    return 0;
+  }
+  _pool_start_workers();
+  workers = pool_num_workers;
+  if (workers == 0) {
+    pthread_mutex_unlock(&pool_lock);
+    return 0;
+  }
+  job->num_bands = (workers+1)*CONVERT_BANDS_PER_THREAD;
+  job->band_rows = (job->height + job->num_bands - 1) / job->num_bands;
+  job->num_bands = (job->height + job->band_rows - 1) / job->band_rows;
+  pool_busy = 1;
+  pool_job = job;
+  pool_pending = workers;
+  pool_generation++;
+  pthread_cond_broadcast(&pool_work_cond);
+  pthread_mutex_unlock(&pool_lock);
+
+  _convert_run_bands(job);
+
+  pthread_mutex_lock(&pool_lock);
+  while (pool_pending > 0) {
+    pthread_cond_wait(&pool_done_cond,&pool_lock);
+  }
+  pool_job = NULL;
+  pool_busy = 0;
+  pthread_cond_broadcast(&pool_done_cond);
+  pthread_mutex_unlock(&pool_lock);
+  return 1;
+}
+
+CAM_IFACE_API void cam_iface_convert_set_num_threads(int num_threads) {
+  int i, n;
+
+  pthread_mutex_lock(&pool_lock);
+  while (pool_busy) {
+    /* let the frame in flight finish */
+    pthread_cond_wait(&pool_done_cond,&pool_lock);
+  }
+  /* Stay busy until the old workers are joined, so that _pool_run()
+     neither starts new workers into pool_threads[] nor waits for
+     workers that are about to quit. */
+  pool_busy = 1;
+  pool_quit = 1;
+  pthread_cond_broadcast(&pool_work_cond);
+  n = pool_num_workers;
+  pool_num_workers = 0;
+  pool_num_threads = (num_threads < 0) ? 0 : num_threads;
+  pthread_mutex_unlock(&pool_lock);
+
+  for (i=0; i<n; i++) {
+    pthread_join(pool_threads[i],NULL);
+  }
+
+  pthread_mutex_lock(&pool_lock);
+  pool_quit = 0;
+  pool_busy = 0;
+  pthread_cond_broadcast(&pool_done_cond);
+  pthread_mutex_unlock(&pool_lock);
+}
+
+#else /* _WIN32 */
+
+/* no pthreads on Windows -- conversions run on the calling thread */
+static int _pool_run(convert_job *job) {
+  return 0;
+}
+
+CAM_IFACE_API void cam_iface_convert_set_num_threads(int num_threads) {
+}
+
+#endif /* _WIN32 */
+
+CAM_IFACE_API int cam_iface_convert_pixels(CameraPixelCoding src_coding,
+                                           const unsigned char *src,
+                                           intptr_t src_stride,
+                                           CameraPixelCoding dst_coding,
+                                           unsigned char *dst,
+                                           intptr_t dst_stride,
+                                           int width,
+                                           int height,
+                                           const CamIfaceConvertOptions *options) {
+  convert_job job;
+  intptr_t src_row_bytes, dst_row_bytes;
+  int group, block_bytes, load_bytes;
+  int y;
+
+  /* block_bytes: source bytes of CONVERT_BLOCK pixels, load_bytes:
+     bytes the vector kernel reads for them */
+  switch (src_coding) {
+  case CAM_IFACE_YUV411: group = 4; block_bytes = 24; load_bytes = 32; break;
+  case CAM_IFACE_YUV422: group = 2; block_bytes = 32; load_bytes = 32; break;
+  case CAM_IFACE_YUV444: group = 1; block_bytes = 48; load_bytes = 64; break;
+  case CAM_IFACE_MONO16: group = 1; block_bytes = 32; load_bytes = 32; break;
+  default:
+    return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+  }
+  switch (dst_coding) {
+  case CAM_IFACE_MONO8:  dst_row_bytes = width;   break;
+  case CAM_IFACE_RGB8:
+    if (src_coding == CAM_IFACE_MONO16) {
+      return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+    }
+    dst_row_bytes = (intptr_t)width*3;
+    break;
+  case CAM_IFACE_RGBA8:
+    if (src_coding == CAM_IFACE_MONO16) {
+      return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+    }
+    dst_row_bytes = (intptr_t)width*4;
+    break;
+  default:
+    return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+  }
+  src_row_bytes = (intptr_t)width*block_bytes/CONVERT_BLOCK;
+  if ((src==NULL) || (dst==NULL) || (width < 0) || (height < 0) ||
+      (width % group) ||
+      (src_stride < src_row_bytes) || (dst_stride < dst_row_bytes)) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+
+  job.row_func = _get_row_func();
+  job.src_coding = src_coding;
+  job.dst_coding = dst_coding;
+  job.src = src;
+  job.src_stride = src_stride;
+  job.dst = dst;
+  job.dst_stride = dst_stride;
+  job.width = width;
+  job.height = height;
+  job.mono16_shift = 8;
+  job.mono16_big_endian = 0;
+  if (options != NULL) {
+    if ((options->mono16_shift < 0) || (options->mono16_shift > 15)) {
+      return CAM_IFACE_GENERIC_ERROR;
+    }
+    job.mono16_shift = options->mono16_shift;
+    job.mono16_big_endian = options->mono16_big_endian;
+  }
+  /* never read past the end of a row */
+  job.vector_width = 0;
+  if (src_row_bytes >= load_bytes) {
+    job.vector_width = (int)((src_row_bytes - load_bytes)/block_bytes + 1);
+    if (job.vector_width > width/CONVERT_BLOCK) {
+      job.vector_width = width/CONVERT_BLOCK;
+    }
+    job.vector_width *= CONVERT_BLOCK;
+  }
+  job.next_band = 0;
+
+  if ((intptr_t)width*height >= CONVERT_MIN_PARALLEL_PIXELS) {
+    if (_pool_run(&job)) {
+      return 0;
+    }
+  }
+
+  for (y=0; y<height; y++) {
+    job.row_func(&job, src + y*src_stride, dst + y*dst_stride);
+  }
+  return 0;
+}
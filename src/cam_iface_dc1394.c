@@ -30,6 +30,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 /* Backend for libdc1394 v2.0 */
 #include "cam_iface.h"
+#include "cam_iface_internal.h"
 
 #if 1
 #define DPRINTF(...)
@@ -51,6 +52,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 
 #include <sys/select.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <errno.h>
 
 #undef CAM_IFACE_DC1394_SLOWDEBUG
@@ -97,6 +101,12 @@ typedef struct {
   void (*set_framerate)(struct CCdc1394*,float);
   void (*get_num_framebuffers)(struct CCdc1394*,int*);
   void (*set_num_framebuffers)(struct CCdc1394*,int);
+  void (*grab_frames_batch)(struct CCdc1394*,
+                            unsigned char**,intptr_t,
+                            double*,unsigned long*,
+                            int,int,int*,float);
+  void (*get_wait_fd)(struct CCdc1394*,int*);
+  void (*get_frame_roi_framenumber)(struct CCdc1394*,unsigned long*);
 } CCdc1394_functable;
 
 typedef struct CCdc1394 {
@@ -114,6 +124,7 @@ typedef struct CCdc1394 {
   int roi_height;
   int buffer_size;     // bytes per frame
   unsigned long nframe_hack;
+  unsigned long roi_framenumber; // first frame with the current ROI
 
   int num_dma_buffers;
   uint64_t last_timestamp;
@@ -125,6 +136,16 @@ typedef struct CCdc1394 {
   int capture_is_set;
 
   int auto_debayer;
+  CameraPixelCoding bayer_coding; // sensor coding when auto_debayer
+  int restart_on_roi_move; // DC1394_BACKEND_RESTART_ON_ROI_MOVE is set
+
+  // Frames lent to the caller by point_next_frame_blocking(), kept as
+  // a FIFO (oldest at pointed_head) so unpoint_frame() re-enqueues
+  // them in the order they were dequeued.
+  dc1394video_frame_t **pointed_frames;
+  int pointed_head;
+  int num_pointed;
+  int max_pointed;
 } CCdc1394;
 
 // forward declarations
@@ -165,6 +186,12 @@ void CCdc1394_get_framerate(struct CCdc1394*,float*);
 void CCdc1394_set_framerate(struct CCdc1394*,float);
 void CCdc1394_get_num_framebuffers(struct CCdc1394*,int*);
 void CCdc1394_set_num_framebuffers(struct CCdc1394*,int);
+void CCdc1394_grab_frames_batch(struct CCdc1394*,
+                                unsigned char**,intptr_t,
+                                double*,unsigned long*,
+                                int,int,int*,float);
+void CCdc1394_get_wait_fd(struct CCdc1394*,int*);
+void CCdc1394_get_frame_roi_framenumber(struct CCdc1394*,unsigned long*);
 
 CCdc1394_functable CCdc1394_vmt = {
   (cam_iface_constructor_func_t)CCdc1394_construct,
@@ -194,7 +221,10 @@ CCdc1394_functable CCdc1394_vmt = {
   CCdc1394_get_framerate,
   CCdc1394_set_framerate,
   CCdc1394_get_num_framebuffers,
-  CCdc1394_set_num_framebuffers
+  CCdc1394_set_num_framebuffers,
+  CCdc1394_grab_frames_batch,
+  CCdc1394_get_wait_fd,
+  CCdc1394_get_frame_roi_framenumber
 };
 
 /* typedefs */
@@ -247,22 +277,22 @@ dc1394_t * libdc1394_instance=NULL;
 myTLS int BACKEND_GLOBAL(cam_iface_error) = 0;
 #define CAM_IFACE_MAX_ERROR_LEN 255
 myTLS char BACKEND_GLOBAL(cam_iface_error_string)[CAM_IFACE_MAX_ERROR_LEN]  = {0x00}; //...
+myTLS cam_iface_deferred_error BACKEND_GLOBAL(cam_iface_error_info) = {NULL};
 
 uint32_t num_cameras = 0;
 dc1394camera_t **cameras = NULL;
 cam_iface_dc1394_modes_t *modes_by_device_number=NULL;
 cam_iface_dc1394_feature_list_t *features_by_device_number=NULL;
 cam_iface_dc1394_trigger_list_t *trigger_list_by_device_number=NULL;
+int *caps_loaded_by_device_number=NULL;
 
-#ifdef MEGA_BACKEND
-#define CAM_IFACE_ERROR_FORMAT(m)                                       \
-  snprintf(dc1394_cam_iface_error_string,CAM_IFACE_MAX_ERROR_LEN,              \
-           "%s (%d): %s\n",__FILE__,__LINE__,(m));
-#else
 #define CAM_IFACE_ERROR_FORMAT(m)                                       \
-  snprintf(cam_iface_error_string,CAM_IFACE_MAX_ERROR_LEN,              \
-           "%s (%d): %s\n",__FILE__,__LINE__,(m));
-#endif
+  CAM_IFACE_DEFER_ERROR(BACKEND_GLOBAL(cam_iface_error_info),(m));
+
+#define CAM_IFACE_DC1394_ERROR_FORMAT(err,hint)                         \
+  CAM_IFACE_DEFER_LIB_ERROR(BACKEND_GLOBAL(cam_iface_error_info),       \
+                            "libdc1394",(err),                          \
+                            dc1394_error_get_string(err),(hint));
 
 #ifdef MEGA_BACKEND
 #define CAM_IFACE_CHECK_DEVICE_NUMBER(m)                                \
@@ -280,57 +310,23 @@ cam_iface_dc1394_trigger_list_t *trigger_list_by_device_number=NULL;
   }
 #endif
 
-#ifdef MEGA_BACKEND
-#define CIDC1394CHK(err) {                                              \
-    dc1394error_t m = (err);                                            \
-    if (m!=DC1394_SUCCESS) {                                            \
-      dc1394_cam_iface_error = -1;                                             \
-      snprintf(dc1394_cam_iface_error_string,CAM_IFACE_MAX_ERROR_LEN,          \
-               "%s (%d): libdc1394 err %d: %s\n",__FILE__,__LINE__,     \
-               m,                                                       \
-               dc1394_error_get_string(m));                             \
-      return;                                                           \
-    }                                                                   \
-  }
-#else
 #define CIDC1394CHK(err) {                                              \
     dc1394error_t m = (err);                                            \
     if (m!=DC1394_SUCCESS) {                                            \
-      cam_iface_error = -1;                                             \
-      snprintf(cam_iface_error_string,CAM_IFACE_MAX_ERROR_LEN,          \
-               "%s (%d): libdc1394 err %d: %s\n",__FILE__,__LINE__,     \
-               m,                                                       \
-               dc1394_error_get_string(m));                             \
+      BACKEND_GLOBAL(cam_iface_error) = -1;                             \
+      CAM_IFACE_DC1394_ERROR_FORMAT(m,NULL);                            \
       return;                                                           \
     }                                                                   \
   }
-#endif
 
-#ifdef MEGA_BACKEND
-#define CIDC1394CHKV(err) {                                             \
-    dc1394error_t m = (err);                                            \
-    if (m!=DC1394_SUCCESS) {                                            \
-      dc1394_cam_iface_error = -1;                                             \
-      snprintf(dc1394_cam_iface_error_string,CAM_IFACE_MAX_ERROR_LEN,          \
-               "%s (%d): libdc1394 err %d: %s\n",__FILE__,__LINE__,     \
-               m,                                                       \
-               dc1394_error_get_string(m));                             \
-      return NULL;                                                      \
-    }                                                                   \
-  }
-#else
 #define CIDC1394CHKV(err) {                                             \
     dc1394error_t m = (err);                                            \
     if (m!=DC1394_SUCCESS) {                                            \
-      cam_iface_error = -1;                                             \
-      snprintf(cam_iface_error_string,CAM_IFACE_MAX_ERROR_LEN,          \
-               "%s (%d): libdc1394 err %d: %s\n",__FILE__,__LINE__,     \
-               m,                                                       \
-               dc1394_error_get_string(m));                             \
+      BACKEND_GLOBAL(cam_iface_error) = -1;                             \
+      CAM_IFACE_DC1394_ERROR_FORMAT(m,NULL);                            \
       return NULL;                                                      \
     }                                                                   \
   }
-#endif
 
 
 #ifdef MEGA_BACKEND
@@ -397,6 +393,9 @@ int BACKEND_METHOD(cam_iface_have_error)() {
 }
 
 const char * BACKEND_METHOD(cam_iface_get_error_string)() {
+  CAM_IFACE_FORMAT_DEFERRED_ERROR(BACKEND_GLOBAL(cam_iface_error_info),
+                                  BACKEND_GLOBAL(cam_iface_error_string),
+                                  CAM_IFACE_MAX_ERROR_LEN);
   return BACKEND_GLOBAL(cam_iface_error_string);
 }
 
@@ -525,16 +524,482 @@ const char *trig_sources_str(dc1394trigger_source_t mode) {
   return result;
 }
 
-void BACKEND_METHOD(cam_iface_startup)() {
-  int device_number,i,j,k,kk,current_mode,feature_number;
+static void _dc1394_free_caps(int device_number) {
+  free(modes_by_device_number[device_number].modes);
+  free(features_by_device_number[device_number].dc1394_feature_ids);
+  free(trigger_list_by_device_number[device_number].is_internal_freerunning);
+  free(trigger_list_by_device_number[device_number].mode);
+  free(trigger_list_by_device_number[device_number].polarity);
+  free(trigger_list_by_device_number[device_number].source);
+  memset(&(modes_by_device_number[device_number]),0,sizeof(cam_iface_dc1394_modes_t));
+  memset(&(features_by_device_number[device_number]),0,sizeof(cam_iface_dc1394_feature_list_t));
+  memset(&(trigger_list_by_device_number[device_number]),0,sizeof(cam_iface_dc1394_trigger_list_t));
+  caps_loaded_by_device_number[device_number] = 0;
+}
+
+static int _dc1394_alloc_triggers(int device_number, int trig_count) {
+  cam_iface_dc1394_trigger_list_t *tl = &(trigger_list_by_device_number[device_number]);
+  tl->num_trigger_modes = trig_count;
+  tl->is_internal_freerunning = calloc(trig_count,sizeof(uint8_t));
+  tl->mode = calloc(trig_count,sizeof(dc1394trigger_mode_t));
+  tl->polarity = calloc(trig_count,sizeof(dc1394trigger_polarity_t));
+  tl->source = calloc(trig_count,sizeof(dc1394trigger_source_t));
+  return ((tl->is_internal_freerunning!=NULL) && (tl->mode!=NULL) &&
+          (tl->polarity!=NULL) && (tl->source!=NULL));
+}
+
+/* Query the video modes, features and trigger modes of a camera. This
+   takes many register reads. */
+static void _dc1394_query_caps(int device_number) {
+  int i,j,k,kk,current_mode,feature_number;
   dc1394video_modes_t video_modes;
   dc1394framerates_t framerates;
   dc1394featureset_t features;
   dc1394feature_info_t    *feature_info;
   dc1394color_codings_t color_codings;
   int trig_count, num_polarities;
+
+  _dc1394_free_caps(device_number);
+
+  // features: pass 1 count num available
+  CIDC1394CHK(dc1394_feature_get_all(cameras[device_number], &features));
+  for (i=0; i<DC1394_FEATURE_NUM; i++) {
+    feature_info = &(features.feature[i]);
+
+    if (_available_feature_filter( cameras[device_number], feature_info->id, feature_info->available)) {
+      features_by_device_number[device_number].num_features++;
+    }
+
+    if (feature_info->id == DC1394_FEATURE_TRIGGER) {
+      trig_count = 1;
+
+      trigger_list_by_device_number[device_number].trigger_polarity_changeable = feature_info->polarity_capable;
+      if (feature_info->polarity_capable) {
+        num_polarities = 2;
+      } else {
+        num_polarities = 1;
+      }
+      trig_count += num_polarities*(feature_info->trigger_modes.num)*(feature_info->trigger_sources.num);
+
+      if (!_dc1394_alloc_triggers(device_number,trig_count)) {
+        BACKEND_GLOBAL(cam_iface_error) = -1;
+        CAM_IFACE_ERROR_FORMAT("error allocating memory");
+        return;
+      }
+
+      // internal, freerunning
+      trigger_list_by_device_number[device_number].is_internal_freerunning[0] = 1;
+
+      trig_count = 1;
+      for (kk=0; kk<num_polarities; kk++) {
+        for (j=0; j<(feature_info->trigger_modes.num); j++) {
+          for (k=0; k<(feature_info->trigger_sources.num); k++) {
+            trigger_list_by_device_number[device_number].is_internal_freerunning[trig_count] = 0;
+            trigger_list_by_device_number[device_number].mode[trig_count] = feature_info->trigger_modes.modes[j];
+            if (kk==0) {
+              trigger_list_by_device_number[device_number].polarity[trig_count] = DC1394_TRIGGER_ACTIVE_HIGH;
+            } else {
+              trigger_list_by_device_number[device_number].polarity[trig_count] = DC1394_TRIGGER_ACTIVE_LOW;
+            }
+            trigger_list_by_device_number[device_number].source[trig_count] = feature_info->trigger_sources.sources[k];
+            trig_count++;
+          }
+        }
+      }
+    }
+
+  }
+
+  // modes:
+  CIDC1394CHK(dc1394_video_get_supported_modes(cameras[device_number],
+                                               &video_modes));
+
+  // enumerate total number of modes ("mode" = dc1394 mode + dc1394 framerate)
+  for (i=video_modes.num-1;i>=0;i--) {
+    // framerates don't work for format 7
+    //fprintf(stderr,"mode: %s ",get_dc1394_mode_string(video_modes.modes[i]));
+    if (cam_iface_is_video_mode_scalable(video_modes.modes[i])) {
+      // format7
+      //dc1394_format7_get_mode_info(cameras[device_number], video_modes.modes[i],&sf7mode);
+      //fprint_dc1394format7mode_t(stderr,&sf7mode);
+      CIDC1394CHK(dc1394_format7_get_color_codings(cameras[device_number],
+                                                   video_modes.modes[i],
+                                                   &color_codings));
+      for (j=0;j<color_codings.num;j++) {
+        modes_by_device_number[device_number].num_modes++; // a single mode entry
+      }
+    } else {
+      CIDC1394CHK(dc1394_video_get_supported_framerates(cameras[device_number],
+                                                        video_modes.modes[i],
+                                                        &framerates));
+      for (j=framerates.num-1;j>=0;j--) {
+        modes_by_device_number[device_number].num_modes++;
+        //fprintf(stderr,"non-format7: num_modes++\n");
+      }
+    }
+  }
+
+  // features: pass 2 - allocate memory
+  features_by_device_number[device_number].dc1394_feature_ids = malloc(features_by_device_number[device_number].num_features *sizeof(int));
+  if (features_by_device_number[device_number].dc1394_feature_ids==NULL) {
+    BACKEND_GLOBAL(cam_iface_error) = -1;
+    CAM_IFACE_ERROR_FORMAT("error allocating memory");
+    return;
+  }
+  feature_number = 0;
+  for (i=0; i<DC1394_FEATURE_NUM; i++) {
+    feature_info = &(features.feature[i]);
+    if (_available_feature_filter( cameras[device_number], feature_info->id, feature_info->available)) {
+      features_by_device_number[device_number].dc1394_feature_ids[feature_number] = feature_info->id;
+      feature_number++;
+    }
+  }
+
+  // modes:
+
+  // allocate memory for each device to store possible modes
+  modes_by_device_number[device_number].modes = malloc(modes_by_device_number[device_number].num_modes * sizeof(cam_iface_dc1394_mode_t));
+  if (modes_by_device_number[device_number].modes==NULL) {
+    BACKEND_GLOBAL(cam_iface_error) = -1;
+    CAM_IFACE_ERROR_FORMAT("error allocating memory");
+    return;
+  }
+
+  // now fill mode list
+  current_mode = 0;
+  // enumerate total number of modes ("mode" = dc1394 mode + dc1394 framerate)
+  for (i=video_modes.num-1;i>=0;i--) {
+    if (cam_iface_is_video_mode_scalable(video_modes.modes[i])) {
+      // format7
+      CIDC1394CHK(dc1394_format7_get_color_codings(cameras[device_number],
+                                                   video_modes.modes[i],
+                                                   &color_codings));
+      for (j=0;j<color_codings.num;j++) {
+        modes_by_device_number[device_number].modes[current_mode].video_mode = video_modes.modes[i];
+        modes_by_device_number[device_number].modes[current_mode].framerate = -1; // format7 - no framerate
+        modes_by_device_number[device_number].modes[current_mode].color_coding = color_codings.codings[j];
+        current_mode++;
+      }
+    } else {
+      CIDC1394CHK(dc1394_video_get_supported_framerates(cameras[device_number],
+                                                        video_modes.modes[i],
+                                                        &framerates));
+      for (j=framerates.num-1;j>=0;j--) {
+        modes_by_device_number[device_number].modes[current_mode].video_mode = video_modes.modes[i];
+        modes_by_device_number[device_number].modes[current_mode].framerate = framerates.framerates[j];
+        CIDC1394CHK(dc1394_get_color_coding_from_video_mode(cameras[device_number],
+                                                            video_modes.modes[i],
+                                                            &(modes_by_device_number[device_number].modes[current_mode].color_coding)));
+        current_mode++;
+      }
+    }
+  }
+
+  caps_loaded_by_device_number[device_number] = 1;
+}
+
+/* Capability cache.
+
+   Querying the capabilities of every camera at startup takes seconds
+   on a bus with many cameras, so they are kept in a file with one line
+   per camera:
+
+     guid vendor_id model_id unit_spec_ID unit_sw_version unit_sub_sw_version iidc_version
+       M video_mode framerate color_coding (M times)
+       F feature_id (F times)
+       T polarity_changeable is_internal_freerunning mode polarity source (T times)
+
+   all on one line. A camera's entry is only used if everything before
+   the mode list matches, so a firmware update that changes the IIDC
+   or unit software version invalidates it. Cameras without a valid
+   entry are queried when first used and their entry is replaced. */
+#define DC1394_CACHE_HEADER "# libcamiface dc1394 capabilities v1"
+
+static char **cache_lines = NULL;
+static int num_cache_lines = 0;
+
+static const char *_dc1394_cache_filename(char *buf, size_t len) {
+  const char *env, *home;
+
+  env = getenv("DC1394_BACKEND_CACHE");
+  if (env!=NULL) {
+    return (env[0]=='\0') ? NULL : env; /* empty: no cache */
+  }
+  env = getenv("XDG_CACHE_HOME");
+  if ((env!=NULL) && (env[0]!='\0')) {
+    snprintf(buf,len,"%s/libcamiface-dc1394.cache",env);
+    return buf;
+  }
+  home = getenv("HOME");
+  if (home==NULL) {
+    return NULL;
+  }
+  snprintf(buf,len,"%s/.cache/libcamiface-dc1394.cache",home);
+  return buf;
+}
+
+static void _dc1394_cache_format_key(int device_number, char *buf, size_t len) {
+  dc1394camera_t *camera = cameras[device_number];
+  snprintf(buf,len,"%016llx %u %u %u %u %u %d",
+           (unsigned long long)camera->guid,
+           camera->vendor_id,camera->model_id,camera->unit_spec_ID,
+           camera->unit_sw_version,camera->unit_sub_sw_version,
+           (int)camera->iidc_version);
+}
+
+static void _dc1394_cache_load(void) {
+  char filename[1024];
+  const char *fname;
+  FILE *f;
+  char *line = NULL;
+  size_t len = 0;
+  ssize_t n;
+  char **grown;
+
+  if (getenv("DC1394_BACKEND_CACHE_REFRESH")!=NULL) {
+    return; /* query everything and rewrite the cache */
+  }
+  fname = _dc1394_cache_filename(filename,sizeof(filename));
+  if (fname==NULL) {
+    return;
+  }
+  f = fopen(fname,"r");
+  if (f==NULL) {
+    return;
+  }
+  n = getline(&line,&len,f);
+  if ((n<0) || strncmp(line,DC1394_CACHE_HEADER,strlen(DC1394_CACHE_HEADER))) {
+    CAM_IFACE_LOG(CAM_IFACE_LOG_DC1394,CAM_IFACE_LOG_INFO,
+                  "ignoring capability cache %s with unknown format",fname);
+    free(line);
+    fclose(f);
+    return;
+  }
+  while ((n = getline(&line,&len,f)) > 0) {
+    if (line[n-1]=='\n') {
+      line[n-1] = '\0';
+    }
+    grown = realloc(cache_lines,(num_cache_lines+1)*sizeof(char*));
+    if (grown==NULL) {
+      break;
+    }
+    cache_lines = grown;
+    cache_lines[num_cache_lines] = strdup(line);
+    if (cache_lines[num_cache_lines]==NULL) {
+      break;
+    }
+    num_cache_lines++;
+  }
+  free(line);
+  fclose(f);
+}
+
+static void _dc1394_cache_free(void) {
+  int i;
+  for (i=0; i<num_cache_lines; i++) {
+    free(cache_lines[i]);
+  }
+  free(cache_lines);
+  cache_lines = NULL;
+  num_cache_lines = 0;
+}
+
+/* next integer of a cache line, returns 0 at the end or on garbage */
+static int _dc1394_cache_next(char **pos, long *value) {
+  char *end;
+  *value = strtol(*pos,&end,10);
+  if (end==*pos) {
+    return 0;
+  }
+  *pos = end;
+  return 1;
+}
+
+static int _dc1394_cache_parse(int device_number, char *pos) {
+  cam_iface_dc1394_modes_t *modes = &(modes_by_device_number[device_number]);
+  cam_iface_dc1394_feature_list_t *fl = &(features_by_device_number[device_number]);
+  cam_iface_dc1394_trigger_list_t *tl = &(trigger_list_by_device_number[device_number]);
+  long n, v[5];
+  int i, j;
+
+  if (!_dc1394_cache_next(&pos,&n) || (n<0) || (n>4096)) {
+    return 0;
+  }
+  modes->modes = malloc((n>0 ? n : 1)*sizeof(cam_iface_dc1394_mode_t));
+  if (modes->modes==NULL) {
+    return 0;
+  }
+  for (i=0; i<n; i++) {
+    for (j=0; j<3; j++) {
+      if (!_dc1394_cache_next(&pos,&(v[j]))) {
+        return 0;
+      }
+    }
+    modes->modes[i].video_mode = (dc1394video_mode_t)v[0];
+    modes->modes[i].framerate = (dc1394framerate_t)v[1];
+    modes->modes[i].color_coding = (dc1394color_coding_t)v[2];
+    modes->num_modes++;
+  }
+
+  if (!_dc1394_cache_next(&pos,&n) || (n<0) || (n>DC1394_FEATURE_NUM)) {
+    return 0;
+  }
+  fl->dc1394_feature_ids = malloc((n>0 ? n : 1)*sizeof(int));
+  if (fl->dc1394_feature_ids==NULL) {
+    return 0;
+  }
+  for (i=0; i<n; i++) {
+    if (!_dc1394_cache_next(&pos,&(v[0]))) {
+      return 0;
+    }
+    fl->dc1394_feature_ids[i] = (int)v[0];
+    fl->num_features++;
+  }
+
+  if (!_dc1394_cache_next(&pos,&n) || (n<1) || (n>4096)) {
+    return 0;
+  }
+  if (!_dc1394_cache_next(&pos,&(v[0]))) {
+    return 0;
+  }
+  if (!_dc1394_alloc_triggers(device_number,(int)n)) {
+    return 0;
+  }
+  tl->trigger_polarity_changeable = (uint8_t)v[0];
+  for (i=0; i<n; i++) {
+    for (j=0; j<4; j++) {
+      if (!_dc1394_cache_next(&pos,&(v[j]))) {
+        return 0;
+      }
+    }
+    tl->is_internal_freerunning[i] = (uint8_t)v[0];
+    tl->mode[i] = (dc1394trigger_mode_t)v[1];
+    tl->polarity[i] = (dc1394trigger_polarity_t)v[2];
+    tl->source[i] = (dc1394trigger_source_t)v[3];
+  }
+  return 1;
+}
+
+/* Take the capabilities of a camera from the cache, if it has them. */
+static void _dc1394_cache_lookup(int device_number) {
+  char key[256];
+  size_t keylen;
+  int i;
+
+  _dc1394_cache_format_key(device_number,key,sizeof(key));
+  keylen = strlen(key);
+  for (i=0; i<num_cache_lines; i++) {
+    if (strncmp(cache_lines[i],key,keylen) || (cache_lines[i][keylen]!=' ')) {
+      continue;
+    }
+    if (_dc1394_cache_parse(device_number,cache_lines[i]+keylen)) {
+      caps_loaded_by_device_number[device_number] = 1;
+      CAM_IFACE_LOG(CAM_IFACE_LOG_DC1394,CAM_IFACE_LOG_DEBUG,
+                    "capabilities of camera %d taken from the cache",device_number);
+    } else {
+      _dc1394_free_caps(device_number);
+    }
+    return;
+  }
+}
+
+static void _dc1394_cache_write_caps(FILE *f, int device_number) {
+  cam_iface_dc1394_modes_t *modes = &(modes_by_device_number[device_number]);
+  cam_iface_dc1394_feature_list_t *fl = &(features_by_device_number[device_number]);
+  cam_iface_dc1394_trigger_list_t *tl = &(trigger_list_by_device_number[device_number]);
+  char key[256];
+  int i;
+
+  _dc1394_cache_format_key(device_number,key,sizeof(key));
+  fprintf(f,"%s %d",key,modes->num_modes);
+  for (i=0; i<modes->num_modes; i++) {
+    fprintf(f," %d %d %d",(int)modes->modes[i].video_mode,
+            (int)modes->modes[i].framerate,(int)modes->modes[i].color_coding);
+  }
+  fprintf(f," %d",fl->num_features);
+  for (i=0; i<fl->num_features; i++) {
+    fprintf(f," %d",fl->dc1394_feature_ids[i]);
+  }
+  fprintf(f," %d %d",tl->num_trigger_modes,(int)tl->trigger_polarity_changeable);
+  for (i=0; i<tl->num_trigger_modes; i++) {
+    fprintf(f," %d %d %d %d",(int)tl->is_internal_freerunning[i],(int)tl->mode[i],
+            (int)tl->polarity[i],(int)tl->source[i]);
+  }
+  fprintf(f,"\n");
+}
+
+/* Rewrite the cache with the entry of device_number, keeping the
+   entries of all other cameras as currently on disk. The file is
+   replaced atomically, so concurrent startups read either version. */
+static void _dc1394_cache_save(int device_number) {
+  char filename[1024], tmpname[1100], key[256];
+  const char *fname;
+  char *slash;
+  size_t keylen, len = 0;
+  ssize_t n;
+  char *line = NULL;
+  FILE *f, *old;
+
+  fname = _dc1394_cache_filename(filename,sizeof(filename));
+  if (fname==NULL) {
+    return;
+  }
+  /* create the cache directory (e.g. ~/.cache), which may exist */
+  snprintf(tmpname,sizeof(tmpname),"%s",fname);
+  slash = strrchr(tmpname,'/');
+  if ((slash!=NULL) && (slash!=tmpname)) {
+    *slash = '\0';
+    mkdir(tmpname,0755);
+  }
+  snprintf(tmpname,sizeof(tmpname),"%s.%d",fname,(int)getpid());
+  f = fopen(tmpname,"w");
+  if (f==NULL) {
+    CAM_IFACE_LOG(CAM_IFACE_LOG_DC1394,CAM_IFACE_LOG_INFO,
+                  "cannot write capability cache %s",tmpname);
+    return;
+  }
+  fprintf(f,"%s\n",DC1394_CACHE_HEADER);
+
+  _dc1394_cache_format_key(device_number,key,sizeof(key));
+  keylen = strcspn(key," "); /* the guid */
+  old = fopen(fname,"r");
+  if (old!=NULL) {
+    n = getline(&line,&len,old);
+    if ((n>0) && !strncmp(line,DC1394_CACHE_HEADER,strlen(DC1394_CACHE_HEADER))) {
+      while ((n = getline(&line,&len,old)) > 0) {
+        if (strncmp(line,key,keylen) || (line[keylen]!=' ')) {
+          fputs(line,f);
+        }
+      }
+    }
+    free(line);
+    fclose(old);
+  }
+
+  _dc1394_cache_write_caps(f,device_number);
+  if ((fclose(f)!=0) || (rename(tmpname,fname)!=0)) {
+    unlink(tmpname);
+  }
+}
+
+/* Make sure the capabilities of a camera are known. Errors are left in
+   the backend error state. */
+static void _dc1394_ensure_caps(int device_number) {
+  if (!cameras[device_number] || caps_loaded_by_device_number[device_number]) {
+    return;
+  }
+  _dc1394_query_caps(device_number);
+  if (caps_loaded_by_device_number[device_number]) {
+    _dc1394_cache_save(device_number);
+  }
+}
+
+void BACKEND_METHOD(cam_iface_startup)() {
+  int device_number;
   dc1394camera_list_t * list;
 
+  cam_iface_log_init();
+
   libdc1394_instance = dc1394_new ();
 
   if (!libdc1394_instance) {
@@ -560,27 +1025,34 @@ void BACKEND_METHOD(cam_iface_startup)() {
     return;
   }
 
-  modes_by_device_number = malloc( num_cameras*sizeof(cam_iface_dc1394_modes_t));
+  modes_by_device_number = calloc( num_cameras, sizeof(cam_iface_dc1394_modes_t));
   if (modes_by_device_number == NULL) {
     BACKEND_GLOBAL(cam_iface_error) = -1;
     CAM_IFACE_ERROR_FORMAT("error allocating memory");
     return;
   }
 
-  features_by_device_number = malloc( num_cameras*sizeof(cam_iface_dc1394_feature_list_t));
+  features_by_device_number = calloc( num_cameras, sizeof(cam_iface_dc1394_feature_list_t));
   if (features_by_device_number == NULL) {
     BACKEND_GLOBAL(cam_iface_error) = -1;
     CAM_IFACE_ERROR_FORMAT("error allocating memory");
     return;
   }
 
-  trigger_list_by_device_number = malloc( num_cameras*sizeof(cam_iface_dc1394_trigger_list_t));
+  trigger_list_by_device_number = calloc( num_cameras, sizeof(cam_iface_dc1394_trigger_list_t));
   if (trigger_list_by_device_number == NULL) {
     BACKEND_GLOBAL(cam_iface_error) = -1;
     CAM_IFACE_ERROR_FORMAT("error allocating memory");
     return;
   }
 
+  caps_loaded_by_device_number = calloc( num_cameras, sizeof(int));
+  if (caps_loaded_by_device_number == NULL) {
+    BACKEND_GLOBAL(cam_iface_error) = -1;
+    CAM_IFACE_ERROR_FORMAT("error allocating memory");
+    return;
+  }
+
   // initialize cameras
   for (device_number=0;device_number<num_cameras;device_number++) {
     cameras[device_number] = dc1394_camera_new( libdc1394_instance, list->ids[device_number].guid );
@@ -593,202 +1065,36 @@ void BACKEND_METHOD(cam_iface_startup)() {
     */
   }
 
-  // initialize new structures
-  for (device_number=0;device_number<num_cameras;device_number++) {
-    modes_by_device_number[device_number].num_modes = 0;
-    modes_by_device_number[device_number].modes = NULL;
-    features_by_device_number[device_number].num_features = 0;
-    features_by_device_number[device_number].dc1394_feature_ids = NULL;
-  }
-
   dc1394_camera_free_list (list);
 
-  // fill new structures
+  // capabilities are taken from the cache or queried on first use
+  _dc1394_cache_load();
   for (device_number=0;device_number<num_cameras;device_number++) {
-    if (!cameras[device_number]) {
-      // camera not available -- skip
-      continue;
-    }
-
-    // features: pass 1 count num available
-    CIDC1394CHK(dc1394_feature_get_all(cameras[device_number], &features));
-    for (i=0; i<DC1394_FEATURE_NUM; i++) {
-      feature_info = &(features.feature[i]);
-
-      if (_available_feature_filter( cameras[device_number], feature_info->id, feature_info->available)) {
-        features_by_device_number[device_number].num_features++;
-      }
-
-      if (feature_info->id == DC1394_FEATURE_TRIGGER) {
-        trig_count = 1;
-
-        trigger_list_by_device_number[device_number].trigger_polarity_changeable = feature_info->polarity_capable;
-        if (feature_info->polarity_capable) {
-          num_polarities = 2;
-        } else {
-          num_polarities = 1;
-        }
-        trig_count += num_polarities*(feature_info->trigger_modes.num)*(feature_info->trigger_sources.num);
-
-        trigger_list_by_device_number[device_number].num_trigger_modes = trig_count;
-        trigger_list_by_device_number[device_number].is_internal_freerunning = malloc(trig_count*sizeof(uint8_t));
-        trigger_list_by_device_number[device_number].mode = malloc(trig_count*sizeof(dc1394trigger_mode_t));
-        trigger_list_by_device_number[device_number].polarity = malloc(trig_count*sizeof(dc1394trigger_polarity_t));
-        trigger_list_by_device_number[device_number].source = malloc(trig_count*sizeof(dc1394trigger_source_t));
-        // XXX TODO: check for memory error
-
-        // internal, freerunning
-        trigger_list_by_device_number[device_number].is_internal_freerunning[0] = 1;
-
-        trig_count = 1;
-        for (kk=0; kk<num_polarities; kk++) {
-          for (j=0; j<(feature_info->trigger_modes.num); j++) {
-            for (k=0; k<(feature_info->trigger_sources.num); k++) {
-              trigger_list_by_device_number[device_number].is_internal_freerunning[trig_count] = 0;
-              trigger_list_by_device_number[device_number].mode[trig_count] = feature_info->trigger_modes.modes[j];
-              if (kk==0) {
-                trigger_list_by_device_number[device_number].polarity[trig_count] = DC1394_TRIGGER_ACTIVE_HIGH;
-              } else {
-                trigger_list_by_device_number[device_number].polarity[trig_count] = DC1394_TRIGGER_ACTIVE_LOW;
-              }
-              trigger_list_by_device_number[device_number].source[trig_count] = feature_info->trigger_sources.sources[k];
-              trig_count++;
-            }
-          }
-        }
-      }
-
-    }
-
-    // modes:
-    CIDC1394CHK(dc1394_video_get_supported_modes(cameras[device_number],
-                                                 &video_modes));
-
-    // enumerate total number of modes ("mode" = dc1394 mode + dc1394 framerate)
-    for (i=video_modes.num-1;i>=0;i--) {
-      // framerates don't work for format 7
-      //fprintf(stderr,"mode: %s ",get_dc1394_mode_string(video_modes.modes[i]));
-      if (cam_iface_is_video_mode_scalable(video_modes.modes[i])) {
-        // format7
-        //dc1394_format7_get_mode_info(cameras[device_number], video_modes.modes[i],&sf7mode);
-        //fprint_dc1394format7mode_t(stderr,&sf7mode);
-        CIDC1394CHK(dc1394_format7_get_color_codings(cameras[device_number],
-                                                     video_modes.modes[i],
-                                                     &color_codings));
-        for (j=0;j<color_codings.num;j++) {
-          modes_by_device_number[device_number].num_modes++; // a single mode entry
-        }
-      } else {
-        CIDC1394CHK(dc1394_video_get_supported_framerates(cameras[device_number],
-                                                          video_modes.modes[i],
-                                                          &framerates));
-        for (j=framerates.num-1;j>=0;j--) {
-          modes_by_device_number[device_number].num_modes++;
-          //fprintf(stderr,"non-format7: num_modes++\n");
-        }
-      }
-    }
-
-    // features: pass 2 - allocate memory
-    features_by_device_number[device_number].dc1394_feature_ids = malloc(features_by_device_number[device_number].num_features *sizeof(int));
-    if (features_by_device_number[device_number].dc1394_feature_ids==NULL) {
-      BACKEND_GLOBAL(cam_iface_error) = -1;
-      CAM_IFACE_ERROR_FORMAT("error allocating memory");
-      return;
-    }
-    feature_number = 0;
-    for (i=0; i<DC1394_FEATURE_NUM; i++) {
-      feature_info = &(features.feature[i]);
-      if (_available_feature_filter( cameras[device_number], feature_info->id, feature_info->available)) {
-        features_by_device_number[device_number].dc1394_feature_ids[feature_number] = feature_info->id;
-        feature_number++;
-      }
-    }
-
-    // modes:
-
-    // allocate memory for each device to store possible modes
-    modes_by_device_number[device_number].modes = malloc(modes_by_device_number[device_number].num_modes * sizeof(cam_iface_dc1394_mode_t));
-    if (modes_by_device_number[device_number].modes==NULL) {
-      BACKEND_GLOBAL(cam_iface_error) = -1;
-      CAM_IFACE_ERROR_FORMAT("error allocating memory");
-      return;
-    }
-
-    // now fill mode list
-    current_mode = 0;
-    // enumerate total number of modes ("mode" = dc1394 mode + dc1394 framerate)
-    for (i=video_modes.num-1;i>=0;i--) {
-      if (cam_iface_is_video_mode_scalable(video_modes.modes[i])) {
-        // format7
-        CIDC1394CHK(dc1394_format7_get_color_codings(cameras[device_number],
-                                                     video_modes.modes[i],
-                                                     &color_codings));
-        for (j=0;j<color_codings.num;j++) {
-          modes_by_device_number[device_number].modes[current_mode].video_mode = video_modes.modes[i];
-          modes_by_device_number[device_number].modes[current_mode].framerate = -1; // format7 - no framerate
-          modes_by_device_number[device_number].modes[current_mode].color_coding = color_codings.codings[j];
-          current_mode++;
-        }
-      } else {
-        CIDC1394CHK(dc1394_video_get_supported_framerates(cameras[device_number],
-                                                          video_modes.modes[i],
-                                                          &framerates));
-        for (j=framerates.num-1;j>=0;j--) {
-          modes_by_device_number[device_number].modes[current_mode].video_mode = video_modes.modes[i];
-          modes_by_device_number[device_number].modes[current_mode].framerate = framerates.framerates[j];
-          CIDC1394CHK(dc1394_get_color_coding_from_video_mode(cameras[device_number],
-                                                              video_modes.modes[i],
-                                                              &(modes_by_device_number[device_number].modes[current_mode].color_coding)));
-          current_mode++;
-        }
-      }
+    if (cameras[device_number]) {
+      _dc1394_cache_lookup(device_number);
     }
-
   }
+  _dc1394_cache_free();
 }
 
 void BACKEND_METHOD(cam_iface_shutdown)() {
   int device_number;
 
   for (device_number=0;device_number<num_cameras;device_number++) {
-    if (modes_by_device_number!=NULL) {
-      if (modes_by_device_number[device_number].modes!=NULL) {
-        free(modes_by_device_number[device_number].modes);
-      }
-    }
-    if (features_by_device_number!=NULL) {
-      if (features_by_device_number[device_number].dc1394_feature_ids!=NULL) {
-        free(features_by_device_number[device_number].dc1394_feature_ids);
-      }
-    }
-    if (trigger_list_by_device_number!=NULL) {
-      if (trigger_list_by_device_number[device_number].is_internal_freerunning!=NULL) {
-        free(trigger_list_by_device_number[device_number].is_internal_freerunning);
-      }
-      if (trigger_list_by_device_number[device_number].mode!=NULL) {
-        free(trigger_list_by_device_number[device_number].mode);
-      }
-      if (trigger_list_by_device_number[device_number].polarity!=NULL) {
-        free(trigger_list_by_device_number[device_number].polarity);
-      }
-      if (trigger_list_by_device_number[device_number].source!=NULL) {
-        free(trigger_list_by_device_number[device_number].source);
-      }
+    if ((modes_by_device_number!=NULL) && (features_by_device_number!=NULL) &&
+        (trigger_list_by_device_number!=NULL) && (caps_loaded_by_device_number!=NULL)) {
+      _dc1394_free_caps(device_number);
     }
   }
 
-  if (modes_by_device_number!=NULL) {
-    free(modes_by_device_number);
-  }
-
-  if (features_by_device_number!=NULL) {
-    free(features_by_device_number);
-  }
-
-  if (trigger_list_by_device_number!=NULL) {
-    free(trigger_list_by_device_number);
-  }
+  free(modes_by_device_number);
+  modes_by_device_number = NULL;
+  free(features_by_device_number);
+  features_by_device_number = NULL;
+  free(trigger_list_by_device_number);
+  trigger_list_by_device_number = NULL;
+  free(caps_loaded_by_device_number);
+  caps_loaded_by_device_number = NULL;
 
   for (device_number=0;device_number<num_cameras;device_number++) {
     if (cameras[device_number]) {
@@ -832,6 +1138,10 @@ void BACKEND_METHOD(cam_iface_get_camera_info)(int device_number, Camwire_id *ou
 
 void BACKEND_METHOD(cam_iface_get_num_modes)(int device_number, int *num_modes) {
   CAM_IFACE_CHECK_DEVICE_NUMBER(device_number);
+  _dc1394_ensure_caps(device_number);
+  if (BACKEND_GLOBAL(cam_iface_error)) {
+    return;
+  }
   *num_modes = modes_by_device_number[device_number].num_modes;
 }
 
@@ -891,6 +1201,10 @@ void BACKEND_METHOD(cam_iface_get_mode_string)(int device_number,
   uint32_t h_size,v_size;
 
   CAM_IFACE_CHECK_DEVICE_NUMBER(device_number);
+  _dc1394_ensure_caps(device_number);
+  if (BACKEND_GLOBAL(cam_iface_error)) {
+    return;
+  }
   if ((mode_number<0)|
       (mode_number>=modes_by_device_number[device_number].num_modes)) {
     BACKEND_GLOBAL(cam_iface_error) = -1;
@@ -978,6 +1292,13 @@ void delete_CCdc1394( CCdc1394 *this ) {
   this = NULL;
 }
 
+// Always leave at least one DMA buffer to the driver so the camera
+// can keep streaming while the caller holds pointed frames. With a
+// single DMA buffer nothing can be pointed to.
+static int _CCdc1394_max_pointed( int num_dma_buffers ) {
+  return num_dma_buffers-1;
+}
+
 void CCdc1394_CCdc1394( CCdc1394 *this,
                         int device_number, int NumImageBuffers,
                         int mode_number, const char *interface) {
@@ -1009,6 +1330,10 @@ void CCdc1394_CCdc1394( CCdc1394 *this,
     CAM_IFACE_ERROR_FORMAT("requested invalid camera number");
     return;
   }
+  _dc1394_ensure_caps(device_number);
+  if (BACKEND_GLOBAL(cam_iface_error)) {
+    return;
+  }
   if ((mode_number<0)|
       (mode_number>=modes_by_device_number[device_number].num_modes)) {
     BACKEND_GLOBAL(cam_iface_error) = -1;
@@ -1029,6 +1354,11 @@ void CCdc1394_CCdc1394( CCdc1394 *this,
   }
   this->cam_iface_mode_number = mode_number; // different than DC1934 mode number
   this->nframe_hack=0;
+  this->roi_framenumber=0;
+  this->pointed_frames = NULL;
+  this->pointed_head = 0;
+  this->num_pointed = 0;
+  this->max_pointed = 0;
   this->fileno = INVALID_FILENO;
   this->nfds = 0;
   FD_ZERO(&(this->fdset));
@@ -1090,6 +1420,7 @@ void CCdc1394_CCdc1394( CCdc1394 *this,
   this->bayer[4]='\0';
 
   this->auto_debayer = 0;
+  this->restart_on_roi_move = (getenv("DC1394_BACKEND_RESTART_ON_ROI_MOVE")!=NULL);
 
   switch (coding) {
   case DC1394_COLOR_CODING_MONO8:
@@ -1114,6 +1445,7 @@ void CCdc1394_CCdc1394( CCdc1394 *this,
     if (this->inherited.coding!=CAM_IFACE_MONO8) {
       if (getenv("DC1394_BACKEND_AUTO_DEBAYER")!=NULL) {
         if (strcmp(getenv("DC1394_BACKEND_AUTO_DEBAYER"),"0")) {
+          this->bayer_coding=this->inherited.coding;
           this->inherited.coding=CAM_IFACE_RGB8;
           this->inherited.depth = 24;
           this->auto_debayer = 1;
@@ -1179,6 +1511,14 @@ void CCdc1394_CCdc1394( CCdc1394 *this,
   this->num_dma_buffers=NumImageBuffers;
   this->buffer_size=(this->roi_width)*(this->roi_height)*this->inherited.depth/8;
 
+  this->max_pointed = _CCdc1394_max_pointed(this->num_dma_buffers);
+  this->pointed_frames = malloc(this->num_dma_buffers*sizeof(dc1394video_frame_t*));
+  if (this->pointed_frames==NULL) {
+    BACKEND_GLOBAL(cam_iface_error) = -1;
+    CAM_IFACE_ERROR_FORMAT("error allocating memory");
+    return;
+  }
+
 #ifdef CAM_IFACE_DEBUG
   fprintf(stdout,"new cam context 1\n");
   fflush(stdout);
@@ -1200,6 +1540,13 @@ void CCdc1394_close(CCdc1394 *this) {
   if (this->capture_is_set>0) {
     CIDC1394CHK(dc1394_capture_stop(camera));
   }
+  this->capture_is_set=0;
+  this->num_pointed=0;
+
+  if (this->pointed_frames!=NULL) {
+    free(this->pointed_frames);
+    this->pointed_frames=NULL;
+  }
 }
 
 void CCdc1394_start_camera( CCdc1394 *this ) {
@@ -1223,6 +1570,9 @@ void CCdc1394_start_camera( CCdc1394 *this ) {
     // Stop the camera if it's already started. (XXX Should check if
     // capture parameters are OK, and only restart if they're not.)
     CCdc1394_stop_camera(this);
+    if (BACKEND_GLOBAL(cam_iface_error)) {
+      return;
+    }
   }
   err = dc1394_capture_setup(camera,
                              this->num_dma_buffers,
@@ -1230,10 +1580,7 @@ void CCdc1394_start_camera( CCdc1394 *this ) {
 
   if (err==DC1394_IOCTL_FAILURE) {
     BACKEND_GLOBAL(cam_iface_error) = -1;
-    snprintf(BACKEND_GLOBAL(cam_iface_error_string),CAM_IFACE_MAX_ERROR_LEN,            \
-             "%s (%d): libdc1394 err %d: %s. (Did you request too many DMA buffers?)\n",__FILE__,__LINE__, \
-             err,                                                       \
-             dc1394_error_get_string(err));
+    CAM_IFACE_DC1394_ERROR_FORMAT(err,". (Did you request too many DMA buffers?)");
     return;
   }
 
@@ -1261,6 +1608,14 @@ void CCdc1394_stop_camera( CCdc1394 *this ) {
   CHECK_CC(this);
   camera = cameras[this->inherited.device_number];
 
+  // dc1394_capture_stop() releases the DMA ring, which would leave the
+  // caller with dangling pointers.
+  if (this->num_pointed > 0) {
+    BACKEND_GLOBAL(cam_iface_error) = -1;
+    CAM_IFACE_ERROR_FORMAT("cannot stop camera while frames are pointed to");
+    return;
+  }
+
   if ((this->fileno) != INVALID_FILENO) {
     FD_CLR(this->fileno, &(this->fdset));
 
@@ -1275,6 +1630,7 @@ void CCdc1394_stop_camera( CCdc1394 *this ) {
     CIDC1394CHK(dc1394_capture_stop(camera));
   }
   this->capture_is_set=0;
+  this->pointed_head=0;
 
 #ifdef CAM_IFACE_DEBUG
   fprintf(stdout,"stop_camera 1\n");
@@ -1520,26 +1876,27 @@ void CCdc1394_set_camera_property(CCdc1394 *this,
   CIDC1394CHK(dc1394_feature_set_mode(camera, feature_id, this_mode));
 }
 
-void CCdc1394_grab_next_frame_blocking_with_stride( CCdc1394 *this,
-                                                    unsigned char *out_bytes,
-                                                    intptr_t stride0, float timeout) {
+/* Wait up to timeout seconds for the next frame and dequeue it from
+   the DMA ring. On success *frame_out is the dequeued frame, which the
+   caller must hand back with dc1394_capture_enqueue(). On error,
+   *frame_out is NULL and the error is set. */
+static void _CCdc1394_dequeue_frame( CCdc1394 *this, float timeout,
+                                     dc1394video_frame_t **frame_out ) {
   dc1394camera_t *camera;
-  dc1394video_frame_t *orig_frame, *frame, *converted_frame;
-  int row, depth, wb;
-  uint32_t w,h;
-#ifdef CAM_IFACE_DC1394_SLOWDEBUG
-  uint32_t h_size,v_size;
-  int scalable;
-#endif
+  dc1394video_frame_t *frame;
   struct timeval tv;
   int retval;
   int errsv;
-  int is_frame_corrupt=0;
-  size_t malloc_size;
 
-  CHECK_CC(this);
+  *frame_out = NULL;
   camera = cameras[this->inherited.device_number];
 
+  if (!this->capture_is_set) {
+    BACKEND_GLOBAL(cam_iface_error) = -1;
+    CAM_IFACE_ERROR_FORMAT("camera not started");
+    return;
+  }
+
   // wait on our fileno
   FD_SET(this->fileno, &(this->fdset));
 
@@ -1584,6 +1941,25 @@ void CCdc1394_grab_next_frame_blocking_with_stride( CCdc1394 *this,
     return;
   }
 
+  *frame_out = frame;
+}
+
+/* Copy a dequeued frame into out_bytes and hand it back to the DMA
+   ring. */
+static void _CCdc1394_copy_frame( CCdc1394 *this, dc1394video_frame_t *frame,
+                                  unsigned char *out_bytes, intptr_t stride0 ) {
+  dc1394camera_t *camera;
+  int row, depth, wb;
+  CameraPixelCoding bayer_coding;
+  uint32_t w,h;
+#ifdef CAM_IFACE_DC1394_SLOWDEBUG
+  uint32_t h_size,v_size;
+  int scalable;
+#endif
+  int is_frame_corrupt=0;
+
+  camera = cameras[this->inherited.device_number];
+
   if (dc1394_capture_is_frame_corrupt(camera,frame)==DC1394_TRUE) {
     is_frame_corrupt = 1;
   }
@@ -1594,33 +1970,6 @@ void CCdc1394_grab_next_frame_blocking_with_stride( CCdc1394 *this,
   h = frame->size[1];
   depth=this->inherited.depth;
 
-  orig_frame = frame;
-  if (this->auto_debayer) {
-    /* remove Bayer image mosaic and convert to RGB8 using libdc1394 */
-    converted_frame = (dc1394video_frame_t*)malloc(sizeof(dc1394video_frame_t));
-    if (converted_frame==NULL) {
-      BACKEND_GLOBAL(cam_iface_error) = CAM_IFACE_GENERIC_ERROR;
-      CAM_IFACE_ERROR_FORMAT("malloc() failed");
-      return;
-    }
-    bzero(converted_frame,sizeof(dc1394video_frame_t));
-    malloc_size = frame->size[0]*frame->size[1]*3;
-    converted_frame->image = (unsigned char*)malloc(malloc_size);
-    if (converted_frame->image==NULL) {
-      BACKEND_GLOBAL(cam_iface_error) = CAM_IFACE_GENERIC_ERROR;
-      CAM_IFACE_ERROR_FORMAT("malloc() failed");
-      return;
-    }
-    converted_frame->allocated_image_bytes = malloc_size;
-
-    CIDC1394CHK(dc1394_debayer_frames(frame,converted_frame, // comes back rgb8
-                                      DC1394_BAYER_METHOD_HQLINEAR));
-    if (converted_frame->stride==0) {
-      converted_frame->stride=stride0; /* workaround libdc1394 bug in convertion */
-    }
-    frame = converted_frame;
-  }
-
 #ifdef CAM_IFACE_DC1394_SLOWDEBUG
   if (!_get_size_for_video_mode(this->inherited.device_number,
                                 camera->video_mode,&h_size,&v_size,&scalable)){
@@ -1661,19 +2010,37 @@ void CCdc1394_grab_next_frame_blocking_with_stride( CCdc1394 *this,
     return;
   }
 
-  for (row=0;row<h;row++) {
-    memcpy((void*)(out_bytes+row*stride0), /*dest*/
-           (const void*)(frame->image + row*(frame->stride)),/*src*/
-           wb);/*size*/
+  if (this->auto_debayer) {
+    /* remove Bayer image mosaic straight into the caller's buffer */
+    bayer_coding = this->bayer_coding;
+    if (bayer_coding==CAM_IFACE_RAW8) {
+      switch (frame->color_filter) {
+      case DC1394_COLOR_FILTER_RGGB: bayer_coding=CAM_IFACE_MONO8_BAYER_RGGB; break;
+      case DC1394_COLOR_FILTER_GBRG: bayer_coding=CAM_IFACE_MONO8_BAYER_GBRG; break;
+      case DC1394_COLOR_FILTER_GRBG: bayer_coding=CAM_IFACE_MONO8_BAYER_GRBG; break;
+      case DC1394_COLOR_FILTER_BGGR: bayer_coding=CAM_IFACE_MONO8_BAYER_BGGR; break;
+      default: break;
+      }
+    }
+    if (cam_iface_demosaic(bayer_coding, CAM_IFACE_DEMOSAIC_HQLINEAR,
+                           frame->image, frame->stride, (int)w, (int)h,
+                           out_bytes, stride0)) {
+      dc1394_capture_enqueue(camera, frame);
+      BACKEND_GLOBAL(cam_iface_error) = CAM_IFACE_GENERIC_ERROR;
+      CAM_IFACE_ERROR_FORMAT("could not demosaic frame");
+      return;
+    }
+  } else {
+    for (row=0;row<h;row++) {
+      memcpy((void*)(out_bytes+row*stride0), /*dest*/
+             (const void*)(frame->image + row*(frame->stride)),/*src*/
+             wb);/*size*/
+    }
   }
 
   this->last_timestamp=frame->timestamp; // get timestamp
 
-  if (this->auto_debayer) {
-    free(converted_frame->image);
-    free(converted_frame);
-  }
-  CIDC1394CHK(dc1394_capture_enqueue (camera, orig_frame));
+  CIDC1394CHK(dc1394_capture_enqueue (camera, frame));
 
   if (is_frame_corrupt) {
     BACKEND_GLOBAL(cam_iface_error) = CAM_IFACE_FRAME_DATA_CORRUPT_ERROR;
@@ -1683,20 +2050,152 @@ void CCdc1394_grab_next_frame_blocking_with_stride( CCdc1394 *this,
 
 }
 
+void CCdc1394_grab_next_frame_blocking_with_stride( CCdc1394 *this,
+                                                    unsigned char *out_bytes,
+                                                    intptr_t stride0, float timeout) {
+  dc1394video_frame_t *frame;
+
+  CHECK_CC(this);
+
+  _CCdc1394_dequeue_frame(this, timeout, &frame);
+  if (frame==NULL) {
+    return;
+  }
+  _CCdc1394_copy_frame(this, frame, out_bytes, stride0);
+}
+
+/* Wait (using select()) only for the first min_frames frames. After
+   that, keep polling the DMA ring and copy whatever is already there. */
+void CCdc1394_grab_frames_batch( CCdc1394 *this,
+                                 unsigned char **out_bytes, intptr_t stride0,
+                                 double *timestamps, unsigned long *framenumbers,
+                                 int max_frames, int min_frames, int *num_frames,
+                                 float timeout) {
+  dc1394camera_t *camera;
+  dc1394video_frame_t *frame;
+  struct timeval start, now;
+  float remaining;
+
+  CHECK_CC(this);
+  camera = cameras[this->inherited.device_number];
+
+  *num_frames = 0;
+  gettimeofday(&start,NULL);
+  while (*num_frames < max_frames) {
+    if (*num_frames < min_frames) {
+      remaining = timeout;
+      if (timeout >= 0) {
+        gettimeofday(&now,NULL);
+        remaining = timeout - ((now.tv_sec-start.tv_sec) +
+                               (now.tv_usec-start.tv_usec)*1e-6);
+        if (remaining < 0) {
+          remaining = 0;
+        }
+      }
+      _CCdc1394_dequeue_frame(this, remaining, &frame);
+      if (frame==NULL) {
+        return;
+      }
+    } else {
+      if (!this->capture_is_set) {
+        return;
+      }
+      CIDC1394CHK(dc1394_capture_dequeue(camera, DC1394_CAPTURE_POLICY_POLL, &frame));
+      if (frame==NULL) {
+        return; /* no more frames waiting */
+      }
+    }
+
+    _CCdc1394_copy_frame(this, frame, out_bytes[*num_frames], stride0);
+    if (BACKEND_GLOBAL(cam_iface_error)) {
+      return;
+    }
+    if (timestamps!=NULL) {
+      CCdc1394_get_last_timestamp(this,&(timestamps[*num_frames]));
+    }
+    if (framenumbers!=NULL) {
+      framenumbers[*num_frames] = this->nframe_hack;
+    }
+    (*num_frames)++;
+  }
+}
+
 void CCdc1394_grab_next_frame_blocking( CCdc1394 *this, unsigned char *out_bytes, float timeout) {
   CHECK_CC(this);
   int stride0 = this->roi_width*(this->inherited.depth/8);
   CCdc1394_grab_next_frame_blocking_with_stride(this,out_bytes,stride0,timeout);
 }
 
+/* Lend the dequeued DMA buffer to the caller without copying. Up to
+   num_dma_buffers-1 frames may be held at once (one buffer is always
+   left to the driver); each call to unpoint_frame() re-enqueues the
+   oldest held frame. Requesting more frames than that fails with
+   CAM_IFACE_BUFFER_OVERFLOW_ERROR. On any error no frame is held. */
 void CCdc1394_point_next_frame_blocking( CCdc1394 *this, unsigned char **buf_ptr, float timeout) {
+  dc1394camera_t *camera;
+  dc1394video_frame_t *frame;
+  int idx;
+
   CHECK_CC(this);
-  NOT_IMPLEMENTED;
+  camera = cameras[this->inherited.device_number];
+
+  if (this->auto_debayer) {
+    BACKEND_GLOBAL(cam_iface_error) = CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+    CAM_IFACE_ERROR_FORMAT("cannot point to frames when DC1394_BACKEND_AUTO_DEBAYER is set");
+    return;
+  }
+
+  if (this->max_pointed < 1) {
+    BACKEND_GLOBAL(cam_iface_error) = CAM_IFACE_BUFFER_OVERFLOW_ERROR;
+    CAM_IFACE_ERROR_FORMAT("need at least two frame buffers to point to frames");
+    return;
+  }
+  if (this->num_pointed >= this->max_pointed) {
+    BACKEND_GLOBAL(cam_iface_error) = CAM_IFACE_BUFFER_OVERFLOW_ERROR;
+    CAM_IFACE_ERROR_FORMAT("too many frames pointed to (call unpoint_frame first)");
+    return;
+  }
+
+  _CCdc1394_dequeue_frame(this, timeout, &frame);
+  if (frame==NULL) {
+    return;
+  }
+
+  (this->nframe_hack)+=1;
+  this->last_timestamp=frame->timestamp; // get timestamp
+
+  if (dc1394_capture_is_frame_corrupt(camera,frame)==DC1394_TRUE) {
+    CIDC1394CHK(dc1394_capture_enqueue (camera, frame));
+    BACKEND_GLOBAL(cam_iface_error) = CAM_IFACE_FRAME_DATA_CORRUPT_ERROR;
+    CAM_IFACE_ERROR_FORMAT("frame data is corrupt");
+    return;
+  }
+
+  idx = (this->pointed_head + this->num_pointed) % this->max_pointed;
+  this->pointed_frames[idx] = frame;
+  this->num_pointed++;
+
+  *buf_ptr = frame->image;
 }
 
 void CCdc1394_unpoint_frame( CCdc1394 *this){
+  dc1394camera_t *camera;
+  dc1394video_frame_t *frame;
+
   CHECK_CC(this);
-  NOT_IMPLEMENTED;
+  camera = cameras[this->inherited.device_number];
+
+  if (this->num_pointed < 1) {
+    BACKEND_GLOBAL(cam_iface_error) = -1;
+    CAM_IFACE_ERROR_FORMAT("no frame pointed to");
+    return;
+  }
+
+  frame = this->pointed_frames[this->pointed_head];
+  this->pointed_head = (this->pointed_head + 1) % this->max_pointed;
+  this->num_pointed--;
+
+  CIDC1394CHK(dc1394_capture_enqueue (camera, frame));
 }
 
 void CCdc1394_get_last_timestamp( CCdc1394 *this, double* timestamp ) {
@@ -1847,6 +2346,37 @@ void CCdc1394_get_frame_roi( CCdc1394 *this,
 
 }
 
+/* Move the ROI of a capturing camera without stopping it. Only the
+   offset may change: the packet size depends on the image size alone,
+   so the DMA ring stays valid, and IIDC cameras apply a new
+   IMAGE_POSITION from the next frame on. Frames already in the ring,
+   at most the buffers not held by the caller, still have the old
+   offset. Returns 0 if the camera did not take the new position. */
+static int _CCdc1394_move_roi( CCdc1394 *this, dc1394camera_t *camera,
+                               dc1394video_mode_t video_mode,
+                               int left, int top ) {
+  uint32_t test_left, test_top;
+
+  if (dc1394_format7_set_image_position(camera, video_mode,
+                                        left, top)!=DC1394_SUCCESS) {
+    return 0;
+  }
+  if (dc1394_format7_get_image_position(camera, video_mode,
+                                        &test_left, &test_top)!=DC1394_SUCCESS) {
+    return 0;
+  }
+  if ((test_left!=(uint32_t)left) || (test_top!=(uint32_t)top)) {
+    return 0;
+  }
+  DPRINTF("moved roi to left: %d, top: %d\n",left,top);
+
+  this->roi_left = test_left;
+  this->roi_top = test_top;
+  this->roi_framenumber = this->nframe_hack +
+    (this->num_dma_buffers - this->num_pointed) + 1;
+  return 1;
+}
+
 void CCdc1394_set_frame_roi( CCdc1394 *this,
                              int left, int top, int width, int height ) {
   dc1394camera_t *camera;
@@ -1884,9 +2414,21 @@ void CCdc1394_set_frame_roi( CCdc1394 *this,
   left = left/h_unit_pos * h_unit_pos;
   top = top/v_unit_pos * v_unit_pos;
 
+  if ((this->capture_is_set>0) &&
+      (width==this->roi_width) && (height==this->roi_height) &&
+      !this->restart_on_roi_move) {
+    if (_CCdc1394_move_roi(this, camera, video_mode, left, top)) {
+      return;
+    }
+    DPRINTF("camera refused roi move while capturing, restarting\n");
+  }
+
   restart = 0;
   if (this->capture_is_set>0) {
     CCdc1394_stop_camera( this );
+    if (BACKEND_GLOBAL(cam_iface_error)) {
+      return; // frames are pointed to
+    }
     DPRINTF("stopped camera\n");
     restart = 1;
   }
@@ -1925,6 +2467,7 @@ void CCdc1394_set_frame_roi( CCdc1394 *this,
   this->roi_width = test_width;
   this->roi_height = test_height;
   this->buffer_size=(this->roi_width)*(this->roi_height)*this->inherited.depth/8;
+  this->roi_framenumber = this->nframe_hack + 1;
 
   if (restart) {
     DPRINTF("started camera\n");
@@ -2003,6 +2546,9 @@ void CCdc1394_set_framerate( CCdc1394 *this,
   if (cam_iface_is_video_mode_scalable(video_mode)) {
     if (this->capture_is_set>0) {
       CCdc1394_stop_camera( this );
+      if (BACKEND_GLOBAL(cam_iface_error)) {
+        return; // frames are pointed to
+      }
       restart = 1;
     }
     // Format 7
@@ -2068,8 +2614,80 @@ void CCdc1394_get_num_framebuffers( CCdc1394 *this,
   *num_framebuffers=this->num_dma_buffers;
 }
 
+/* The DMA ring is sized by dc1394_capture_setup(), so a running camera
+   is stopped and started again with the new count. If the kernel
+   refuses that many buffers the previous count is restored. */
 void CCdc1394_set_num_framebuffers( CCdc1394 *this,
                                     int num_framebuffers ) {
+  dc1394video_frame_t **pointed_frames;
+  int old_num, restart;
+
+  CHECK_CC(this);
+  if (num_framebuffers < 1) {
+    BACKEND_GLOBAL(cam_iface_error) = -1;
+    CAM_IFACE_ERROR_FORMAT("need at least one frame buffer");
+    return;
+  }
+  if (num_framebuffers==this->num_dma_buffers) {
+    return;
+  }
+  if (this->num_pointed > 0) {
+    BACKEND_GLOBAL(cam_iface_error) = -1;
+    CAM_IFACE_ERROR_FORMAT("cannot change the number of frame buffers while frames are pointed to");
+    return;
+  }
+
+  // big enough for the old count too, in case it is restored
+  old_num = this->num_dma_buffers;
+  pointed_frames = realloc(this->pointed_frames,
+                           ((num_framebuffers > old_num) ? num_framebuffers : old_num)*
+                           sizeof(dc1394video_frame_t*));
+  if (pointed_frames==NULL) {
+    BACKEND_GLOBAL(cam_iface_error) = -1;
+    CAM_IFACE_ERROR_FORMAT("error allocating memory");
+    return;
+  }
+  this->pointed_frames = pointed_frames;
+  this->pointed_head = 0;
+
+  restart = (this->capture_is_set>0);
+  if (restart) {
+    CCdc1394_stop_camera(this);
+    if (BACKEND_GLOBAL(cam_iface_error)) {
+      return;
+    }
+  }
+
+  this->num_dma_buffers = num_framebuffers;
+  this->max_pointed = _CCdc1394_max_pointed(num_framebuffers);
+  if (!restart) {
+    return;
+  }
+
+  CCdc1394_start_camera(this);
+  if (!BACKEND_GLOBAL(cam_iface_error)) {
+    return;
+  }
+
+  DPRINTF("could not set up %d DMA buffers, restoring %d\n",num_framebuffers,old_num);
+  BACKEND_GLOBAL(cam_iface_error) = 0;
+  this->num_dma_buffers = old_num;
+  this->max_pointed = _CCdc1394_max_pointed(old_num);
+  CCdc1394_start_camera(this);
+  if (!BACKEND_GLOBAL(cam_iface_error)) {
+    BACKEND_GLOBAL(cam_iface_error) = -1;
+    CAM_IFACE_ERROR_FORMAT("could not set up that many DMA buffers, kept the previous number");
+  }
+}
+
+void CCdc1394_get_frame_roi_framenumber( CCdc1394 *this,
+                                         unsigned long *framenumber ) {
+  CHECK_CC(this);
+  *framenumber = this->roi_framenumber;
+}
+
+void CCdc1394_get_wait_fd( CCdc1394 *this, int *fd ) {
   CHECK_CC(this);
-  NOT_IMPLEMENTED;
+  // the capture fileno polls readable while DMA frames are waiting
+  *fd = this->capture_is_set ? this->fileno : -1;
 }
@@ -0,0 +1,781 @@
+/*
+
+Copyright (c) 2004-2009, California Institute of Technology. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+/* FMF (fly movie format) recording and playback.
+
+   An FMF v3 file is a header followed by fixed-size chunks, one per
+   frame, each a little-endian double timestamp followed by the image
+   rows without padding:
+
+     uint32 version (3)
+     uint32 len_format
+     char   format[len_format]     e.g. "MONO8" or "MONO8:RGGB"
+     uint32 bpp
+     uint32 rows
+     uint32 cols
+     uint64 bytes_per_chunk
+     uint64 n_frames               0 while recording, patched on close
+
+   The writer keeps the file image in a ring buffer allocated when the
+   file is opened. cam_iface_fmf_writer_add_frame() only copies into the
+   ring, so the grab loop never waits for the disk. A writer thread
+   drains the ring with large writes at offsets and sizes aligned to
+   FMF_WRITER_ALIGN, which also satisfies O_DIRECT. The unaligned tail
+   is written on close. */
+
+#include "cam_iface.h"
+#include "cam_iface_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#endif
+
+#define FMF_WRITER_ALIGN 4096
+#define FMF_WRITER_MAX_WRITE (8*1024*1024)  /* largest single write */
+#define FMF_WRITER_MIN_WRITE (1024*1024)    /* write once this much is queued */
+#define FMF_WRITER_FLUSH_INTERVAL 0.25      /* otherwise write every ... (seconds) */
+
+/* FMF format string and bits per pixel of a pixel coding */
+static int _fmf_format_for_coding(CameraPixelCoding coding,
+                                  const char **format, int *bpp) {
+  switch (coding) {
+  case CAM_IFACE_MONO8:            *format = "MONO8";      *bpp = 8;  break;
+  case CAM_IFACE_RAW8:             *format = "RAW8";       *bpp = 8;  break;
+  case CAM_IFACE_MONO8_BAYER_BGGR: *format = "MONO8:BGGR"; *bpp = 8;  break;
+  case CAM_IFACE_MONO8_BAYER_RGGB: *format = "MONO8:RGGB"; *bpp = 8;  break;
+  case CAM_IFACE_MONO8_BAYER_GRBG: *format = "MONO8:GRBG"; *bpp = 8;  break;
+  case CAM_IFACE_MONO8_BAYER_GBRG: *format = "MONO8:GBRG"; *bpp = 8;  break;
+  case CAM_IFACE_YUV411:           *format = "YUV411";     *bpp = 12; break;
+  case CAM_IFACE_YUV422:           *format = "YUV422";     *bpp = 16; break;
+  case CAM_IFACE_YUV444:           *format = "YUV444";     *bpp = 24; break;
+  case CAM_IFACE_MONO16:           *format = "MONO16";     *bpp = 16; break;
+  case CAM_IFACE_RGB8:             *format = "RGB8";       *bpp = 24; break;
+  case CAM_IFACE_RGBA8:            *format = "RGBA8";      *bpp = 32; break;
+  default:
+    return -1;
+  }
+  return 0;
+}
+
+#ifndef _WIN32
+
+#pragma pack(push)
+#pragma pack(1)
+typedef struct {
+  uint32_t bpp;
+  uint32_t rows;
+  uint32_t cols;
+  uint64_t bytes_per_chunk;
+  uint64_t n_frames;
+} fmf_v3_header_part2;
+#pragma pack(pop)
+
+/* The ring holds bytes [tail,head) of the file. The caller only writes
+   head, the writer thread only writes tail. The mutex and condition
+   variable are only used to put the writer thread to sleep. */
+struct CamIfaceFmfWriter {
+  int fd;
+  int direct;                    /* fd was opened with O_DIRECT */
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  unsigned char *ring;
+  size_t ring_size;              /* multiple of FMF_WRITER_ALIGN */
+  size_t min_write;
+  uint64_t head;                 /* file bytes queued */
+  uint64_t tail;                 /* file bytes written */
+
+  size_t row_bytes;
+  int height;
+  size_t chunk_bytes;
+  size_t header_bytes;
+  off_t n_frames_offset;
+  int num_buffers;
+
+  unsigned long num_frames;
+  unsigned long num_dropped;
+  int buffers_high_water;
+  int quit;
+  int writer_waiting;
+  int write_errno;               /* first failed write, stops the writer */
+};
+
+/* Copy len bytes into the ring at file position pos. */
+static void _fmf_ring_put(CamIfaceFmfWriter *w, uint64_t pos,
+                          const void *src, size_t len) {
+  size_t off = (size_t)(pos % w->ring_size);
+  size_t n = w->ring_size - off;
+  if (n > len) {
+    n = len;
+  }
+  memcpy(w->ring+off,src,n);
+  if (n < len) {
+    memcpy(w->ring,(const unsigned char*)src+n,len-n);
+  }
+}
+
+/* Write ring bytes [tail,tail+len) to the file; len must not cross the
+   end of the ring. */
+static int _fmf_write(CamIfaceFmfWriter *w, uint64_t tail, size_t len) {
+  const unsigned char *p = w->ring + (size_t)(tail % w->ring_size);
+  ssize_t n;
+  while (len > 0) {
+    n = pwrite(w->fd,p,len,(off_t)tail);
+    if (n < 0) {
+      if (errno==EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    p += n;
+    tail += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/* Number of bytes to write next: as much as is queued up to the end of
+   the ring and FMF_WRITER_MAX_WRITE, rounded down to FMF_WRITER_ALIGN
+   unless final. */
+static size_t _fmf_next_write(CamIfaceFmfWriter *w, uint64_t head,
+                              uint64_t tail, int final) {
+  size_t len = (size_t)(head - tail);
+  size_t to_end = w->ring_size - (size_t)(tail % w->ring_size);
+  if (len > to_end) {
+    len = to_end;
+  }
+  if (len > FMF_WRITER_MAX_WRITE) {
+    len = FMF_WRITER_MAX_WRITE;
+  }
+  if (!final) {
+    len -= len % FMF_WRITER_ALIGN;
+  }
+  return len;
+}
+
+static void* _fmf_writer_thread_func(void *arg) {
+  CamIfaceFmfWriter *w = (CamIfaceFmfWriter*)arg;
+  uint64_t head, tail;
+  size_t len;
+  int quit, err, flush = 0;
+  struct timeval now;
+  struct timespec abstime;
+  double deadline;
+
+  while (1) {
+    quit = cam_iface_atomic_load(&(w->quit));
+    head = cam_iface_atomic_load(&(w->head));
+    tail = w->tail;
+    len = _fmf_next_write(w,head,tail,0);
+    if ((len > 0) && (flush || quit || (len >= w->min_write) ||
+                      (head-tail >= w->min_write))) {
+      err = _fmf_write(w,tail,len);
+      if (err) {
+        cam_iface_atomic_store(&(w->write_errno),err);
+        break;
+      }
+      cam_iface_atomic_store(&(w->tail),tail+len);
+      continue;
+    }
+    flush = 0;
+    if (quit) {
+      break;
+    }
+
+    /* sleep until more data is queued or the flush interval passes */
+    pthread_mutex_lock(&(w->lock));
+    cam_iface_atomic_store(&(w->writer_waiting),1);
+    cam_iface_atomic_fence();
+    if ((cam_iface_atomic_load(&(w->head)) == head) &&
+        !cam_iface_atomic_load(&(w->quit))) {
+      gettimeofday(&now,NULL);
+      deadline = now.tv_sec + now.tv_usec*1e-6 + FMF_WRITER_FLUSH_INTERVAL;
+      abstime.tv_sec = (time_t)deadline;
+      abstime.tv_nsec = (long)((deadline - abstime.tv_sec)*1e9);
+      if (pthread_cond_timedwait(&(w->cond),&(w->lock),&abstime)==ETIMEDOUT) {
+        flush = 1;
+      }
+    }
+    cam_iface_atomic_store(&(w->writer_waiting),0);
+    pthread_mutex_unlock(&(w->lock));
+  }
+  return NULL;
+}
+
+static void _fmf_writer_free(CamIfaceFmfWriter *w) {
+  if (w->fd >= 0) {
+    close(w->fd);
+  }
+  free(w->ring);
+  pthread_cond_destroy(&(w->cond));
+  pthread_mutex_destroy(&(w->lock));
+  free(w);
+}
+
+CAM_IFACE_API int cam_iface_fmf_writer_open( CamIfaceFmfWriter **writer,
+                                             const char *filename,
+                                             CameraPixelCoding coding,
+                                             int width,
+                                             int height,
+                                             int num_buffers,
+                                             int flags ) {
+  CamIfaceFmfWriter *w;
+  const char *format;
+  int bpp, open_flags;
+  uint32_t part1[2];
+  fmf_v3_header_part2 part2;
+  size_t ring_size;
+
+  if (writer==NULL) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  *writer = NULL;
+  if (_fmf_format_for_coding(coding,&format,&bpp)) {
+    return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+  }
+  if ((filename==NULL) || (width < 1) || (height < 1) || (num_buffers < 1) ||
+      (((size_t)width*bpp) % 8)) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+
+  w = (CamIfaceFmfWriter*)calloc(1,sizeof(CamIfaceFmfWriter));
+  if (w==NULL) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  w->fd = -1;
+  pthread_mutex_init(&(w->lock),NULL);
+  pthread_cond_init(&(w->cond),NULL);
+
+  w->row_bytes = (size_t)width*bpp/8;
+  w->height = height;
+  w->chunk_bytes = sizeof(double) + w->row_bytes*height;
+  w->header_bytes = sizeof(part1) + strlen(format) + sizeof(part2);
+  w->n_frames_offset = (off_t)(w->header_bytes - sizeof(uint64_t));
+  w->num_buffers = num_buffers;
+
+  /* room for num_buffers frames even with an unaligned remainder
+     still waiting to be written */
+  ring_size = w->header_bytes + (size_t)num_buffers*w->chunk_bytes + FMF_WRITER_ALIGN;
+  ring_size = (ring_size + FMF_WRITER_ALIGN - 1) / FMF_WRITER_ALIGN * FMF_WRITER_ALIGN;
+  w->ring_size = ring_size;
+  w->min_write = FMF_WRITER_MIN_WRITE;
+  if (w->min_write > ring_size/4) {
+    w->min_write = ring_size/4;
+  }
+  if (posix_memalign((void**)&(w->ring),FMF_WRITER_ALIGN,ring_size)) {
+    w->ring = NULL;
+    _fmf_writer_free(w);
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+
+  open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_CLOEXEC
+  open_flags |= O_CLOEXEC;
+#endif
+#ifdef O_DIRECT
+  if (flags & CAM_IFACE_FMF_WRITER_DIRECT) {
+    w->fd = open(filename,open_flags | O_DIRECT,0666);
+    if (w->fd >= 0) {
+      w->direct = 1;
+    } else if (errno != EINVAL) {
+      _fmf_writer_free(w);
+      return CAM_IFACE_GENERIC_ERROR;
+    }
+    /* EINVAL: the filesystem does not support O_DIRECT */
+  }
+#endif
+  if (w->fd < 0) {
+    w->fd = open(filename,open_flags,0666);
+  }
+  if (w->fd < 0) {
+    _fmf_writer_free(w);
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+
+  /* the header goes through the ring like everything else */
+  part1[0] = 3;
+  part1[1] = (uint32_t)strlen(format);
+  part2.bpp = bpp;
+  part2.rows = height;
+  part2.cols = width;
+  part2.bytes_per_chunk = w->chunk_bytes;
+  part2.n_frames = 0;
+  _fmf_ring_put(w,0,part1,sizeof(part1));
+  _fmf_ring_put(w,sizeof(part1),format,part1[1]);
+  _fmf_ring_put(w,sizeof(part1)+part1[1],&part2,sizeof(part2));
+  w->head = w->header_bytes;
+
+  if (pthread_create(&(w->thread),NULL,_fmf_writer_thread_func,w)) {
+    _fmf_writer_free(w);
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  *writer = w;
+  return 0;
+}
+
+CAM_IFACE_API int cam_iface_fmf_writer_add_frame( CamIfaceFmfWriter *w,
+                                                  const unsigned char *pixels,
+                                                  intptr_t stride,
+                                                  double timestamp ) {
+  uint64_t head, tail, pos, written;
+  long in_flight;
+  int row;
+
+  if ((w==NULL) || (pixels==NULL) || (stride < (intptr_t)w->row_bytes)) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  if (cam_iface_atomic_load(&(w->write_errno))) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+
+  head = w->head;
+  tail = cam_iface_atomic_load(&(w->tail));
+  if (head - tail + w->chunk_bytes > w->ring_size) {
+    cam_iface_atomic_store(&(w->num_dropped),w->num_dropped+1);
+    return CAM_IFACE_BUFFER_OVERFLOW_ERROR;
+  }
+
+  pos = head;
+  _fmf_ring_put(w,pos,&timestamp,sizeof(double));
+  pos += sizeof(double);
+  for (row=0; row<w->height; row++) {
+    _fmf_ring_put(w,pos,pixels+row*stride,w->row_bytes);
+    pos += w->row_bytes;
+  }
+  cam_iface_atomic_store(&(w->num_frames),w->num_frames+1);
+
+  /* frames not completely on disk yet, including this one */
+  written = (tail > w->header_bytes) ? (tail - w->header_bytes)/w->chunk_bytes : 0;
+  in_flight = (long)(w->num_frames - written);
+  if (in_flight > w->buffers_high_water) {
+    cam_iface_atomic_store(&(w->buffers_high_water),(int)in_flight);
+  }
+
+  cam_iface_atomic_store(&(w->head),pos);
+  cam_iface_atomic_fence();
+  if (cam_iface_atomic_load(&(w->writer_waiting)) &&
+      (pos - tail >= w->min_write)) {
+    pthread_mutex_lock(&(w->lock));
+    pthread_cond_signal(&(w->cond));
+    pthread_mutex_unlock(&(w->lock));
+  }
+  return 0;
+}
+
+CAM_IFACE_API int cam_iface_fmf_writer_get_stats( CamIfaceFmfWriter *w,
+                                                  CamIfaceFmfWriterStats *stats ) {
+  if ((w==NULL) || (stats==NULL)) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  stats->num_frames = cam_iface_atomic_load(&(w->num_frames));
+  stats->num_dropped = cam_iface_atomic_load(&(w->num_dropped));
+  stats->num_buffers = w->num_buffers;
+  stats->buffers_high_water = cam_iface_atomic_load(&(w->buffers_high_water));
+  stats->bytes_written = cam_iface_atomic_load(&(w->tail));
+  stats->write_errno = cam_iface_atomic_load(&(w->write_errno));
+  return 0;
+}
+
+CAM_IFACE_API int cam_iface_fmf_writer_close( CamIfaceFmfWriter *w,
+                                              CamIfaceFmfWriterStats *stats ) {
+  uint64_t n_frames, tail;
+  size_t len;
+  int err;
+
+  if (w==NULL) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+
+  pthread_mutex_lock(&(w->lock));
+  cam_iface_atomic_store(&(w->quit),1);
+  pthread_cond_signal(&(w->cond));
+  pthread_mutex_unlock(&(w->lock));
+  pthread_join(w->thread,NULL);
+
+  /* the writer thread left at most an unaligned remainder */
+  err = w->write_errno;
+#ifdef O_DIRECT
+  if (!err && w->direct) {
+    if (fcntl(w->fd,F_SETFL,fcntl(w->fd,F_GETFL) & ~O_DIRECT)) {
+      err = errno;
+    }
+  }
+#endif
+  tail = w->tail;
+  while (!err && (tail < w->head)) {
+    len = _fmf_next_write(w,w->head,tail,1);
+    err = _fmf_write(w,tail,len);
+    tail += len;
+  }
+  w->tail = tail;
+
+  if (!err) {
+    n_frames = w->num_frames;
+    if (pwrite(w->fd,&n_frames,sizeof(n_frames),w->n_frames_offset) != sizeof(n_frames)) {
+      err = errno;
+    }
+  }
+  if ((close(w->fd) != 0) && !err) {
+    err = errno;
+  }
+  w->fd = -1;
+  w->write_errno = err;
+
+  if (stats != NULL) {
+    cam_iface_fmf_writer_get_stats(w,stats);
+  }
+  _fmf_writer_free(w);
+  return err ? CAM_IFACE_GENERIC_ERROR : 0;
+}
+
+/* FMF reading. The whole file is mapped read-only; frame k starts at
+   data_offset + k*bytes_per_chunk, so frames are found in constant
+   time and handed out without copying. FMF v1 files (MONO8 only, no
+   format string) are read too. */
+
+#define FMF_READER_PREFETCH_BYTES (32*1024*1024)
+
+struct CamIfaceFmfReader {
+  int fd;
+  const unsigned char *map;
+  size_t map_size;
+  size_t data_offset;
+  size_t chunk_bytes;
+  long num_frames;
+  int sequential;
+  size_t prefetched_to;          /* end of the last MADV_WILLNEED range */
+  char format[64];
+  CamIfaceFmfInfo info;
+};
+
+static uint32_t _fmf_get_u32(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v,p,sizeof(v));
+  return v;
+}
+
+static uint64_t _fmf_get_u64(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v,p,sizeof(v));
+  return v;
+}
+
+static CameraPixelCoding _fmf_coding_for_format(const char *format) {
+  static const CameraPixelCoding codings[] = {
+    CAM_IFACE_MONO8, CAM_IFACE_RAW8,
+    CAM_IFACE_MONO8_BAYER_BGGR, CAM_IFACE_MONO8_BAYER_RGGB,
+    CAM_IFACE_MONO8_BAYER_GRBG, CAM_IFACE_MONO8_BAYER_GBRG,
+    CAM_IFACE_YUV411, CAM_IFACE_YUV422, CAM_IFACE_YUV444,
+    CAM_IFACE_MONO16, CAM_IFACE_RGB8, CAM_IFACE_RGBA8 };
+  const char *name;
+  int i, bpp;
+  for (i=0; i<(int)(sizeof(codings)/sizeof(codings[0])); i++) {
+    if (!_fmf_format_for_coding(codings[i],&name,&bpp) && !strcmp(name,format)) {
+      return codings[i];
+    }
+  }
+  return CAM_IFACE_UNKNOWN;
+}
+
+/* Parse the header of a mapped file. Returns 0 if it is valid. */
+static int _fmf_reader_parse(CamIfaceFmfReader *r) {
+  const unsigned char *p = r->map;
+  size_t size = r->map_size;
+  uint32_t version, len_format, rows, cols, bpp;
+  uint64_t bytes_per_chunk, n_frames, available;
+
+  if (size < 8) {
+    return -1;
+  }
+  version = _fmf_get_u32(p);
+  if (version == 1) {
+    /* version, rows, cols, bytes_per_chunk, n_frames */
+    if (size < 28) {
+      return -1;
+    }
+    strcpy(r->format,"MONO8");
+    bpp = 8;
+    rows = _fmf_get_u32(p+4);
+    cols = _fmf_get_u32(p+8);
+    bytes_per_chunk = _fmf_get_u64(p+12);
+    n_frames = _fmf_get_u64(p+20);
+    r->data_offset = 28;
+  } else if (version == 3) {
+    len_format = _fmf_get_u32(p+4);
+    if ((len_format >= sizeof(r->format)) || (size < 8 + (size_t)len_format + 28)) {
+      return -1;
+    }
+    memcpy(r->format,p+8,len_format);
+    r->format[len_format] = '\0';
+    p += 8 + len_format;
+    bpp = _fmf_get_u32(p);
+    rows = _fmf_get_u32(p+4);
+    cols = _fmf_get_u32(p+8);
+    bytes_per_chunk = _fmf_get_u64(p+12);
+    n_frames = _fmf_get_u64(p+20);
+    r->data_offset = 8 + len_format + 28;
+  } else {
+    return -1;
+  }
+
+  if ((rows == 0) || (cols == 0) || (bpp == 0) ||
+      (bytes_per_chunk < sizeof(double) + ((uint64_t)rows*cols*bpp+7)/8)) {
+    return -1;
+  }
+
+  /* n_frames is 0 when the recording was not closed properly; trust
+     the file size then, and also if the header claims too many */
+  available = (size - r->data_offset) / bytes_per_chunk;
+  if ((n_frames == 0) || (n_frames > available)) {
+    n_frames = available;
+  }
+
+  r->chunk_bytes = (size_t)bytes_per_chunk;
+  r->num_frames = (long)n_frames;
+  r->info.coding = _fmf_coding_for_format(r->format);
+  r->info.format = r->format;
+  r->info.width = (int)cols;
+  r->info.height = (int)rows;
+  r->info.bpp = (int)bpp;
+  r->info.stride = ((intptr_t)cols*bpp+7)/8;
+  r->info.num_frames = r->num_frames;
+  return 0;
+}
+
+CAM_IFACE_API int cam_iface_fmf_reader_open( CamIfaceFmfReader **reader,
+                                             const char *filename,
+                                             int flags ) {
+  CamIfaceFmfReader *r;
+  struct stat st;
+  void *map;
+
+  if ((reader==NULL) || (filename==NULL)) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  *reader = NULL;
+
+  r = (CamIfaceFmfReader*)calloc(1,sizeof(CamIfaceFmfReader));
+  if (r==NULL) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  r->fd = open(filename,O_RDONLY);
+  if ((r->fd < 0) || fstat(r->fd,&st) || (st.st_size <= 0) ||
+      ((uint64_t)st.st_size > (uint64_t)SIZE_MAX)) {
+    cam_iface_fmf_reader_close(r);
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  r->map_size = (size_t)st.st_size;
+  map = mmap(NULL,r->map_size,PROT_READ,MAP_SHARED,r->fd,0);
+  if (map == MAP_FAILED) {
+    r->map_size = 0;
+    cam_iface_fmf_reader_close(r);
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  r->map = (const unsigned char*)map;
+
+  if (_fmf_reader_parse(r)) {
+    cam_iface_fmf_reader_close(r);
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+
+  r->sequential = (flags & CAM_IFACE_FMF_READER_SEQUENTIAL) != 0;
+  madvise(map,r->map_size,r->sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+  *reader = r;
+  return 0;
+}
+
+CAM_IFACE_API int cam_iface_fmf_reader_close( CamIfaceFmfReader *r ) {
+  if (r==NULL) {
+    return 0;
+  }
+  if (r->map != NULL) {
+    munmap((void*)r->map,r->map_size);
+  }
+  if (r->fd >= 0) {
+    close(r->fd);
+  }
+  free(r);
+  return 0;
+}
+
+CAM_IFACE_API int cam_iface_fmf_reader_get_info( CamIfaceFmfReader *r,
+                                                 CamIfaceFmfInfo *info ) {
+  if ((r==NULL) || (info==NULL)) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  *info = r->info;
+  return 0;
+}
+
+/* In sequential mode, ask the kernel to read ahead of offset. Only
+   issued when offset gets within half a window of the last request,
+   so one madvise() covers many frames. */
+static void _fmf_reader_prefetch(CamIfaceFmfReader *r, size_t offset) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t start, end;
+  if (offset + FMF_READER_PREFETCH_BYTES/2 < r->prefetched_to) {
+    return;
+  }
+  start = (offset > r->prefetched_to) ? offset : r->prefetched_to;
+  start -= start % page;
+  end = start + FMF_READER_PREFETCH_BYTES;
+  if (end > r->map_size) {
+    end = r->map_size;
+  }
+  if (end > start) {
+    madvise((void*)(r->map+start),end-start,MADV_WILLNEED);
+  }
+  r->prefetched_to = end;
+}
+
+CAM_IFACE_API int cam_iface_fmf_reader_get_frame( CamIfaceFmfReader *r,
+                                                  long frame,
+                                                  const unsigned char **pixels,
+                                                  double *timestamp ) {
+  const unsigned char *chunk;
+  size_t offset;
+
+  if ((r==NULL) || (frame < 0) || (frame >= r->num_frames)) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  offset = r->data_offset + (size_t)frame*r->chunk_bytes;
+  if (r->sequential) {
+    _fmf_reader_prefetch(r,offset);
+  }
+  chunk = r->map + offset;
+  if (timestamp != NULL) {
+    memcpy(timestamp,chunk,sizeof(double));
+  }
+  if (pixels != NULL) {
+    *pixels = chunk + sizeof(double);
+  }
+  return 0;
+}
+
+CAM_IFACE_API int cam_iface_fmf_reader_find_timestamp( CamIfaceFmfReader *r,
+                                                       double timestamp,
+                                                       long *frame ) {
+  long lo, hi, mid;
+  double t;
+
+  if ((r==NULL) || (frame==NULL)) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  /* first frame with a timestamp >= timestamp */
+  lo = 0;
+  hi = r->num_frames;
+  while (lo < hi) {
+    mid = lo + (hi-lo)/2;
+    memcpy(&t,r->map + r->data_offset + (size_t)mid*r->chunk_bytes,sizeof(double));
+    if (t < timestamp) {
+      lo = mid+1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == r->num_frames) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  *frame = lo;
+  return 0;
+}
+
+#else /* _WIN32 */
+
+/* no pthreads or mmap on Windows -- FMF reading and writing are not
+   available */
+
+CAM_IFACE_API int cam_iface_fmf_writer_open( CamIfaceFmfWriter **writer,
+                                             const char *filename,
+                                             CameraPixelCoding coding,
+                                             int width,
+                                             int height,
+                                             int num_buffers,
+                                             int flags ) {
+  return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+}
+
+CAM_IFACE_API int cam_iface_fmf_writer_add_frame( CamIfaceFmfWriter *w,
+                                                  const unsigned char *pixels,
+                                                  intptr_t stride,
+                                                  double timestamp ) {
+  return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+}
+
+CAM_IFACE_API int cam_iface_fmf_writer_get_stats( CamIfaceFmfWriter *w,
+                                                  CamIfaceFmfWriterStats *stats ) {
+  return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+}
+
+CAM_IFACE_API int cam_iface_fmf_writer_close( CamIfaceFmfWriter *w,
+                                              CamIfaceFmfWriterStats *stats ) {
+  return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+}
+
+CAM_IFACE_API int cam_iface_fmf_reader_open( CamIfaceFmfReader **reader,
+                                             const char *filename,
+                                             int flags ) {
+  return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+}
+
+CAM_IFACE_API int cam_iface_fmf_reader_close( CamIfaceFmfReader *reader ) {
+  return 0;
+}
+
+CAM_IFACE_API int cam_iface_fmf_reader_get_info( CamIfaceFmfReader *reader,
+                                                 CamIfaceFmfInfo *info ) {
+  return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+}
+
+CAM_IFACE_API int cam_iface_fmf_reader_get_frame( CamIfaceFmfReader *reader,
+                                                  long frame,
+                                                  const unsigned char **pixels,
+                                                  double *timestamp ) {
+  return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+}
+
+CAM_IFACE_API int cam_iface_fmf_reader_find_timestamp( CamIfaceFmfReader *reader,
+                                                       double timestamp,
+                                                       long *frame ) {
+  return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+}
+
+#endif /* _WIN32 */
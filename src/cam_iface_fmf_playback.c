@@ -0,0 +1,861 @@
+/*
+
+Copyright (c) 2004-2009, California Institute of Technology. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* Backend that plays back FMF movies as if they were cameras.
+
+   Each file listed in the FMF_PLAYBACK_FILES environment variable
+   (separated by ':') is one camera with a single mode. Frames are
+   served straight out of the memory mapping made by the FMF reader,
+   so point_next_frame_blocking() copies nothing. The pointed memory is
+   read-only.
+
+   The trigger modes select the pacing: frames are released at their
+   recorded timestamps, at a fixed framerate (set_framerate() switches
+   to this), or as fast as they are asked for. The timestamps and frame
+   numbers reported are the recorded ones; when looping, timestamps
+   keep increasing across the wrap. */
+#include "cam_iface.h"
+#include "cam_iface_internal.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
+
+struct CCfmf; // forward declaration
+
+// keep functable in sync across backends
+typedef struct {
+  cam_iface_constructor_func_t construct;
+  void (*destruct)(struct CamContext*);
+
+  void (*CCfmf)(struct CCfmf*,int,int,int,const char*);
+  void (*close)(struct CCfmf*);
+  void (*start_camera)(struct CCfmf*);
+  void (*stop_camera)(struct CCfmf*);
+  void (*get_num_camera_properties)(struct CCfmf*,int*);
+  void (*get_camera_property_info)(struct CCfmf*,
+                                   int,
+                                   CameraPropertyInfo*);
+  void (*get_camera_property)(struct CCfmf*,int,long*,int*);
+  void (*set_camera_property)(struct CCfmf*,int,long,int);
+  void (*grab_next_frame_blocking)(struct CCfmf*,
+                                   unsigned char*,
+                                   float);
+  void (*grab_next_frame_blocking_with_stride)(struct CCfmf*,
+                                               unsigned char*,
+                                               intptr_t,
+                                               float);
+  void (*point_next_frame_blocking)(struct CCfmf*,unsigned char**,float);
+  void (*unpoint_frame)(struct CCfmf*);
+  void (*get_last_timestamp)(struct CCfmf*,double*);
+  void (*get_last_framenumber)(struct CCfmf*,unsigned long*);
+  void (*get_num_trigger_modes)(struct CCfmf*,int*);
+  void (*get_trigger_mode_string)(struct CCfmf*,int,char*,int);
+  void (*get_trigger_mode_number)(struct CCfmf*,int*);
+  void (*set_trigger_mode_number)(struct CCfmf*,int);
+  void (*get_frame_roi)(struct CCfmf*,int*,int*,int*,int*);
+  void (*set_frame_roi)(struct CCfmf*,int,int,int,int);
+  void (*get_max_frame_size)(struct CCfmf*,int*,int*);
+  void (*get_buffer_size)(struct CCfmf*,int*);
+  void (*get_framerate)(struct CCfmf*,float*);
+  void (*set_framerate)(struct CCfmf*,float);
+  void (*get_num_framebuffers)(struct CCfmf*,int*);
+  void (*set_num_framebuffers)(struct CCfmf*,int);
+  void (*grab_frames_batch)(struct CCfmf*,
+                            unsigned char**,intptr_t,
+                            double*,unsigned long*,
+                            int,int,int*,float);
+  void (*get_wait_fd)(struct CCfmf*,int*);
+  void (*get_frame_roi_framenumber)(struct CCfmf*,unsigned long*);
+} CCfmf_functable;
+
+/* pacing, doubling as the trigger mode number */
+typedef enum {
+  FMF_PACING_RECORDED = 0,
+  FMF_PACING_FIXED,
+  FMF_PACING_MAX,
+  NUM_FMF_PACING
+} FmfPacing_t;
+
+static const char *fmf_pacing_names[NUM_FMF_PACING] = {
+  "recorded timestamps",
+  "fixed framerate",
+  "as fast as possible",
+};
+
+typedef struct CCfmf {
+  CamContext inherited;
+
+  CamIfaceFmfReader *reader;
+  CamIfaceFmfInfo info;
+  double first_timestamp;
+  double duration;        /* from first to last frame plus one interval */
+
+  int started;
+  int num_buffers;
+  int num_pointed;
+
+  FmfPacing_t pacing;
+  float framerate;        /* for FMF_PACING_FIXED */
+  int loop;
+
+  long next_frame;        /* index in the file of the next frame */
+  double timestamp_offset; /* added to recorded timestamps, grows per loop */
+  unsigned long num_served;
+
+  /* schedule: frames since sched_time, and the (offset) recorded
+  timestamp due at sched_time */
+  double sched_time;
+  double sched_timestamp;
+  unsigned long sched_count;
+
+  double last_timestamp;
+  unsigned long last_framenumber;
+
+  /* timerfd that expires when the next frame is due, created by
+  get_wait_fd(). -1 if unused. */
+  int wait_fd;
+
+} CCfmf;
+
+// forward declarations
+CCfmf* CCfmf_construct( int device_number, int NumImageBuffers,
+                        int mode_number, const char *interface);
+void delete_CCfmf(struct CCfmf*);
+
+void CCfmf_CCfmf(struct CCfmf*,int,int,int,const char *);
+void CCfmf_close(struct CCfmf*);
+void CCfmf_start_camera(struct CCfmf*);
+void CCfmf_stop_camera(struct CCfmf*);
+void CCfmf_get_num_camera_properties(struct CCfmf*,int*);
+void CCfmf_get_camera_property_info(struct CCfmf*,
+                                    int,
+                                    CameraPropertyInfo*);
+void CCfmf_get_camera_property(struct CCfmf*,int,long*,int*);
+void CCfmf_set_camera_property(struct CCfmf*,int,long,int);
+void CCfmf_grab_next_frame_blocking(struct CCfmf*,
+                                    unsigned char*,
+                                    float);
+void CCfmf_grab_next_frame_blocking_with_stride(struct CCfmf*,
+                                                unsigned char*,
+                                                intptr_t,
+                                                float);
+void CCfmf_point_next_frame_blocking(struct CCfmf*,unsigned char**,float);
+void CCfmf_unpoint_frame(struct CCfmf*);
+void CCfmf_get_last_timestamp(struct CCfmf*,double*);
+void CCfmf_get_last_framenumber(struct CCfmf*,unsigned long*);
+void CCfmf_get_num_trigger_modes(struct CCfmf*,int*);
+void CCfmf_get_trigger_mode_string(struct CCfmf*,int,char*,int);
+void CCfmf_get_trigger_mode_number(struct CCfmf*,int*);
+void CCfmf_set_trigger_mode_number(struct CCfmf*,int);
+void CCfmf_get_frame_roi(struct CCfmf*,int*,int*,int*,int*);
+void CCfmf_set_frame_roi(struct CCfmf*,int,int,int,int);
+void CCfmf_get_max_frame_size(struct CCfmf*,int*,int*);
+void CCfmf_get_buffer_size(struct CCfmf*,int*);
+void CCfmf_get_framerate(struct CCfmf*,float*);
+void CCfmf_set_framerate(struct CCfmf*,float);
+void CCfmf_get_num_framebuffers(struct CCfmf*,int*);
+void CCfmf_set_num_framebuffers(struct CCfmf*,int);
+void CCfmf_get_wait_fd(struct CCfmf*,int*);
+
+CCfmf_functable CCfmf_vmt = {
+  (cam_iface_constructor_func_t)CCfmf_construct,
+  (void (*)(CamContext*))delete_CCfmf,
+  CCfmf_CCfmf,
+  CCfmf_close,
+  CCfmf_start_camera,
+  CCfmf_stop_camera,
+  CCfmf_get_num_camera_properties,
+  CCfmf_get_camera_property_info,
+  CCfmf_get_camera_property,
+  CCfmf_set_camera_property,
+  CCfmf_grab_next_frame_blocking,
+  CCfmf_grab_next_frame_blocking_with_stride,
+  CCfmf_point_next_frame_blocking,
+  CCfmf_unpoint_frame,
+  CCfmf_get_last_timestamp,
+  CCfmf_get_last_framenumber,
+  CCfmf_get_num_trigger_modes,
+  CCfmf_get_trigger_mode_string,
+  CCfmf_get_trigger_mode_number,
+  CCfmf_set_trigger_mode_number,
+  CCfmf_get_frame_roi,
+  CCfmf_set_frame_roi,
+  CCfmf_get_max_frame_size,
+  CCfmf_get_buffer_size,
+  CCfmf_get_framerate,
+  CCfmf_set_framerate,
+  CCfmf_get_num_framebuffers,
+  CCfmf_set_num_framebuffers,
+  NULL, /* grab_frames_batch: use generic loop */
+  CCfmf_get_wait_fd,
+  NULL /* get_frame_roi_framenumber: not known */
+};
+
+#ifdef __APPLE__
+#define myTLS
+#else
+#define myTLS __thread
+#endif
+
+#ifdef MEGA_BACKEND
+  #define BACKEND_GLOBAL(m) fmf_playback_##m
+#else
+  #define BACKEND_GLOBAL(m) m
+#endif
+
+/* globals -- allocate space */
+typedef struct {
+  char *filename;
+  CamIfaceFmfInfo info;
+  char format[32];        /* info.format points here */
+} FmfGlobalCamera;
+
+myTLS int BACKEND_GLOBAL(cam_iface_error) = 0;
+#define CAM_IFACE_MAX_ERROR_LEN 255
+myTLS char BACKEND_GLOBAL(cam_iface_error_string)[CAM_IFACE_MAX_ERROR_LEN]  = {0x00}; //...
+myTLS cam_iface_deferred_error BACKEND_GLOBAL(cam_iface_error_info) = {NULL};
+
+static int fmf_num_cameras = 0;
+static FmfGlobalCamera *fmf_cameras = NULL;
+
+#define CAM_IFACE_ERROR_FORMAT(m)                                       \
+  CAM_IFACE_DEFER_ERROR(BACKEND_GLOBAL(cam_iface_error_info),(m));
+
+#define FMF_ERROR(_code, _msg)                                          \
+  BACKEND_GLOBAL(cam_iface_error) = _code;                              \
+  CAM_IFACE_ERROR_FORMAT(_msg);
+
+#include "cam_iface_fmf_playback.h"
+
+const char *BACKEND_METHOD(cam_iface_get_driver_name)() {
+  return "fmf_playback";
+}
+
+void BACKEND_METHOD(cam_iface_clear_error)() {
+  BACKEND_GLOBAL(cam_iface_error) = 0;
+}
+
+int BACKEND_METHOD(cam_iface_have_error)() {
+  return BACKEND_GLOBAL(cam_iface_error);
+}
+
+const char * BACKEND_METHOD(cam_iface_get_error_string)() {
+  CAM_IFACE_FORMAT_DEFERRED_ERROR(BACKEND_GLOBAL(cam_iface_error_info),
+                                  BACKEND_GLOBAL(cam_iface_error_string),
+                                  CAM_IFACE_MAX_ERROR_LEN);
+  return BACKEND_GLOBAL(cam_iface_error_string);
+}
+
+const char* BACKEND_METHOD(cam_iface_get_api_version)() {
+  return CAM_IFACE_API_VERSION;
+}
+
+static double fmf_monotonic_time(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + t.tv_nsec*1e-9;
+}
+
+static void fmf_sleep(double seconds) {
+  struct timespec t;
+  if (seconds <= 0)
+    return;
+  t.tv_sec = (time_t)seconds;
+  t.tv_nsec = (long)((seconds - (double)t.tv_sec)*1e9);
+  while (nanosleep(&t, &t) != 0 && errno == EINTR)
+    ;
+}
+
+void BACKEND_METHOD(cam_iface_startup)() {
+  const char *env;
+  char *files, *name, *saveptr;
+  CamIfaceFmfReader *reader;
+  FmfGlobalCamera *cam;
+  int n;
+
+  cam_iface_log_init();
+
+  env = getenv("FMF_PLAYBACK_FILES");
+  if (env == NULL || env[0] == '\0')
+    return;
+
+  /* one slot per separator is enough */
+  n = 1;
+  for (name = (char*)env; *name; name++)
+    if (*name == ':')
+      n++;
+  fmf_cameras = calloc(n, sizeof(FmfGlobalCamera));
+  files = strdup(env);
+  if (fmf_cameras == NULL || files == NULL) {
+    free(fmf_cameras);
+    free(files);
+    fmf_cameras = NULL;
+    FMF_ERROR(CAM_IFACE_GENERIC_ERROR, "error allocating memory");
+    return;
+  }
+
+  for (name = strtok_r(files, ":", &saveptr); name != NULL;
+       name = strtok_r(NULL, ":", &saveptr)) {
+    if (cam_iface_fmf_reader_open(&reader, name, 0)) {
+      CAM_IFACE_LOG(CAM_IFACE_LOG_FMF_PLAYBACK,CAM_IFACE_LOG_WARN,
+                    "cannot open %s, skipping",name);
+      continue;
+    }
+    cam = &fmf_cameras[fmf_num_cameras];
+    cam_iface_fmf_reader_get_info(reader, &cam->info);
+    snprintf(cam->format, sizeof(cam->format), "%s", cam->info.format);
+    cam->info.format = cam->format;
+    cam_iface_fmf_reader_close(reader);
+
+    if (cam->info.num_frames < 1) {
+      CAM_IFACE_LOG(CAM_IFACE_LOG_FMF_PLAYBACK,CAM_IFACE_LOG_WARN,
+                    "%s has no frames, skipping",name);
+      continue;
+    }
+    cam->filename = strdup(name);
+    fmf_num_cameras++;
+  }
+  free(files);
+}
+
+void BACKEND_METHOD(cam_iface_shutdown)() {
+  int i;
+  for (i=0; i<fmf_num_cameras; i++)
+    free(fmf_cameras[i].filename);
+  free(fmf_cameras);
+  fmf_cameras = NULL;
+  fmf_num_cameras = 0;
+}
+
+int BACKEND_METHOD(cam_iface_get_num_cameras)() {
+  return fmf_num_cameras;
+}
+
+void BACKEND_METHOD(cam_iface_get_camera_info)(int device_number, Camwire_id *out_camid) {
+  const char *base;
+
+  if (out_camid==NULL) {
+    FMF_ERROR(CAM_IFACE_GENERIC_ERROR, "return structure NULL");
+    return;
+  }
+  if (device_number < 0 || device_number >= fmf_num_cameras) {
+    FMF_ERROR(CAM_IFACE_CAMERA_NOT_AVAILABLE_ERROR, "invalid device number");
+    return;
+  }
+
+  base = strrchr(fmf_cameras[device_number].filename, '/');
+  base = base ? base+1 : fmf_cameras[device_number].filename;
+
+  snprintf(out_camid->vendor, CAMWIRE_ID_MAX_CHARS, "%s", "FMF");
+  snprintf(out_camid->model, CAMWIRE_ID_MAX_CHARS, "%s", base);
+  snprintf(out_camid->chip, CAMWIRE_ID_MAX_CHARS, "%s", fmf_cameras[device_number].filename);
+}
+
+void BACKEND_METHOD(cam_iface_get_num_modes)(int device_number, int *num_modes) {
+  if (device_number < 0 || device_number >= fmf_num_cameras) {
+    FMF_ERROR(CAM_IFACE_CAMERA_NOT_AVAILABLE_ERROR, "invalid device number");
+    return;
+  }
+  *num_modes = 1;
+}
+
+void BACKEND_METHOD(cam_iface_get_mode_string)(int device_number,
+                               int mode_number,
+                               char* mode_string,
+                               int mode_string_maxlen) {
+  CamIfaceFmfInfo *info;
+
+  if (device_number < 0 || device_number >= fmf_num_cameras) {
+    FMF_ERROR(CAM_IFACE_CAMERA_NOT_AVAILABLE_ERROR, "invalid device number");
+    return;
+  }
+  if (mode_number != 0) {
+    FMF_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "invalid mode number");
+    return;
+  }
+
+  info = &fmf_cameras[device_number].info;
+  snprintf(mode_string,mode_string_maxlen,
+           "%d x %d %s (FMF playback, %ld frames)",
+           info->width, info->height, info->format, info->num_frames);
+}
+
+cam_iface_constructor_func_t BACKEND_METHOD(cam_iface_get_constructor_func)(int device_number) {
+  (void)device_number;
+  return (CamContext* (*)(int, int, int, const char *))CCfmf_construct;
+}
+
+CCfmf* CCfmf_construct( int device_number, int NumImageBuffers,
+                        int mode_number, const char *interface) {
+  CCfmf* this=NULL;
+
+  this = malloc(sizeof(CCfmf));
+  if (this==NULL) {
+    FMF_ERROR(CAM_IFACE_GENERIC_ERROR, "error allocating memory");
+  } else {
+    CCfmf_CCfmf( this,
+                 device_number, NumImageBuffers,
+                 mode_number, interface);
+    if (BACKEND_GLOBAL(cam_iface_error)) {
+      CCfmf_close(this);
+      free(this);
+      return NULL;
+    }
+  }
+  return this;
+}
+
+void delete_CCfmf( CCfmf *this ) {
+  CCfmf_close(this);
+  this->inherited.vmt = NULL;
+  free(this);
+}
+
+void CCfmf_CCfmf( CCfmf *this,
+                  int device_number, int NumImageBuffers,
+                  int mode_number, const char *interface) {
+  const char *env;
+  double last_timestamp;
+  const unsigned char *pixels;
+  char *end;
+  int rc;
+
+  /* call parent */
+  CamContext_CamContext((CamContext*)this,device_number,NumImageBuffers,mode_number,interface);
+  this->inherited.vmt = (CamContext_functable*)&CCfmf_vmt;
+
+  /* initialize */
+  this->inherited.cam = (void *)NULL;
+  this->inherited.backend_extras = (void *)NULL;
+  this->inherited.device_number = device_number;
+
+  this->reader = NULL;
+  this->wait_fd = -1;
+  this->started = 0;
+  this->num_buffers = NumImageBuffers > 0 ? NumImageBuffers : 1;
+  this->num_pointed = 0;
+  this->next_frame = 0;
+  this->timestamp_offset = 0.0;
+  this->num_served = 0;
+  this->last_timestamp = 0.0;
+  this->last_framenumber = 0;
+
+  if (device_number < 0 || device_number >= fmf_num_cameras) {
+    FMF_ERROR(CAM_IFACE_CAMERA_NOT_AVAILABLE_ERROR, "invalid device number");
+    return;
+  }
+  if (mode_number != 0) {
+    FMF_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "invalid mode number");
+    return;
+  }
+
+  rc = cam_iface_fmf_reader_open(&this->reader,
+                                 fmf_cameras[device_number].filename,
+                                 CAM_IFACE_FMF_READER_SEQUENTIAL);
+  if (rc) {
+    this->reader = NULL;
+    FMF_ERROR(rc, "error opening FMF file");
+    return;
+  }
+  cam_iface_fmf_reader_get_info(this->reader, &this->info);
+
+  this->inherited.depth = this->info.bpp;
+  this->inherited.coding = this->info.coding;
+
+  /* a loop lasts from the first timestamp to one mean frame interval
+  after the last */
+  cam_iface_fmf_reader_get_frame(this->reader, 0, &pixels, &this->first_timestamp);
+  cam_iface_fmf_reader_get_frame(this->reader, this->info.num_frames-1, &pixels, &last_timestamp);
+  this->duration = last_timestamp - this->first_timestamp;
+  if (this->info.num_frames > 1 && this->duration > 0)
+    this->duration += this->duration / (this->info.num_frames-1);
+  else
+    this->duration = 0.0;
+
+  this->pacing = FMF_PACING_RECORDED;
+  this->framerate = this->duration > 0 ? this->info.num_frames / this->duration : 30.0f;
+  env = getenv("FMF_PLAYBACK_PACING");
+  if (env != NULL) {
+    if (!strcmp(env, "recorded")) {
+      this->pacing = FMF_PACING_RECORDED;
+    } else if (!strcmp(env, "max")) {
+      this->pacing = FMF_PACING_MAX;
+    } else {
+      double fps = strtod(env, &end);
+      if (end == env || fps <= 0) {
+        FMF_ERROR(CAM_IFACE_GENERIC_ERROR,
+                  "FMF_PLAYBACK_PACING must be 'recorded', 'max' or a framerate");
+        return;
+      }
+      this->pacing = FMF_PACING_FIXED;
+      this->framerate = fps;
+    }
+  }
+
+  env = getenv("FMF_PLAYBACK_LOOP");
+  this->loop = (env != NULL && strcmp(env, "0"));
+}
+
+void CCfmf_close(CCfmf *this) {
+  if (this->wait_fd >= 0) {
+    close(this->wait_fd);
+    this->wait_fd = -1;
+  }
+  if (this->reader) {
+    cam_iface_fmf_reader_close(this->reader);
+    this->reader = NULL;
+  }
+}
+
+/* Recorded timestamp of the next frame, including the loop offset.
+Returns 0 at the end of a file that does not loop. */
+static int _CCfmf_peek_timestamp( CCfmf *this, double *timestamp ) {
+  const unsigned char *pixels;
+
+  if (this->next_frame >= this->info.num_frames) {
+    if (!this->loop)
+      return 0;
+    this->next_frame = 0;
+    this->timestamp_offset += this->duration;
+  }
+  cam_iface_fmf_reader_get_frame(this->reader, this->next_frame, &pixels, timestamp);
+  *timestamp += this->timestamp_offset;
+  return 1;
+}
+
+/* Start the schedule afresh from now, e.g. after changing the pacing. */
+static void _CCfmf_reset_schedule( CCfmf *this ) {
+  double timestamp;
+
+  this->sched_time = fmf_monotonic_time();
+  this->sched_count = 0;
+  if (_CCfmf_peek_timestamp(this, &timestamp))
+    this->sched_timestamp = timestamp;
+}
+
+/* Monotonic time at which the frame with the given timestamp is due. */
+static double _CCfmf_due_time( CCfmf *this, double timestamp ) {
+  switch (this->pacing) {
+  case FMF_PACING_RECORDED:
+    return this->sched_time + (timestamp - this->sched_timestamp);
+  case FMF_PACING_FIXED:
+    return this->sched_time + this->sched_count / this->framerate;
+  default:
+    return 0.0;
+  }
+}
+
+static void _CCfmf_arm_wait_fd( CCfmf *this ) {
+#ifdef __linux__
+  struct itimerspec its;
+  double timestamp, due;
+
+  if (this->wait_fd < 0)
+    return;
+
+  memset(&its, 0, sizeof(its));
+  if (this->started && _CCfmf_peek_timestamp(this, &timestamp)) {
+    due = _CCfmf_due_time(this, timestamp);
+    its.it_value.tv_sec = (time_t)due;
+    its.it_value.tv_nsec = (long)((due - (double)its.it_value.tv_sec)*1e9);
+    if (its.it_value.tv_sec <= 0 && its.it_value.tv_nsec <= 0)
+      its.it_value.tv_nsec = 1; /* already due; zero would disarm */
+  }
+  timerfd_settime(this->wait_fd, TFD_TIMER_ABSTIME, &its, NULL);
+#endif
+}
+
+/* Wait until the next frame is due and point pixels at it. */
+static void _CCfmf_next_frame( CCfmf *this, const unsigned char **pixels, float timeout ) {
+  double timestamp, wait;
+  int rc;
+
+  if (!this->started) {
+    FMF_ERROR(CAM_IFACE_GENERIC_ERROR, "camera not started");
+    return;
+  }
+
+  if (!_CCfmf_peek_timestamp(this, &timestamp)) {
+    FMF_ERROR(CAM_IFACE_OTHER_ERROR, "end of FMF file");
+    return;
+  }
+
+  wait = _CCfmf_due_time(this, timestamp) - fmf_monotonic_time();
+  if (wait > 0) {
+    if (timeout >= 0 && wait > timeout) {
+      fmf_sleep(timeout);
+      FMF_ERROR(CAM_IFACE_FRAME_TIMEOUT, "timeout exceeded");
+      return;
+    }
+    fmf_sleep(wait);
+  }
+
+  rc = cam_iface_fmf_reader_get_frame(this->reader, this->next_frame, pixels, &timestamp);
+  if (rc) {
+    FMF_ERROR(rc, "error reading frame");
+    return;
+  }
+
+  this->last_timestamp = timestamp + this->timestamp_offset;
+  this->last_framenumber = this->num_served;
+  this->num_served++;
+  this->next_frame++;
+  this->sched_count++;
+
+  _CCfmf_arm_wait_fd(this);
+}
+
+void CCfmf_start_camera( CCfmf *this ) {
+  this->started = 1;
+  _CCfmf_reset_schedule(this);
+  _CCfmf_arm_wait_fd(this);
+}
+
+void CCfmf_stop_camera( CCfmf *this ) {
+  this->started = 0;
+  _CCfmf_arm_wait_fd(this);
+}
+
+void CCfmf_get_num_camera_properties(CCfmf *this,
+                                     int* num_properties) {
+  (void)this;
+  *num_properties = 0;
+}
+
+void CCfmf_get_camera_property_info(CCfmf *this,
+                                    int property_number,
+                                    CameraPropertyInfo *info) {
+  (void)this;
+  (void)property_number;
+  (void)info;
+  FMF_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "unknown property");
+}
+
+void CCfmf_get_camera_property(CCfmf *this,
+                               int property_number,
+                               long* Value,
+                               int* Auto ) {
+  (void)this;
+  (void)property_number;
+  (void)Value;
+  (void)Auto;
+  FMF_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "unknown property");
+}
+
+void CCfmf_set_camera_property(CCfmf *this,
+                               int property_number,
+                               long Value,
+                               int Auto ) {
+  (void)this;
+  (void)property_number;
+  (void)Value;
+  (void)Auto;
+  FMF_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "unknown property");
+}
+
+void CCfmf_grab_next_frame_blocking_with_stride( CCfmf *this,
+                                                 unsigned char *out_bytes,
+                                                 intptr_t stride0, float timeout) {
+  const unsigned char *pixels;
+  intptr_t rowsize = this->info.stride;
+  int row;
+
+  if (stride0 < rowsize) {
+    FMF_ERROR(CAM_IFACE_GENERIC_ERROR, "stride too small for frame");
+    return;
+  }
+
+  _CCfmf_next_frame(this, &pixels, timeout);
+  if (BACKEND_GLOBAL(cam_iface_error))
+    return;
+
+  if (stride0 == rowsize) {
+    memcpy(out_bytes, pixels, rowsize*this->info.height);
+  } else {
+    for (row=0; row<this->info.height; row++)
+      memcpy(out_bytes + row*stride0, pixels + row*rowsize, rowsize);
+  }
+}
+
+void CCfmf_grab_next_frame_blocking( CCfmf *this, unsigned char *out_bytes, float timeout) {
+  CCfmf_grab_next_frame_blocking_with_stride(this, out_bytes, this->info.stride, timeout);
+}
+
+void CCfmf_point_next_frame_blocking( CCfmf *this, unsigned char **buf_ptr, float timeout) {
+  const unsigned char *pixels;
+
+  if (this->num_pointed >= this->num_buffers) {
+    FMF_ERROR(CAM_IFACE_BUFFER_OVERFLOW_ERROR, "too many frames pointed to (call unpoint_frame first)");
+    return;
+  }
+
+  _CCfmf_next_frame(this, &pixels, timeout);
+  if (BACKEND_GLOBAL(cam_iface_error))
+    return;
+
+  this->num_pointed++;
+  *buf_ptr = (unsigned char*)pixels;
+}
+
+void CCfmf_unpoint_frame( CCfmf *this ) {
+  if (this->num_pointed == 0) {
+    FMF_ERROR(CAM_IFACE_GENERIC_ERROR, "no frame pointed to");
+    return;
+  }
+  this->num_pointed--;
+}
+
+void CCfmf_get_last_timestamp( CCfmf *this, double* timestamp ) {
+  *timestamp = this->last_timestamp;
+}
+
+void CCfmf_get_last_framenumber( CCfmf *this, unsigned long* framenumber ) {
+  *framenumber = this->last_framenumber;
+}
+
+void CCfmf_get_num_trigger_modes( CCfmf *this,
+                                  int *num_trigger_modes ) {
+  (void)this;
+  *num_trigger_modes = NUM_FMF_PACING;
+}
+
+void CCfmf_get_trigger_mode_string( CCfmf *this,
+                                    int trigger_mode_number,
+                                    char* trigger_mode_string, //output parameter
+                                    int trigger_mode_string_maxlen) {
+  (void)this;
+  if (trigger_mode_number < 0 || trigger_mode_number >= NUM_FMF_PACING) {
+    FMF_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "unknown trigger mode");
+    return;
+  }
+  snprintf(trigger_mode_string,trigger_mode_string_maxlen,"%s",
+           fmf_pacing_names[trigger_mode_number]);
+}
+
+void CCfmf_get_trigger_mode_number( CCfmf *this,
+                                    int *trigger_mode_number ) {
+  *trigger_mode_number = this->pacing;
+}
+
+void CCfmf_set_trigger_mode_number( CCfmf *this,
+                                    int trigger_mode_number ) {
+  if (trigger_mode_number < 0 || trigger_mode_number >= NUM_FMF_PACING) {
+    FMF_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "unknown trigger mode");
+    return;
+  }
+  this->pacing = trigger_mode_number;
+  _CCfmf_reset_schedule(this);
+  _CCfmf_arm_wait_fd(this);
+}
+
+void CCfmf_get_frame_roi( CCfmf *this,
+                          int *left, int *top, int* width, int* height ) {
+  *left = 0;
+  *top = 0;
+  *width = this->info.width;
+  *height = this->info.height;
+}
+
+void CCfmf_set_frame_roi( CCfmf *this,
+                          int left, int top, int width, int height ) {
+  if (left != 0 || top != 0 ||
+      width != this->info.width || height != this->info.height) {
+    FMF_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "FMF playback is always full frame");
+  }
+}
+
+void CCfmf_get_max_frame_size( CCfmf *this,
+                               int *width, int *height ) {
+  *width = this->info.width;
+  *height = this->info.height;
+}
+
+void CCfmf_get_buffer_size( CCfmf *this,
+                            int *size) {
+  *size = (int)(this->info.stride * this->info.height);
+}
+
+void CCfmf_get_framerate( CCfmf *this,
+                          float *framerate ) {
+  *framerate = this->pacing == FMF_PACING_MAX ? 0.0f : this->framerate;
+}
+
+void CCfmf_set_framerate( CCfmf *this,
+                          float framerate ) {
+  if (framerate <= 0) {
+    FMF_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "framerate must be positive");
+    return;
+  }
+  this->framerate = framerate;
+  this->pacing = FMF_PACING_FIXED;
+  _CCfmf_reset_schedule(this);
+  _CCfmf_arm_wait_fd(this);
+}
+
+void CCfmf_get_num_framebuffers( CCfmf *this,
+                                 int *num_framebuffers ) {
+  *num_framebuffers = this->num_buffers;
+}
+
+/* The frames live in the file mapping, so this only limits how many
+may be pointed to at once. */
+void CCfmf_set_num_framebuffers( CCfmf *this,
+                                 int num_framebuffers ) {
+  if (num_framebuffers < 1 || num_framebuffers < this->num_pointed) {
+    FMF_ERROR(CAM_IFACE_GENERIC_ERROR, "too few framebuffers");
+    return;
+  }
+  this->num_buffers = num_framebuffers;
+}
+
+void CCfmf_get_wait_fd( CCfmf *this, int *fd ) {
+#ifdef __linux__
+  if (this->wait_fd < 0) {
+    this->wait_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (this->wait_fd < 0) {
+      *fd = -1;
+      return;
+    }
+    _CCfmf_arm_wait_fd(this);
+  }
+  *fd = this->wait_fd;
+#else
+  *fd = -1;
+#endif
+}
@@ -0,0 +1,10 @@
+/* internal structures for fmf_playback implementation */
+
+#undef BACKEND_METHOD
+#ifdef MEGA_BACKEND
+  #define BACKEND_METHOD(m) fmf_playback_##m
+#else
+  #define BACKEND_METHOD(m) m
+#endif
+
+#include "cam_iface_static_functions.h"
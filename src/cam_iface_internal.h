@@ -42,6 +42,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #endif
 #endif
 
+/* Like cam_iface_thread_local, but never exported, also where thread
+   local storage is not available. */
+#if defined(_MSC_VER) || defined(__APPLE__)
+#define cam_iface_static_thread_local static
+#else
+#define cam_iface_static_thread_local static __thread
+#endif
+
 
 #ifdef _WIN32
 #if _MSC_VER == 1310
@@ -52,3 +60,128 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #else
 #define cam_iface_snprintf(...) snprintf(__VA_ARGS__)
 #endif
+
+/* Atomic access to data shared between threads without a lock. */
+#if defined(__GNUC__)
+#define cam_iface_atomic_load(ptr) __atomic_load_n((ptr),__ATOMIC_ACQUIRE)
+#define cam_iface_atomic_store(ptr,val) __atomic_store_n((ptr),(val),__ATOMIC_RELEASE)
+#define cam_iface_atomic_add(ptr,val) __atomic_add_fetch((ptr),(val),__ATOMIC_RELAXED)
+#define cam_iface_atomic_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+/* Best effort for compilers without the GCC builtins: aligned word
+   access. Only used for counters where a torn update is harmless. */
+#define cam_iface_atomic_load(ptr) (*(ptr))
+#define cam_iface_atomic_store(ptr,val) (*(ptr) = (val))
+#define cam_iface_atomic_add(ptr,val) (*(ptr) += (val))
+#define cam_iface_atomic_fence()
+#endif
+
+/* Deferred error messages. Backends record where an error happened and
+   which static strings describe it; the text is only formatted when
+   cam_iface_get_error_string() is called. This keeps timeouts and
+   dropped frames on the grab path free of snprintf(). All strings
+   must have static storage duration. */
+typedef struct {
+  const char *file;     /* NULL when nothing is pending */
+  int line;
+  const char *msg;      /* plain message, or hint appended to lib_msg */
+  const char *lib_name; /* NULL unless raised by an underlying library */
+  int lib_err;
+  const char *lib_msg;
+} cam_iface_deferred_error;
+
+#define CAM_IFACE_DEFER_ERROR(d,m) {                                    \
+    (d).file=__FILE__; (d).line=__LINE__;                               \
+    (d).msg=(m); (d).lib_name=NULL;                                     \
+  }
+
+#define CAM_IFACE_DEFER_LIB_ERROR(d,name,err,errmsg,hint) {             \
+    (d).file=__FILE__; (d).line=__LINE__;                               \
+    (d).msg=(hint); (d).lib_name=(name);                                \
+    (d).lib_err=(int)(err); (d).lib_msg=(errmsg);                       \
+  }
+
+/* Render a pending deferred error into buf (of length len) and mark it
+   as consumed. Does nothing if the error was already formatted, so
+   messages written directly into buf are left alone. */
+#define CAM_IFACE_FORMAT_DEFERRED_ERROR(d,buf,len) {                    \
+    if ((d).file!=NULL) {                                               \
+      if ((d).lib_name!=NULL) {                                         \
+        cam_iface_snprintf((buf),(len),"%s (%d): %s err %d: %s%s\n",    \
+                           (d).file,(d).line,(d).lib_name,(d).lib_err,  \
+                           (d).lib_msg ? (d).lib_msg : "(unknown error)", \
+                           (d).msg ? (d).msg : "");                     \
+      } else {                                                          \
+        cam_iface_snprintf((buf),(len),"%s (%d): %s\n",                 \
+                           (d).file,(d).line,(d).msg);                  \
+      }                                                                 \
+      (d).file=NULL;                                                    \
+    }                                                                   \
+  }
+
+/* Route the error state of a camera to the backend that created it, so
+   that the CamContext_*_rc() functions need not poll every backend.
+   Used by the mega and unity backends, implemented in
+   cam_iface_common.c. */
+#ifdef __cplusplus
+extern "C" {
+#endif
+struct CamContext;
+void cam_iface_core_set_error_funcs(struct CamContext *cam,
+                                    int (*have_error)(void),
+                                    void (*clear_error)(void));
+
+/* Logging, implemented in cam_iface_log.c. cam_iface_log_init() reads
+   the environment the first time it is called; every
+   cam_iface_startup() calls it. The level array is an exported symbol
+   so that, under the unity backend, dynamically loaded backends share
+   the loader's copy. */
+extern int cam_iface_log_levels[CAM_IFACE_LOG_NUM_CATEGORIES];
+void cam_iface_log_init(void);
+void cam_iface_log_write(int category, int level, const char *fmt, ...)
+#ifdef __GNUC__
+  __attribute__((format(printf,3,4)))
+#endif
+  ;
+#ifdef __cplusplus
+}
+#endif
+
+/* Software ROI, implemented in cam_iface_reduce.c. Frames are
+   reduced in cells of cell_width x cell_height pixels that take
+   cell_bytes bytes of each row. left and top are in pixels and must
+   be multiples of the cell size. */
+typedef struct {
+  int cell_width;
+  int cell_height;
+  int cell_bytes;
+  int sample_bits;  /* 8, 16, or -16 for signed 16-bit samples */
+  int num_luma;     /* packed YUV: Y samples per cell, else 0 */
+  int luma_offsets[4]; /* packed YUV: byte offset of each Y sample */
+} cam_iface_reduce_layout;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Returns 0, or CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE if coding
+   cannot be reduced. */
+int cam_iface_reduce_get_layout(CameraPixelCoding coding,
+                                cam_iface_reduce_layout *layout);
+/* binning is 1, 2 or 4 */
+void cam_iface_reduce_frame(const cam_iface_reduce_layout *layout,
+                            const unsigned char *src, intptr_t src_stride,
+                            int left, int top,
+                            int out_cells_x, int out_cells_y,
+                            int binning, int decimation,
+                            unsigned char *dst, intptr_t dst_stride);
+#ifdef __cplusplus
+}
+#endif
+
+/* Log a printf style message. The arguments are not evaluated unless
+   level is enabled for category. */
+#define CAM_IFACE_LOG(category,level,...) {                             \
+    if (cam_iface_atomic_load(&(cam_iface_log_levels[(category)])) >= (level)) { \
+      cam_iface_log_write((category),(level),__VA_ARGS__);              \
+    }                                                                   \
+  }
@@ -0,0 +1,320 @@
+/*
+
+Copyright (c) 2004-2009, California Institute of Technology. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+/* Library-wide logging, see the description in cam_iface.h. */
+
+#include "cam_iface.h"
+#include "cam_iface_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+
+#ifdef _WIN32
+#include <sys/timeb.h>
+#else
+#include <sys/time.h>
+#endif
+
+/* names used in CAM_IFACE_LOG, in CamIfaceLogCategory order */
+static const char *log_category_names[CAM_IFACE_LOG_NUM_CATEGORIES] = {
+  "core",
+  "mega",
+  "unity",
+  "dc1394",
+  "aravis",
+  "prosilica_gige",
+  "basler_pylon",
+  "pgr_flycapture",
+  "quicktime",
+  "fmf_playback",
+  "synthetic",
+};
+
+/* names used in CAM_IFACE_LOG, in CamIfaceLogLevel order */
+static const char *log_level_names[CAM_IFACE_LOG_TRACE+1] = {
+  "off", "error", "warn", "info", "debug", "trace",
+};
+
+/* prefixes of messages written to stderr */
+static const char *log_level_prefixes[CAM_IFACE_LOG_TRACE+1] = {
+  "", "ERROR", "WARN ", "INFO ", "DEBUG", "TRACE",
+};
+
+int cam_iface_log_levels[CAM_IFACE_LOG_NUM_CATEGORIES] = {
+  CAM_IFACE_LOG_WARN, CAM_IFACE_LOG_WARN, CAM_IFACE_LOG_WARN,
+  CAM_IFACE_LOG_WARN, CAM_IFACE_LOG_WARN, CAM_IFACE_LOG_WARN,
+  CAM_IFACE_LOG_WARN, CAM_IFACE_LOG_WARN, CAM_IFACE_LOG_WARN,
+  CAM_IFACE_LOG_WARN, CAM_IFACE_LOG_WARN,
+};
+
+static int log_sinks = CAM_IFACE_LOG_SINK_STDERR;
+static int log_initialized = 0;
+
+/* The ring is written by any number of threads and read by one.
+
+   A writer takes a ticket from log_ring_head and owns slot ticket %
+   CAM_IFACE_LOG_RING_SIZE. It marks the slot busy by setting seq to 0,
+   fills it in and publishes it by setting seq to ticket+1. The reader
+   expects seq==log_ring_tail+1 in the slot it reads; a larger value
+   means the message was overwritten by a writer one lap ahead. Since
+   an overwrite may also happen while the reader copies a slot, seq is
+   checked again afterwards. Old messages are lost, writers never
+   wait. */
+typedef struct {
+  unsigned long seq;
+  double timestamp;
+  int category;
+  int level;
+  char text[CAM_IFACE_LOG_MSG_LEN];
+} log_ring_entry;
+
+static log_ring_entry log_ring[CAM_IFACE_LOG_RING_SIZE];
+static unsigned long log_ring_head = 0; /* next ticket */
+static unsigned long log_ring_tail = 0; /* next ticket to read, reader only */
+static unsigned long log_ring_lost = 0; /* not yet reported, reader only */
+
+static double log_floattime(void) {
+#ifdef _WIN32
+  struct _timeb t;
+  _ftime(&t);
+  return (double)t.time + (double)t.millitm * (double)0.001;
+#else
+  struct timeval t;
+  if (gettimeofday(&t, (struct timezone *)NULL) == 0)
+    return (double)t.tv_sec + t.tv_usec*0.000001;
+  else
+    return 0.0;
+#endif
+}
+
+/* case insensitive comparison of the n characters at s with name */
+static int log_name_equal(const char *s, size_t n, const char *name) {
+  size_t i;
+  if (strlen(name)!=n) {
+    return 0;
+  }
+  for (i=0; i<n; i++) {
+    if (tolower((unsigned char)s[i])!=name[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int log_parse_level(const char *s, size_t n) {
+  int i;
+  for (i=0; i<=CAM_IFACE_LOG_TRACE; i++) {
+    if (log_name_equal(s,n,log_level_names[i])) {
+      return i;
+    }
+  }
+  if ((n==1) && (s[0]>='0') && (s[0]<='0'+CAM_IFACE_LOG_TRACE)) {
+    return s[0]-'0';
+  }
+  return -1;
+}
+
+static int log_parse_category(const char *s, size_t n) {
+  int i;
+  if ((n==1) && (s[0]=='*')) {
+    return -1;
+  }
+  for (i=0; i<CAM_IFACE_LOG_NUM_CATEGORIES; i++) {
+    if (log_name_equal(s,n,log_category_names[i])) {
+      return i;
+    }
+  }
+  return -2;
+}
+
+/* parse "category=level,level,..." */
+static void log_parse_config(const char *config) {
+  const char *item, *end, *eq;
+  int category, level;
+
+  item = config;
+  while (*item) {
+    end = strchr(item,',');
+    if (end==NULL) {
+      end = item+strlen(item);
+    }
+    eq = memchr(item,'=',end-item);
+    if (eq==NULL) {
+      category = -1;
+      level = log_parse_level(item,end-item);
+    } else {
+      category = log_parse_category(item,eq-item);
+      level = log_parse_level(eq+1,end-(eq+1));
+    }
+    if ((category < -1) || (level < 0)) {
+      fprintf(stderr,"WARN :    cannot parse CAM_IFACE_LOG item '%.*s', ignoring\n",
+              (int)(end-item),item);
+    } else {
+      cam_iface_log_set_level(category,level);
+    }
+    item = (*end) ? end+1 : end;
+  }
+}
+
+void cam_iface_log_init(void) {
+  const char *env;
+
+  if (log_initialized) {
+    return;
+  }
+  log_initialized = 1;
+
+  /* the per-backend debug switches that predate CAM_IFACE_LOG */
+  if (getenv("MEGA_BACKEND_DEBUG")!=NULL) {
+    cam_iface_log_set_level(CAM_IFACE_LOG_MEGA,CAM_IFACE_LOG_DEBUG);
+  }
+  if (getenv("UNITY_BACKEND_DEBUG")!=NULL) {
+    cam_iface_log_set_level(CAM_IFACE_LOG_UNITY,CAM_IFACE_LOG_DEBUG);
+  }
+  if (getenv("PROSILICA_BACKEND_DEBUG")!=NULL) {
+    cam_iface_log_set_level(CAM_IFACE_LOG_PROSILICA_GIGE,CAM_IFACE_LOG_TRACE);
+  }
+
+  env = getenv("CAM_IFACE_LOG");
+  if (env!=NULL) {
+    log_parse_config(env);
+  }
+
+  env = getenv("CAM_IFACE_LOG_SINK");
+  if (env!=NULL) {
+    if (!strcmp(env,"stderr")) {
+      cam_iface_log_set_sinks(CAM_IFACE_LOG_SINK_STDERR);
+    } else if (!strcmp(env,"ring")) {
+      cam_iface_log_set_sinks(CAM_IFACE_LOG_SINK_RING);
+    } else if (!strcmp(env,"both")) {
+      cam_iface_log_set_sinks(CAM_IFACE_LOG_SINK_STDERR|CAM_IFACE_LOG_SINK_RING);
+    } else {
+      fprintf(stderr,"WARN :    cannot parse CAM_IFACE_LOG_SINK=%s, using stderr\n",env);
+    }
+  }
+}
+
+CAM_IFACE_API void cam_iface_log_set_level( int category, int level ) {
+  int i;
+  if (level < CAM_IFACE_LOG_OFF) {
+    level = CAM_IFACE_LOG_OFF;
+  }
+  if (level > CAM_IFACE_LOG_TRACE) {
+    level = CAM_IFACE_LOG_TRACE;
+  }
+  if (category < 0) {
+    for (i=0; i<CAM_IFACE_LOG_NUM_CATEGORIES; i++) {
+      cam_iface_atomic_store(&(cam_iface_log_levels[i]),level);
+    }
+  } else if (category < CAM_IFACE_LOG_NUM_CATEGORIES) {
+    cam_iface_atomic_store(&(cam_iface_log_levels[category]),level);
+  }
+}
+
+CAM_IFACE_API int cam_iface_log_get_level( int category ) {
+  if ((category < 0) || (category >= CAM_IFACE_LOG_NUM_CATEGORIES)) {
+    return CAM_IFACE_LOG_OFF;
+  }
+  return cam_iface_atomic_load(&(cam_iface_log_levels[category]));
+}
+
+CAM_IFACE_API void cam_iface_log_set_sinks( int sinks ) {
+  cam_iface_atomic_store(&log_sinks,sinks);
+}
+
+void cam_iface_log_write(int category, int level, const char *fmt, ...) {
+  char text[CAM_IFACE_LOG_MSG_LEN];
+  log_ring_entry *e;
+  unsigned long ticket;
+  int sinks;
+  va_list ap;
+
+  va_start(ap,fmt);
+  vsnprintf(text,sizeof(text),fmt,ap);
+  va_end(ap);
+
+  sinks = cam_iface_atomic_load(&log_sinks);
+  if (sinks & CAM_IFACE_LOG_SINK_RING) {
+    ticket = cam_iface_atomic_add(&log_ring_head,1) - 1;
+    e = &(log_ring[ticket % CAM_IFACE_LOG_RING_SIZE]);
+    cam_iface_atomic_store(&(e->seq),0);
+    cam_iface_atomic_fence();
+    e->timestamp = log_floattime();
+    e->category = category;
+    e->level = level;
+    memcpy(e->text,text,sizeof(text));
+    cam_iface_atomic_store(&(e->seq),ticket+1);
+  }
+  if (sinks & CAM_IFACE_LOG_SINK_STDERR) {
+    fprintf(stderr,"%s:    %s: %s\n",log_level_prefixes[level],
+            log_category_names[category],text);
+  }
+}
+
+CAM_IFACE_API int cam_iface_log_read( CamIfaceLogMessage *msg ) {
+  log_ring_entry *e;
+  unsigned long head, seq;
+
+  while (1) {
+    head = cam_iface_atomic_load(&log_ring_head);
+    if (head - log_ring_tail > CAM_IFACE_LOG_RING_SIZE) {
+      /* the writers lapped us */
+      log_ring_lost += head - CAM_IFACE_LOG_RING_SIZE - log_ring_tail;
+      log_ring_tail = head - CAM_IFACE_LOG_RING_SIZE;
+    }
+    if (log_ring_tail == head) {
+      return 0;
+    }
+    e = &(log_ring[log_ring_tail % CAM_IFACE_LOG_RING_SIZE]);
+    seq = cam_iface_atomic_load(&(e->seq));
+    if (seq < log_ring_tail+1) {
+      return 0; /* still being written, or the previous lap's entry */
+    }
+    if (seq == log_ring_tail+1) {
+      msg->timestamp = e->timestamp;
+      msg->category = e->category;
+      msg->level = e->level;
+      memcpy(msg->text,e->text,sizeof(msg->text));
+      cam_iface_atomic_fence();
+      if (cam_iface_atomic_load(&(e->seq)) == seq) {
+        log_ring_tail++;
+        msg->num_lost = log_ring_lost;
+        log_ring_lost = 0;
+        return 1;
+      }
+    }
+    /* overwritten by a later lap before or while we copied it */
+    log_ring_lost++;
+    log_ring_tail++;
+  }
+}
@@ -33,6 +33,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <errno.h>
+#include <sys/time.h>
+#endif
 
 struct backend_info_t {
   char* name;
@@ -159,10 +164,202 @@ int cam_iface_get_num_cameras(void) {
   return mega_num_cameras;
 }
 
+/* Number of cameras found by each backend during startup. */
+#if(NUM_BACKENDS>0)
+static int backend_num_cameras[NUM_BACKENDS];
+#else
+static int backend_num_cameras[1];
+#endif
+
+/* Start one backend. Backend errors are thread local, so this runs
+   entirely on the calling thread. Returns the number of cameras or -1
+   on error. */
+static int _mega_startup_backend(struct backend_info_t* this_backend_info) {
+  this_backend_info->clear_error();
+  this_backend_info->startup();
+  if (this_backend_info->have_error()) {
+    CAM_IFACE_LOG(CAM_IFACE_LOG_MEGA,CAM_IFACE_LOG_DEBUG,
+                  "%s backend startup() had error '%s'",
+                  this_backend_info->name,
+                  this_backend_info->get_error_string());
+    this_backend_info->clear_error();
+    return -1; //  backend startup had error
+  }
+  return this_backend_info->get_num_cameras();
+}
+
+/* Backends are started concurrently, since network and bus discovery
+   take seconds for some of them. A backend that does not finish within
+   MEGA_BACKEND_STARTUP_TIMEOUT seconds (default 30, negative for no
+   limit) is left out; its thread is abandoned and shuts the backend
+   down if startup ever returns. The backend is skipped by later
+   startups until then. MEGA_BACKEND_SERIAL_STARTUP starts the backends
+   one after another on the calling thread instead, for vendor
+   libraries which insist on that. */
+static void _mega_startup_backends_serial(void) {
+  int i;
+  for (i=0; i<NUM_BACKENDS; i++) {
+    backend_num_cameras[i] = _mega_startup_backend(&(backend_info[i]));
+    backend_info[i].started = (backend_num_cameras[i] >= 0);
+  }
+}
+
+#ifndef _WIN32
+
+#define MEGA_DEFAULT_STARTUP_TIMEOUT 30.0
+
+static double _mega_getenv_timeout(void) {
+  const char *env = getenv("MEGA_BACKEND_STARTUP_TIMEOUT");
+  if (env==NULL) {
+    return MEGA_DEFAULT_STARTUP_TIMEOUT;
+  }
+  return atof(env);
+}
+
+typedef struct {
+  int index;
+  int current;      /* started by this call of cam_iface_startup() */
+  int busy;         /* thread running */
+  int done;         /* startup returned */
+  int abandoned;    /* timed out, the thread cleans up after itself */
+  int num_cameras;
+} mega_startup_job;
+
+/* startup_lock protects startup_jobs */
+static pthread_mutex_t startup_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t startup_cond = PTHREAD_COND_INITIALIZER;
+#if(NUM_BACKENDS>0)
+static mega_startup_job startup_jobs[NUM_BACKENDS];
+#else
+static mega_startup_job startup_jobs[1];
+#endif
+
+static void* _mega_startup_thread_func(void *arg) {
+  mega_startup_job *job = (mega_startup_job*)arg;
+  struct backend_info_t* this_backend_info = &(backend_info[job->index]);
+  int num_cameras, abandoned;
+
+  num_cameras = _mega_startup_backend(this_backend_info);
+
+  pthread_mutex_lock(&startup_lock);
+  job->num_cameras = num_cameras;
+  job->done = 1;
+  abandoned = job->abandoned;
+  if (!abandoned) {
+    job->busy = 0;
+  }
+  pthread_cond_broadcast(&startup_cond);
+  pthread_mutex_unlock(&startup_lock);
+
+  if (abandoned) {
+    CAM_IFACE_LOG(CAM_IFACE_LOG_MEGA,CAM_IFACE_LOG_WARN,
+                  "%s backend finished starting after the timeout",
+                  this_backend_info->name);
+    if (num_cameras >= 0) {
+      this_backend_info->shutdown();
+    }
+    pthread_mutex_lock(&startup_lock);
+    job->busy = 0;
+    pthread_mutex_unlock(&startup_lock);
+  }
+  return NULL;
+}
+
+static void _mega_startup_backends(void) {
+  mega_startup_job *job;
+  pthread_t thread;
+  struct timeval now;
+  struct timespec abstime;
+  double timeout, t;
+  int i, pending;
+
+  if (getenv("MEGA_BACKEND_SERIAL_STARTUP")!=NULL) {
+    _mega_startup_backends_serial();
+    return;
+  }
+
+  timeout = _mega_getenv_timeout();
+  gettimeofday(&now,NULL);
+  t = (double)now.tv_sec + now.tv_usec*1e-6 + timeout;
+  abstime.tv_sec = (time_t)t;
+  abstime.tv_nsec = (long)((t-(double)abstime.tv_sec)*1e9);
+
+  pthread_mutex_lock(&startup_lock);
+  for (i=0; i<NUM_BACKENDS; i++) {
+    job = &(startup_jobs[i]);
+    backend_num_cameras[i] = -1;
+    job->current = 0;
+    if (job->busy) {
+      CAM_IFACE_LOG(CAM_IFACE_LOG_MEGA,CAM_IFACE_LOG_WARN,
+                    "%s backend still starting from a previous call, skipped",
+                    backend_info[i].name);
+      continue;
+    }
+    job->index = i;
+    job->current = 1;
+    job->busy = 1;
+    job->done = 0;
+    job->abandoned = 0;
+    if (pthread_create(&thread,NULL,_mega_startup_thread_func,job)) {
+      /* no thread, so start it here */
+      pthread_mutex_unlock(&startup_lock);
+      job->num_cameras = _mega_startup_backend(&(backend_info[i]));
+      pthread_mutex_lock(&startup_lock);
+      job->done = 1;
+      job->busy = 0;
+    } else {
+      pthread_detach(thread);
+    }
+  }
+
+  /* wait for all of them, up to the timeout */
+  for (;;) {
+    pending = 0;
+    for (i=0; i<NUM_BACKENDS; i++) {
+      if (startup_jobs[i].current && !startup_jobs[i].done) {
+        pending++;
+      }
+    }
+    if (pending==0) {
+      break;
+    }
+    if (timeout < 0) {
+      pthread_cond_wait(&startup_cond,&startup_lock);
+    } else if (pthread_cond_timedwait(&startup_cond,&startup_lock,&abstime)==ETIMEDOUT) {
+      break;
+    }
+  }
+
+  for (i=0; i<NUM_BACKENDS; i++) {
+    job = &(startup_jobs[i]);
+    if (!job->current) {
+      /* skipped above */
+    } else if (job->done) {
+      backend_num_cameras[i] = job->num_cameras;
+    } else {
+      job->abandoned = 1;
+      CAM_IFACE_LOG(CAM_IFACE_LOG_MEGA,CAM_IFACE_LOG_WARN,
+                    "%s backend did not start within %g seconds, skipped",
+                    backend_info[i].name,timeout);
+    }
+    backend_info[i].started = (backend_num_cameras[i] >= 0);
+  }
+  pthread_mutex_unlock(&startup_lock);
+}
+
+#else /* _WIN32 */
+
+static void _mega_startup_backends(void) {
+  _mega_startup_backends_serial();
+}
+
+#endif /* _WIN32 */
+
 void cam_iface_startup(void) {
   struct backend_info_t* this_backend_info;
   int i, next_num_cameras;
 
+  cam_iface_log_init();
   mega_num_cameras = 0;
 
   for (i=0; i<NUM_BACKENDS; i++) {
@@ -170,14 +367,12 @@ void cam_iface_startup(void) {
     this_backend_info->name = backend_names[i];
     this_backend_info->started = 0;
 
-    if (getenv("MEGA_BACKEND_DEBUG")!=NULL) {
-      fprintf(stderr,"%s: %d: this_backend_info = %p\n",
-              __FILE__,__LINE__,this_backend_info);
-      fprintf(stderr,"%s: %d: this_backend_info->name = %s\n",
-              __FILE__,__LINE__,this_backend_info->name);
-      fprintf(stderr,"%s: %d: this_backend_info->started = %d\n",
-              __FILE__,__LINE__,this_backend_info->started);
-    }
+    CAM_IFACE_LOG(CAM_IFACE_LOG_MEGA,CAM_IFACE_LOG_DEBUG,
+                  "this_backend_info = %p",this_backend_info);
+    CAM_IFACE_LOG(CAM_IFACE_LOG_MEGA,CAM_IFACE_LOG_DEBUG,
+                  "this_backend_info->name = %s",this_backend_info->name);
+    CAM_IFACE_LOG(CAM_IFACE_LOG_MEGA,CAM_IFACE_LOG_DEBUG,
+                  "this_backend_info->started = %d",this_backend_info->started);
 
     if (!strcmp(backend_names[i],"staticdc1394")) {
 #ifdef MEGA_BACKEND_DC1394
@@ -263,44 +458,71 @@ void cam_iface_startup(void) {
 #else
       fprintf(stderr,"ERROR: don't know backend %s\n",backend_names[i]);
       exit(1);
+#endif
+    } else if (!strcmp(backend_names[i],"staticfmf_playback")) {
+#ifdef MEGA_BACKEND_FMF_PLAYBACK
+#include "cam_iface_fmf_playback.h"
+      this_backend_info->have_error = fmf_playback_cam_iface_have_error;
+      this_backend_info->clear_error = fmf_playback_cam_iface_clear_error;
+      this_backend_info->get_error_string = fmf_playback_cam_iface_get_error_string;
+      this_backend_info->startup = fmf_playback_cam_iface_startup;
+      this_backend_info->shutdown = fmf_playback_cam_iface_shutdown;
+      this_backend_info->get_num_cameras = fmf_playback_cam_iface_get_num_cameras;
+      this_backend_info->get_num_modes = fmf_playback_cam_iface_get_num_modes;
+      this_backend_info->get_camera_info = fmf_playback_cam_iface_get_camera_info;
+      this_backend_info->get_mode_string = fmf_playback_cam_iface_get_mode_string;
+      this_backend_info->get_constructor_func = fmf_playback_cam_iface_get_constructor_func;
+#else
+      fprintf(stderr,"ERROR: don't know backend %s\n",backend_names[i]);
+      exit(1);
+#endif
+    } else if (!strcmp(backend_names[i],"staticsynthetic")) {
+#ifdef MEGA_BACKEND_SYNTHETIC
+#include "cam_iface_synthetic.h"
+      this_backend_info->have_error = synthetic_cam_iface_have_error;
+      this_backend_info->clear_error = synthetic_cam_iface_clear_error;
+      this_backend_info->get_error_string = synthetic_cam_iface_get_error_string;
+      this_backend_info->startup = synthetic_cam_iface_startup;
+      this_backend_info->shutdown = synthetic_cam_iface_shutdown;
+      this_backend_info->get_num_cameras = synthetic_cam_iface_get_num_cameras;
+      this_backend_info->get_num_modes = synthetic_cam_iface_get_num_modes;
+      this_backend_info->get_camera_info = synthetic_cam_iface_get_camera_info;
+      this_backend_info->get_mode_string = synthetic_cam_iface_get_mode_string;
+      this_backend_info->get_constructor_func = synthetic_cam_iface_get_constructor_func;
+#else
+      fprintf(stderr,"ERROR: don't know backend %s\n",backend_names[i]);
+      exit(1);
 #endif
     } else {
       fprintf(stderr,"ERROR: don't know unidentified backend %s\n",backend_names[i]);
       exit(1);
     }
 
-    if (getenv("MEGA_BACKEND_DEBUG")!=NULL) {
-      fprintf(stderr,"%s: %d: this_backend_info = %p\n",
-              __FILE__,__LINE__,this_backend_info);
-      fprintf(stderr,"%s: %d: this_backend_info->name = %s\n",
-              __FILE__,__LINE__,this_backend_info->name);
-      fprintf(stderr,"%s: %d: this_backend_info->started = %d\n",
-              __FILE__,__LINE__,this_backend_info->started);
-      fprintf(stderr,"%s: %d: this_backend_info->have_error = %p\n",
-              __FILE__,__LINE__,this_backend_info->have_error);
-    }
+    CAM_IFACE_LOG(CAM_IFACE_LOG_MEGA,CAM_IFACE_LOG_DEBUG,
+                  "this_backend_info = %p",this_backend_info);
+    CAM_IFACE_LOG(CAM_IFACE_LOG_MEGA,CAM_IFACE_LOG_DEBUG,
+                  "this_backend_info->name = %s",this_backend_info->name);
+    CAM_IFACE_LOG(CAM_IFACE_LOG_MEGA,CAM_IFACE_LOG_DEBUG,
+                  "this_backend_info->started = %d",this_backend_info->started);
+    CAM_IFACE_LOG(CAM_IFACE_LOG_MEGA,CAM_IFACE_LOG_DEBUG,
+                  "this_backend_info->have_error = %p",this_backend_info->have_error);
 
     /* -------- XXXXXXXXX ------- */
     //    fprintf(stderr,"be:%s",(MEGA_BACKENDS)[i]);
     //exit(1);
+  }
 
-    this_backend_info->clear_error();
-    CHECK_CI_ERR();
-
-    this_backend_info->startup();
-    if (this_backend_info->have_error()) {
-      if (getenv("MEGA_BACKEND_DEBUG")!=NULL) {
-        fprintf(stderr,"%s: %d: %s backend startup() had error '%s'\n",
-                __FILE__,__LINE__,
-                this_backend_info->name,
-                this_backend_info->get_error_string());
-      }
-      continue; //  backend startup had error
-    }
-
-    this_backend_info->started = 1;
+  _mega_startup_backends();
 
-    next_num_cameras = mega_num_cameras + this_backend_info->get_num_cameras();
+  /* assign camera numbers in backend order, however long each took */
+  for (i=0; i<NUM_BACKENDS; i++) {
+    this_backend_info = &(backend_info[i]);
+    if (!this_backend_info->started) {
+      this_backend_info->cam_start_idx = 0;
+      this_backend_info->cam_stop_idx = 0;
+      continue;
+    }
+    next_num_cameras = mega_num_cameras + backend_num_cameras[i];
     this_backend_info->cam_start_idx = mega_num_cameras;
     this_backend_info->cam_stop_idx = next_num_cameras;
     mega_num_cameras = next_num_cameras;
@@ -359,6 +581,11 @@ CamContext* CCmega_construct( int device_number, int NumImageBuffers,
       result = construct( device_number-this_backend_info->cam_start_idx,
                           NumImageBuffers, mode_number, interface );
       CHECK_CI_ERRV();
+      if (result!=NULL) {
+        cam_iface_core_set_error_funcs(result,
+                                       this_backend_info->have_error,
+                                       this_backend_info->clear_error);
+      }
     }
   }
   if (did_attempt_constructor == 0) {
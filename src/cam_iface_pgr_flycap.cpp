@@ -111,7 +111,7 @@ std::string pixfmt2string(FlyCapture2::PixelFormat pixfmt) {
 
 int get_mode_list(int device_number, std::vector<CamMode> &result ) {
 
-  FlyCapture2::Camera *cam = new FlyCapture2::Camera;
+  FlyCapture2::Camera cam;
   FlyCapture2::PGRGuid guid;
   FlyCapture2::Error err;
   CamMode mode;
@@ -175,19 +175,19 @@ int get_mode_list(int device_number, std::vector<CamMode> &result ) {
   pixfmts.push_back(FlyCapture2::PIXEL_FORMAT_RGBU);
 
   err = BACKEND_GLOBAL(busMgr_ptr)->GetCameraFromIndex(device_number, &guid);
-  // if (err!=FlyCapture2::PGRERROR_OK) {
-  //   goto errlabel2;
-  // }
-  err = cam->Connect(&guid);
-  // if (err!=FlyCapture2::PGRERROR_OK) {
-  //   goto errlabel2;
-  // }
+  if (err.GetType()!=FlyCapture2::PGRERROR_OK) {
+    return 1;
+  }
+  err = cam.Connect(&guid);
+  if (err.GetType()!=FlyCapture2::PGRERROR_OK) {
+    return 1;
+  }
 
   // FORMAT 7 -- test all modes
   std::vector<FlyCapture2::Mode>::const_iterator fmt7mode;
   for(fmt7mode=fmt7modes.begin(); fmt7mode!=fmt7modes.end(); fmt7mode++) {
     fmt7Info.mode = *fmt7mode;
-    err = cam->GetFormat7Info( &fmt7Info, &supported );
+    err = cam.GetFormat7Info( &fmt7Info, &supported );
     // if (err != FlyCapture2::PGRERROR_OK) goto errlabel1;
 
     // Do work
@@ -210,7 +210,7 @@ int get_mode_list(int device_number, std::vector<CamMode> &result ) {
 	  mode.fmt7ImageSettings.pixelFormat = *pixfmt;
 
 	  bool valid;
-	  err = cam->ValidateFormat7Settings( &mode.fmt7ImageSettings,
+	  err = cam.ValidateFormat7Settings( &mode.fmt7ImageSettings,
 					      &valid,
 					      &mode.fmt7PacketInfo );
 	  if (err == FlyCapture2::PGRERROR_OK) {
@@ -262,7 +262,7 @@ int get_mode_list(int device_number, std::vector<CamMode> &result ) {
   for(videomode=videomodes.begin(); videomode!=videomodes.end(); videomode++) {
     std::vector<FlyCapture2::FrameRate>::const_iterator framerate;
     for(framerate=framerates.begin(); framerate!=framerates.end(); framerate++) {
-      err = cam->GetVideoModeAndFrameRateInfo(*videomode, *framerate, &supported);
+      err = cam.GetVideoModeAndFrameRateInfo(*videomode, *framerate, &supported);
       if (err == FlyCapture2::PGRERROR_OK) {
 	if (supported) {
 	  std::ostringstream oss;
@@ -275,15 +275,47 @@ int get_mode_list(int device_number, std::vector<CamMode> &result ) {
     }
   }
 
-  // err = cam->Disconnect();
-  cam->Disconnect();
+  cam.Disconnect();
   return 0;
+}
 
+/* Mode lists of the cameras, probed when first needed. Probing
+   connects to the camera and tries every Format7 mode, so only the
+   cameras actually used pay for it, and only once. */
+static std::vector< std::vector<CamMode> > BACKEND_GLOBAL(mode_lists);
+static std::vector<bool> BACKEND_GLOBAL(mode_lists_valid);
+
+static const std::vector<CamMode>* get_cached_mode_list(int device_number) {
+  if (!BACKEND_GLOBAL(mode_lists_valid)[device_number]) {
+    BACKEND_GLOBAL(mode_lists)[device_number].clear();
+    if (get_mode_list(device_number, BACKEND_GLOBAL(mode_lists)[device_number])) {
+      return NULL;
+    }
+    BACKEND_GLOBAL(mode_lists_valid)[device_number] = true;
+  }
+  return &(BACKEND_GLOBAL(mode_lists)[device_number]);
+}
 
- // errlabel1:
-  // err = cam->Disconnect();
- // errlabel2:
- //  return 1;
+static int pixfmt2bits(FlyCapture2::PixelFormat pixfmt) {
+  switch (pixfmt) {
+  case FlyCapture2::PIXEL_FORMAT_MONO8: return 8;
+  case FlyCapture2::PIXEL_FORMAT_RAW8: return 8;
+  case FlyCapture2::PIXEL_FORMAT_411YUV8: return 12;
+  case FlyCapture2::PIXEL_FORMAT_MONO12: return 12;
+  case FlyCapture2::PIXEL_FORMAT_RAW12: return 12;
+  case FlyCapture2::PIXEL_FORMAT_422YUV8: return 16;
+  case FlyCapture2::PIXEL_FORMAT_MONO16: return 16;
+  case FlyCapture2::PIXEL_FORMAT_S_MONO16: return 16;
+  case FlyCapture2::PIXEL_FORMAT_RAW16: return 16;
+  case FlyCapture2::PIXEL_FORMAT_444YUV8: return 24;
+  case FlyCapture2::PIXEL_FORMAT_RGB8: return 24;
+  case FlyCapture2::PIXEL_FORMAT_BGR: return 24;
+  case FlyCapture2::PIXEL_FORMAT_BGRU: return 32;
+  case FlyCapture2::PIXEL_FORMAT_RGBU: return 32;
+  case FlyCapture2::PIXEL_FORMAT_RGB16: return 48;
+  case FlyCapture2::PIXEL_FORMAT_S_RGB16: return 48;
+  default: return 0;
+  }
 }
 
 extern "C" {
@@ -366,6 +398,12 @@ typedef struct {
   void (*set_framerate)(struct CCflycap*,float);
   void (*get_num_framebuffers)(struct CCflycap*,int*);
   void (*set_num_framebuffers)(struct CCflycap*,int);
+  void (*grab_frames_batch)(struct CCflycap*,
+                            unsigned char**,intptr_t,
+                            double*,unsigned long*,
+                            int,int,int*,float);
+  void (*get_wait_fd)(struct CCflycap*,int*);
+  void (*get_frame_roi_framenumber)(struct CCflycap*,unsigned long*);
 } CCflycap_functable;
 
 typedef struct CCflycap {
@@ -440,7 +478,10 @@ CCflycap_functable CCflycap_vmt = {
   CCflycap_get_framerate,
   CCflycap_set_framerate,
   CCflycap_get_num_framebuffers,
-  CCflycap_set_num_framebuffers
+  CCflycap_set_num_framebuffers,
+  NULL, /* grab_frames_batch: use generic loop */
+  NULL, /* get_wait_fd: use a capture thread to wait */
+  NULL /* get_frame_roi_framenumber: not known */
 };
 
 /* globals -- allocate space */
@@ -451,6 +492,8 @@ cam_iface_thread_local int BACKEND_GLOBAL(cam_iface_error)=0;
 cam_iface_thread_local char BACKEND_GLOBAL(cam_iface_error_string)[CAM_IFACE_MAX_ERROR_LEN];
 cam_iface_thread_local char BACKEND_GLOBAL(cam_iface_backend_string)[CAM_IFACE_MAX_ERROR_LEN];
 
+#define NUM_CAM_PROPS 18
+
 typedef struct cam_iface_backend_extras cam_iface_backend_extras;
 struct cam_iface_backend_extras {
   unsigned int buf_size; // current buffer size (number of bytes)
@@ -460,7 +503,10 @@ struct cam_iface_backend_extras {
   unsigned int max_width;
   double last_timestamp;
   unsigned long last_framecount;
+  int trigger_mode_info_valid; // trigger_mode_info queried
   FlyCapture2::TriggerModeInfo trigger_mode_info;
+  int property_info_valid[NUM_CAM_PROPS];
+  CameraPropertyInfo property_info[NUM_CAM_PROPS];
 };
 
 #ifdef MEGA_BACKEND
@@ -633,12 +679,18 @@ void BACKEND_METHOD(cam_iface_startup)() {
   FlyCapture2::Error error;
   unsigned int numCameras;
 
+  cam_iface_log_init();
+
   BACKEND_GLOBAL(busMgr_ptr)  = new FlyCapture2::BusManager;
   error = BACKEND_GLOBAL(busMgr_ptr)->GetNumOfCameras(&numCameras);
   BACKEND_GLOBAL(num_cameras) = (int)numCameras;
+  BACKEND_GLOBAL(mode_lists).assign(numCameras, std::vector<CamMode>());
+  BACKEND_GLOBAL(mode_lists_valid).assign(numCameras, false);
 }
 
 void BACKEND_METHOD(cam_iface_shutdown)() {
+  BACKEND_GLOBAL(mode_lists).clear();
+  BACKEND_GLOBAL(mode_lists_valid).clear();
   delete BACKEND_GLOBAL(busMgr_ptr);
 }
 
@@ -670,12 +722,11 @@ void BACKEND_METHOD(cam_iface_get_camera_info)(int device_number, Camwire_id *ou
 
 void BACKEND_METHOD(cam_iface_get_num_modes)(int device_number, int *num_modes) {
   CAM_IFACE_CHECK_DEVICE_NUMBER(device_number);
-  std::vector<CamMode> result;
-  int myerr = get_mode_list(device_number, result);
-  if (myerr) {
+  const std::vector<CamMode> *result = get_cached_mode_list(device_number);
+  if (result==NULL) {
     {CAM_IFACE_THROW_ERROR("problem getting mode list for camera"); }
   }
-  *num_modes = result.size();
+  *num_modes = result->size();
 }
 
 void BACKEND_METHOD(cam_iface_get_mode_string)(int device_number,
@@ -683,12 +734,14 @@ void BACKEND_METHOD(cam_iface_get_mode_string)(int device_number,
 					       char* mode_string,
 					       int mode_string_maxlen) {
   CAM_IFACE_CHECK_DEVICE_NUMBER(device_number);
-  std::vector<CamMode> result;
-  int myerr = get_mode_list(device_number, result);
-  if (myerr) {
+  const std::vector<CamMode> *result = get_cached_mode_list(device_number);
+  if (result==NULL) {
     {CAM_IFACE_THROW_ERROR("problem getting mode list for camera"); }
   }
-  cam_iface_snprintf(mode_string, mode_string_maxlen, result[mode_number].descr.c_str());
+  if ((mode_number<0) || (mode_number>=(int)result->size())) {
+    CAM_IFACE_THROW_ERROR("invalid mode_number");
+  }
+  cam_iface_snprintf(mode_string, mode_string_maxlen, "%s", (*result)[mode_number].descr.c_str());
 }
 
 cam_iface_constructor_func_t BACKEND_METHOD(cam_iface_get_constructor_func)(int device_number) {
@@ -705,6 +758,42 @@ CCflycap* CCflycap_construct( int device_number, int NumImageBuffers,
   return ccntxt;
 }
 
+/* Set coding from the pixel format and Bayer tiling of the camera. */
+static void _flycap_set_coding( CCflycap *ccntxt, FlyCapture2::PixelFormat pixfmt,
+                                FlyCapture2::BayerTileFormat bayer ) {
+  switch (pixfmt) {
+  case FlyCapture2::PIXEL_FORMAT_MONO8:
+    ccntxt->inherited.coding = CAM_IFACE_MONO8;
+    if (bayer!=FlyCapture2::NONE) {
+      NOT_IMPLEMENTED;
+    }
+    break;
+  case FlyCapture2::PIXEL_FORMAT_RAW8:
+    switch (bayer) {
+    case FlyCapture2::NONE:
+      ccntxt->inherited.coding = CAM_IFACE_RAW8;
+      break;
+    case FlyCapture2::RGGB:
+      ccntxt->inherited.coding = CAM_IFACE_MONO8_BAYER_RGGB;
+      break;
+    case FlyCapture2::GRBG:
+      ccntxt->inherited.coding = CAM_IFACE_MONO8_BAYER_GRBG;
+      break;
+    case FlyCapture2::GBRG:
+      ccntxt->inherited.coding = CAM_IFACE_MONO8_BAYER_GBRG;
+      break;
+    case FlyCapture2::BGGR:
+      ccntxt->inherited.coding = CAM_IFACE_MONO8_BAYER_BGGR;
+      break;
+    default:
+      NOT_IMPLEMENTED;
+    }
+    break;
+  default:
+    break;
+  }
+}
+
 void CCflycap_CCflycap( CCflycap * ccntxt, int device_number, int NumImageBuffers,
                         int mode_number, const char *interface) {
 
@@ -713,8 +802,13 @@ void CCflycap_CCflycap( CCflycap * ccntxt, int device_number, int NumImageBuffer
   ccntxt->inherited.vmt = (CamContext_functable*)&CCflycap_vmt;
 
   CAM_IFACE_CHECK_DEVICE_NUMBER(device_number);
-  std::vector<CamMode> result;
-  int myerr = get_mode_list(device_number, result);
+  const std::vector<CamMode> *result = get_cached_mode_list(device_number);
+  if (result==NULL) {
+    CAM_IFACE_THROW_ERROR("problem getting mode list for camera");
+  }
+  if ((mode_number<0) || (mode_number>=(int)result->size())) {
+    CAM_IFACE_THROW_ERROR("invalid mode_number");
+  }
 
   ccntxt->inherited.device_number = device_number;
   ccntxt->inherited.backend_extras = new cam_iface_backend_extras;
@@ -731,7 +825,7 @@ void CCflycap_CCflycap( CCflycap * ccntxt, int device_number, int NumImageBuffer
   CIPGRCHK(cam->SetConfiguration(&cfg));
 
   // Set the settings to the camera
-  CamMode target_mode = result[mode_number];
+  CamMode target_mode = (*result)[mode_number];
 
   if (target_mode.videomode == FlyCapture2::VIDEOMODE_FORMAT7) {
     CIPGRCHK(cam->SetFormat7Configuration(&target_mode.fmt7ImageSettings,
@@ -742,53 +836,42 @@ void CCflycap_CCflycap( CCflycap * ccntxt, int device_number, int NumImageBuffer
 
   ccntxt->inherited.cam = (void*)cam;
 
-  // XXX move this to start camera and query camera for settings
-
-  CIPGRCHK(cam->StartCapture());
+  cam_iface_backend_extras *extras = (cam_iface_backend_extras *)ccntxt->inherited.backend_extras;
 
+  if (target_mode.videomode == FlyCapture2::VIDEOMODE_FORMAT7) {
+    // The Format7 settings give the image size, no need to grab.
+    FlyCapture2::CameraInfo camInfo;
+    FlyCapture2::Format7ImageSettings *settings = &target_mode.fmt7ImageSettings;
+    CIPGRCHK(cam->GetCameraInfo(&camInfo));
+
+    ccntxt->inherited.depth = pixfmt2bits(settings->pixelFormat);
+    extras->current_height = settings->height;
+    extras->current_width = settings->width;
+    extras->max_height = settings->height; // the mode list uses the maximum size
+    extras->max_width = settings->width;
+    extras->buf_size = settings->width*settings->height*ccntxt->inherited.depth/8;
+    // the camera's tiling only applies to raw images
+    _flycap_set_coding(ccntxt, settings->pixelFormat,
+                       (settings->pixelFormat==FlyCapture2::PIXEL_FORMAT_RAW8) ?
+                       camInfo.bayerTileFormat : FlyCapture2::NONE);
+    INTERNAL_CHK();
+    return;
+  }
 
-  // Retrieve an image to get width, height. XXX change to query later.
+  // Other video modes: retrieve an image to get width, height.
+  CIPGRCHK(cam->StartCapture());
   FlyCapture2::Image rawImage;
   CIPGRCHK( cam->RetrieveBuffer( &rawImage ));
 
-  cam_iface_backend_extras *extras = (cam_iface_backend_extras *)ccntxt->inherited.backend_extras;
-
   ccntxt->inherited.depth = rawImage.GetBitsPerPixel();
   extras->buf_size = rawImage.GetDataSize();
   extras->current_height = rawImage.GetRows();
   extras->current_width = rawImage.GetCols();
   extras->max_height = rawImage.GetRows();
   extras->max_width = rawImage.GetCols();
-  CIPGRCHK( cam->GetTriggerModeInfo( &extras->trigger_mode_info ));
 
-  switch (rawImage.GetPixelFormat()) {
-  case FlyCapture2::PIXEL_FORMAT_MONO8:
-    ccntxt->inherited.coding = CAM_IFACE_MONO8;
-    if (rawImage.GetBayerTileFormat()!=FlyCapture2::NONE) {
-      NOT_IMPLEMENTED;
-    }
-    break;
-  case FlyCapture2::PIXEL_FORMAT_RAW8:
-    switch (rawImage.GetBayerTileFormat()) {
-    case FlyCapture2::NONE:
-      ccntxt->inherited.coding = CAM_IFACE_RAW8;
-      break;
-    case FlyCapture2::RGGB:
-      ccntxt->inherited.coding = CAM_IFACE_MONO8_BAYER_RGGB;
-      break;
-    case FlyCapture2::GRBG:
-      ccntxt->inherited.coding = CAM_IFACE_MONO8_BAYER_GRBG;
-      break;
-    case FlyCapture2::GBRG:
-      ccntxt->inherited.coding = CAM_IFACE_MONO8_BAYER_GBRG;
-      break;
-    case FlyCapture2::BGGR:
-      ccntxt->inherited.coding = CAM_IFACE_MONO8_BAYER_BGGR;
-      break;
-    default:
-      NOT_IMPLEMENTED;
-    }
-  }
+  _flycap_set_coding(ccntxt, rawImage.GetPixelFormat(), rawImage.GetBayerTileFormat());
+  INTERNAL_CHK();
   CIPGRCHK(cam->StopCapture());
 
 }
@@ -858,14 +941,19 @@ FlyCapture2::PropertyType propno2prop(int n) {
   return result;
 }
 
-#define NUM_CAM_PROPS 18
-
 void CCflycap_get_num_camera_properties(CCflycap *ccntxt,
 					int* num_properties) {
   CHECK_CC(ccntxt);
   *num_properties = NUM_CAM_PROPS;
 }
 
+/* Forget the cached property info. Limits such as the shutter's
+   absMin/absMax follow the frame rate and trigger settings. */
+static void _flycap_invalidate_property_info( CCflycap *ccntxt ) {
+  cam_iface_backend_extras* backend_extras = (cam_iface_backend_extras*)(ccntxt->inherited.backend_extras);
+  memset(backend_extras->property_info_valid,0,sizeof(backend_extras->property_info_valid));
+}
+
 void CCflycap_get_camera_property_info(CCflycap *ccntxt,
 				       int property_number,
 				       CameraPropertyInfo *info) {
@@ -879,6 +967,15 @@ void CCflycap_get_camera_property_info(CCflycap *ccntxt,
   if ((property_number<0) || (property_number>=NUM_CAM_PROPS)) {
     BACKEND_GLOBAL(cam_iface_error) = CAM_IFACE_GENERIC_ERROR;
     CAM_IFACE_ERROR_FORMAT("property invalid");
+    return;
+  }
+
+  // Ask the camera only once until a setting that may move the limits
+  // changes, see _flycap_invalidate_property_info().
+  cam_iface_backend_extras* backend_extras = (cam_iface_backend_extras*)(ccntxt->inherited.backend_extras);
+  if (backend_extras->property_info_valid[property_number]) {
+    *info = backend_extras->property_info[property_number];
+    return;
   }
 
   FlyCapture2::Property prop;
@@ -911,6 +1008,8 @@ void CCflycap_get_camera_property_info(CCflycap *ccntxt,
   FlyCapture2::Error error = cam->GetProperty( &prop );
   if (error.GetType()==FlyCapture2::PGRERROR_PROPERTY_FAILED) {
     info->is_present = 0;
+    backend_extras->property_info[property_number] = *info;
+    backend_extras->property_info_valid[property_number] = 1;
     return;
   }
   CIPGRCHK(error);
@@ -938,6 +1037,8 @@ void CCflycap_get_camera_property_info(CCflycap *ccntxt,
   info->absolute_min_value = propinfo.absMin;
   info->absolute_max_value = propinfo.absMax;
 
+  backend_extras->property_info[property_number] = *info;
+  backend_extras->property_info_valid[property_number] = 1;
   return;
 }
 
@@ -981,6 +1082,7 @@ void CCflycap_set_camera_property(CCflycap *ccntxt,
 
   prop.valueA = Value;
   prop.autoManualMode = Auto;
+  _flycap_invalidate_property_info(ccntxt); // e.g. frame rate moves the shutter limits
   CIPGRCHK(cam->SetProperty( &prop ));
   return;
 }
@@ -1047,10 +1149,21 @@ void CCflycap_get_last_framenumber( CCflycap *ccntxt, unsigned long* framenumber
   *framenumber = backend_extras->last_framecount;
 }
 
+/* Query the trigger capabilities the first time they are needed. */
+static void _flycap_get_trigger_mode_info( CCflycap *ccntxt ) {
+  cam_iface_backend_extras* backend_extras = (cam_iface_backend_extras*)(ccntxt->inherited.backend_extras);
+  if (!backend_extras->trigger_mode_info_valid) {
+    CIPGRCHK(((FlyCapture2::Camera *)(ccntxt->inherited.cam))->GetTriggerModeInfo( &backend_extras->trigger_mode_info ));
+    backend_extras->trigger_mode_info_valid = 1;
+  }
+}
+
 void CCflycap_get_num_trigger_modes( CCflycap *ccntxt,
 				     int *num_exposure_modes ) {
   CHECK_CC(ccntxt);
   cam_iface_backend_extras* backend_extras = (cam_iface_backend_extras*)(ccntxt->inherited.backend_extras);
+  _flycap_get_trigger_mode_info(ccntxt);
+  INTERNAL_CHK();
   *num_exposure_modes = 1;
 
   if (backend_extras->trigger_mode_info.present) {
@@ -1070,6 +1183,8 @@ void CCflycap_get_trigger_mode_string( CCflycap *ccntxt,
 				       int exposure_mode_string_maxlen) {
   CHECK_CC(ccntxt);
   cam_iface_backend_extras* backend_extras = (cam_iface_backend_extras*)(ccntxt->inherited.backend_extras);
+  _flycap_get_trigger_mode_info(ccntxt);
+  INTERNAL_CHK();
 
   switch (exposure_mode_number) {
   case 0:
@@ -1110,6 +1225,8 @@ void CCflycap_get_trigger_mode_number( CCflycap *ccntxt,
 				       int *exposure_mode_number ) {
   CHECK_CC(ccntxt);
   cam_iface_backend_extras* backend_extras = (cam_iface_backend_extras*)(ccntxt->inherited.backend_extras);
+  _flycap_get_trigger_mode_info(ccntxt);
+  INTERNAL_CHK();
   FlyCapture2::TriggerMode trigger_mode;
 
   if (!(backend_extras->trigger_mode_info.present)) {
@@ -1143,6 +1260,8 @@ void CCflycap_set_trigger_mode_number( CCflycap *ccntxt,
 				       int exposure_mode_number ) {
   CHECK_CC(ccntxt);
   cam_iface_backend_extras* backend_extras = (cam_iface_backend_extras*)(ccntxt->inherited.backend_extras);
+  _flycap_get_trigger_mode_info(ccntxt);
+  INTERNAL_CHK();
   FlyCapture2::TriggerMode trigger_mode;
 
   switch (exposure_mode_number) {
@@ -1165,6 +1284,7 @@ void CCflycap_set_trigger_mode_number( CCflycap *ccntxt,
 
   if (((backend_extras->trigger_mode_info.present) &&
        (backend_extras->trigger_mode_info.onOffSupported))) {
+    _flycap_invalidate_property_info(ccntxt);
     CIPGRCHK(((FlyCapture2::Camera *)(ccntxt->inherited.cam))->SetTriggerMode( &trigger_mode ));
   }
 
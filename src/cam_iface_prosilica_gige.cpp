@@ -136,6 +136,12 @@ typedef struct {
   void (*set_framerate)(struct CCprosil*,float);
   void (*get_num_framebuffers)(struct CCprosil*,int*);
   void (*set_num_framebuffers)(struct CCprosil*,int);
+  void (*grab_frames_batch)(struct CCprosil*,
+                            unsigned char**,intptr_t,
+                            double*,unsigned long*,
+                            int,int,int*,float);
+  void (*get_wait_fd)(struct CCprosil*,int*);
+  void (*get_frame_roi_framenumber)(struct CCprosil*,unsigned long*);
 } CCprosil_functable;
 
 typedef struct CCprosil {
@@ -210,7 +216,10 @@ CCprosil_functable CCprosil_vmt = {
   CCprosil_get_framerate,
   CCprosil_set_framerate,
   CCprosil_get_num_framebuffers,
-  CCprosil_set_num_framebuffers
+  CCprosil_set_num_framebuffers,
+  NULL, /* grab_frames_batch: use generic loop */
+  NULL, /* get_wait_fd: use a capture thread to wait */
+  NULL /* get_frame_roi_framenumber: not known */
 };
 
 
@@ -248,26 +257,41 @@ double ciprosil_floattime() {
 #endif
 
 /* globals -- allocate space */
-  u_int64_t BACKEND_GLOBAL(prev_ts_uint64); //tmp
-
 cam_iface_thread_local int BACKEND_GLOBAL(cam_iface_error)=0;
 #define CAM_IFACE_MAX_ERROR_LEN 255
 cam_iface_thread_local char BACKEND_GLOBAL(cam_iface_error_string)[CAM_IFACE_MAX_ERROR_LEN];
+cam_iface_thread_local cam_iface_deferred_error BACKEND_GLOBAL(cam_iface_error_info);
 cam_iface_thread_local char BACKEND_GLOBAL(cam_iface_backend_string)[CAM_IFACE_MAX_ERROR_LEN];
 
 #define PV_MAX_ENUM_LEN 32
 
 /* global variables */
-#define PV_MAX_NUM_CAMERAS 1
+#define PV_MAX_NUM_CAMERAS 16
 #define PV_MAX_NUM_BUFFERS 80
 static int BACKEND_GLOBAL(num_cameras) = 0;
 static tPvCameraInfo BACKEND_GLOBAL(camera_list)[PV_MAX_NUM_CAMERAS];
 
-// circular buffer that takes advantage of 8-bit rollover
-tPvFrame* BACKEND_GLOBAL(frames_ready_list_cam0)[256];
-u_int8_t BACKEND_GLOBAL(frames_ready_cam0_write_idx)=0;
-u_int8_t BACKEND_GLOBAL(frames_ready_cam0_read_idx)=0;
-u_int8_t BACKEND_GLOBAL(frames_ready_cam0_num)=0;
+// FIFO of frames owned by one camera. Each camera keeps its own rings
+// so that several cameras can be grabbed from separate threads.
+typedef struct prosil_frame_ring prosil_frame_ring;
+struct prosil_frame_ring {
+  tPvFrame** frames;
+  int capacity;
+  int head; // index of the oldest frame
+  int num;
+};
+
+static void prosil_frame_ring_push( prosil_frame_ring* ring, tPvFrame* frame ) {
+  ring->frames[(ring->head+ring->num)%(ring->capacity)] = frame;
+  ring->num++;
+}
+
+static tPvFrame* prosil_frame_ring_pop( prosil_frame_ring* ring ) {
+  tPvFrame* frame = ring->frames[ring->head];
+  ring->head = (ring->head+1)%(ring->capacity);
+  ring->num--;
+  return frame;
+}
 
 typedef struct cam_iface_backend_extras cam_iface_backend_extras;
 struct cam_iface_backend_extras {
@@ -279,6 +303,8 @@ struct cam_iface_backend_extras {
   int max_height;
   int max_width;
   tPvFrame** frames;
+  prosil_frame_ring frames_queued; // queued to the driver, in queue order
+  prosil_frame_ring frames_pointed; // lent out by point_next_frame_blocking()
   int frame_number_currently_waiting_for;
   long last_framecount; // same type as Prosilica's FrameCount in struct tPvFrame
   long frame_epoch;
@@ -286,6 +312,7 @@ struct cam_iface_backend_extras {
 #ifndef CIPROSIL_TIME_HOST
   u_int64_t last_timestamp;
   double timestamp_tick;
+  u_int64_t prev_ts_uint64;
 #else
   double last_timestamp;
 #endif // #ifndef CIPROSIL_TIME_HOST
@@ -327,15 +354,15 @@ const char *BACKEND_GLOBAL(pv_error_strings)[PV_ERROR_NUM] = {
   "Attribute is not available at this time"
 };
 
-#ifdef MEGA_BACKEND
 #define CAM_IFACE_ERROR_FORMAT(m)                                       \
-  cam_iface_snprintf(prosilica_gige_cam_iface_error_string,CAM_IFACE_MAX_ERROR_LEN,    \
-                     "%s (%d): %s\n",__FILE__,__LINE__,(m));
-#else
-#define CAM_IFACE_ERROR_FORMAT(m)                                       \
-  cam_iface_snprintf(cam_iface_error_string,CAM_IFACE_MAX_ERROR_LEN,    \
-                     "%s (%d): %s\n",__FILE__,__LINE__,(m));
-#endif
+  CAM_IFACE_DEFER_ERROR(BACKEND_GLOBAL(cam_iface_error_info),(m));
+
+#define CAM_IFACE_PV_ERROR_FORMAT(err)                                  \
+  CAM_IFACE_DEFER_LIB_ERROR(BACKEND_GLOBAL(cam_iface_error_info),       \
+                            "Prosilica GigE",(err),                     \
+                            ((err)<PV_ERROR_NUM) ?                      \
+                            BACKEND_GLOBAL(pv_error_strings)[(err)] : NULL, \
+                            NULL);
 
 #ifdef MEGA_BACKEND
 #define CAM_IFACE_THROW_ERROR(m)                        \
@@ -408,97 +435,29 @@ const char *BACKEND_GLOBAL(pv_error_strings)[PV_ERROR_NUM] = {
   }
 #endif
 
-#ifdef MEGA_BACKEND
 #define CIPVCHK(err) {                                                  \
   tPvErr m = err;                                                       \
   if (m!=ePvErrSuccess) {                                               \
-    prosilica_gige_cam_iface_error = CAM_IFACE_GENERIC_ERROR;                          \
+    BACKEND_GLOBAL(cam_iface_error) = CAM_IFACE_GENERIC_ERROR;          \
     if (m==ePvErrTimeout) {                                             \
-      prosilica_gige_cam_iface_error = CAM_IFACE_FRAME_TIMEOUT;                        \
-    }                                                                   \
-    if (m<PV_ERROR_NUM) {                                               \
-      cam_iface_snprintf(prosilica_gige_cam_iface_error_string,CAM_IFACE_MAX_ERROR_LEN, \
-                         "%s (%d): Prosilica GigE err %d: %s\n",__FILE__,__LINE__, \
-                         m,                                             \
-                         prosilica_gige_pv_error_strings[m]);                          \
-    } else {                                                            \
-      cam_iface_snprintf(prosilica_gige_cam_iface_error_string,CAM_IFACE_MAX_ERROR_LEN, \
-                         "%s (%d): Prosilica GigE err %d: (unknown error)\n", \
-                         __FILE__,__LINE__,                             \
-                         m);                                            \
+      BACKEND_GLOBAL(cam_iface_error) = CAM_IFACE_FRAME_TIMEOUT;        \
     }                                                                   \
+    CAM_IFACE_PV_ERROR_FORMAT(m);                                       \
     return;                                                             \
   }                                                                     \
   }
-#else
-#define CIPVCHK(err) {                                                  \
-  tPvErr m = err;                                                       \
-  if (m!=ePvErrSuccess) {                                               \
-    cam_iface_error = CAM_IFACE_GENERIC_ERROR;                          \
-    if (m==ePvErrTimeout) {                                             \
-      cam_iface_error = CAM_IFACE_FRAME_TIMEOUT;                        \
-    }                                                                   \
-    if (m<PV_ERROR_NUM) {                                               \
-      cam_iface_snprintf(cam_iface_error_string,CAM_IFACE_MAX_ERROR_LEN, \
-                         "%s (%d): Prosilica GigE err %d: %s\n",__FILE__,__LINE__, \
-                         m,                                             \
-                         pv_error_strings[m]);                          \
-    } else {                                                            \
-      cam_iface_snprintf(cam_iface_error_string,CAM_IFACE_MAX_ERROR_LEN, \
-                         "%s (%d): Prosilica GigE err %d: (unknown error)\n", \
-                         __FILE__,__LINE__,                             \
-                         m);                                            \
-    }                                                                   \
-    return;                                                             \
-  }                                                                     \
-  }
-#endif
 
-#ifdef MEGA_BACKEND
 #define CIPVCHKV(err) {                                                 \
   tPvErr m = err;                                                       \
   if (m!=ePvErrSuccess) {                                               \
-    prosilica_gige_cam_iface_error = CAM_IFACE_GENERIC_ERROR;                          \
+    BACKEND_GLOBAL(cam_iface_error) = CAM_IFACE_GENERIC_ERROR;          \
     if (m==ePvErrTimeout) {                                             \
-      prosilica_gige_cam_iface_error = CAM_IFACE_FRAME_TIMEOUT;                        \
-    }                                                                   \
-    if (m<PV_ERROR_NUM) {                                               \
-      cam_iface_snprintf(prosilica_gige_cam_iface_error_string,CAM_IFACE_MAX_ERROR_LEN, \
-                         "%s (%d): Prosilica GigE err %d: %s\n",__FILE__,__LINE__, \
-                         m,                                             \
-                         prosilica_gige_pv_error_strings[m]);                          \
-    } else {                                                            \
-      cam_iface_snprintf(prosilica_gige_cam_iface_error_string,CAM_IFACE_MAX_ERROR_LEN, \
-                         "%s (%d): Prosilica GigE err %d: (unknown error)\n", \
-                         __FILE__,__LINE__,                             \
-                         m);                                            \
+      BACKEND_GLOBAL(cam_iface_error) = CAM_IFACE_FRAME_TIMEOUT;        \
     }                                                                   \
+    CAM_IFACE_PV_ERROR_FORMAT(m);                                       \
     return NULL;                                                        \
   }                                                                     \
-}
-#else
-#define CIPVCHKV(err) {                                                 \
-  tPvErr m = err;                                                       \
-  if (m!=ePvErrSuccess) {                                               \
-    cam_iface_error = CAM_IFACE_GENERIC_ERROR;                          \
-    if (m==ePvErrTimeout) {                                             \
-      cam_iface_error = CAM_IFACE_FRAME_TIMEOUT;                        \
-    }                                                                   \
-    if (m<PV_ERROR_NUM) {                                               \
-      cam_iface_snprintf(cam_iface_error_string,CAM_IFACE_MAX_ERROR_LEN, \
-                         "%s (%d): Prosilica GigE err %d: %s\n",__FILE__,__LINE__, \
-                         m,                                             \
-                         pv_error_strings[m]);                          \
-    } else {                                                            \
-      cam_iface_snprintf(cam_iface_error_string,CAM_IFACE_MAX_ERROR_LEN, \
-                         "%s (%d): Prosilica GigE err %d: (unknown error)\n", \
-                         __FILE__,__LINE__,                             \
-                         m);                                            \
-    }                                                                   \
-    return NULL;                                                        \
-  }                                                                     \
-}
-#endif
+  }
 
 #ifdef MEGA_BACKEND
 #define INTERNAL_CHK() {                                                \
@@ -554,11 +513,13 @@ void _internal_start_streaming( CCprosil * ccntxt,
     backend_extras->frames[i]->ImageBufferSize = backend_extras->buf_size;
   }
 
+  backend_extras->frames_queued.head = 0;
+  backend_extras->frames_queued.num = 0;
+  backend_extras->frames_pointed.head = 0;
+  backend_extras->frames_pointed.num = 0;
   for (int i=0; i<backend_extras->num_buffers; i++) {
     CIPVCHK(PvCaptureQueueFrame(*handle_ptr,backend_extras->frames[i],NULL));
-    BACKEND_GLOBAL(frames_ready_list_cam0)[BACKEND_GLOBAL(frames_ready_cam0_write_idx)] = backend_extras->frames[i];
-    BACKEND_GLOBAL(frames_ready_cam0_write_idx)++;
-    BACKEND_GLOBAL(frames_ready_cam0_num)++;
+    prosil_frame_ring_push(&(backend_extras->frames_queued),backend_extras->frames[i]);
   }
 
   CIPVCHK(PvCommandRun(*handle_ptr,"AcquisitionStart"));
@@ -593,6 +554,12 @@ void _internal_stop_streaming( CCprosil * ccntxt,
     // capture was stopped anyway)
     CIPVCHK(PvCaptureQueueClear(iHandle));
   }
+
+  // The driver no longer holds any frames, and every frame will be
+  // requeued by the next _internal_start_streaming(). Callers other
+  // than close refuse to get here while frames are pointed to.
+  backend_extras->frames_queued.num = 0;
+  backend_extras->frames_pointed.num = 0;
 }
 
 #include "cam_iface_prosilica_gige.h"
@@ -614,6 +581,9 @@ int BACKEND_METHOD(cam_iface_have_error)() {
 }
 
 const char * BACKEND_METHOD(cam_iface_get_error_string)() {
+  CAM_IFACE_FORMAT_DEFERRED_ERROR(BACKEND_GLOBAL(cam_iface_error_info),
+                                  BACKEND_GLOBAL(cam_iface_error_string),
+                                  CAM_IFACE_MAX_ERROR_LEN);
   return BACKEND_GLOBAL(cam_iface_error_string);
 }
 
@@ -624,6 +594,8 @@ const char* BACKEND_METHOD(cam_iface_get_api_version)() {
 void BACKEND_METHOD(cam_iface_startup)() {
   unsigned long major, minor;
 
+  cam_iface_log_init();
+
   PvVersion(&major,&minor);
 #if defined(CAMIFACE_PROSIL_MAJOR)
   if (major!=CAMIFACE_PROSIL_MAJOR) {
@@ -858,6 +830,13 @@ void CCprosil_CCprosil( CCprosil * ccntxt, int device_number, int NumImageBuffer
   for (int i=0; i<NumImageBuffers; i++) {
     backend_extras->frames[i] = NULL;
   }
+
+  backend_extras->frames_queued.capacity = NumImageBuffers;
+  backend_extras->frames_queued.frames = (tPvFrame**)malloc( NumImageBuffers*sizeof(tPvFrame*) );
+  if (backend_extras->frames_queued.frames == NULL) {CAM_IFACE_THROW_ERROR("could not alloc frames");}
+  backend_extras->frames_pointed.capacity = NumImageBuffers;
+  backend_extras->frames_pointed.frames = (tPvFrame**)malloc( NumImageBuffers*sizeof(tPvFrame*) );
+  if (backend_extras->frames_pointed.frames == NULL) {CAM_IFACE_THROW_ERROR("could not alloc frames");}
   for (int i=0; i<NumImageBuffers; i++) {
     backend_extras->frames[i] = new tPvFrame;
     if (backend_extras->frames[i] == NULL) {CAM_IFACE_THROW_ERROR("could not alloc frames");}
@@ -902,6 +881,8 @@ void CCprosil_close(CCprosil *ccntxt) {
       }
       free(backend_extras->frames);
     }
+    free(backend_extras->frames_queued.frames);
+    free(backend_extras->frames_pointed.frames);
     delete backend_extras;
     ccntxt->inherited.backend_extras = (void*)NULL;
   }
@@ -921,6 +902,9 @@ void CCprosil_stop_camera( CCprosil *ccntxt ) {
   CHECK_CC(ccntxt);
   tPvHandle* handle_ptr = (tPvHandle*)ccntxt->inherited.cam;
   cam_iface_backend_extras* backend_extras = (cam_iface_backend_extras*)(ccntxt->inherited.backend_extras);
+  if (backend_extras->frames_pointed.num > 0) {
+    CAM_IFACE_THROW_ERROR("cannot stop camera while frames are pointed to");
+  }
   _internal_stop_streaming(ccntxt,handle_ptr,backend_extras);INTERNAL_CHK();
 }
 
@@ -1085,11 +1069,13 @@ void CCprosil_grab_next_frame_blocking( CCprosil *ccntxt, unsigned char *out_byt
                                                   timeout);
 }
 
-void CCprosil_grab_next_frame_blocking_with_stride( CCprosil *ccntxt,
-                                                      unsigned char *out_bytes,
-                                                      intptr_t stride0,
-                                                      float timeout ) {
-  CHECK_CC(ccntxt);
+// Wait for the oldest queued frame to complete and take it off the
+// queued ring, updating the frame count and timestamp. On success the
+// caller owns *frame_ptr and must hand it back with
+// _internal_requeue_frame().
+static void _internal_wait_for_frame( CCprosil *ccntxt,
+                                      float timeout,
+                                      tPvFrame** frame_ptr ) {
   tPvHandle* handle_ptr = (tPvHandle*)ccntxt->inherited.cam;
   tPvFrame* frame;
   cam_iface_backend_extras* backend_extras = (cam_iface_backend_extras*)(ccntxt->inherited.backend_extras);
@@ -1098,30 +1084,23 @@ void CCprosil_grab_next_frame_blocking_with_stride( CCprosil *ccntxt,
   double now;
   bool recent_rollover;
 
+  *frame_ptr = NULL;
+
   if (timeout < 0)
     pvTimeout = PVINFINITE;
   else
     pvTimeout = (unsigned long)ceilf(timeout*1000.0f); // convert to msec
 
-  frame = BACKEND_GLOBAL(frames_ready_list_cam0)[BACKEND_GLOBAL(frames_ready_cam0_read_idx)];
+  if (backend_extras->frames_queued.num < 1) CAM_IFACE_THROW_ERROR("no frames queued (camera not started?)");
+  frame = backend_extras->frames_queued.frames[backend_extras->frames_queued.head];
   if (frame==NULL) CAM_IFACE_THROW_ERROR("internal cam_iface error: frame not allocated");
 
   CIPVCHK(PvCaptureWaitForFrameDone(*handle_ptr,frame,pvTimeout));
 
-  BACKEND_GLOBAL(frames_ready_cam0_read_idx)++;
-  BACKEND_GLOBAL(frames_ready_cam0_num)--;
-
-  size_t wb = frame->Width;
-  int height = frame->Height;
+  prosil_frame_ring_pop(&(backend_extras->frames_queued));
 
-  for (int row=0;row<height;row++) {
-    memcpy((void*)(out_bytes+row*stride0), //dest
-           (const void*)( ((intptr_t)(frame->ImageBuffer)) + row*wb),//src
-           wb);//size
-  }
-  if (getenv("PROSILICA_BACKEND_DEBUG")!=NULL) {
-    fprintf(stderr,"frame->FrameCount %lu\n",frame->FrameCount);
-  }
+  CAM_IFACE_LOG(CAM_IFACE_LOG_PROSILICA_GIGE,CAM_IFACE_LOG_TRACE,
+                "frame->FrameCount %lu",frame->FrameCount);
 
   now = ciprosil_floattime();
   recent_rollover = (now - (backend_extras->frame_epoch_start) <= 30.0);
@@ -1151,15 +1130,14 @@ void CCprosil_grab_next_frame_blocking_with_stride( CCprosil *ccntxt,
       ((long)frame->FrameCount);
   }
 
-  if (getenv("PROSILICA_BACKEND_DEBUG")!=NULL) {
-    fprintf(stderr,"backend_extras->last_framecount %ld\n",backend_extras->last_framecount);
-  }
+  CAM_IFACE_LOG(CAM_IFACE_LOG_PROSILICA_GIGE,CAM_IFACE_LOG_TRACE,
+                "backend_extras->last_framecount %ld",backend_extras->last_framecount);
 #ifndef CIPROSIL_TIME_HOST
   u_int64_t ts_uint64;
   ts_uint64 = (((u_int64_t)(frame->TimestampHi))<<32) + (frame->TimestampLo);
   int64_t dif64; //tmp
-  dif64=ts_uint64-BACKEND_GLOBAL(prev_ts_uint64);
-  BACKEND_GLOBAL(prev_ts_uint64) = ts_uint64;
+  dif64=ts_uint64-backend_extras->prev_ts_uint64;
+  backend_extras->prev_ts_uint64 = ts_uint64;
 
   DPRINTF("got it                         (ts %llu)    (diff %lld)!\n",ts_uint64,dif64);
   backend_extras->last_timestamp = ts_uint64;
@@ -1167,38 +1145,102 @@ void CCprosil_grab_next_frame_blocking_with_stride( CCprosil *ccntxt,
   backend_extras->last_timestamp = ciprosil_floattime();
 #endif // #ifndef CIPROSIL_TIME_HOST
 
-  tPvErr oldstatus = frame->Status;
+  *frame_ptr = frame;
+}
+
+static void _internal_requeue_frame( CCprosil *ccntxt, tPvFrame* frame ) {
+  tPvHandle* handle_ptr = (tPvHandle*)ccntxt->inherited.cam;
+  cam_iface_backend_extras* backend_extras = (cam_iface_backend_extras*)(ccntxt->inherited.backend_extras);
 
-  //if (requeue_int==0) {
-    // re-queue frame buffer
-    CIPVCHK(PvCaptureQueueFrame(*handle_ptr,frame,NULL));
-    //    printf("queued frame %d\n",int(frame->Context[0]));
-    BACKEND_GLOBAL(frames_ready_list_cam0)[BACKEND_GLOBAL(frames_ready_cam0_write_idx)] = frame;
-    BACKEND_GLOBAL(frames_ready_cam0_write_idx)++;
-    BACKEND_GLOBAL(frames_ready_cam0_num)++;
-    //}
+  CIPVCHK(PvCaptureQueueFrame(*handle_ptr,frame,NULL));
+  prosil_frame_ring_push(&(backend_extras->frames_queued),frame);
+}
 
-  if(oldstatus == ePvErrDataMissing) {
+// Translate the completion status of a frame into a cam_iface error.
+static void _internal_check_frame_status( tPvErr status ) {
+  if(status == ePvErrDataMissing) {
     BACKEND_GLOBAL(cam_iface_error) = CAM_IFACE_FRAME_DATA_MISSING_ERROR;
     CAM_IFACE_ERROR_FORMAT("frame data missing");
     return;
   }
 
-  if(oldstatus == ePvErrDataLost) {
+  if(status == ePvErrDataLost) {
     BACKEND_GLOBAL(cam_iface_error) = CAM_IFACE_FRAME_DATA_LOST_ERROR;
     CAM_IFACE_ERROR_FORMAT("frame data lost");
     return;
   }
 }
 
+void CCprosil_grab_next_frame_blocking_with_stride( CCprosil *ccntxt,
+                                                      unsigned char *out_bytes,
+                                                      intptr_t stride0,
+                                                      float timeout ) {
+  CHECK_CC(ccntxt);
+  tPvFrame* frame;
+
+  _internal_wait_for_frame(ccntxt,timeout,&frame);INTERNAL_CHK();
+
+  size_t wb = frame->Width;
+  int height = frame->Height;
+
+  for (int row=0;row<height;row++) {
+    memcpy((void*)(out_bytes+row*stride0), //dest
+           (const void*)( ((intptr_t)(frame->ImageBuffer)) + row*wb),//src
+           wb);//size
+  }
+
+  tPvErr oldstatus = frame->Status;
+
+  // re-queue frame buffer
+  _internal_requeue_frame(ccntxt,frame);INTERNAL_CHK();
+
+  _internal_check_frame_status(oldstatus);
+}
+
+// Lend a completed tPvFrame to the caller without copying. Up to
+// num_buffers-1 frames may be held at once, so the driver always has
+// a frame to fill. unpoint_frame() requeues the oldest held frame.
 void CCprosil_point_next_frame_blocking( CCprosil *ccntxt, unsigned char **buf_ptr,
                                            float timeout){
   CHECK_CC(ccntxt);
-  NOT_IMPLEMENTED;
+  tPvFrame* frame;
+  cam_iface_backend_extras* backend_extras = (cam_iface_backend_extras*)(ccntxt->inherited.backend_extras);
+
+  if (backend_extras->num_buffers < 2) {
+    BACKEND_GLOBAL(cam_iface_error) = CAM_IFACE_BUFFER_OVERFLOW_ERROR;
+    CAM_IFACE_ERROR_FORMAT("need at least two frame buffers to point to frames");
+    return;
+  }
+  if (backend_extras->frames_pointed.num >= (backend_extras->num_buffers-1)) {
+    BACKEND_GLOBAL(cam_iface_error) = CAM_IFACE_BUFFER_OVERFLOW_ERROR;
+    CAM_IFACE_ERROR_FORMAT("too many frames pointed to (call unpoint_frame first)");
+    return;
+  }
+
+  _internal_wait_for_frame(ccntxt,timeout,&frame);INTERNAL_CHK();
+
+  tPvErr oldstatus = frame->Status;
+  if (oldstatus != ePvErrSuccess) {
+    // do not hand out incomplete frames
+    _internal_requeue_frame(ccntxt,frame);INTERNAL_CHK();
+    _internal_check_frame_status(oldstatus);
+    return;
+  }
+
+  prosil_frame_ring_push(&(backend_extras->frames_pointed),frame);
+  *buf_ptr = (unsigned char*)frame->ImageBuffer;
 }
+
 void CCprosil_unpoint_frame( CCprosil *ccntxt){
   CHECK_CC(ccntxt);
-  NOT_IMPLEMENTED;
+  cam_iface_backend_extras* backend_extras = (cam_iface_backend_extras*)(ccntxt->inherited.backend_extras);
+
+  if (backend_extras->frames_pointed.num < 1) {
+    CAM_IFACE_THROW_ERROR("no frame pointed to");
+  }
+
+  tPvFrame* frame = prosil_frame_ring_pop(&(backend_extras->frames_pointed));
+  _internal_requeue_frame(ccntxt,frame);
 }
 
 void CCprosil_get_last_timestamp( CCprosil *ccntxt, double* timestamp ) {
@@ -1217,9 +1259,8 @@ void CCprosil_get_last_framenumber( CCprosil *ccntxt, unsigned long* framenumber
   CHECK_CC(ccntxt);
   cam_iface_backend_extras* backend_extras = (cam_iface_backend_extras*)(ccntxt->inherited.backend_extras);
   *framenumber = (unsigned long)(backend_extras->last_framecount);
-  if (getenv("PROSILICA_BACKEND_DEBUG")!=NULL) {
-    fprintf(stderr,"*framenumber %lu\n",*framenumber);
-  }
+  CAM_IFACE_LOG(CAM_IFACE_LOG_PROSILICA_GIGE,CAM_IFACE_LOG_TRACE,
+                "*framenumber %lu",*framenumber);
 }
 
 void CCprosil_get_num_trigger_modes( CCprosil *ccntxt,
@@ -1268,6 +1309,9 @@ void CCprosil_set_trigger_mode_number( CCprosil *ccntxt,
   CHECK_CC(ccntxt);
   cam_iface_backend_extras* backend_extras = (cam_iface_backend_extras*)(ccntxt->inherited.backend_extras);
   tPvHandle* handle_ptr = (tPvHandle*)ccntxt->inherited.cam;
+  if (backend_extras->frames_pointed.num > 0) {
+    CAM_IFACE_THROW_ERROR("cannot change trigger mode while frames are pointed to");
+  }
   switch (exposure_mode_number) {
   case 0:
     CIPVCHK(PvAttrEnumSet(*handle_ptr,"FrameStartTriggerMode","Freerun"));
@@ -1321,6 +1365,9 @@ void CCprosil_set_frame_roi( CCprosil *ccntxt,
 
   l=left;// XXX should check for int overflow...
   t=top;
+  if (backend_extras->frames_pointed.num > 0) {
+    CAM_IFACE_THROW_ERROR("cannot change roi while frames are pointed to");
+  }
   _internal_stop_streaming( ccntxt, handle_ptr, backend_extras );INTERNAL_CHK();
   CIPVCHK(PvAttrUint32Set(*handle_ptr,"Width",w));
   backend_extras->current_width = width;
@@ -1375,10 +1422,85 @@ void CCprosil_get_num_framebuffers( CCprosil *ccntxt,
   *num_framebuffers = backend_extras->num_buffers;
 }
 
+// Grow or shrink the frame arrays to num_buffers frames. Must not be
+// called while frames are queued to the driver or pointed to.
+static void _internal_resize_frames( cam_iface_backend_extras* backend_extras,
+                                     int num_buffers ) {
+  tPvFrame** frames;
+  tPvFrame** queued;
+  tPvFrame** pointed;
+  int old_num = backend_extras->num_buffers;
+
+  for (int i=num_buffers; i<old_num; i++) {
+    free(backend_extras->frames[i]->ImageBuffer);
+    delete backend_extras->frames[i];
+    backend_extras->frames[i] = NULL;
+  }
+
+  frames = (tPvFrame**)realloc( backend_extras->frames, num_buffers*sizeof(tPvFrame*) );
+  if (frames == NULL) {CAM_IFACE_THROW_ERROR("could not alloc frames");}
+  backend_extras->frames = frames;
+  queued = (tPvFrame**)realloc( backend_extras->frames_queued.frames, num_buffers*sizeof(tPvFrame*) );
+  if (queued == NULL) {CAM_IFACE_THROW_ERROR("could not alloc frames");}
+  backend_extras->frames_queued.frames = queued;
+  pointed = (tPvFrame**)realloc( backend_extras->frames_pointed.frames, num_buffers*sizeof(tPvFrame*) );
+  if (pointed == NULL) {CAM_IFACE_THROW_ERROR("could not alloc frames");}
+  backend_extras->frames_pointed.frames = pointed;
+  backend_extras->frames_queued.capacity = num_buffers;
+  backend_extras->frames_queued.head = 0;
+  backend_extras->frames_pointed.capacity = num_buffers;
+  backend_extras->frames_pointed.head = 0;
+
+  // frames are counted as they are allocated, so that close() frees
+  // what exists if we fail half way
+  if (num_buffers < old_num) {
+    backend_extras->num_buffers = num_buffers;
+  }
+  for (int i=old_num; i<num_buffers; i++) {
+    frames[i] = new tPvFrame;
+    memset(frames[i],0,sizeof(tPvFrame));
+    frames[i]->ImageBuffer = malloc(backend_extras->malloced_buf_size);
+    if (frames[i]->ImageBuffer == NULL) {
+      delete frames[i];
+      frames[i] = NULL;
+      CAM_IFACE_THROW_ERROR("could not alloc buffers");
+    }
+    frames[i]->ImageBufferSize = backend_extras->buf_size;
+    frames[i]->AncillaryBuffer = NULL;
+    frames[i]->AncillaryBufferSize = 0;
+    frames[i]->Context[0] = (void*)(intptr_t)i;
+    backend_extras->num_buffers = i+1;
+  }
+}
+
+// The driver only takes frames through PvCaptureQueueFrame(), so a
+// streaming camera is stopped, the frames are reallocated and all of
+// them are queued again.
 void CCprosil_set_num_framebuffers( CCprosil *ccntxt,
                                       int num_framebuffers ) {
   CHECK_CC(ccntxt);
-  NOT_IMPLEMENTED;
+  tPvHandle* handle_ptr = (tPvHandle*)ccntxt->inherited.cam;
+  cam_iface_backend_extras* backend_extras = (cam_iface_backend_extras*)(ccntxt->inherited.backend_extras);
+  unsigned long lCapturing;
+
+  if ((num_framebuffers < 2) || (num_framebuffers > PV_MAX_NUM_BUFFERS)) {
+    CAM_IFACE_THROW_ERROR("number of frame buffers out of range");
+  }
+  if (num_framebuffers == backend_extras->num_buffers) {
+    return;
+  }
+  if (backend_extras->frames_pointed.num > 0) {
+    CAM_IFACE_THROW_ERROR("cannot change the number of frame buffers while frames are pointed to");
+  }
+
+  CIPVCHK(PvCaptureQuery(*handle_ptr,&lCapturing));
+  if (lCapturing) {
+    _internal_stop_streaming( ccntxt, handle_ptr, backend_extras );INTERNAL_CHK();
+  }
+  _internal_resize_frames( backend_extras, num_framebuffers );INTERNAL_CHK();
+  if (lCapturing) {
+    _internal_start_streaming( ccntxt, handle_ptr, backend_extras );INTERNAL_CHK();
+  }
 }
 
 } // closes: extern "C"
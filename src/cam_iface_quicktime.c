@@ -38,6 +38,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "cam_iface.h"
+#include "cam_iface_internal.h"
 
 #include <Carbon/Carbon.h>
 #include <QuickTime/QuickTime.h>
@@ -85,6 +86,12 @@ typedef struct {
   void (*set_framerate)(struct CCquicktime*,float);
   void (*get_num_framebuffers)(struct CCquicktime*,int*);
   void (*set_num_framebuffers)(struct CCquicktime*,int);
+  void (*grab_frames_batch)(struct CCquicktime*,
+                            unsigned char**,intptr_t,
+                            double*,unsigned long*,
+                            int,int,int*,float);
+  void (*get_wait_fd)(struct CCquicktime*,int*);
+  void (*get_frame_roi_framenumber)(struct CCquicktime*,unsigned long*);
 } CCquicktime_functable;
 
 typedef struct CCquicktime {
@@ -171,7 +178,10 @@ CCquicktime_functable CCquicktime_vmt = {
   CCquicktime_get_framerate,
   CCquicktime_set_framerate,
   CCquicktime_get_num_framebuffers,
-  CCquicktime_set_num_framebuffers
+  CCquicktime_set_num_framebuffers,
+  NULL, /* grab_frames_batch: use generic loop */
+  NULL, /* get_wait_fd: use a capture thread to wait */
+  NULL /* get_frame_roi_framenumber: not known */
 };
 
 
@@ -438,6 +448,8 @@ void BACKEND_METHOD(cam_iface_startup)() {
   Handle componentName=NULL;
   char info[256];
   Handle componentInfo=NULL;
+  cam_iface_log_init();
+
   componentName=NewHandle(sizeof(name));
   componentInfo=NewHandle(sizeof(info));
 
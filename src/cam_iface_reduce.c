@@ -0,0 +1,277 @@
+/*
+
+Copyright (c) 2004-2009, California Institute of Technology. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+/* Software ROI, binning and decimation, see
+   CamContext_set_software_roi().
+
+   Frames are handled in cells: one pixel for plain codings, a 2x2
+   quad for Bayer mosaics (so binning averages pixels of the same
+   colour and the mosaic survives) and the 2 or 4 pixels that share
+   chroma in packed YUV. Output cell (cx,cy) is the average of
+   binning x binning source cells starting at cell
+   (cx,cy)*binning*decimation of the region, computed byte (or 16-bit
+   sample) wise. Packed YUV is the exception: chroma is averaged across
+   the cells, but each output Y sample averages binning neighbouring
+   source pixels, so luma is binned like a mono image. Each output row
+   reads binning source rows directly, so reducing and copying is a
+   single pass. */
+
+#include "cam_iface.h"
+#include "cam_iface_internal.h"
+#include <string.h>
+
+int cam_iface_reduce_get_layout(CameraPixelCoding coding,
+                                cam_iface_reduce_layout *layout) {
+  layout->cell_width = 1;
+  layout->cell_height = 1;
+  layout->sample_bits = 8;
+  layout->num_luma = 0;
+  switch (coding) {
+  case CAM_IFACE_MONO8:
+    layout->cell_bytes = 1;
+    break;
+  case CAM_IFACE_RAW8:
+  case CAM_IFACE_MONO8_BAYER_BGGR:
+  case CAM_IFACE_MONO8_BAYER_RGGB:
+  case CAM_IFACE_MONO8_BAYER_GRBG:
+  case CAM_IFACE_MONO8_BAYER_GBRG:
+    layout->cell_width = 2;
+    layout->cell_height = 2;
+    layout->cell_bytes = 2;
+    break;
+  case CAM_IFACE_YUV411:
+    /* U Y Y V Y Y */
+    layout->cell_width = 4;
+    layout->cell_bytes = 6;
+    layout->num_luma = 4;
+    layout->luma_offsets[0] = 1;
+    layout->luma_offsets[1] = 2;
+    layout->luma_offsets[2] = 4;
+    layout->luma_offsets[3] = 5;
+    break;
+  case CAM_IFACE_YUV422:
+    /* U Y V Y */
+    layout->cell_width = 2;
+    layout->cell_bytes = 4;
+    layout->num_luma = 2;
+    layout->luma_offsets[0] = 1;
+    layout->luma_offsets[1] = 3;
+    break;
+  case CAM_IFACE_YUV444:
+  case CAM_IFACE_RGB8:
+    layout->cell_bytes = 3;
+    break;
+  case CAM_IFACE_ARGB8:
+  case CAM_IFACE_RGBA8:
+    layout->cell_bytes = 4;
+    break;
+  case CAM_IFACE_MONO16:
+    layout->cell_bytes = 2;
+    layout->sample_bits = 16;
+    break;
+  case CAM_IFACE_MONO16S:
+    layout->cell_bytes = 2;
+    layout->sample_bits = -16;
+    break;
+  case CAM_IFACE_RAW16:
+    layout->cell_width = 2;
+    layout->cell_height = 2;
+    layout->cell_bytes = 4;
+    layout->sample_bits = 16;
+    break;
+  case CAM_IFACE_RGB16:
+    layout->cell_bytes = 6;
+    layout->sample_bits = 16;
+    break;
+  case CAM_IFACE_RGB16S:
+    layout->cell_bytes = 6;
+    layout->sample_bits = -16;
+    break;
+  default:
+    return CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE;
+  }
+  return 0;
+}
+
+/* binning is 2 or 4, so the average is a shift */
+static void _reduce_row_8(const unsigned char * const *rows, int binning,
+                          int cell_bytes, intptr_t step, int num_cells,
+                          unsigned char *dst) {
+  int shift = (binning==2) ? 2 : 4;
+  int round = 1 << (shift-1);
+  int cx, b, i, j;
+  unsigned int sum;
+  intptr_t off;
+
+  for (cx=0; cx<num_cells; cx++) {
+    off = cx*step;
+    for (b=0; b<cell_bytes; b++) {
+      sum = 0;
+      for (j=0; j<binning; j++) {
+        for (i=0; i<binning; i++) {
+          sum += rows[j][off + i*cell_bytes + b];
+        }
+      }
+      *dst++ = (unsigned char)((sum + round) >> shift);
+    }
+  }
+}
+
+/* Packed YUV. Output Y sample k of a cell averages source pixels
+   k*binning to (k+1)*binning-1 of the binning cells it covers, which
+   is the same number of samples as for chroma. */
+static void _reduce_row_yuv(const unsigned char * const *rows, int binning,
+                            const cam_iface_reduce_layout *layout,
+                            intptr_t step, int num_cells, unsigned char *dst) {
+  int shift = (binning==2) ? 2 : 4;
+  int round = 1 << (shift-1);
+  int cw = layout->cell_width;
+  int cb = layout->cell_bytes;
+  int cx, b, i, j, k, p;
+  unsigned int sum;
+  intptr_t off;
+
+  for (cx=0; cx<num_cells; cx++) {
+    off = cx*step;
+    /* chroma, then overwrite the Y samples */
+    for (b=0; b<cb; b++) {
+      sum = 0;
+      for (j=0; j<binning; j++) {
+        for (i=0; i<binning; i++) {
+          sum += rows[j][off + i*cb + b];
+        }
+      }
+      dst[b] = (unsigned char)((sum + round) >> shift);
+    }
+    for (k=0; k<layout->num_luma; k++) {
+      sum = 0;
+      for (j=0; j<binning; j++) {
+        for (p=k*binning; p<(k+1)*binning; p++) {
+          sum += rows[j][off + (p/cw)*cb + layout->luma_offsets[p%cw]];
+        }
+      }
+      dst[layout->luma_offsets[k]] = (unsigned char)((sum + round) >> shift);
+    }
+    dst += cb;
+  }
+}
+
+/* 16-bit samples in host byte order, read with memcpy() because rows
+   need not be aligned */
+static void _reduce_row_16(const unsigned char * const *rows, int binning,
+                           int cell_bytes, intptr_t step, int num_cells,
+                           int is_signed, unsigned char *dst) {
+  int shift = (binning==2) ? 2 : 4;
+  int round = 1 << (shift-1);
+  int cx, b, i, j;
+  long sum;
+  intptr_t off;
+  unsigned short u;
+  short s;
+
+  for (cx=0; cx<num_cells; cx++) {
+    off = cx*step;
+    for (b=0; b<cell_bytes; b+=2) {
+      sum = 0;
+      for (j=0; j<binning; j++) {
+        for (i=0; i<binning; i++) {
+          if (is_signed) {
+            memcpy(&s, rows[j] + off + i*cell_bytes + b, 2);
+            sum += s;
+          } else {
+            memcpy(&u, rows[j] + off + i*cell_bytes + b, 2);
+            sum += u;
+          }
+        }
+      }
+      /* arithmetic shift rounds towards minus infinity for signed data */
+      sum = (sum + round) >> shift;
+      if (is_signed) {
+        s = (short)sum;
+        memcpy(dst, &s, 2);
+      } else {
+        u = (unsigned short)sum;
+        memcpy(dst, &u, 2);
+      }
+      dst += 2;
+    }
+  }
+}
+
+void cam_iface_reduce_frame(const cam_iface_reduce_layout *layout,
+                            const unsigned char *src, intptr_t src_stride,
+                            int left, int top,
+                            int out_cells_x, int out_cells_y,
+                            int binning, int decimation,
+                            unsigned char *dst, intptr_t dst_stride) {
+  const unsigned char *rows[4];
+  int cw = layout->cell_width;
+  int ch = layout->cell_height;
+  int cb = layout->cell_bytes;
+  int group = binning*decimation;  /* source cells per output cell */
+  intptr_t step = (intptr_t)group*cb;
+  int cy, py, cx, j, src_y;
+  const unsigned char *s;
+  unsigned char *d;
+
+  src += (intptr_t)(left/cw)*cb;
+  for (cy=0; cy<out_cells_y; cy++) {
+    for (py=0; py<ch; py++) {
+      src_y = top + cy*group*ch + py;
+      d = dst + (intptr_t)(cy*ch + py)*dst_stride;
+      if (binning==1) {
+        s = src + src_y*src_stride;
+        if (decimation==1) {
+          memcpy(d, s, (size_t)out_cells_x*cb);
+        } else {
+          for (cx=0; cx<out_cells_x; cx++) {
+            memcpy(d, s, cb);
+            s += step;
+            d += cb;
+          }
+        }
+        continue;
+      }
+      for (j=0; j<binning; j++) {
+        rows[j] = src + (intptr_t)(src_y + j*ch)*src_stride;
+      }
+      if (layout->num_luma > 0) {
+        _reduce_row_yuv(rows, binning, layout, step, out_cells_x, d);
+      } else if (layout->sample_bits==8) {
+        _reduce_row_8(rows, binning, cb, step, out_cells_x, d);
+      } else {
+        _reduce_row_16(rows, binning, cb, step, out_cells_x,
+                       layout->sample_bits < 0, d);
+      }
+    }
+  }
+}
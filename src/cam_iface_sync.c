@@ -0,0 +1,352 @@
+/*
+
+Copyright (c) 2004-2009, California Institute of Technology. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+/* Multi-camera frame sets, see the description in cam_iface.h.
+
+   The synchronizer holds at most one frame per camera, its head,
+   pointed to in the camera's capture ring. Once every camera has a
+   head, the heads are compared by key: the frame number plus the
+   camera's offset, or the host timestamp. If they all belong to the
+   same set, the set is handed out. Otherwise the heads of the oldest
+   set are discarded and replaced by the next frames of their cameras.
+   The oldest set is always discarded first, so every incomplete set
+   is counted exactly once. */
+
+#include "cam_iface.h"
+#include "cam_iface_internal.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+#include <sys/timeb.h>
+#else
+#include <sys/time.h>
+#endif
+
+struct CamIfaceSync {
+  int n;
+  CamContext **ctxs;
+  int match;
+  double tolerance;
+  unsigned long modulus;
+
+  CamIfaceQueuedFrame *heads;
+  int *have_head;
+  double *keys;                /* of the heads, relative to heads[0] */
+  unsigned long *offsets;      /* added to frame numbers */
+  int aligned;                 /* offsets known */
+  int set_out;                 /* heads handed out as a set */
+
+  CamContext **wait_ctxs;      /* scratch for cam_iface_wait_any() */
+  int *wait_index;
+
+  CamIfaceSyncStats stats;
+};
+
+static double _sync_floattime(void) {
+#ifdef _WIN32
+  struct _timeb t;
+  _ftime(&t);
+  return (double)t.time + (double)t.millitm * (double)0.001;
+#else
+  struct timeval t;
+  if (gettimeofday(&t, (struct timezone *)NULL) == 0)
+    return (double)t.tv_sec + t.tv_usec*0.000001;
+  else
+    return 0.0;
+#endif
+}
+
+/* Host time of a head. The camera timestamp is on the camera's own
+   clock, so until it can be mapped use the arrival time, which is late
+   by the transfer delay but on the same clock as the other cameras. */
+static double _sync_host_time(CamIfaceSync *sync, int i) {
+  double host;
+  if (CamContext_camera_to_host_time(sync->ctxs[i],sync->heads[i].timestamp,&host)) {
+    host = sync->heads[i].arrival;
+  }
+  return host;
+}
+
+/* a-b for frame numbers, taking the modulus into account */
+static double _sync_framenumber_diff(CamIfaceSync *sync, unsigned long a, unsigned long b) {
+  long d = (long)(a-b);
+  long m = (long)sync->modulus;
+  if (m > 0) {
+    d %= m;
+    if (d >= (m+1)/2) {
+      d -= m;
+    } else if (d < -(m/2)) {
+      d += m;
+    }
+  }
+  return (double)d;
+}
+
+/* Key of every head relative to heads[0]. Returns the largest
+   difference within a set. */
+static double _sync_compute_keys(CamIfaceSync *sync) {
+  double t0;
+  int i;
+
+  if ((sync->match==CAM_IFACE_SYNC_BY_FRAMENUMBER) && sync->aligned) {
+    for (i=0; i<sync->n; i++) {
+      sync->keys[i] = _sync_framenumber_diff(sync,
+                                             sync->heads[i].framenumber + sync->offsets[i],
+                                             sync->heads[0].framenumber + sync->offsets[0]);
+    }
+    return 0.0;
+  }
+  t0 = _sync_host_time(sync,0);
+  for (i=0; i<sync->n; i++) {
+    sync->keys[i] = _sync_host_time(sync,i) - t0;
+  }
+  return sync->tolerance;
+}
+
+static void _sync_drop_head(CamIfaceSync *sync, int i) {
+  CamContext_unpoint_queued_frame(sync->ctxs[i]);
+  sync->have_head[i] = 0;
+}
+
+/* Point a head for every camera without one, waiting at most until
+   stop_time (no limit if negative). */
+static int _sync_fill_heads(CamIfaceSync *sync, double stop_time) {
+  double remaining;
+  int i, nwait, ready, err;
+
+  while (1) {
+    nwait = 0;
+    for (i=0; i<sync->n; i++) {
+      if (sync->have_head[i]) {
+        continue;
+      }
+      err = CamContext_point_queued_frame(sync->ctxs[i],&(sync->heads[i]),0.0f);
+      if (err==0) {
+        if (sync->heads[i].error) {
+          /* no usable frame number or timestamp, its set is incomplete */
+          CamContext_unpoint_queued_frame(sync->ctxs[i]);
+          sync->stats.frames_discarded++;
+          i--;
+          continue;
+        }
+        sync->have_head[i] = 1;
+      } else if (err==CAM_IFACE_FRAME_TIMEOUT) {
+        sync->wait_ctxs[nwait] = sync->ctxs[i];
+        sync->wait_index[nwait] = i;
+        nwait++;
+      } else {
+        return err;
+      }
+    }
+    if (nwait==0) {
+      return 0;
+    }
+
+    remaining = -1.0;
+    if (stop_time >= 0.0) {
+      remaining = stop_time - _sync_floattime();
+      if (remaining < 0.0) {
+        return CAM_IFACE_FRAME_TIMEOUT;
+      }
+    }
+    err = cam_iface_wait_any(sync->wait_ctxs,nwait,(float)remaining,&ready);
+    if (err) {
+      return err;
+    }
+  }
+}
+
+CAM_IFACE_API int cam_iface_sync_open( CamIfaceSync **sync_out,
+                                       CamContext **ctxs,
+                                       int n,
+                                       int match,
+                                       double tolerance,
+                                       unsigned long modulus,
+                                       int num_slots ) {
+  CamIfaceSync *sync;
+  int i, err;
+
+  *sync_out = NULL;
+  if ((n < 1) || (num_slots < 2) || (tolerance < 0.0) ||
+      ((match!=CAM_IFACE_SYNC_BY_FRAMENUMBER) && (match!=CAM_IFACE_SYNC_BY_TIMESTAMP))) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+
+  sync = (CamIfaceSync*)calloc(1,sizeof(CamIfaceSync));
+  if (sync==NULL) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  sync->n = n;
+  sync->match = match;
+  sync->tolerance = tolerance;
+  sync->modulus = modulus;
+  sync->ctxs = (CamContext**)malloc(n*sizeof(CamContext*));
+  sync->heads = (CamIfaceQueuedFrame*)calloc(n,sizeof(CamIfaceQueuedFrame));
+  sync->have_head = (int*)calloc(n,sizeof(int));
+  sync->keys = (double*)calloc(n,sizeof(double));
+  sync->offsets = (unsigned long*)calloc(n,sizeof(unsigned long));
+  sync->wait_ctxs = (CamContext**)malloc(n*sizeof(CamContext*));
+  sync->wait_index = (int*)malloc(n*sizeof(int));
+  if ((sync->ctxs==NULL) || (sync->heads==NULL) || (sync->have_head==NULL) ||
+      (sync->keys==NULL) || (sync->offsets==NULL) || (sync->wait_ctxs==NULL) ||
+      (sync->wait_index==NULL)) {
+    cam_iface_sync_close(sync);
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  memcpy(sync->ctxs,ctxs,n*sizeof(CamContext*));
+
+  for (i=0; i<n; i++) {
+    err = CamContext_start_capture_thread(ctxs[i],num_slots);
+    if (err) {
+      sync->n = i; /* only stop the threads we started */
+      cam_iface_sync_close(sync);
+      return err;
+    }
+  }
+  *sync_out = sync;
+  return 0;
+}
+
+CAM_IFACE_API int cam_iface_sync_close( CamIfaceSync *sync ) {
+  int i;
+
+  if ((sync->ctxs!=NULL) && (sync->have_head!=NULL)) {
+    for (i=0; i<sync->n; i++) {
+      if (sync->have_head[i]) {
+        _sync_drop_head(sync,i);
+      }
+      CamContext_stop_capture_thread(sync->ctxs[i]);
+    }
+  }
+  free(sync->ctxs);
+  free(sync->heads);
+  free(sync->have_head);
+  free(sync->keys);
+  free(sync->offsets);
+  free(sync->wait_ctxs);
+  free(sync->wait_index);
+  free(sync);
+  return 0;
+}
+
+CAM_IFACE_API int cam_iface_sync_set_framenumber_offset( CamIfaceSync *sync,
+                                                         int camera,
+                                                         long offset ) {
+  if ((camera < 0) || (camera >= sync->n)) {
+    return CAM_IFACE_GENERIC_ERROR;
+  }
+  sync->offsets[camera] = (unsigned long)offset;
+  sync->aligned = 1;
+  return 0;
+}
+
+CAM_IFACE_API int cam_iface_sync_next_set( CamIfaceSync *sync,
+                                           CamIfaceFrameSet *set,
+                                           float timeout ) {
+  double stop_time = -1.0, tolerance, kmin, kmax;
+  int i, err, num_discarded;
+
+  if (sync->set_out) {
+    return CAM_IFACE_GENERIC_ERROR; /* release the previous set first */
+  }
+  if (timeout >= 0) {
+    stop_time = _sync_floattime() + timeout;
+  }
+
+  while (1) {
+    err = _sync_fill_heads(sync,stop_time);
+    if (err) {
+      return err;
+    }
+
+    tolerance = _sync_compute_keys(sync);
+    kmin = kmax = sync->keys[0];
+    for (i=1; i<sync->n; i++) {
+      if (sync->keys[i] < kmin) {
+        kmin = sync->keys[i];
+      }
+      if (sync->keys[i] > kmax) {
+        kmax = sync->keys[i];
+      }
+    }
+    if (kmax - kmin <= tolerance) {
+      break;
+    }
+
+    /* discard the oldest set, which some camera did not deliver */
+    num_discarded = 0;
+    for (i=0; i<sync->n; i++) {
+      if (sync->keys[i] - kmin <= tolerance) {
+        _sync_drop_head(sync,i);
+        num_discarded++;
+      }
+    }
+    sync->stats.sets_incomplete++;
+    sync->stats.frames_discarded += num_discarded;
+  }
+
+  if ((sync->match==CAM_IFACE_SYNC_BY_FRAMENUMBER) && !sync->aligned) {
+    /* the first set was matched by timestamp, take the offsets from it */
+    for (i=0; i<sync->n; i++) {
+      sync->offsets[i] = sync->heads[0].framenumber - sync->heads[i].framenumber;
+    }
+    sync->aligned = 1;
+  }
+
+  sync->set_out = 1;
+  sync->stats.sets_complete++;
+  set->num_frames = sync->n;
+  set->frames = sync->heads;
+  set->framenumber = sync->heads[0].framenumber + sync->offsets[0];
+  set->timestamp = _sync_host_time(sync,0);
+  return 0;
+}
+
+CAM_IFACE_API int cam_iface_sync_release_set( CamIfaceSync *sync ) {
+  int i;
+
+  if (!sync->set_out) {
+    return CAM_IFACE_GENERIC_ERROR; /* no set handed out */
+  }
+  for (i=0; i<sync->n; i++) {
+    _sync_drop_head(sync,i);
+  }
+  sync->set_out = 0;
+  return 0;
+}
+
+CAM_IFACE_API int cam_iface_sync_get_stats( CamIfaceSync *sync,
+                                            CamIfaceSyncStats *stats ) {
+  *stats = sync->stats;
+  return 0;
+}
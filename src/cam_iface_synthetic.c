@@ -0,0 +1,1076 @@
+/*
+
+Copyright (c) 2004-2009, California Institute of Technology. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/* Backend that generates test patterns, for measuring the library and
+   the code using it without any hardware.
+
+   The cameras behave like free running cameras with num_buffers frame
+   buffers: frames are due at a fixed framerate (or as fast as they are
+   asked for if it is 0), a consumer that falls further behind than the
+   buffers allow loses frames, and the frame numbers show the gaps.
+   Timestamps are the nominal time each frame was due, on the
+   gettimeofday() clock, so the delivery latency can be measured
+   against the host clock.
+
+   The patterns are cheap to make: the ramps are copied row by row from
+   precomputed rows, so generating a frame costs about one memcpy().
+
+   Jitter, dropped frames and corrupt frames can be injected. All
+   settings come from environment variables, see README.rst. */
+#include "cam_iface.h"
+#include "cam_iface_internal.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#endif
+
+struct CCsynth; // forward declaration
+
+// keep functable in sync across backends
+typedef struct {
+  cam_iface_constructor_func_t construct;
+  void (*destruct)(struct CamContext*);
+
+  void (*CCsynth)(struct CCsynth*,int,int,int,const char*);
+  void (*close)(struct CCsynth*);
+  void (*start_camera)(struct CCsynth*);
+  void (*stop_camera)(struct CCsynth*);
+  void (*get_num_camera_properties)(struct CCsynth*,int*);
+  void (*get_camera_property_info)(struct CCsynth*,
+                                   int,
+                                   CameraPropertyInfo*);
+  void (*get_camera_property)(struct CCsynth*,int,long*,int*);
+  void (*set_camera_property)(struct CCsynth*,int,long,int);
+  void (*grab_next_frame_blocking)(struct CCsynth*,
+                                   unsigned char*,
+                                   float);
+  void (*grab_next_frame_blocking_with_stride)(struct CCsynth*,
+                                               unsigned char*,
+                                               intptr_t,
+                                               float);
+  void (*point_next_frame_blocking)(struct CCsynth*,unsigned char**,float);
+  void (*unpoint_frame)(struct CCsynth*);
+  void (*get_last_timestamp)(struct CCsynth*,double*);
+  void (*get_last_framenumber)(struct CCsynth*,unsigned long*);
+  void (*get_num_trigger_modes)(struct CCsynth*,int*);
+  void (*get_trigger_mode_string)(struct CCsynth*,int,char*,int);
+  void (*get_trigger_mode_number)(struct CCsynth*,int*);
+  void (*set_trigger_mode_number)(struct CCsynth*,int);
+  void (*get_frame_roi)(struct CCsynth*,int*,int*,int*,int*);
+  void (*set_frame_roi)(struct CCsynth*,int,int,int,int);
+  void (*get_max_frame_size)(struct CCsynth*,int*,int*);
+  void (*get_buffer_size)(struct CCsynth*,int*);
+  void (*get_framerate)(struct CCsynth*,float*);
+  void (*set_framerate)(struct CCsynth*,float);
+  void (*get_num_framebuffers)(struct CCsynth*,int*);
+  void (*set_num_framebuffers)(struct CCsynth*,int);
+  void (*grab_frames_batch)(struct CCsynth*,
+                            unsigned char**,intptr_t,
+                            double*,unsigned long*,
+                            int,int,int*,float);
+  void (*get_wait_fd)(struct CCsynth*,int*);
+  void (*get_frame_roi_framenumber)(struct CCsynth*,unsigned long*);
+} CCsynth_functable;
+
+typedef enum {
+  SYNTH_RAMP = 0,
+  SYNTH_NOISE,
+  SYNTH_BLOB
+} SynthPattern_t;
+
+typedef struct {
+  const char *name;
+  SynthPattern_t pattern;
+  CameraPixelCoding coding;
+  int depth;
+  const char *bayer;      /* colours of the top left 2x2 pixels, or NULL */
+} SynthMode;
+
+static const SynthMode synth_modes[] = {
+  {"MONO8 ramp",        SYNTH_RAMP,  CAM_IFACE_MONO8,            8,  NULL},
+  {"MONO8 noise",       SYNTH_NOISE, CAM_IFACE_MONO8,            8,  NULL},
+  {"MONO8 moving blob", SYNTH_BLOB,  CAM_IFACE_MONO8,            8,  NULL},
+  {"MONO8:RGGB ramp",   SYNTH_RAMP,  CAM_IFACE_MONO8_BAYER_RGGB, 8,  "RGGB"},
+  {"MONO8:BGGR ramp",   SYNTH_RAMP,  CAM_IFACE_MONO8_BAYER_BGGR, 8,  "BGGR"},
+  {"MONO8:GRBG ramp",   SYNTH_RAMP,  CAM_IFACE_MONO8_BAYER_GRBG, 8,  "GRBG"},
+  {"MONO8:GBRG ramp",   SYNTH_RAMP,  CAM_IFACE_MONO8_BAYER_GBRG, 8,  "GBRG"},
+  {"YUV422 ramp",       SYNTH_RAMP,  CAM_IFACE_YUV422,           16, NULL},
+  {"MONO16 ramp",       SYNTH_RAMP,  CAM_IFACE_MONO16,           16, NULL},
+};
+#define NUM_SYNTH_MODES ((int)(sizeof(synth_modes)/sizeof(synth_modes[0])))
+
+/* the ramps repeat every SYNTH_RAMP_PERIOD pixels */
+#define SYNTH_RAMP_PERIOD 256
+
+typedef struct CCsynth {
+  CamContext inherited;
+
+  const SynthMode *mode;
+  int bytes_per_pixel;
+
+  int roi_left;
+  int roi_top;
+  int roi_width;
+  int roi_height;
+  int brightness;
+
+  /* ramp rows (two for Bayer mosaics), max width plus one period long */
+  unsigned char *ramp_rows[2];
+
+  /* frames lent out by point_next_frame_blocking(), oldest first */
+  unsigned char **buffers;
+  int num_buffers;
+  int first_pointed;
+  int num_pointed;
+
+  int started;
+  float framerate;
+  uint64_t rng;
+
+  /* schedule: frame sched_count is due sched_count/framerate after
+  sched_time (monotonic clock) */
+  double sched_time;
+  unsigned long sched_count;
+  double wall_offset;     /* gettimeofday() minus monotonic time */
+
+  /* drops and jitter of the next frame, decided once so that timeouts
+  do not re-roll them */
+  int pending;
+  double pending_due;
+  double pending_jitter;
+
+  unsigned long framenumber; /* of the next frame */
+  double last_timestamp;
+  unsigned long last_framenumber;
+  unsigned long roi_framenumber; /* first frame with the current roi */
+
+  /* timerfd that expires when the next frame is due, created by
+  get_wait_fd(). -1 if unused. */
+  int wait_fd;
+
+} CCsynth;
+
+// forward declarations
+CCsynth* CCsynth_construct( int device_number, int NumImageBuffers,
+                            int mode_number, const char *interface);
+void delete_CCsynth(struct CCsynth*);
+
+void CCsynth_CCsynth(struct CCsynth*,int,int,int,const char *);
+void CCsynth_close(struct CCsynth*);
+void CCsynth_start_camera(struct CCsynth*);
+void CCsynth_stop_camera(struct CCsynth*);
+void CCsynth_get_num_camera_properties(struct CCsynth*,int*);
+void CCsynth_get_camera_property_info(struct CCsynth*,
+                                      int,
+                                      CameraPropertyInfo*);
+void CCsynth_get_camera_property(struct CCsynth*,int,long*,int*);
+void CCsynth_set_camera_property(struct CCsynth*,int,long,int);
+void CCsynth_grab_next_frame_blocking(struct CCsynth*,
+                                      unsigned char*,
+                                      float);
+void CCsynth_grab_next_frame_blocking_with_stride(struct CCsynth*,
+                                                  unsigned char*,
+                                                  intptr_t,
+                                                  float);
+void CCsynth_point_next_frame_blocking(struct CCsynth*,unsigned char**,float);
+void CCsynth_unpoint_frame(struct CCsynth*);
+void CCsynth_get_last_timestamp(struct CCsynth*,double*);
+void CCsynth_get_last_framenumber(struct CCsynth*,unsigned long*);
+void CCsynth_get_num_trigger_modes(struct CCsynth*,int*);
+void CCsynth_get_trigger_mode_string(struct CCsynth*,int,char*,int);
+void CCsynth_get_trigger_mode_number(struct CCsynth*,int*);
+void CCsynth_set_trigger_mode_number(struct CCsynth*,int);
+void CCsynth_get_frame_roi(struct CCsynth*,int*,int*,int*,int*);
+void CCsynth_set_frame_roi(struct CCsynth*,int,int,int,int);
+void CCsynth_get_max_frame_size(struct CCsynth*,int*,int*);
+void CCsynth_get_buffer_size(struct CCsynth*,int*);
+void CCsynth_get_framerate(struct CCsynth*,float*);
+void CCsynth_set_framerate(struct CCsynth*,float);
+void CCsynth_get_num_framebuffers(struct CCsynth*,int*);
+void CCsynth_set_num_framebuffers(struct CCsynth*,int);
+void CCsynth_get_wait_fd(struct CCsynth*,int*);
+void CCsynth_get_frame_roi_framenumber(struct CCsynth*,unsigned long*);
+
+CCsynth_functable CCsynth_vmt = {
+  (cam_iface_constructor_func_t)CCsynth_construct,
+  (void (*)(CamContext*))delete_CCsynth,
+  CCsynth_CCsynth,
+  CCsynth_close,
+  CCsynth_start_camera,
+  CCsynth_stop_camera,
+  CCsynth_get_num_camera_properties,
+  CCsynth_get_camera_property_info,
+  CCsynth_get_camera_property,
+  CCsynth_set_camera_property,
+  CCsynth_grab_next_frame_blocking,
+  CCsynth_grab_next_frame_blocking_with_stride,
+  CCsynth_point_next_frame_blocking,
+  CCsynth_unpoint_frame,
+  CCsynth_get_last_timestamp,
+  CCsynth_get_last_framenumber,
+  CCsynth_get_num_trigger_modes,
+  CCsynth_get_trigger_mode_string,
+  CCsynth_get_trigger_mode_number,
+  CCsynth_set_trigger_mode_number,
+  CCsynth_get_frame_roi,
+  CCsynth_set_frame_roi,
+  CCsynth_get_max_frame_size,
+  CCsynth_get_buffer_size,
+  CCsynth_get_framerate,
+  CCsynth_set_framerate,
+  CCsynth_get_num_framebuffers,
+  CCsynth_set_num_framebuffers,
+  NULL, /* grab_frames_batch: use generic loop */
+  CCsynth_get_wait_fd,
+  CCsynth_get_frame_roi_framenumber
+};
+
+#ifdef __APPLE__
+#define myTLS
+#else
+#define myTLS __thread
+#endif
+
+#ifdef MEGA_BACKEND
+  #define BACKEND_GLOBAL(m) synthetic_##m
+#else
+  #define BACKEND_GLOBAL(m) m
+#endif
+
+/* globals -- allocate space */
+myTLS int BACKEND_GLOBAL(cam_iface_error) = 0;
+#define CAM_IFACE_MAX_ERROR_LEN 255
+myTLS char BACKEND_GLOBAL(cam_iface_error_string)[CAM_IFACE_MAX_ERROR_LEN]  = {0x00}; //...
+myTLS cam_iface_deferred_error BACKEND_GLOBAL(cam_iface_error_info) = {NULL};
+
+static int synth_num_cameras = 1;
+static int synth_width = 640;
+static int synth_height = 480;
+static float synth_framerate = 100.0f;
+static double synth_jitter = 0.0;
+static double synth_drop_rate = 0.0;
+static double synth_corrupt_rate = 0.0;
+static int synth_camera_clock = 0;      /* timestamps on a simulated camera clock */
+static double synth_clock_offset = 0.0;
+static double synth_clock_drift = 0.0;  /* ppm */
+
+#define CAM_IFACE_ERROR_FORMAT(m)                                       \
+  CAM_IFACE_DEFER_ERROR(BACKEND_GLOBAL(cam_iface_error_info),(m));
+
+#define SYNTH_ERROR(_code, _msg)                                        \
+  BACKEND_GLOBAL(cam_iface_error) = _code;                              \
+  CAM_IFACE_ERROR_FORMAT(_msg);
+
+#include "cam_iface_synthetic.h"
+
+const char *BACKEND_METHOD(cam_iface_get_driver_name)() {
+  return "synthetic";
+}
+
+void BACKEND_METHOD(cam_iface_clear_error)() {
+  BACKEND_GLOBAL(cam_iface_error) = 0;
+}
+
+int BACKEND_METHOD(cam_iface_have_error)() {
+  return BACKEND_GLOBAL(cam_iface_error);
+}
+
+const char * BACKEND_METHOD(cam_iface_get_error_string)() {
+  CAM_IFACE_FORMAT_DEFERRED_ERROR(BACKEND_GLOBAL(cam_iface_error_info),
+                                  BACKEND_GLOBAL(cam_iface_error_string),
+                                  CAM_IFACE_MAX_ERROR_LEN);
+  return BACKEND_GLOBAL(cam_iface_error_string);
+}
+
+const char* BACKEND_METHOD(cam_iface_get_api_version)() {
+  return CAM_IFACE_API_VERSION;
+}
+
+static double synth_monotonic_time(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + t.tv_nsec*1e-9;
+}
+
+static double synth_wall_time(void) {
+  struct timeval t;
+  gettimeofday(&t, NULL);
+  return (double)t.tv_sec + t.tv_usec*1e-6;
+}
+
+static void synth_sleep(double seconds) {
+  struct timespec t;
+  if (seconds <= 0)
+    return;
+  t.tv_sec = (time_t)seconds;
+  t.tv_nsec = (long)((seconds - (double)t.tv_sec)*1e9);
+  while (nanosleep(&t, &t) != 0 && errno == EINTR)
+    ;
+}
+
+/* xorshift64* */
+static uint64_t synth_random(CCsynth *this) {
+  this->rng ^= this->rng >> 12;
+  this->rng ^= this->rng << 25;
+  this->rng ^= this->rng >> 27;
+  return this->rng * 0x2545F4914F6CDD1DULL;
+}
+
+/* uniform in [0,1) */
+static double synth_random_unit(CCsynth *this) {
+  return (synth_random(this) >> 11) * (1.0/9007199254740992.0);
+}
+
+static double synth_getenv_double(const char *name, double def) {
+  const char *env = getenv(name);
+  char *end;
+  double value;
+  if (env == NULL)
+    return def;
+  value = strtod(env, &end);
+  if (end == env) {
+    CAM_IFACE_LOG(CAM_IFACE_LOG_SYNTHETIC,CAM_IFACE_LOG_WARN,
+                  "cannot parse %s=%s, using %g",name,env,def);
+    return def;
+  }
+  return value;
+}
+
+void BACKEND_METHOD(cam_iface_startup)() {
+  const char *env;
+
+  cam_iface_log_init();
+
+  synth_num_cameras = (int)synth_getenv_double("SYNTHETIC_BACKEND_CAMERAS", 1);
+  if (synth_num_cameras < 0)
+    synth_num_cameras = 0;
+
+  env = getenv("SYNTHETIC_BACKEND_SIZE");
+  if (env != NULL) {
+    if (sscanf(env, "%dx%d", &synth_width, &synth_height) != 2 ||
+        synth_width < 2 || synth_height < 2) {
+      CAM_IFACE_LOG(CAM_IFACE_LOG_SYNTHETIC,CAM_IFACE_LOG_WARN,
+                    "cannot parse SYNTHETIC_BACKEND_SIZE=%s, using 640x480",env);
+      synth_width = 640;
+      synth_height = 480;
+    }
+    synth_width &= ~1; /* keep Bayer and YUV422 pixel pairs whole */
+    synth_height &= ~1;
+  }
+
+  synth_framerate = synth_getenv_double("SYNTHETIC_BACKEND_FRAMERATE", 100.0);
+  if (synth_framerate < 0)
+    synth_framerate = 0;
+  synth_jitter = synth_getenv_double("SYNTHETIC_BACKEND_JITTER", 0.0);
+  synth_drop_rate = synth_getenv_double("SYNTHETIC_BACKEND_DROP_RATE", 0.0);
+  if (synth_drop_rate > 0.99) /* leave some frames to deliver */
+    synth_drop_rate = 0.99;
+  synth_corrupt_rate = synth_getenv_double("SYNTHETIC_BACKEND_CORRUPT_RATE", 0.0);
+  synth_camera_clock = (getenv("SYNTHETIC_BACKEND_CLOCK_OFFSET") != NULL ||
+                        getenv("SYNTHETIC_BACKEND_CLOCK_DRIFT") != NULL);
+  synth_clock_offset = synth_getenv_double("SYNTHETIC_BACKEND_CLOCK_OFFSET", 0.0);
+  synth_clock_drift = synth_getenv_double("SYNTHETIC_BACKEND_CLOCK_DRIFT", 0.0);
+
+  /* mimic the bus or network discovery of real backends */
+  synth_sleep(synth_getenv_double("SYNTHETIC_BACKEND_STARTUP_DELAY", 0.0));
+}
+
+void BACKEND_METHOD(cam_iface_shutdown)() {
+}
+
+int BACKEND_METHOD(cam_iface_get_num_cameras)() {
+  return synth_num_cameras;
+}
+
+void BACKEND_METHOD(cam_iface_get_camera_info)(int device_number, Camwire_id *out_camid) {
+  if (out_camid==NULL) {
+    SYNTH_ERROR(CAM_IFACE_GENERIC_ERROR, "return structure NULL");
+    return;
+  }
+  if (device_number < 0 || device_number >= synth_num_cameras) {
+    SYNTH_ERROR(CAM_IFACE_CAMERA_NOT_AVAILABLE_ERROR, "invalid device number");
+    return;
+  }
+
+  snprintf(out_camid->vendor, CAMWIRE_ID_MAX_CHARS, "%s", "libcamiface");
+  snprintf(out_camid->model, CAMWIRE_ID_MAX_CHARS, "%s", "synthetic");
+  snprintf(out_camid->chip, CAMWIRE_ID_MAX_CHARS, "synthetic-%d", device_number);
+}
+
+void BACKEND_METHOD(cam_iface_get_num_modes)(int device_number, int *num_modes) {
+  if (device_number < 0 || device_number >= synth_num_cameras) {
+    SYNTH_ERROR(CAM_IFACE_CAMERA_NOT_AVAILABLE_ERROR, "invalid device number");
+    return;
+  }
+  *num_modes = NUM_SYNTH_MODES;
+}
+
+void BACKEND_METHOD(cam_iface_get_mode_string)(int device_number,
+                               int mode_number,
+                               char* mode_string,
+                               int mode_string_maxlen) {
+  if (device_number < 0 || device_number >= synth_num_cameras) {
+    SYNTH_ERROR(CAM_IFACE_CAMERA_NOT_AVAILABLE_ERROR, "invalid device number");
+    return;
+  }
+  if (mode_number < 0 || mode_number >= NUM_SYNTH_MODES) {
+    SYNTH_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "invalid mode number");
+    return;
+  }
+
+  snprintf(mode_string,mode_string_maxlen,
+           "%d x %d %s (synthetic)",
+           synth_width, synth_height, synth_modes[mode_number].name);
+}
+
+cam_iface_constructor_func_t BACKEND_METHOD(cam_iface_get_constructor_func)(int device_number) {
+  (void)device_number;
+  return (CamContext* (*)(int, int, int, const char *))CCsynth_construct;
+}
+
+CCsynth* CCsynth_construct( int device_number, int NumImageBuffers,
+                            int mode_number, const char *interface) {
+  CCsynth* this=NULL;
+
+  this = malloc(sizeof(CCsynth));
+  if (this==NULL) {
+    SYNTH_ERROR(CAM_IFACE_GENERIC_ERROR, "error allocating memory");
+  } else {
+    CCsynth_CCsynth( this,
+                     device_number, NumImageBuffers,
+                     mode_number, interface);
+    if (BACKEND_GLOBAL(cam_iface_error)) {
+      CCsynth_close(this);
+      free(this);
+      return NULL;
+    }
+  }
+  return this;
+}
+
+void delete_CCsynth( CCsynth *this ) {
+  CCsynth_close(this);
+  this->inherited.vmt = NULL;
+  free(this);
+}
+
+/* Fill the ramp rows. Pixel i of a row has the value i+brightness
+(mod 256); Bayer mosaics show that value in red, shifted by a third
+in green and two thirds in blue; YUV422 varies the chroma with it. */
+static void _CCsynth_fill_ramp_rows( CCsynth *this ) {
+  int n = synth_width + SYNTH_RAMP_PERIOD;
+  int i, r;
+  unsigned char v, *row;
+
+  for (r=0; r<2; r++) {
+    row = this->ramp_rows[r];
+    for (i=0; i<n; i++) {
+      v = (unsigned char)(i + this->brightness);
+      switch (this->mode->coding) {
+      case CAM_IFACE_MONO16:
+        /* both bytes equal, so the byte order does not matter */
+        row[2*i] = row[2*i+1] = v;
+        break;
+      case CAM_IFACE_YUV422:
+        /* UYVY */
+        row[2*i] = (i & 1) ? (unsigned char)(255-v) : v;
+        row[2*i+1] = v;
+        break;
+      default:
+        if (this->mode->bayer) {
+          switch (this->mode->bayer[2*r + (i & 1)]) {
+          case 'R': row[i] = v; break;
+          case 'G': row[i] = (unsigned char)(v + 85); break;
+          default:  row[i] = (unsigned char)(v + 170); break;
+          }
+        } else {
+          row[i] = v;
+        }
+        break;
+      }
+    }
+  }
+}
+
+void CCsynth_CCsynth( CCsynth *this,
+                      int device_number, int NumImageBuffers,
+                      int mode_number, const char *interface) {
+  int i;
+  size_t row_size;
+
+  /* call parent */
+  CamContext_CamContext((CamContext*)this,device_number,NumImageBuffers,mode_number,interface);
+  this->inherited.vmt = (CamContext_functable*)&CCsynth_vmt;
+
+  /* initialize */
+  this->inherited.cam = (void *)NULL;
+  this->inherited.backend_extras = (void *)NULL;
+  this->inherited.device_number = device_number;
+
+  this->ramp_rows[0] = this->ramp_rows[1] = NULL;
+  this->buffers = NULL;
+  this->num_buffers = 0;
+  this->first_pointed = 0;
+  this->num_pointed = 0;
+  this->wait_fd = -1;
+  this->started = 0;
+  this->pending = 0;
+  this->framenumber = 0;
+  this->last_timestamp = 0.0;
+  this->last_framenumber = 0;
+  this->roi_framenumber = 0;
+  this->framerate = synth_framerate;
+  this->brightness = 0;
+  this->rng = 0x9E3779B97F4A7C15ULL * (uint64_t)(device_number+1);
+
+  if (device_number < 0 || device_number >= synth_num_cameras) {
+    SYNTH_ERROR(CAM_IFACE_CAMERA_NOT_AVAILABLE_ERROR, "invalid device number");
+    return;
+  }
+  if (mode_number < 0 || mode_number >= NUM_SYNTH_MODES) {
+    SYNTH_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "invalid mode number");
+    return;
+  }
+
+  this->mode = &synth_modes[mode_number];
+  this->bytes_per_pixel = this->mode->depth / 8;
+  this->inherited.depth = this->mode->depth;
+  this->inherited.coding = this->mode->coding;
+
+  this->roi_left = 0;
+  this->roi_top = 0;
+  this->roi_width = synth_width;
+  this->roi_height = synth_height;
+
+  row_size = (size_t)(synth_width + SYNTH_RAMP_PERIOD) * this->bytes_per_pixel;
+  for (i=0; i<2; i++) {
+    this->ramp_rows[i] = malloc(row_size);
+    if (this->ramp_rows[i] == NULL) {
+      SYNTH_ERROR(CAM_IFACE_GENERIC_ERROR, "error allocating memory");
+      return;
+    }
+  }
+  _CCsynth_fill_ramp_rows(this);
+
+  CCsynth_set_num_framebuffers(this, NumImageBuffers > 0 ? NumImageBuffers : 1);
+}
+
+static void _CCsynth_free_buffers( CCsynth *this ) {
+  int i;
+  if (this->buffers) {
+    for (i=0; i<this->num_buffers; i++)
+      free(this->buffers[i]);
+    free(this->buffers);
+  }
+  this->buffers = NULL;
+  this->num_buffers = 0;
+}
+
+void CCsynth_close(CCsynth *this) {
+  if (this->wait_fd >= 0) {
+    close(this->wait_fd);
+    this->wait_fd = -1;
+  }
+  _CCsynth_free_buffers(this);
+  free(this->ramp_rows[0]);
+  free(this->ramp_rows[1]);
+  this->ramp_rows[0] = this->ramp_rows[1] = NULL;
+}
+
+static int _isqrt( int n ) {
+  int r = 0, bit = 1 << 30;
+  while (bit > n)
+    bit >>= 2;
+  while (bit) {
+    if (n >= r + bit) {
+      n -= r + bit;
+      r = (r >> 1) + bit;
+    } else {
+      r >>= 1;
+    }
+    bit >>= 2;
+  }
+  return r;
+}
+
+/* position along a path bouncing between 0 and max */
+static int _bounce( unsigned long t, int max ) {
+  unsigned long p = t % (2*(unsigned long)max);
+  return (int)(p < (unsigned long)max ? p : 2*(unsigned long)max - p);
+}
+
+/* Draw frame number frame of the pattern into dst. All patterns are
+computed in sensor coordinates, so the ROI crops them. */
+static void _CCsynth_render( CCsynth *this, unsigned char *dst, intptr_t stride,
+                             unsigned long frame ) {
+  int bpp = this->bytes_per_pixel;
+  size_t row_bytes = (size_t)this->roi_width * bpp;
+  int y, off;
+
+  switch (this->mode->pattern) {
+  case SYNTH_RAMP:
+    /* scroll diagonally by two pixels per frame, keeping Bayer and
+    YUV422 pixel pairs aligned */
+    for (y=0; y<this->roi_height; y++) {
+      int sy = y + this->roi_top;
+      off = (int)((2*((unsigned long)sy + frame)) % SYNTH_RAMP_PERIOD);
+      memcpy(dst + y*stride,
+             this->ramp_rows[this->mode->bayer ? (sy & 1) : 0] + (size_t)(this->roi_left + off)*bpp,
+             row_bytes);
+    }
+    break;
+
+  case SYNTH_NOISE:
+    for (y=0; y<this->roi_height; y++) {
+      unsigned char *row = dst + y*stride;
+      size_t i;
+      uint64_t r;
+      for (i=0; i+8<=row_bytes; i+=8) {
+        r = synth_random(this);
+        memcpy(row+i, &r, 8);
+      }
+      if (i < row_bytes) {
+        r = synth_random(this);
+        memcpy(row+i, &r, row_bytes-i);
+      }
+    }
+    break;
+
+  case SYNTH_BLOB:
+    {
+      int radius = synth_height/10 > 1 ? synth_height/10 : 1;
+      int cx = _bounce(3*frame, synth_width-1);
+      int cy = _bounce(2*frame, synth_height-1);
+      int dy, half, x0, x1;
+
+      for (y=0; y<this->roi_height; y++) {
+        unsigned char *row = dst + y*stride;
+        memset(row, this->brightness, row_bytes);
+        dy = y + this->roi_top - cy;
+        if (dy < -radius || dy > radius)
+          continue;
+        half = _isqrt(radius*radius - dy*dy);
+        x0 = cx - half - this->roi_left;
+        x1 = cx + half - this->roi_left + 1;
+        if (x0 < 0) x0 = 0;
+        if (x1 > this->roi_width) x1 = this->roi_width;
+        if (x1 > x0)
+          memset(row + x0, 255, x1 - x0);
+      }
+    }
+    break;
+  }
+}
+
+/* Decide the drops and jitter of the next frame and when it is due. */
+static void _CCsynth_prepare_frame( CCsynth *this ) {
+  double behind;
+  unsigned long lost;
+
+  if (this->pending)
+    return;
+
+  while (synth_drop_rate > 0 && synth_random_unit(this) < synth_drop_rate) {
+    this->framenumber++;
+    this->sched_count++;
+  }
+
+  if (this->framerate > 0) {
+    /* a consumer further behind than the buffers hold loses frames */
+    behind = (synth_monotonic_time() - this->sched_time) * this->framerate - this->sched_count;
+    if (behind > this->num_buffers) {
+      lost = (unsigned long)behind - this->num_buffers + 1;
+      this->framenumber += lost;
+      this->sched_count += lost;
+    }
+    this->pending_due = this->sched_time + this->sched_count / this->framerate;
+    this->pending_jitter = synth_jitter > 0 ? synth_jitter * synth_random_unit(this) : 0.0;
+  } else {
+    this->pending_due = 0.0;
+    this->pending_jitter = 0.0;
+  }
+  this->pending = 1;
+}
+
+static void _CCsynth_reset_schedule( CCsynth *this ) {
+  this->sched_time = synth_monotonic_time();
+  this->wall_offset = synth_wall_time() - this->sched_time;
+  this->sched_count = 0;
+  this->pending = 0;
+}
+
+static void _CCsynth_arm_wait_fd( CCsynth *this ) {
+#ifdef __linux__
+  struct itimerspec its;
+  double due;
+
+  if (this->wait_fd < 0)
+    return;
+
+  memset(&its, 0, sizeof(its));
+  if (this->started) {
+    _CCsynth_prepare_frame(this);
+    due = this->pending_due + this->pending_jitter;
+    its.it_value.tv_sec = (time_t)due;
+    its.it_value.tv_nsec = (long)((due - (double)its.it_value.tv_sec)*1e9);
+    if (its.it_value.tv_sec <= 0 && its.it_value.tv_nsec <= 0)
+      its.it_value.tv_nsec = 1; /* already due; zero would disarm */
+  }
+  timerfd_settime(this->wait_fd, TFD_TIMER_ABSTIME, &its, NULL);
+#endif
+}
+
+/* Wait until the next frame is due. Leaves an error set if the frame
+is not to be delivered. */
+static void _CCsynth_wait_frame( CCsynth *this, float timeout ) {
+  double wait, timestamp;
+
+  if (!this->started) {
+    SYNTH_ERROR(CAM_IFACE_GENERIC_ERROR, "camera not started");
+    return;
+  }
+
+  _CCsynth_prepare_frame(this);
+
+  if (this->framerate > 0) {
+    wait = this->pending_due + this->pending_jitter - synth_monotonic_time();
+    if (wait > 0) {
+      if (timeout >= 0 && wait > timeout) {
+        synth_sleep(timeout);
+        SYNTH_ERROR(CAM_IFACE_FRAME_TIMEOUT, "timeout exceeded");
+        return;
+      }
+      synth_sleep(wait);
+    }
+    timestamp = this->pending_due;
+  } else {
+    timestamp = synth_monotonic_time();
+  }
+  if (synth_camera_clock) {
+    timestamp = synth_clock_offset + timestamp*(1.0 + synth_clock_drift*1e-6);
+  } else {
+    timestamp += this->wall_offset;
+  }
+
+  this->pending = 0;
+  this->last_timestamp = timestamp;
+  this->last_framenumber = this->framenumber++;
+  this->sched_count++;
+
+  _CCsynth_arm_wait_fd(this);
+
+  if (synth_corrupt_rate > 0 && synth_random_unit(this) < synth_corrupt_rate) {
+    SYNTH_ERROR(CAM_IFACE_FRAME_DATA_CORRUPT_ERROR, "injected corrupt frame");
+  }
+}
+
+void CCsynth_start_camera( CCsynth *this ) {
+  this->started = 1;
+  _CCsynth_reset_schedule(this);
+  _CCsynth_arm_wait_fd(this);
+}
+
+void CCsynth_stop_camera( CCsynth *this ) {
+  this->started = 0;
+  this->pending = 0;
+  _CCsynth_arm_wait_fd(this);
+}
+
+typedef enum {
+  SYNTH_PROPERTY_BRIGHTNESS = 0,
+  NUM_SYNTH_PROPERTIES
+} SynthProperties_t;
+
+void CCsynth_get_num_camera_properties(CCsynth *this,
+                                       int* num_properties) {
+  (void)this;
+  *num_properties = NUM_SYNTH_PROPERTIES;
+}
+
+void CCsynth_get_camera_property_info(CCsynth *this,
+                                      int property_number,
+                                      CameraPropertyInfo *info) {
+  memset(info, 0, sizeof(CameraPropertyInfo));
+  if (property_number != SYNTH_PROPERTY_BRIGHTNESS) {
+    info->name = "";
+    SYNTH_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "unknown property");
+    return;
+  }
+  info->name = "brightness";
+  info->is_present = 1;
+  info->available = 1;
+  info->min_value = 0;
+  info->max_value = 255;
+  info->has_manual_mode = 1;
+  info->readout_capable = 1;
+  info->original_value = this->brightness;
+}
+
+void CCsynth_get_camera_property(CCsynth *this,
+                                 int property_number,
+                                 long* Value,
+                                 int* Auto ) {
+  if (property_number != SYNTH_PROPERTY_BRIGHTNESS) {
+    SYNTH_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "unknown property");
+    return;
+  }
+  *Value = this->brightness;
+  *Auto = 0;
+}
+
+void CCsynth_set_camera_property(CCsynth *this,
+                                 int property_number,
+                                 long Value,
+                                 int Auto ) {
+  if (property_number != SYNTH_PROPERTY_BRIGHTNESS) {
+    SYNTH_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "unknown property");
+    return;
+  }
+  if (Value < 0 || Value > 255 || Auto) {
+    SYNTH_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "brightness must be 0-255, manual");
+    return;
+  }
+  this->brightness = (int)Value;
+  _CCsynth_fill_ramp_rows(this);
+}
+
+void CCsynth_grab_next_frame_blocking_with_stride( CCsynth *this,
+                                                   unsigned char *out_bytes,
+                                                   intptr_t stride0, float timeout) {
+  if (stride0 < (intptr_t)this->roi_width * this->bytes_per_pixel) {
+    SYNTH_ERROR(CAM_IFACE_GENERIC_ERROR, "stride too small for frame");
+    return;
+  }
+
+  _CCsynth_wait_frame(this, timeout);
+  if (BACKEND_GLOBAL(cam_iface_error))
+    return;
+
+  _CCsynth_render(this, out_bytes, stride0, this->last_framenumber);
+}
+
+void CCsynth_grab_next_frame_blocking( CCsynth *this, unsigned char *out_bytes, float timeout) {
+  CCsynth_grab_next_frame_blocking_with_stride(this, out_bytes,
+                                               this->roi_width * this->bytes_per_pixel,
+                                               timeout);
+}
+
+void CCsynth_point_next_frame_blocking( CCsynth *this, unsigned char **buf_ptr, float timeout) {
+  unsigned char *buf;
+
+  if (this->num_pointed >= this->num_buffers) {
+    SYNTH_ERROR(CAM_IFACE_BUFFER_OVERFLOW_ERROR, "too many frames pointed to (call unpoint_frame first)");
+    return;
+  }
+
+  _CCsynth_wait_frame(this, timeout);
+  if (BACKEND_GLOBAL(cam_iface_error))
+    return;
+
+  buf = this->buffers[(this->first_pointed + this->num_pointed) % this->num_buffers];
+  _CCsynth_render(this, buf, this->roi_width * this->bytes_per_pixel, this->last_framenumber);
+  this->num_pointed++;
+  *buf_ptr = buf;
+}
+
+void CCsynth_unpoint_frame( CCsynth *this ) {
+  if (this->num_pointed == 0) {
+    SYNTH_ERROR(CAM_IFACE_GENERIC_ERROR, "no frame pointed to");
+    return;
+  }
+  this->first_pointed = (this->first_pointed + 1) % this->num_buffers;
+  this->num_pointed--;
+}
+
+void CCsynth_get_last_timestamp( CCsynth *this, double* timestamp ) {
+  *timestamp = this->last_timestamp;
+}
+
+void CCsynth_get_last_framenumber( CCsynth *this, unsigned long* framenumber ) {
+  *framenumber = this->last_framenumber;
+}
+
+void CCsynth_get_num_trigger_modes( CCsynth *this,
+                                    int *num_trigger_modes ) {
+  (void)this;
+  *num_trigger_modes = 1;
+}
+
+void CCsynth_get_trigger_mode_string( CCsynth *this,
+                                      int trigger_mode_number,
+                                      char* trigger_mode_string, //output parameter
+                                      int trigger_mode_string_maxlen) {
+  (void)this;
+  if (trigger_mode_number != 0) {
+    SYNTH_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "unknown trigger mode");
+    return;
+  }
+  snprintf(trigger_mode_string,trigger_mode_string_maxlen,"%s","internal (free running)");
+}
+
+void CCsynth_get_trigger_mode_number( CCsynth *this,
+                                      int *trigger_mode_number ) {
+  (void)this;
+  *trigger_mode_number = 0;
+}
+
+void CCsynth_set_trigger_mode_number( CCsynth *this,
+                                      int trigger_mode_number ) {
+  (void)this;
+  if (trigger_mode_number != 0) {
+    SYNTH_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "unknown trigger mode");
+  }
+}
+
+void CCsynth_get_frame_roi( CCsynth *this,
+                            int *left, int *top, int* width, int* height ) {
+  *left = this->roi_left;
+  *top = this->roi_top;
+  *width = this->roi_width;
+  *height = this->roi_height;
+}
+
+void CCsynth_set_frame_roi( CCsynth *this,
+                            int left, int top, int width, int height ) {
+  if (left < 0 || top < 0 || width < 1 || height < 1 ||
+      left + width > synth_width || top + height > synth_height) {
+    SYNTH_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "roi outside the sensor");
+    return;
+  }
+  if (this->mode->coding == CAM_IFACE_YUV422 && ((left | width) & 1)) {
+    SYNTH_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "YUV422 roi left and width must be even");
+    return;
+  }
+  if (this->num_pointed) {
+    SYNTH_ERROR(CAM_IFACE_GENERIC_ERROR, "cannot change roi while frames are pointed to");
+    return;
+  }
+  this->roi_left = left;
+  this->roi_top = top;
+  this->roi_width = width;
+  this->roi_height = height;
+  /* frames are rendered when grabbed, so the next one has it */
+  this->roi_framenumber = this->framenumber;
+}
+
+void CCsynth_get_max_frame_size( CCsynth *this,
+                                 int *width, int *height ) {
+  (void)this;
+  *width = synth_width;
+  *height = synth_height;
+}
+
+void CCsynth_get_buffer_size( CCsynth *this,
+                              int *size) {
+  *size = this->roi_width * this->roi_height * this->bytes_per_pixel;
+}
+
+void CCsynth_get_framerate( CCsynth *this,
+                            float *framerate ) {
+  *framerate = this->framerate;
+}
+
+/* A framerate of 0 delivers frames as fast as they are asked for. */
+void CCsynth_set_framerate( CCsynth *this,
+                            float framerate ) {
+  if (framerate < 0) {
+    SYNTH_ERROR(CAM_IFACE_HARDWARE_FEATURE_NOT_AVAILABLE, "framerate must not be negative");
+    return;
+  }
+  this->framerate = framerate;
+  _CCsynth_reset_schedule(this);
+  _CCsynth_arm_wait_fd(this);
+}
+
+void CCsynth_get_num_framebuffers( CCsynth *this,
+                                   int *num_framebuffers ) {
+  *num_framebuffers = this->num_buffers;
+}
+
+void CCsynth_set_num_framebuffers( CCsynth *this,
+                                   int num_framebuffers ) {
+  size_t size = (size_t)synth_width * synth_height * this->bytes_per_pixel;
+  int i;
+
+  if (num_framebuffers < 1) {
+    SYNTH_ERROR(CAM_IFACE_GENERIC_ERROR, "need at least one framebuffer");
+    return;
+  }
+  if (this->num_pointed) {
+    SYNTH_ERROR(CAM_IFACE_GENERIC_ERROR, "cannot change framebuffers while frames are pointed to");
+    return;
+  }
+
+  _CCsynth_free_buffers(this);
+  this->buffers = calloc(num_framebuffers, sizeof(unsigned char*));
+  if (this->buffers == NULL) {
+    SYNTH_ERROR(CAM_IFACE_GENERIC_ERROR, "error allocating memory");
+    return;
+  }
+  this->num_buffers = num_framebuffers;
+  for (i=0; i<num_framebuffers; i++) {
+    this->buffers[i] = malloc(size);
+    if (this->buffers[i] == NULL) {
+      _CCsynth_free_buffers(this);
+      SYNTH_ERROR(CAM_IFACE_GENERIC_ERROR, "error allocating memory");
+      return;
+    }
+  }
+  this->first_pointed = 0;
+}
+
+void CCsynth_get_frame_roi_framenumber( CCsynth *this, unsigned long *framenumber ) {
+  *framenumber = this->roi_framenumber;
+}
+
+void CCsynth_get_wait_fd( CCsynth *this, int *fd ) {
+#ifdef __linux__
+  if (this->wait_fd < 0) {
+    this->wait_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (this->wait_fd < 0) {
+      *fd = -1;
+      return;
+    }
+    _CCsynth_arm_wait_fd(this);
+  }
+  *fd = this->wait_fd;
+#else
+  *fd = -1;
+#endif
+}
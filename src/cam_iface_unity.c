@@ -185,6 +185,7 @@ void cam_iface_startup(void) {
   char *envvar;
   int try_this_name;
 
+  cam_iface_log_init();
   unity_num_cameras = 0;
 
   for (i=0; i<NUM_BACKENDS; i++) {
@@ -192,14 +193,12 @@ void cam_iface_startup(void) {
     this_backend_info->name = backend_names[i];
     this_backend_info->started = 0;
 
-    if (getenv("UNITY_BACKEND_DEBUG")!=NULL) {
-      fprintf(stderr,"%s: %d: this_backend_info = %p\n",
-              __FILE__,__LINE__,this_backend_info);
-      fprintf(stderr,"%s: %d: this_backend_info->name = %s\n",
-              __FILE__,__LINE__,this_backend_info->name);
-      fprintf(stderr,"%s: %d: this_backend_info->started = %d\n",
-              __FILE__,__LINE__,this_backend_info->started);
-    }
+    CAM_IFACE_LOG(CAM_IFACE_LOG_UNITY,CAM_IFACE_LOG_DEBUG,
+                  "this_backend_info = %p",this_backend_info);
+    CAM_IFACE_LOG(CAM_IFACE_LOG_UNITY,CAM_IFACE_LOG_DEBUG,
+                  "this_backend_info->name = %s",this_backend_info->name);
+    CAM_IFACE_LOG(CAM_IFACE_LOG_UNITY,CAM_IFACE_LOG_DEBUG,
+                  "this_backend_info->started = %d",this_backend_info->started);
 
     for (j=0; j<3; j++) {
 
@@ -238,24 +237,19 @@ void cam_iface_startup(void) {
       // RTLD_GLOBAL needed for embedded Python to work. (For examples, see pythoncall.c
       // and pymplug.c.)
 
-      if (getenv("UNITY_BACKEND_DEBUG")!=NULL) {
-        fprintf(stderr,"%s: %d: attempting to open: %s\n",__FILE__,__LINE__,full_backend_name);
-      }
+      CAM_IFACE_LOG(CAM_IFACE_LOG_UNITY,CAM_IFACE_LOG_DEBUG,
+                    "attempting to open: %s",full_backend_name);
       libhandle = dlopen(full_backend_name, RTLD_NOW | RTLD_GLOBAL );
       if (libhandle==NULL) {
-        if (getenv("UNITY_BACKEND_DEBUG")!=NULL) {
-          fprintf(stderr,"%s: %d: %s failed.\n",__FILE__,__LINE__,full_backend_name);
-        }
+        CAM_IFACE_LOG(CAM_IFACE_LOG_UNITY,CAM_IFACE_LOG_DEBUG,
+                      "%s failed.",full_backend_name);
         this_backend_info->cam_start_idx = unity_num_cameras;
         this_backend_info->cam_stop_idx = unity_num_cameras;
         free(full_backend_name);
         continue;
       } else {
-        if (getenv("UNITY_BACKEND_DEBUG")!=NULL) {
-          fprintf(stderr,"%s: %d: %s OK, libhandle = %p\n",
-                  __FILE__,__LINE__,
-                  full_backend_name,libhandle);
-        }
+        CAM_IFACE_LOG(CAM_IFACE_LOG_UNITY,CAM_IFACE_LOG_DEBUG,
+                      "%s OK, libhandle = %p",full_backend_name,libhandle);
         free(full_backend_name);
         break; // found backend, stop searching
       }
@@ -265,10 +259,8 @@ void cam_iface_startup(void) {
       continue; //  no backend loaded
     }
 
-    if (getenv("UNITY_BACKEND_DEBUG")!=NULL) {
-      fprintf(stderr,"%s: %d: Loading symbols from libhandle %p\n",
-              __FILE__,__LINE__,libhandle);
-    }
+    CAM_IFACE_LOG(CAM_IFACE_LOG_UNITY,CAM_IFACE_LOG_DEBUG,
+                  "Loading symbols from libhandle %p",libhandle);
 
     LOAD_DLSYM(this_backend_info->have_error,"cam_iface_have_error");
     LOAD_DLSYM(this_backend_info->clear_error,"cam_iface_clear_error");
@@ -282,28 +274,22 @@ void cam_iface_startup(void) {
     LOAD_DLSYM(this_backend_info->get_mode_string,"cam_iface_get_mode_string");
     LOAD_DLSYM(this_backend_info->get_constructor_func,"cam_iface_get_constructor_func");
 
-    if (getenv("UNITY_BACKEND_DEBUG")!=NULL) {
-      fprintf(stderr,"%s: %d: this_backend_info = %p\n",
-              __FILE__,__LINE__,this_backend_info);
-      fprintf(stderr,"%s: %d: this_backend_info->name = %s\n",
-              __FILE__,__LINE__,this_backend_info->name);
-      fprintf(stderr,"%s: %d: this_backend_info->started = %d\n",
-              __FILE__,__LINE__,this_backend_info->started);
-      fprintf(stderr,"%s: %d: this_backend_info->have_error = %p\n",
-              __FILE__,__LINE__,this_backend_info->have_error);
-    }
+    CAM_IFACE_LOG(CAM_IFACE_LOG_UNITY,CAM_IFACE_LOG_DEBUG,
+                  "this_backend_info = %p",this_backend_info);
+    CAM_IFACE_LOG(CAM_IFACE_LOG_UNITY,CAM_IFACE_LOG_DEBUG,
+                  "this_backend_info->name = %s",this_backend_info->name);
+    CAM_IFACE_LOG(CAM_IFACE_LOG_UNITY,CAM_IFACE_LOG_DEBUG,
+                  "this_backend_info->started = %d",this_backend_info->started);
+    CAM_IFACE_LOG(CAM_IFACE_LOG_UNITY,CAM_IFACE_LOG_DEBUG,
+                  "this_backend_info->have_error = %p",this_backend_info->have_error);
 
     this_backend_info->clear_error();
     CHECK_CI_ERR();
 
     this_backend_info->startup();
     if (this_backend_info->have_error()) {
-      if (getenv("UNITY_BACKEND_DEBUG")!=NULL) {
-        fprintf(stderr,"%s: %d: %s backend startup() had error '%s'\n",
-                __FILE__,__LINE__,
-                this_backend_info->name,
-                this_backend_info->get_error_string());
-      }
+      CAM_IFACE_LOG(CAM_IFACE_LOG_UNITY,CAM_IFACE_LOG_DEBUG,
+                    "%s backend startup() had error '%s'",this_backend_info->name,this_backend_info->get_error_string());
       continue; //  backend startup had error
     }
 
@@ -345,6 +331,11 @@ CamContext* CCunity_construct( int device_number, int NumImageBuffers,
       result = construct( device_number-this_backend_info->cam_start_idx,
                           NumImageBuffers, mode_number, interface );
       CHECK_CI_ERRV();
+      if (result!=NULL) {
+        cam_iface_core_set_error_funcs(result,
+                                       this_backend_info->have_error,
+                                       this_backend_info->clear_error);
+      }
     }
   }
   return result;